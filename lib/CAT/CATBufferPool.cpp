@@ -0,0 +1,296 @@
+/// \file    CATBufferPool.cpp
+/// \brief   Size-class pool of aligned buffers for image data
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include <stdlib.h>
+#include <string.h>
+#include "CATBufferPool.h"
+
+// Smallest size class is 1 << kMinClassShift bytes.
+const CATUInt32 kMinClassShift   = 6;
+
+// Marks the header in front of each buffer, to catch frees of
+// buffers that didn't come from a pool.
+const CATUInt32 kBufferMagic     = 0x43424650;  // 'CBFP'
+
+/// \struct CATBufferHeader
+/// \brief Stored just in front of each aligned buffer.
+struct CATBufferHeader
+{
+   void*       rawPtr;        // pointer from malloc()
+   CATUInt32   sizeClass;     // size class of the buffer
+   CATUInt32   magic;         // kBufferMagic
+};
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+CATBufferPool::CATBufferPool(CATUInt32 maxBytesRetained, CATUInt32 maxPerClass)
+{
+   fMaxBytes      = maxBytesRetained;
+   fMaxPerClass   = maxPerClass;
+   memset(&fStats, 0, sizeof(fStats));
+}
+
+//---------------------------------------------------------------------------
+// Destructor - frees retained buffers.
+//---------------------------------------------------------------------------
+CATBufferPool::~CATBufferPool()
+{
+   Trim();
+   CATASSERT(fStats.bytesInUse == 0, "Buffer pool destroyed with buffers in use.");
+}
+
+//---------------------------------------------------------------------------
+// Alloc() returns an aligned buffer of at least size bytes.
+//---------------------------------------------------------------------------
+CATUInt8* CATBufferPool::Alloc(CATUInt32 size)
+{
+   CATUInt32 sizeClass = SizeToClass(size);
+   if (sizeClass >= kNumClasses)
+   {
+      return 0;
+   }
+
+   CATUInt32 capacity = ClassToSize(sizeClass);
+   CATUInt8* buffer   = 0;
+
+   fLock.Wait();
+   std::vector<CATUInt8*>& freeList = fFree[sizeClass];
+   if (freeList.size() != 0)
+   {
+      buffer = freeList.back();
+      freeList.pop_back();
+      fStats.bytesRetained -= capacity;
+      fStats.buffersRetained--;
+      fStats.hits++;
+   }
+   else
+   {
+      fStats.misses++;
+   }
+   fLock.Release();
+
+   if (buffer == 0)
+   {
+      buffer = HeapAlloc(sizeClass);
+      if (buffer == 0)
+      {
+         return 0;
+      }
+   }
+
+   fLock.Wait();
+   fStats.bytesInUse += capacity;
+   if (fStats.bytesInUse > fStats.peakBytesInUse)
+   {
+      fStats.peakBytesInUse = fStats.bytesInUse;
+   }
+   fLock.Release();
+
+   return buffer;
+}
+
+//---------------------------------------------------------------------------
+// Free() returns a buffer to the pool, or to the heap if the pool is full.
+//---------------------------------------------------------------------------
+void CATBufferPool::Free(CATUInt8* buffer)
+{
+   if (buffer == 0)
+   {
+      return;
+   }
+
+   CATBufferHeader* header = (CATBufferHeader*)buffer - 1;
+   CATASSERT(header->magic == kBufferMagic, "Freeing a buffer that isn't from a buffer pool.");
+   if (header->magic != kBufferMagic)
+   {
+      return;
+   }
+
+   CATUInt32 sizeClass = header->sizeClass;
+   CATUInt32 capacity  = ClassToSize(sizeClass);
+   bool      keep      = false;
+
+   fLock.Wait();
+   fStats.bytesInUse -= capacity;
+   if ((fFree[sizeClass].size() < fMaxPerClass) &&
+       (fStats.bytesRetained + capacity <= fMaxBytes))
+   {
+      fFree[sizeClass].push_back(buffer);
+      fStats.bytesRetained += capacity;
+      fStats.buffersRetained++;
+      keep = true;
+   }
+   else
+   {
+      fStats.discards++;
+   }
+   fLock.Release();
+
+   if (!keep)
+   {
+      HeapFree(buffer);
+   }
+}
+
+//---------------------------------------------------------------------------
+// SetRetention() changes the retention limits.
+//---------------------------------------------------------------------------
+void CATBufferPool::SetRetention(CATUInt32 maxBytesRetained, CATUInt32 maxPerClass)
+{
+   fLock.Wait();
+   fMaxBytes      = maxBytesRetained;
+   fMaxPerClass   = maxPerClass;
+   TrimToLimits();
+   fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// Trim() frees all retained buffers.
+//---------------------------------------------------------------------------
+void CATBufferPool::Trim()
+{
+   fLock.Wait();
+   for (CATUInt32 i = 0; i < kNumClasses; i++)
+   {
+      for (size_t j = 0; j < fFree[i].size(); j++)
+      {
+         HeapFree(fFree[i][j]);
+      }
+      fFree[i].clear();
+   }
+   fStats.bytesRetained    = 0;
+   fStats.buffersRetained  = 0;
+   fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// GetStats() retrieves the pool's counters.
+//---------------------------------------------------------------------------
+void CATBufferPool::GetStats(CATBufferPoolStats& stats)
+{
+   fLock.Wait();
+   stats = fStats;
+   fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// ResetStats() zeroes the event counters.
+//---------------------------------------------------------------------------
+void CATBufferPool::ResetStats()
+{
+   fLock.Wait();
+   fStats.hits             = 0;
+   fStats.misses           = 0;
+   fStats.discards         = 0;
+   fStats.peakBytesInUse   = fStats.bytesInUse;
+   fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// SizeToClass() returns the size class for a request.  Classes are four
+// per power of two: 64, 80, 96, 112, 128, 160, 192, 224, 256, ...
+//---------------------------------------------------------------------------
+CATUInt32 CATBufferPool::SizeToClass(CATUInt32 size)
+{
+   if (size <= (1u << kMinClassShift))
+   {
+      return 0;
+   }
+
+   // Past the largest class (7 << 29 bytes)
+   if (size > (7u << 29))
+   {
+      return kNumClasses;
+   }
+
+   // Highest set bit of (size - 1) gives the power of two we're above.
+   CATUInt32 last  = size - 1;
+   CATUInt32 shift = kMinClassShift;
+   while ((shift < 31) && ((last >> (shift + 1)) != 0))
+   {
+      shift++;
+   }
+
+   CATUInt32 base    = 1u << shift;
+   CATUInt32 quarter = base >> 2;
+   CATUInt32 step    = (last - base) / quarter + 1;    // 1..4
+
+   return (shift - kMinClassShift) * 4 + step;
+}
+
+//---------------------------------------------------------------------------
+// ClassToSize() returns the capacity of a size class.
+//---------------------------------------------------------------------------
+CATUInt32 CATBufferPool::ClassToSize(CATUInt32 sizeClass)
+{
+   CATUInt32 shift = sizeClass / 4 + kMinClassShift;
+   CATUInt32 sub   = sizeClass % 4;
+   return (4 + sub) << (shift - 2);
+}
+
+//---------------------------------------------------------------------------
+// HeapAlloc() gets an aligned buffer from the heap, with a header in
+// front of it.
+//---------------------------------------------------------------------------
+CATUInt8* CATBufferPool::HeapAlloc(CATUInt32 sizeClass)
+{
+   size_t capacity = ClassToSize(sizeClass);
+   size_t padding  = sizeof(CATBufferHeader) + kAlignment - 1;
+
+   CATUInt8* rawPtr = (CATUInt8*)malloc(capacity + padding);
+   if (rawPtr == 0)
+   {
+      return 0;
+   }
+
+   size_t    aligned = ((size_t)rawPtr + padding) & ~((size_t)kAlignment - 1);
+   CATUInt8* buffer  = (CATUInt8*)aligned;
+
+   CATBufferHeader* header = (CATBufferHeader*)buffer - 1;
+   header->rawPtr    = rawPtr;
+   header->sizeClass = sizeClass;
+   header->magic     = kBufferMagic;
+
+   return buffer;
+}
+
+//---------------------------------------------------------------------------
+// HeapFree() returns a buffer from HeapAlloc() to the heap.
+//---------------------------------------------------------------------------
+void CATBufferPool::HeapFree(CATUInt8* buffer)
+{
+   CATBufferHeader* header = (CATBufferHeader*)buffer - 1;
+   header->magic = 0;
+   free(header->rawPtr);
+}
+
+//---------------------------------------------------------------------------
+// TrimToLimits() frees retained buffers over the limits, largest first.
+// Caller must hold fLock.
+//---------------------------------------------------------------------------
+void CATBufferPool::TrimToLimits()
+{
+   for (CATInt32 i = kNumClasses - 1; i >= 0; i--)
+   {
+      CATUInt32 capacity = ClassToSize(i);
+      while ((fFree[i].size() != 0) &&
+             ((fFree[i].size() > fMaxPerClass) ||
+              (fStats.bytesRetained > fMaxBytes)))
+      {
+         HeapFree(fFree[i].back());
+         fFree[i].pop_back();
+         fStats.bytesRetained -= capacity;
+         fStats.buffersRetained--;
+      }
+   }
+}
@@ -0,0 +1,137 @@
+/// \file    CATBufferPool.h
+/// \brief   Size-class pool of aligned buffers for image data
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+#ifndef _CATBufferPool_H_
+#define _CATBufferPool_H_
+
+#include <vector>
+#include "CATInternal.h"
+#include "CATCritSec.h"
+
+/// \struct CATBufferPoolStats
+/// \brief Counters returned by CATBufferPool::GetStats()
+/// \ingroup CAT
+struct CATBufferPoolStats
+{
+   CATUInt64   hits;             ///< Alloc() calls served from the pool
+   CATUInt64   misses;           ///< Alloc() calls that went to the heap
+   CATUInt64   discards;         ///< Free() calls that went to the heap
+   CATUInt64   bytesRetained;    ///< Bytes held in the pool, unused
+   CATUInt32   buffersRetained;  ///< Buffers held in the pool, unused
+   CATUInt64   bytesInUse;       ///< Bytes handed out and not yet freed
+   CATUInt64   peakBytesInUse;   ///< High-water mark of bytesInUse
+};
+
+/// \class CATBufferPool
+/// \brief Size-class pool of aligned buffers for image data
+/// \ingroup CAT
+///
+/// Freed buffers are kept on a list for their size class rather than
+/// returned to the heap, so code that keeps creating and releasing
+/// same-sized images (video frames, window-sized backbuffers) reuses
+/// memory that's already mapped instead of taking fresh page faults.
+///
+/// Size classes are spaced four per power of two, so a buffer may be up
+/// to 25% larger than requested.  All buffers are aligned to
+/// kAlignment bytes.
+///
+/// Retention is bounded both in total bytes and in buffers per class;
+/// anything past the limits is freed immediately.  All calls are
+/// thread-safe.
+class CATBufferPool
+{
+   public:
+      enum
+      {
+         kAlignment              = 64,                ///< Buffer alignment
+         kDefaultMaxBytes        = 64 * 1024 * 1024,  ///< Default total retention
+         kDefaultMaxPerClass     = 8                  ///< Default per-class retention
+      };
+
+      /// Constructor
+      ///
+      /// \param maxBytesRetained - most bytes to keep in the pool.
+      /// \param maxPerClass      - most buffers to keep per size class.
+      CATBufferPool( CATUInt32 maxBytesRetained = kDefaultMaxBytes,
+                     CATUInt32 maxPerClass      = kDefaultMaxPerClass);
+
+      /// Destructor - frees retained buffers.  Buffers still in use must
+      /// not be freed to the pool afterwards.
+      virtual ~CATBufferPool();
+
+      /// Alloc() returns a buffer of at least size bytes, aligned to
+      /// kAlignment.  The contents are undefined.
+      ///
+      /// \param size - bytes required.
+      /// \return CATUInt8* - buffer, or 0 if out of memory.
+      CATUInt8* Alloc(CATUInt32 size);
+
+      /// Free() returns a buffer from Alloc() to the pool, or to the heap
+      /// if the pool is full.
+      ///
+      /// \param buffer - buffer from Alloc() on this pool. May be 0.
+      void Free(CATUInt8* buffer);
+
+      /// SetRetention() changes the retention limits.  Retained buffers
+      /// over the new limits are freed.
+      ///
+      /// \param maxBytesRetained - most bytes to keep in the pool.
+      ///                           0 disables pooling.
+      /// \param maxPerClass      - most buffers to keep per size class.
+      void SetRetention(CATUInt32 maxBytesRetained, CATUInt32 maxPerClass);
+
+      /// Trim() frees all retained buffers.
+      void Trim();
+
+      /// GetStats() retrieves the pool's counters.
+      ///
+      /// \param stats - receives the counters.
+      void GetStats(CATBufferPoolStats& stats);
+
+      /// ResetStats() zeroes the hit, miss and discard counters and resets
+      /// the peak to the current bytes in use.
+      void ResetStats();
+
+   protected:
+      /// SizeToClass() returns the size class for a request.
+      static CATUInt32 SizeToClass(CATUInt32 size);
+
+      /// ClassToSize() returns the capacity of a size class.
+      static CATUInt32 ClassToSize(CATUInt32 sizeClass);
+
+      /// HeapAlloc() gets an aligned buffer from the heap.
+      static CATUInt8* HeapAlloc(CATUInt32 sizeClass);
+
+      /// HeapFree() returns a buffer from HeapAlloc() to the heap.
+      static void HeapFree(CATUInt8* buffer);
+
+      /// TrimToLimits() frees retained buffers over the limits.
+      /// Caller must hold fLock.
+      void TrimToLimits();
+
+   private:
+      CATBufferPool(const CATBufferPool&);
+      CATBufferPool& operator=(const CATBufferPool&);
+
+      enum
+      {
+         kNumClasses = 4 * 26       // 64 bytes up to 3.5GB
+      };
+
+      std::vector<CATUInt8*>  fFree[kNumClasses];  ///< Retained buffers by class
+      CATUInt32               fMaxBytes;           ///< Retention limit, bytes
+      CATUInt32               fMaxPerClass;        ///< Retention limit per class
+      CATBufferPoolStats      fStats;              ///< Counters
+      CATCritSec              fLock;               ///< Protects the above
+};
+
+#endif // _CATBufferPool_H_
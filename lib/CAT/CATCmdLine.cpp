@@ -143,7 +143,12 @@ CATResult CATCmdLine::Parse( CATInt32              argc,
             curCmd->SetArg(argvw[i]);
             curCmd = 0;
         }
+#ifdef CAT_CONFIG_POSIX
+        // '/' starts absolute paths here, so only '-' starts switches.
+        else if (*argvw[i] == '-')
+#else
         else if ((*argvw[i] == '/') || (*argvw[i] == '-'))
+#endif
         {
             // It's a switch (or multiple switches)
             CATInt32 numSwitches = (CATInt32)wcslen(argvw[i]);
@@ -34,7 +34,8 @@ typedef CATResult (*CATCMDFUNC)(CATCmdLine*      cmdLinePtr,
 ///  -# Operand - A command with no switch preceeding it.
 ///  -# Switch  - A command that starts with a '/' or '-' and is proceeded by
 ///               a single character. Multiple switches may follow a single
-///               '/' or '-' on the command line.
+///               '/' or '-' on the command line.  On POSIX, where '/'
+///               starts a path, switches start with '-' only.
 ///  -# Switch w/Arg - A switch, like the above, but with an argument after it.
 ///               The switch and argument must be seperated by a space.
 ///
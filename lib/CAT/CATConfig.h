@@ -33,6 +33,26 @@
     #define CAT_DRIVESEPERATOR      ':'
     #define CAT_OPTPATHSEPERATOR    '/'
     #define CAT_EXTSEPERATOR        '.'
+#elif defined(__unix__)
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <stdarg.h>
+    #include <stdint.h>
+    #include <wchar.h>
+    #include <pthread.h>
+    // Define for POSIX platforms (Linux).  Only the non-GUI parts of
+    // CAT build here - threads, streams, images and command lines.
+    #define CAT_CONFIG_POSIX
+
+    #if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        #define CAT_BIG_ENDIAN
+    #else
+        #define CAT_LITTLE_ENDIAN
+    #endif
+    #define CAT_PATHSEPERATOR       '/'
+    #define CAT_DRIVESEPERATOR      '\0'
+    #define CAT_OPTPATHSEPERATOR    '/'
+    #define CAT_EXTSEPERATOR        '.'
 #else
     #include <ConditionalMacros.h>
     #include <MacTypes.h>
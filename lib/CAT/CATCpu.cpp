@@ -0,0 +1,112 @@
+/// \file    CATCpu.cpp
+/// \brief   CPU feature detection for SIMD code paths
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include "CATCpu.h"
+
+#if defined(CAT_CONFIG_SIMD_X86)
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #elif defined(__GNUC__)
+        #include <cpuid.h>
+    #endif
+#endif
+
+static CATUInt32 gCpuFeatureMask = CATCPU_ALL;
+
+//---------------------------------------------------------------------------
+// CATCpuDetect() queries cpuid (and xgetbv for AVX state) for the
+// features we have code paths for.
+//---------------------------------------------------------------------------
+static CATUInt32 CATCpuDetect()
+{
+   CATUInt32 features = CATCPU_NONE;
+
+#if defined(CAT_CONFIG_SIMD_X86)
+   unsigned int regs[4] = {0,0,0,0};   // eax, ebx, ecx, edx
+   unsigned int maxLeaf = 0;
+
+   #if defined(_MSC_VER)
+      __cpuid((int*)regs, 0);
+      maxLeaf = regs[0];
+      if (maxLeaf < 1)
+         return features;
+      __cpuid((int*)regs, 1);
+   #elif defined(__GNUC__)
+      maxLeaf = __get_cpuid_max(0, 0);
+      if (maxLeaf < 1)
+         return features;
+      __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+   #endif
+
+   if (regs[3] & (1 << 26))   features |= CATCPU_SSE2;
+   if (regs[2] & (1 << 9))    features |= CATCPU_SSSE3;
+   if (regs[2] & (1 << 19))   features |= CATCPU_SSE41;
+
+   // AVX2 needs both the CPU bit and the OS saving the ymm state (OSXSAVE,
+   // then XCR0 bits 1 and 2).
+   bool osSavesYmm = false;
+   if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)))
+   {
+      CATUInt64 xcr0 = 0;
+   #if defined(_MSC_VER) && (_MSC_FULL_VER >= 160040219)
+      xcr0 = _xgetbv(0);
+   #elif defined(__GNUC__)
+      unsigned int xlo, xhi;
+      __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(xlo), "=d"(xhi) : "c"(0));
+      xcr0 = ((CATUInt64)xhi << 32) | xlo;
+   #endif
+      osSavesYmm = ((xcr0 & 0x6) == 0x6);
+   }
+
+   #if defined(CAT_CONFIG_SIMD_AVX2)
+   if (osSavesYmm && (maxLeaf >= 7))
+   {
+      #if defined(_MSC_VER)
+         __cpuidex((int*)regs, 7, 0);
+      #else
+         __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+      #endif
+      if (regs[1] & (1 << 5))
+         features |= CATCPU_AVX2;
+   }
+   #endif
+#endif
+
+   return features;
+}
+
+//---------------------------------------------------------------------------
+// CATCpuFeatures() returns the SIMD features available on the current
+// CPU, masked by CATCpuSetFeatureMask().
+//---------------------------------------------------------------------------
+CATUInt32 CATCpuFeatures()
+{
+   // Detection has no side effects, so a race on first use just means
+   // two threads store the same value.
+   static bool      detected = false;
+   static CATUInt32 features = CATCPU_NONE;
+   if (!detected)
+   {
+      features = CATCpuDetect();
+      detected = true;
+   }
+
+   return features & gCpuFeatureMask;
+}
+
+//---------------------------------------------------------------------------
+// CATCpuSetFeatureMask() limits the features reported by CATCpuFeatures()
+//---------------------------------------------------------------------------
+void CATCpuSetFeatureMask(CATUInt32 mask)
+{
+   gCpuFeatureMask = mask;
+}
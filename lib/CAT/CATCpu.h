@@ -0,0 +1,76 @@
+/// \file    CATCpu.h
+/// \brief   CPU feature detection for SIMD code paths
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+#ifndef _CATCpu_H_
+#define _CATCpu_H_
+
+#include "CATTypes.h"
+
+// CAT_CONFIG_SIMD_X86 is defined when building for an x86 / x64 target
+// that can compile SSE intrinsics.  CAT_CONFIG_SIMD_AVX2 is additionally
+// defined when the compiler knows about the AVX2 intrinsics (VS2012+, or
+// gcc/clang with function target attributes).
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+    #define CAT_CONFIG_SIMD_X86
+    #if (defined(_MSC_VER) && (_MSC_VER >= 1700)) || defined(__GNUC__)
+        #define CAT_CONFIG_SIMD_AVX2
+    #endif
+#endif
+
+// MSVC lets any intrinsic be used in any function. gcc and clang need the
+// instruction set enabled per-function unless the whole file is built with
+// the matching -m flag, so kernels are tagged with these.
+#if defined(__GNUC__)
+    #define CAT_TARGET_SSE2    __attribute__((target("sse2")))
+    #define CAT_TARGET_SSSE3   __attribute__((target("ssse3")))
+    #define CAT_TARGET_SSE41   __attribute__((target("sse4.1")))
+    #define CAT_TARGET_AVX2    __attribute__((target("avx2")))
+#else
+    #define CAT_TARGET_SSE2
+    #define CAT_TARGET_SSSE3
+    #define CAT_TARGET_SSE41
+    #define CAT_TARGET_AVX2
+#endif
+
+/// CPU feature flags returned by CATCpuFeatures().
+enum CATCPU_FEATURE
+{
+    CATCPU_SSE2     = 0x0001,
+    CATCPU_SSSE3    = 0x0002,
+    CATCPU_SSE41    = 0x0004,
+    CATCPU_AVX2     = 0x0008,
+
+    CATCPU_NONE     = 0x0000,
+    CATCPU_ALL      = 0xFFFF
+};
+
+/// CATCpuFeatures() returns the SIMD features available on the current
+/// CPU, combined with the OS support check for the wider registers and
+/// masked by CATCpuSetFeatureMask().
+///
+/// Detection is performed once and cached.
+///
+/// \return CATUInt32 - combination of CATCPU_FEATURE flags.
+CATUInt32 CATCpuFeatures();
+
+/// CATCpuSetFeatureMask() limits the features reported by
+/// CATCpuFeatures(). This is mainly for benchmarking and for checking the
+/// SIMD paths against the scalar ones - pass CATCPU_NONE to force the
+/// plain C code, or CATCPU_ALL to restore normal detection.
+///
+/// Modules that select kernels at startup need to be told to reselect
+/// after changing the mask (see CATImageKernelsInit()).
+///
+/// \param mask - combination of CATCPU_FEATURE flags to allow.
+void CATCpuSetFeatureMask(CATUInt32 mask);
+
+#endif // _CATCpu_H_
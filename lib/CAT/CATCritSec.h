@@ -48,7 +48,11 @@ class CATCritSec
       }
 
       // Platform specific critical section handles
+#ifdef CAT_CONFIG_WIN32
       CRITICAL_SECTION fCritSec;
+#else
+      pthread_mutex_t  fCritSec;
+#endif
 };
 
 
@@ -0,0 +1,39 @@
+/// \file    CATCritSec_Posix.cpp
+/// \brief   POSIX version of critical sections for thread synchronization.
+/// \ingroup CAT
+///
+/// Copyright (c) 2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include "CATCritSec.h"
+
+// Win32 critical sections may be re-entered by their owner,
+// so the mutex is recursive to match.
+CATCritSec::CATCritSec()
+{
+    pthread_mutexattr_t attribs;
+    pthread_mutexattr_init(&attribs);
+    pthread_mutexattr_settype(&attribs, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&fCritSec, &attribs);
+    pthread_mutexattr_destroy(&attribs);
+}
+
+CATCritSec::~CATCritSec()
+{
+    pthread_mutex_destroy(&fCritSec);
+}
+
+void CATCritSec::Wait()
+{
+    pthread_mutex_lock(&fCritSec);
+}
+
+void CATCritSec::Release()
+{
+    pthread_mutex_unlock(&fCritSec);
+}
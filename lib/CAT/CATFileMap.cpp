@@ -0,0 +1,172 @@
+/// \file    CATFileMap.cpp
+/// \brief   Read-only, copy-on-write memory mapping of a file
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include "CATFileMap.h"
+#include "CATString.h"
+
+#ifndef CAT_CONFIG_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+CATFileMap::CATFileMap()
+{
+   fData    = 0;
+   fSize    = 0;
+#ifdef CAT_CONFIG_WIN32
+   fFile    = INVALID_HANDLE_VALUE;
+   fMapping = 0;
+#endif
+}
+
+//---------------------------------------------------------------------------
+// Destructor
+//---------------------------------------------------------------------------
+CATFileMap::~CATFileMap()
+{
+   Close();
+}
+
+//---------------------------------------------------------------------------
+// Open() maps a file.
+//---------------------------------------------------------------------------
+CATResult CATFileMap::Open(const CATWChar* pathname)
+{
+   CATASSERT(fData == 0, "File map is already open.");
+   Close();
+
+#ifdef CAT_CONFIG_WIN32
+   fFile = ::CreateFileW(  pathname,
+                           GENERIC_READ,
+                           FILE_SHARE_READ,
+                           0,
+                           OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL,
+                           0);
+   if (fFile == INVALID_HANDLE_VALUE)
+   {
+      return CATRESULTFILE(CAT_ERR_FILE_OPEN, pathname);
+   }
+
+   LARGE_INTEGER fileSize;
+   if ((!::GetFileSizeEx(fFile, &fileSize)) || (fileSize.QuadPart == 0))
+   {
+      Close();
+      return CATRESULTFILE(CAT_ERR_FILE_READ, pathname);
+   }
+
+   // PAGE_WRITECOPY/FILE_MAP_COPY give a private view that can be
+   // written to without touching the file.
+   fMapping = ::CreateFileMapping(fFile, 0, PAGE_WRITECOPY, 0, 0, 0);
+   if (fMapping == 0)
+   {
+      Close();
+      return CATRESULTFILE(CAT_ERR_FILE_OPEN, pathname);
+   }
+
+   fData = (CATUInt8*)::MapViewOfFile(fMapping, FILE_MAP_COPY, 0, 0, 0);
+   if (fData == 0)
+   {
+      Close();
+      return CATRESULTFILE(CAT_ERR_OUT_OF_MEMORY, pathname);
+   }
+   fSize = (CATUInt64)fileSize.QuadPart;
+#else
+   CATString path = pathname;
+   int fd = open((const char*)path, O_RDONLY);
+   if (fd < 0)
+   {
+      return CATRESULTFILE(CAT_ERR_FILE_OPEN, pathname);
+   }
+
+   struct stat fileStat;
+   if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0))
+   {
+      close(fd);
+      return CATRESULTFILE(CAT_ERR_FILE_READ, pathname);
+   }
+
+   // MAP_PRIVATE gives a copy-on-write view. The mapping holds its own
+   // reference to the file, so the descriptor can go.
+   void* view = mmap(0, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (view == MAP_FAILED)
+   {
+      return CATRESULTFILE(CAT_ERR_OUT_OF_MEMORY, pathname);
+   }
+
+   fData = (CATUInt8*)view;
+   fSize = (CATUInt64)fileStat.st_size;
+#endif
+
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// Close() unmaps the file.
+//---------------------------------------------------------------------------
+void CATFileMap::Close()
+{
+#ifdef CAT_CONFIG_WIN32
+   if (fData != 0)
+   {
+      ::UnmapViewOfFile(fData);
+   }
+   if (fMapping != 0)
+   {
+      ::CloseHandle(fMapping);
+      fMapping = 0;
+   }
+   if (fFile != INVALID_HANDLE_VALUE)
+   {
+      ::CloseHandle(fFile);
+      fFile = INVALID_HANDLE_VALUE;
+   }
+#else
+   if (fData != 0)
+   {
+      munmap(fData, (size_t)fSize);
+   }
+#endif
+
+   fData = 0;
+   fSize = 0;
+}
+
+//---------------------------------------------------------------------------
+// IsOpen() returns true if a file is mapped.
+//---------------------------------------------------------------------------
+bool CATFileMap::IsOpen() const
+{
+   return (fData != 0);
+}
+
+//---------------------------------------------------------------------------
+// GetData() returns the start of the view.
+//---------------------------------------------------------------------------
+CATUInt8* CATFileMap::GetData() const
+{
+   return fData;
+}
+
+//---------------------------------------------------------------------------
+// GetSize() returns the mapped size.
+//---------------------------------------------------------------------------
+CATUInt64 CATFileMap::GetSize() const
+{
+   return fSize;
+}
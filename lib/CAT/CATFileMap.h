@@ -0,0 +1,68 @@
+/// \file    CATFileMap.h
+/// \brief   Read-only, copy-on-write memory mapping of a file
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+#ifndef _CATFileMap_H_
+#define _CATFileMap_H_
+
+#include "CATInternal.h"
+
+/// \class CATFileMap
+/// \brief Read-only, copy-on-write memory mapping of a file
+/// \ingroup CAT
+///
+/// Maps an entire file into memory.  Pages are read from the file as
+/// they're touched.  The view is copy-on-write: it may be written to,
+/// but changes stay private to the process and never reach the file.
+///
+/// The mapping starts on a page boundary, so data at an aligned offset
+/// within the file is equally aligned in memory.
+class CATFileMap
+{
+   public:
+      CATFileMap();
+
+      /// Destructor - unmaps the file if it's open.
+      virtual ~CATFileMap();
+
+      /// Open() maps a file.
+      ///
+      /// \param pathname - path of the file to map.
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult Open(const CATWChar* pathname);
+
+      /// Close() unmaps the file. Pointers from GetData() become invalid.
+      void      Close();
+
+      /// IsOpen() returns true if a file is mapped.
+      bool      IsOpen() const;
+
+      /// GetData() returns the start of the mapped file, or 0.
+      CATUInt8* GetData() const;
+
+      /// GetSize() returns the size of the mapped file in bytes.
+      CATUInt64 GetSize() const;
+
+   private:
+      CATFileMap(const CATFileMap&);
+      CATFileMap& operator=(const CATFileMap&);
+
+      CATUInt8*   fData;         ///< Start of the view
+      CATUInt64   fSize;         ///< Bytes mapped
+
+      // Platform specific handles
+#ifdef CAT_CONFIG_WIN32
+      HANDLE      fFile;
+      HANDLE      fMapping;
+#endif
+};
+
+#endif // _CATFileMap_H_
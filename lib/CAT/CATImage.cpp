@@ -11,12 +11,518 @@
 // $NoKeywords: $
 
 #include <memory.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
 #include "png.h"
 #include "CATImage.h"
 #include "CATStreamFile.h"
+#include "CATImageKernels.h"
+#include "CATWorkPool.h"
+#include "CATBufferPool.h"
+#include "CATFileMap.h"
 
 const CATInt32 kBytesPerPixel = 4;
 
+// zlib output buffer for Save(), so the stream sees a few large writes.
+const CATUInt32 kPNGWriteBufferSize = 64 * 1024;
+
+// Save() presets - see CATImage.h
+const CATImage::CATPNGSaveOptions CATImage::kPNGSaveDefault =
+   { -1, CATImage::CATPNGFILTER_DEFAULT, CATImage::CATPNGSTRATEGY_DEFAULT };
+const CATImage::CATPNGSaveOptions CATImage::kPNGSaveFast    =
+   {  1, CATImage::CATPNGFILTER_SUB,     CATImage::CATPNGSTRATEGY_RLE     };
+
+// Fills of at least this many bytes use non-temporal stores.  Anything
+// smaller is likely to be drawn over right away, so it's better left in
+// the cache.
+const CATInt32 kNonTemporalMinBytes = 8 * 1024 * 1024;
+
+// Sub images packed by CreateAtlas() start on multiples of this many
+// pixels, so their rows stay 16-byte aligned for the SIMD kernels.
+const CATInt32 kAtlasAlign = 4;
+
+// Smallest band, in pixels, worth handing to another thread.  Keeps
+// short, wide images from being split into one-row slivers.
+const CATInt32 kParallelMinBandPixels = 16384;
+
+// Pool for pixel buffers - see CATImage::GetBufferPool()
+static CATBufferPool* gImageBufferPool = 0;
+
+// Row-parallel settings - see CATImage::SetParallel().  The default
+// threshold hasn't been tuned; see CATImage::kParallelMinPixels.
+static bool       gParallelEnabled     = false;
+static CATInt32   gParallelMinPixels   = CATImage::kParallelMinPixels;
+
+//---------------------------------------------------------------------------
+// CATImageBand holds everything one of the row-band procedures below
+// needs to process rows [yStart, yEnd) of an operation.  The public
+// functions do the checks and pointer math, then hand the band to
+// RunBands(), which either runs it directly or splits it across the
+// shared work pool.
+//---------------------------------------------------------------------------
+struct CATImageBand;
+typedef void (*CATImageBandProc)(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd);
+
+struct CATImageBand
+{
+   CATImageBandProc  proc;
+   CATUInt8*         dstPtr;           // first destination row
+   const CATUInt8*   srcPtr;           // first source row, if any
+   CATInt32          dstLineLength;    // bytes between destination rows
+   CATInt32          srcLineLength;    // bytes between source rows
+   CATInt32          width;            // pixels per row
+   CATOverlayRowFunc rowFunc;          // kernel for KernelRows()
+   CATFillRowFunc    fillFunc;         // kernel for FillRows()
+   CATUInt32         fillVal;          // pixel for FillRows() and MemsetRows()
+   CATStateRowFunc   stateFunc;        // kernel for StateRows()
+   bool              premultiplied;    // format for StateRows()
+   const void*       context;          // tables for the Resample*Rows() procs
+};
+
+static void BandWorkProc(void* param, CATInt32 yStart, CATInt32 yEnd)
+{
+   const CATImageBand* band = (const CATImageBand*)param;
+   band->proc(*band, yStart, yEnd);
+}
+
+static void RunBands(const CATImageBand& band, CATInt32 height)
+{
+   if ((band.width <= 0) || (height <= 0))
+   {
+      return;
+   }
+
+   if ((gParallelEnabled) && (band.width * height >= gParallelMinPixels))
+   {
+      CATInt32 minRows = kParallelMinBandPixels / band.width;
+      if (minRows < 1)
+      {
+         minRows = 1;
+      }
+      CATWorkPool::GetShared()->ParallelFor(height, minRows, BandWorkProc, (void*)&band);
+   }
+   else
+   {
+      band.proc(band, 0, height);
+   }
+}
+
+// Clear() - memset when all four bytes of fillVal are the same.  Rows
+// with no gap between them are done in one call.
+static void MemsetRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   int value = band.fillVal & 0xFF;
+   if (band.dstLineLength == band.width * 4)
+   {
+      memset(band.dstPtr + yStart * band.dstLineLength, value,
+             (size_t)(yEnd - yStart) * band.dstLineLength);
+      return;
+   }
+
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      memset(band.dstPtr + y * band.dstLineLength, value, band.width * 4);
+   }
+}
+
+// Clear(), FillRect() - fill kernel with fillVal
+static void FillRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      band.fillFunc(band.dstPtr + y * band.dstLineLength, band.fillVal, band.width);
+   }
+}
+
+// MakeDisabled(), CreateStateImage() - state look kernels
+static void StateRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      band.stateFunc(   band.dstPtr + y * band.dstLineLength,
+                        band.srcPtr + y * band.srcLineLength,
+                        band.width,
+                        band.premultiplied);
+   }
+}
+
+// CopyOver() between images of the same format
+static void CopyRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      memcpy(  band.dstPtr + y * band.dstLineLength,
+               band.srcPtr + y * band.srcLineLength,
+               band.width * kBytesPerPixel);
+   }
+}
+
+// Overlay() and converting CopyOver() - runs a row kernel
+static void KernelRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      band.rowFunc(  band.dstPtr + y * band.dstLineLength,
+                     band.srcPtr + y * band.srcLineLength,
+                     band.width);
+   }
+}
+
+// Resample() horizontal pass - context is the CATResampleTable
+static void ResampleRowsH(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   const CATResampleTable& table = *(const CATResampleTable*)band.context;
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      gCATImageKernels.ResampleRowH(   band.dstPtr + y * band.dstLineLength,
+                                       band.srcPtr + y * band.srcLineLength,
+                                       band.width,
+                                       table);
+   }
+}
+
+// Resample() vertical pass - context is the CATResampleTable
+static void ResampleRowsV(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   const CATResampleTable& table = *(const CATResampleTable*)band.context;
+   std::vector<const CATUInt8*> srcRows(table.taps);
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      const CATUInt8* srcPtr = band.srcPtr + table.starts[y] * band.srcLineLength;
+      for (CATInt32 k = 0; k < table.taps; k++)
+      {
+         srcRows[k] = srcPtr;
+         srcPtr    += band.srcLineLength;
+      }
+
+      gCATImageKernels.ResampleRowV(   band.dstPtr + y * band.dstLineLength,
+                                       &srcRows[0],
+                                       table.weights + y * table.taps,
+                                       table.taps,
+                                       band.width * kBytesPerPixel);
+   }
+}
+
+// Resample() with CATRESAMPLE_NEAREST - context is the x index table
+// followed by the y index table.
+static void ResampleRowsNearest(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   const CATInt32* xIndex = (const CATInt32*)band.context;
+   const CATInt32* yIndex = xIndex + band.width;
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      const CATUInt32* srcPtr = (const CATUInt32*)(band.srcPtr + yIndex[y] * band.srcLineLength);
+      CATUInt32*       dstPtr = (CATUInt32*)(band.dstPtr + y * band.dstLineLength);
+      for (CATInt32 x = 0; x < band.width; x++)
+      {
+         dstPtr[x] = srcPtr[xIndex[x]];
+      }
+   }
+}
+
+// OverlaySliced() tiled and stretched pieces - gathers each source row
+// through index tables like ResampleRowsNearest(), then merges it with
+// the overlay kernel.  Rows that repeat a source row reuse the gather.
+static void OverlayNearestRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   const CATInt32* xIndex = (const CATInt32*)band.context;
+   const CATInt32* yIndex = xIndex + band.width;
+   std::vector<CATUInt32> rowBuf(band.width);
+   CATInt32 lastRow = -1;
+
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      if (yIndex[y] != lastRow)
+      {
+         const CATUInt32* srcPtr = (const CATUInt32*)(band.srcPtr + yIndex[y] * band.srcLineLength);
+         for (CATInt32 x = 0; x < band.width; x++)
+         {
+            rowBuf[x] = srcPtr[xIndex[x]];
+         }
+         lastRow = yIndex[y];
+      }
+
+      band.rowFunc(  band.dstPtr + y * band.dstLineLength,
+                     (const CATUInt8*)&rowBuf[0],
+                     band.width);
+   }
+}
+
+// Resample() with CATRESAMPLE_LANCZOS3 - the negative lobes can ring
+// past alpha, which isn't a valid premultiplied pixel.
+static void ClampToAlphaRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      CATUInt8* dstPtr = band.dstPtr + y * band.dstLineLength;
+      for (CATInt32 x = 0; x < band.width; x++)
+      {
+         CATUInt8 alpha = dstPtr[3];
+         if (dstPtr[0] > alpha) dstPtr[0] = alpha;
+         if (dstPtr[1] > alpha) dstPtr[1] = alpha;
+         if (dstPtr[2] > alpha) dstPtr[2] = alpha;
+         dstPtr += 4;
+      }
+   }
+}
+
+// CopyInYUV() - context is the CATYUVBand
+struct CATYUVBand
+{
+   CATYUVRowFunc     rowFunc;
+   const CATUInt8*   planes[3];
+   CATInt32          strides[3];
+   CATInt32          chromaShift;      // 1 when chroma rows are halved
+   CATYUVCoeffs      coeffs;
+};
+
+static void YUVRows(const CATImageBand& band, CATInt32 yStart, CATInt32 yEnd)
+{
+   const CATYUVBand& yuv = *(const CATYUVBand*)band.context;
+   for (CATInt32 y = yStart; y < yEnd; y++)
+   {
+      CATInt32        chromaRow = y >> yuv.chromaShift;
+      const CATUInt8* planes[3];
+      planes[0] = yuv.planes[0] + y * yuv.strides[0];
+      planes[1] = yuv.planes[1] ? yuv.planes[1] + chromaRow * yuv.strides[1] : 0;
+      planes[2] = yuv.planes[2] ? yuv.planes[2] + chromaRow * yuv.strides[2] : 0;
+
+      yuv.rowFunc(band.dstPtr + y * band.dstLineLength, planes, band.width, yuv.coeffs);
+   }
+}
+
+//---------------------------------------------------------------------------
+// ResampleKernel() evaluates the continuous filter for Resample() at
+// distance x, in source pixels scaled by the filter width.
+//---------------------------------------------------------------------------
+static double ResampleKernel(CATImage::CATRESAMPLEFILTER filter, double x)
+{
+   const double kPi = 3.14159265358979323846;
+   x = fabs(x);
+
+   switch (filter)
+   {
+      case CATImage::CATRESAMPLE_BILINEAR:
+         return (x < 1.0) ? (1.0 - x) : 0.0;
+
+      case CATImage::CATRESAMPLE_LANCZOS3:
+         if (x < 1e-8)
+            return 1.0;
+         if (x >= 3.0)
+            return 0.0;
+         return (3.0 * sin(kPi * x) * sin(kPi * x / 3.0)) / (kPi * kPi * x * x);
+
+      default:
+         return 0.0;
+   }
+}
+
+//---------------------------------------------------------------------------
+// BuildResampleTable() computes the fixed-point weights for scaling one
+// axis from srcSize to dstSize pixels.
+//
+// Pixel centers are aligned (output pixel i covers source
+// [i*scale, (i+1)*scale)).  When shrinking, bilinear keeps its 2-tap
+// support and aliases; box and Lanczos widen with the scale so every
+// source pixel contributes.  Every output pixel gets the same number of
+// taps so the kernels can run without per-pixel branches; short
+// footprints are padded with zero weights.
+//---------------------------------------------------------------------------
+static CATInt32 BuildResampleTable( CATInt32                   srcSize,
+                                    CATInt32                   dstSize,
+                                    CATImage::CATRESAMPLEFILTER filter,
+                                    std::vector<CATInt32>&     starts,
+                                    std::vector<CATInt16>&     weights)
+{
+   double scale       = (double)srcSize / (double)dstSize;
+   double filterScale = 1.0;
+   double support     = 1.0;
+
+   if (filter == CATImage::CATRESAMPLE_LANCZOS3)
+   {
+      filterScale = (scale > 1.0) ? scale : 1.0;
+      support     = 3.0 * filterScale;
+   }
+
+   // Floating-point weights first, one footprint per output pixel.
+   std::vector<CATInt32>  first(dstSize);
+   std::vector<CATInt32>  count(dstSize);
+   std::vector<double>    raw;
+   std::vector<CATInt32>  rawStart(dstSize);
+   CATInt32 taps = 1;
+
+   for (CATInt32 i = 0; i < dstSize; i++)
+   {
+      CATInt32 lo, hi;
+      if (filter == CATImage::CATRESAMPLE_BOX)
+      {
+         double left  = i * scale;
+         double right = left + scale;
+         lo = (CATInt32)floor(left);
+         hi = (CATInt32)ceil(right);
+      }
+      else
+      {
+         double center = (i + 0.5) * scale;
+         lo = (CATInt32)floor(center - support);
+         hi = (CATInt32)ceil(center + support);
+      }
+
+      if (lo < 0)          lo = 0;
+      if (hi > srcSize)    hi = srcSize;
+      if (hi <= lo)
+      {
+         lo = (lo < srcSize) ? lo : srcSize - 1;
+         hi = lo + 1;
+      }
+
+      rawStart[i] = (CATInt32)raw.size();
+      double total = 0;
+      for (CATInt32 j = lo; j < hi; j++)
+      {
+         double w;
+         if (filter == CATImage::CATRESAMPLE_BOX)
+         {
+            double left  = i * scale;
+            double right = left + scale;
+            w = ((right < j + 1) ? right : j + 1) - ((left > j) ? left : j);
+            if (w < 0)
+               w = 0;
+         }
+         else
+         {
+            w = ResampleKernel(filter, (j + 0.5 - (i + 0.5) * scale) / filterScale);
+         }
+         raw.push_back(w);
+         total += w;
+      }
+
+      // Fall back to the nearest pixel if the footprint missed entirely.
+      if (total == 0)
+      {
+         CATInt32 nearest = (CATInt32)((i + 0.5) * scale);
+         if (nearest >= hi)
+            nearest = hi - 1;
+         raw[rawStart[i] + nearest - lo] = 1.0;
+         total = 1.0;
+      }
+
+      for (CATInt32 j = lo; j < hi; j++)
+      {
+         raw[rawStart[i] + j - lo] /= total;
+      }
+
+      // Drop zero weights off the ends
+      while ((hi - lo > 1) && (raw[rawStart[i]] == 0))
+      {
+         rawStart[i]++;
+         lo++;
+      }
+      while ((hi - lo > 1) && (raw[rawStart[i] + hi - lo - 1] == 0))
+      {
+         hi--;
+      }
+
+      first[i] = lo;
+      count[i] = hi - lo;
+      if (count[i] > taps)
+      {
+         taps = count[i];
+      }
+   }
+
+   // Convert to fixed point at a common tap count.  Footprints near the
+   // right edge are shifted left so start + taps stays in the source.
+   const CATInt32 kOne = 1 << kCATResampleBits;
+   starts.assign(dstSize, 0);
+   weights.assign(dstSize * taps, 0);
+
+   for (CATInt32 i = 0; i < dstSize; i++)
+   {
+      CATInt32 start = first[i];
+      if (start + taps > srcSize)
+      {
+         start = srcSize - taps;
+      }
+      starts[i] = start;
+
+      CATInt16* outWeights = &weights[i * taps];
+      CATInt32  sum        = 0;
+      CATInt32  largest    = 0;
+      for (CATInt32 k = 0; k < count[i]; k++)
+      {
+         CATInt32 index = first[i] - start + k;
+         CATInt32 w     = (CATInt32)floor(raw[rawStart[i] + k] * kOne + 0.5);
+         outWeights[index] = (CATInt16)w;
+         sum += w;
+         if (outWeights[index] > outWeights[largest])
+         {
+            largest = index;
+         }
+      }
+
+      // Put any rounding error on the biggest tap so flat areas stay flat.
+      outWeights[largest] = (CATInt16)(outWeights[largest] + kOne - sum);
+   }
+
+   return taps;
+}
+
+//---------------------------------------------------------------------------
+// BuildPaletteLut() fills lut with the RGBA value of every palette index,
+// folding in alpha from tRNS.  Indices past the palette are opaque black.
+//---------------------------------------------------------------------------
+static void BuildPaletteLut(png_structp png_ptr, png_infop info_ptr, CATUInt32* lut)
+{
+   png_colorp palette    = 0;
+   int        numPalette = 0;
+   png_bytep  trans      = 0;
+   int        numTrans   = 0;
+
+   png_get_PLTE(png_ptr, info_ptr, &palette, &numPalette);
+   if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+   {
+      png_get_tRNS(png_ptr, info_ptr, &trans, &numTrans, (png_color_16p*)NULL);
+   }
+
+   // Written bytewise so the entries are in memory order on any platform.
+   CATUInt8* entry = (CATUInt8*)lut;
+   for (int i = 0; i < 256; i++)
+   {
+      if (i < numPalette)
+      {
+         entry[0] = palette[i].red;
+         entry[1] = palette[i].green;
+         entry[2] = palette[i].blue;
+         entry[3] = (i < numTrans) ? trans[i] : 255;
+      }
+      else
+      {
+         entry[0] = entry[1] = entry[2] = 0;
+         entry[3] = 255;
+      }
+      entry += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// ExpandPaletteRow() looks up a row of 8-bit palette indices.  Each index
+// is read before its pixel is written, so the indices may sit in the tail
+// of the destination row.
+//---------------------------------------------------------------------------
+static void ExpandPaletteRow( CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width,
+                              const CATUInt32*  lut)
+{
+   CATUInt32* dstPixel = (CATUInt32*)dstPtr;
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dstPixel[x] = lut[srcPtr[x]];
+   }
+}
+
 //------------------------------------------------------------------------
 // CreateImage creates an image.
 //
@@ -153,8 +659,19 @@ CATResult CATImage::CreateSub      (  const CATImage*    orgImg,
       return CATRESULT(CAT_ERR_IMAGE_INVALID_SUB_POSITION);
    }
 
-   // Create an uninitialized image object
+   // A sub image can be written through, and would be left pointing at
+   // the old buffer if a copy-on-write parent detached later - so detach
+   // it now.
    CATResult result;
+   if (orgImg->fCopyOnWrite)
+   {
+      if (CATFAILED(result = ((CATImage*)orgImg)->DetachCopy()))
+      {
+         return result;
+      }
+   }
+
+   // Create an uninitialized image object
    if (CATFAILED(result = 
          CreateImage(dstImg, 0, 0, false)))
    {
@@ -178,6 +695,15 @@ CATResult CATImage::CreateSub      (  const CATImage*    orgImg,
    // within the fData data buffer, use XOffsetAbs() and YOffsetAbs().
    dstImg->fXOffset     = xOffset;
    dstImg->fYOffset     = yOffset;
+
+   // Shares the parent's pixels, so shares its alpha format too.
+   dstImg->fFormat      = orgImg->fFormat;
+
+   dstImg->fRootImage   = orgImg->fRootImage;
+   dstImg->UpdateAbsOffsets();
+
+   // So SetSubPosition() on the parent can update our offsets too.
+   ((CATImage*)orgImg)->fSubImages.push_back(dstImg);
    
    // Add reference to ourself and our parents.  CreateImage() did not do this
    // previously, since width and height were set to 0.
@@ -206,11 +732,12 @@ CATResult CATImage::CopyImage      (  const CATImage*    srcImg,
       return CATRESULT(CAT_ERR_IMAGE_NULL);
    }
 
-   // Simply copy - make full copy of source 
+   // Simply copy - make full copy of source. Offsets are relative to
+   // srcImg itself, not its parent.
    return CopyImage( srcImg, 
                      dstImg, 
-                     srcImg->XOffsetRel(), 
-                     srcImg->YOffsetRel(),
+                     0, 
+                     0,
                      srcImg->Width(),
                      srcImg->Height());
 }
@@ -260,90 +787,273 @@ CATResult CATImage::CopyImage      (  const CATImage*    srcImg,
       return CATRESULT(CAT_ERR_IMAGE_INVALID_SUB_POSITION);
    }
 
-   // Create an image object and allocate space for memory.
+   // Create an empty image object - it shares the source's root buffer
+   // until one of them is written to. See PrepareWrite().
    CATResult result;
-   if (CATFAILED(result = CreateImage(  dstImg, 
-                                       width, 
-                                       height, 
-                                       false)))
+   if (CATFAILED(result = CreateImage(dstImg, 0, 0, false)))
    {
       return result;
    }
 
-   // Copy image buffer...
-   CATInt32 y;
-   
-   // Offset into line for source buffer in bytes
-   CATInt32 srcLineOffset = 
-         (srcImg->XOffsetAbs() + xOffset) * kBytesPerPixel;
-   
-   // current position of start of buffer in source
-   unsigned char* srcPtr = 
-            srcImg->fData + srcLineOffset + 
-            ((srcImg->YOffsetAbs() + yOffset) * srcImg->AbsWidth() * kBytesPerPixel);
+   CATImage* root = (CATImage*)srcImg;
+   while (root->fParentImage != 0)
+   {
+      root = root->fParentImage;
+   }
 
-   unsigned char* dstPtr = dstImg->fData;
+   dstImg->fOwnData     = false;
+   dstImg->fCopyOnWrite = true;
+   dstImg->fParentImage = root;
+   dstImg->fData        = root->fData;
+   dstImg->fWidth       = width;
+   dstImg->fHeight      = height;
+   dstImg->fXOffset     = srcImg->XOffsetAbs() + xOffset;
+   dstImg->fYOffset     = srcImg->YOffsetAbs() + yOffset;
+   dstImg->fFormat      = srcImg->fFormat;
+   dstImg->fRootImage   = root;
+   dstImg->UpdateAbsOffsets();
 
-   for (y = 0; y < height; y++)
-   {
-      // Copy one row at a time into our new image
-      memcpy(  dstPtr,
-               srcPtr,
-               width * kBytesPerPixel );
+   root->fCowCopies.push_back(dstImg);
 
-      // step to next line in source
-      srcPtr += srcImg->AbsWidth() * kBytesPerPixel;
-      
-      // and in destination....
-      dstPtr += width * kBytesPerPixel;
-   }
+   // References ourself and the root.
+   dstImg->AddRef();
 
    return CAT_SUCCESS;
 }
 
 //---------------------------------------------------------------------------
-// Increment reference count
-//---------------------------------------------------------------------------
-unsigned long  CATImage::AddRef()
+// Resample() creates a new image of the given size from srcImg, scaled
+// with the requested filter.
+//
+// Filtering is done as two separable passes - horizontal into a pooled
+// intermediate buffer, then vertical into the new image - using weight
+// tables built once per call.  Filters that blend pixels work on
+// premultiplied data so transparent pixels' colors don't bleed into
+// the edges of opaque ones; straight-alpha sources are converted on
+// the way in and back on the way out.
+//
+//        srcImg - source image to scale.
+//        dstImg - uninitialized image ptr. Set on return.
+//        width  - width of the new image.
+//        height - height of the new image.
+//        filter - CATRESAMPLE_* filter to use.
+//---------------------------------------------------------------------------
+CATResult CATImage::Resample       (  const CATImage*    srcImg,
+                                      CATImage*&         dstImg,
+                                      CATInt32           width,
+                                      CATInt32           height,
+                                      CATRESAMPLEFILTER  filter)
 {
-   // Increment parent reference count
-   if (fParentImage != 0)
+   dstImg = 0;
+   CATASSERT(srcImg != 0, "Can't resample a null image.");
+   if (srcImg == 0)
    {
-      fParentImage->AddRef();
+      return CATRESULT(CAT_ERR_IMAGE_NULL);
    }
 
-   fRefCount++;
-   return fRefCount;
-}
+   CATASSERT(srcImg->fData != 0, "Source image is invalid.");
+   if (srcImg->fData == 0)
+   {
+      return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
+   }
 
-//---------------------------------------------------------------------------
-// Decrement reference count
-//---------------------------------------------------------------------------
-unsigned long  CATImage::DecRef()
-{
-   if (fParentImage != 0)
+   CATASSERT((width > 0) && (height > 0), "Invalid resample size.");
+   if ((width <= 0) || (height <= 0))
    {
-      // If parent is non-null, release our ref count for it.
-      // This may delete it.
-      ReleaseImage(fParentImage);
-      
-      // If parent was deleted, then our ref count should be 1    
-      if (fParentImage == 0)
-      {
-         // Make sure that if we deleted parent, we're going to delete here
-         CATASSERT(fRefCount == 1, "Deleted parent, but we're not done here!");
-      }
+      return CATRESULT(CAT_ERR_IMAGE_INVALID_SIZE);
    }
 
-   CATASSERT(fRefCount != 0, "Decrementing reference count too far!");
-   if (fRefCount == 0)
-      return fRefCount;
+   CATInt32 srcWidth  = srcImg->Width();
+   CATInt32 srcHeight = srcImg->Height();
 
-   fRefCount--;
-   return fRefCount;
-}
+   if ((width == srcWidth) && (height == srcHeight))
+   {
+      return CopyImage(srcImg, dstImg, 0, 0, width, height);
+   }
 
-//---------------------------------------------------------------------------
+   CATResult result;
+   if (CATFAILED(result = CreateImage(dstImg, width, height, false)))
+   {
+      return result;
+   }
+   dstImg->fFormat = srcImg->fFormat;
+
+   CATImageBand band;
+   band.dstPtr        = dstImg->fData;
+   band.dstLineLength = width * kBytesPerPixel;
+   band.width         = width;
+
+   if (filter == CATRESAMPLE_NEAREST)
+   {
+      // Source index for each destination column, then each row.
+      std::vector<CATInt32> index(width + height);
+      for (CATInt32 x = 0; x < width; x++)
+      {
+         index[x] = (CATInt32)(((CATInt64)(2*x + 1) * srcWidth) / (2 * width));
+      }
+      for (CATInt32 y = 0; y < height; y++)
+      {
+         index[width + y] = (CATInt32)(((CATInt64)(2*y + 1) * srcHeight) / (2 * height));
+      }
+
+      CATImageRows srcRows;
+      srcImg->GetRowsForRead(srcRows);
+
+      band.proc          = ResampleRowsNearest;
+      band.srcLineLength = srcRows.stride;
+      band.srcPtr        = srcRows.data;
+      band.context       = &index[0];
+      RunBands(band, height);
+      return CAT_SUCCESS;
+   }
+
+   // Get a premultiplied copy of straight-alpha sources to filter.
+   const CATImage* filterSrc  = srcImg;
+   CATImage*       premulImg  = 0;
+   if (srcImg->fFormat != CATIMAGE_RGBA32_PREMULTIPLIED)
+   {
+      if (CATFAILED(result = CreateImage(premulImg, srcWidth, srcHeight, false)))
+      {
+         ReleaseImage(dstImg);
+         return result;
+      }
+      premulImg->fFormat = CATIMAGE_RGBA32_PREMULTIPLIED;
+      premulImg->CopyOver(srcImg, 0, 0, 0, 0, srcWidth, srcHeight);
+      filterSrc = premulImg;
+   }
+
+   CATImageRows srcRows;
+   filterSrc->GetRowsForRead(srcRows);
+
+   CATInt32        srcLineLength = srcRows.stride;
+   const CATUInt8* srcPtr        = srcRows.data;
+
+   // Horizontal pass, into a srcHeight x width intermediate - or
+   // straight into the new image if there's no vertical pass.
+   CATUInt8* tmpBuf = 0;
+   if (width != srcWidth)
+   {
+      CATUInt8* hDstPtr = dstImg->fData;
+      if (height != srcHeight)
+      {
+         hDstPtr = tmpBuf = GetBufferPool()->Alloc(width * srcHeight * kBytesPerPixel);
+      }
+
+      if (hDstPtr == 0)
+      {
+         if (premulImg)
+            ReleaseImage(premulImg);
+         ReleaseImage(dstImg);
+         return CATRESULT(CAT_ERR_OUT_OF_MEMORY);
+      }
+
+      std::vector<CATInt32> starts;
+      std::vector<CATInt16> weights;
+      CATResampleTable      table;
+      table.taps    = BuildResampleTable(srcWidth, width, filter, starts, weights);
+      table.starts  = &starts[0];
+      table.weights = &weights[0];
+
+      CATImageBand hBand;
+      hBand.proc           = ResampleRowsH;
+      hBand.dstPtr         = hDstPtr;
+      hBand.srcPtr         = srcPtr;
+      hBand.dstLineLength  = width * kBytesPerPixel;
+      hBand.srcLineLength  = srcLineLength;
+      hBand.width          = width;
+      hBand.context        = &table;
+      RunBands(hBand, srcHeight);
+
+      srcPtr        = tmpBuf;
+      srcLineLength = width * kBytesPerPixel;
+   }
+
+   // Vertical pass, into the new image.
+   if (height != srcHeight)
+   {
+      band.srcPtr        = srcPtr;
+      band.srcLineLength = srcLineLength;
+
+      std::vector<CATInt32> starts;
+      std::vector<CATInt16> weights;
+      CATResampleTable      table;
+      table.taps    = BuildResampleTable(srcHeight, height, filter, starts, weights);
+      table.starts  = &starts[0];
+      table.weights = &weights[0];
+
+      band.proc    = ResampleRowsV;
+      band.context = &table;
+      RunBands(band, height);
+   }
+
+   GetBufferPool()->Free(tmpBuf);
+   if (premulImg)
+   {
+      ReleaseImage(premulImg);
+   }
+
+   if (filter == CATRESAMPLE_LANCZOS3)
+   {
+      band.proc = ClampToAlphaRows;
+      RunBands(band, height);
+   }
+
+   // Back to straight alpha, in place.
+   if (dstImg->fFormat != CATIMAGE_RGBA32_PREMULTIPLIED)
+   {
+      band.proc          = KernelRows;
+      band.rowFunc       = gCATImageKernels.UnpremultiplyRow;
+      band.srcPtr        = band.dstPtr;
+      band.srcLineLength = band.dstLineLength;
+      RunBands(band, height);
+   }
+
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// Increment reference count
+//---------------------------------------------------------------------------
+unsigned long  CATImage::AddRef()
+{
+   // Increment parent reference count
+   if (fParentImage != 0)
+   {
+      fParentImage->AddRef();
+   }
+
+   fRefCount++;
+   return fRefCount;
+}
+
+//---------------------------------------------------------------------------
+// Decrement reference count
+//---------------------------------------------------------------------------
+unsigned long  CATImage::DecRef()
+{
+   if (fParentImage != 0)
+   {
+      // If parent is non-null, release our ref count for it.
+      // This may delete it.
+      ReleaseImage(fParentImage);
+      
+      // If parent was deleted, then our ref count should be 1    
+      if (fParentImage == 0)
+      {
+         // Make sure that if we deleted parent, we're going to delete here
+         CATASSERT(fRefCount == 1, "Deleted parent, but we're not done here!");
+      }
+   }
+
+   CATASSERT(fRefCount != 0, "Decrementing reference count too far!");
+   if (fRefCount == 0)
+      return fRefCount;
+
+   fRefCount--;
+   return fRefCount;
+}
+
+//---------------------------------------------------------------------------
 // Protected constructor
 //---------------------------------------------------------------------------
 CATImage::CATImage()
@@ -356,6 +1066,12 @@ CATImage::CATImage()
    fYOffset       = 0;
    fParentImage   = 0;
    fRefCount      = 0;
+   fFormat        = CATIMAGE_PNG_RGBA32;
+   fFileMap       = 0;
+   fCopyOnWrite   = false;
+   fRootImage     = this;
+   fAbsXOffset    = 0;
+   fAbsYOffset    = 0;
 }
 
 //---------------------------------------------------------------------------
@@ -363,6 +1079,26 @@ CATImage::CATImage()
 //---------------------------------------------------------------------------
 CATImage::~CATImage()
 {
+   // Copies hold references to their root, so a root with copies
+   // can't get here - only a copy needs to unregister.
+   CATASSERT(fCowCopies.empty(), "Image destroyed while copies share its data.");
+   CATASSERT(fSubImages.empty(), "Image destroyed while sub images use its data.");
+   if (fParentImage != 0)
+   {
+      // Sub images likewise hold references to their parent, and are
+      // in its fSubImages.
+      std::vector<CATImage*>& list = fCopyOnWrite ? fParentImage->fCowCopies
+                                                  : fParentImage->fSubImages;
+      for (size_t i = 0; i < list.size(); i++)
+      {
+         if (list[i] == this)
+         {
+            list.erase(list.begin() + i);
+            break;
+         }
+      }
+   }
+
    // Dec and check our reference count - make sure we're not in here when
    // we shouldn't be.
    if (fData)
@@ -374,10 +1110,17 @@ CATImage::~CATImage()
    {
       if (fData != 0)
       {
-         delete [] fData;
+         GetBufferPool()->Free(fData);
          fData = 0;
       }
    }
+
+   if (fFileMap != 0)
+   {
+      fData = 0;
+      delete fFileMap;
+      fFileMap = 0;
+   }
 }
 
 
@@ -394,12 +1137,14 @@ CATResult CATImage::Create(CATInt32 width, CATInt32 height, bool init, bool tran
       return CATRESULT(CAT_ERR_IMAGE_INVALID_SIZE);
    }
 
-	if (fData != 0)
+	if ((fData != 0) && (fOwnData))
 	{
-		delete [] fData;
+		GetBufferPool()->Free(fData);
 	}
    
-   fData = new unsigned char[width * height * kBytesPerPixel];
+   // Pooled rather than new[] - images are created and released at the
+   // same few sizes over and over.
+   fData = GetBufferPool()->Alloc(width * height * kBytesPerPixel);
    if (fData == 0)
    {
       return CATRESULT(CAT_ERR_OUT_OF_MEMORY);
@@ -417,6 +1162,104 @@ CATResult CATImage::Create(CATInt32 width, CATInt32 height, bool init, bool tran
    return CAT_SUCCESS;
 }
 
+//---------------------------------------------------------------------------
+// PrepareWrite
+//    Called before pixels are changed. A copy-on-write copy is given its
+//    own buffer. Otherwise, any copies still sharing our root's buffer
+//    are given theirs, so they keep the pixels they were copied with.
+//---------------------------------------------------------------------------
+CATResult CATImage::PrepareWrite()
+{
+   if (fCopyOnWrite)
+   {
+      return DetachCopy();
+   }
+
+   CATImage* root = this;
+   while (root->fParentImage != 0)
+   {
+      root = root->fParentImage;
+   }
+
+   // Each detach removes the copy from the list. We hold a reference
+   // to the root, so it stays around.
+   CATResult result = CAT_SUCCESS;
+   while (!root->fCowCopies.empty())
+   {
+      if (CATFAILED(result = root->fCowCopies.back()->DetachCopy()))
+      {
+         return result;
+      }
+   }
+
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// DetachCopy
+//    Copies our part of the root's buffer into a buffer of our own,
+//    then drops the root.
+//---------------------------------------------------------------------------
+CATResult CATImage::DetachCopy()
+{
+   CATASSERT(fCopyOnWrite, "Only copy-on-write copies can detach.");
+   if (!fCopyOnWrite)
+   {
+      return CAT_SUCCESS;
+   }
+
+   CATUInt8* data = GetBufferPool()->Alloc(fWidth * fHeight * kBytesPerPixel);
+   if (data == 0)
+   {
+      return CATRESULT(CAT_ERR_OUT_OF_MEMORY);
+   }
+
+   CATImage*       root          = fParentImage;
+   CATInt32        srcLineLength = root->fWidth * kBytesPerPixel;
+   CATInt32        dstLineLength = fWidth * kBytesPerPixel;
+   const CATUInt8* srcPtr        = fData + (fXOffset * kBytesPerPixel) + 
+                                   (fYOffset * srcLineLength);
+
+   CATImageBand band;
+   band.proc            = CopyRows;
+   band.dstPtr          = data;
+   band.srcPtr          = srcPtr;
+   band.dstLineLength   = dstLineLength;
+   band.srcLineLength   = srcLineLength;
+   band.width           = fWidth;
+
+   RunBands(band, fHeight);
+
+   std::vector<CATImage*>& copies = root->fCowCopies;
+   for (size_t i = 0; i < copies.size(); i++)
+   {
+      if (copies[i] == this)
+      {
+         copies.erase(copies.begin() + i);
+         break;
+      }
+   }
+
+   // Each of our references held one on the root - give them back.
+   unsigned long refs = fRefCount;
+
+   fData          = data;
+   fOwnData       = true;
+   fCopyOnWrite   = false;
+   fParentImage   = 0;
+   fXOffset       = 0;
+   fYOffset       = 0;
+   fRootImage     = this;
+   UpdateAbsOffsets();
+
+   for (unsigned long i = 0; (i < refs) && (root != 0); i++)
+   {
+      ReleaseImage(root);
+   }
+
+   return CAT_SUCCESS;
+}
+
 //---------------------------------------------------------------------------
 // Clear
 //    Clears the image data to 0
@@ -429,35 +1272,29 @@ CATResult CATImage::Clear(bool transparent)
       return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
    }
 
-   // Offset into line for source buffer in bytes
-   CATInt32 dstOffX = this->XOffsetAbs() * kBytesPerPixel;   
-   // Absolute length of line in fData in bytes ( >= fWidth * 3)
-   CATInt32 dstLineLength = this->AbsWidth()   * kBytesPerPixel;   
-   // Distance from end of one line to beginning of the next in bytes.
-   CATInt32 dstStep   = dstLineLength - (fWidth * kBytesPerPixel);
+   CATImageRows rows;
+   CATResult    result = GetRowsForWrite(rows);
+   if (CATFAILED(result))
+   {
+      return result;
+   }
 
-   // current position of start of buffer in source
-   unsigned char* dstPtr = fData + (YOffsetAbs() * dstLineLength);
- 
    unsigned char alpha = (transparent?0:255);
 
    // Endian-neutral way to set it up
-   *(CATUInt32 *)dstPtr = 0;
-   dstPtr[3] = alpha;
+   CATUInt8 pixel[4] = {0, 0, 0, alpha};
+   bool     uniform  = (pixel[0] == pixel[1]) && (pixel[1] == pixel[2]) && (pixel[2] == pixel[3]);
 
-   // Get the val we'll copy in for clear into a reg/var
-   CATUInt32 val = *(CATUInt32*)dstPtr;
-
-   for (CATInt32 y = 0; y < fHeight; y++)
-   {      
-      for (CATInt32 x = 0; x < fWidth; x++)
-      {
-         *(CATUInt32*)dstPtr = val;
-         dstPtr += kBytesPerPixel;         
-      }
+   CATImageBand band;
+   band.proc            = uniform ? MemsetRows : FillRows;
+   band.fillFunc        = (fWidth * fHeight * kBytesPerPixel >= kNonTemporalMinBytes) ?
+                              gCATImageKernels.FillRowStream : gCATImageKernels.FillRow;
+   band.dstPtr          = rows.data;
+   band.dstLineLength   = rows.stride;
+   band.width           = fWidth;
+   band.fillVal         = *(CATUInt32*)pixel;
 
-      dstPtr += dstStep;   
-   }
+   RunBands(band, fHeight);
 
    return CAT_SUCCESS;
 }
@@ -490,69 +1327,40 @@ CATResult CATImage::FillRect(const CATRect& rect, const CATColor& color)
       return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
    }
 
-   // Now fill the image in on all four channels.
-   CATInt32 x,y;
+   CATImageRows rows;
+   if (CATFAILED(result = GetRowsForWrite(rows)))
+   {
+      return result;
+   }
 
-   // Offset into line for source buffer in bytes
-   CATInt32 dstOffX = (this->XOffsetAbs() + rect.left) * kBytesPerPixel;   
-   
-   // Absolute length of line in fData in bytes ( >= fWidth * 3)
-   CATInt32 dstLineLength = this->AbsWidth() * kBytesPerPixel;   
-   
-   // Distance from end of one line to beginning of the next in bytes.
-   CATInt32 dstStep   = dstLineLength - (rect.Width() * kBytesPerPixel);
-   
-   // current position of start of buffer in source
-   unsigned char* dstPtr = fData + 
-                           dstOffX + 
-                           ((YOffsetAbs() + rect.top) * dstLineLength);
+   CATASSERT(kBytesPerPixel == 4, "Woops.");
 
+   // Fill the r,g,b channels. If we're not totally opaque, then alpha
+   // blend the fill color; otherwise just overwrite.
+   CATUInt8 pixel[4] = {color.r, color.g, color.b, color.a};
 
-   CATASSERT(kBytesPerPixel == 4, "Woops.");
+   // Big opaque fills stream like Clear() does.  Blends are left in the
+   // cache, since they have to read every pixel anyway.
+   bool stream = (rect.Width() * rect.Height() * kBytesPerPixel >= kNonTemporalMinBytes);
 
-   // If we're not totally opaque, then alpha blend fill color
+   CATImageBand band;
+   band.proc            = FillRows;
    if (color.a != 255)
    {
-      // Loop through image performing fill
-      for (y = 0; y < rect.Height(); y++)
-      {      
-         for (x = 0; x < rect.Width(); x++)
-         {            
-            // Blend the r,g,b channels. Alpha remains the same for destination image.         
-            dstPtr[0] =  (CATUInt8)(((CATInt32)(color.r   * color.a) +
-                                  (CATInt32)(dstPtr[0] * (255 - color.a))) / 255);
-
-            dstPtr[1] =  (CATUInt8)(((CATInt32)(color.g   * color.a) +
-                                  (CATInt32)(dstPtr[1] * (255 - color.a))) / 255);
-
-            dstPtr[2] =  (CATUInt8)(((CATInt32)(color.b   * color.a) +
-                                  (CATInt32)(dstPtr[2] * (255 - color.a))) / 255);
-
-            dstPtr+=4;
-         }         
-         dstPtr += dstStep;
-      }
-
+      band.fillFunc     = gCATImageKernels.FillBlendRow;
    }
    else
    {
-      // Totally opaque - just overwrite.
+      band.fillFunc     = stream ? gCATImageKernels.FillRGBRowStream :
+                                   gCATImageKernels.FillRGBRow;
+   }
+   band.dstPtr          = rows.Pixel(rect.left, rect.top);
+   band.dstLineLength   = rows.stride;
+   band.width           = rect.Width();
+   band.fillVal         = *(CATUInt32*)pixel;
 
-      // Loop through image performing merge
-      for (y = 0; y < rect.Height(); y++)
-      {      
-         for (x = 0; x < rect.Width(); x++)
-         {         
-            dstPtr[0] = color.r;
-            dstPtr[1] = color.g;
-            dstPtr[2] = color.b;
-            
-            dstPtr += 4;
-         }
+   RunBands(band, rect.Height());
 
-         dstPtr += dstStep;
-      }
-   }
    return result;
 }
 
@@ -563,7 +1371,8 @@ CATResult CATImage::FillRect(const CATRect& rect, const CATColor& color)
 //---------------------------------------------------------------------------
 CATInt32 CATImage::XOffsetRel () const
 {
-   return fXOffset;
+   // Copy-on-write copies are roots as far as callers are concerned.
+   return fCopyOnWrite ? 0 : fXOffset;
 }
 
 //---------------------------------------------------------------------------
@@ -572,25 +1381,17 @@ CATInt32 CATImage::XOffsetRel () const
 //---------------------------------------------------------------------------
 CATInt32 CATImage::YOffsetRel () const
 {
-   return fYOffset;
+   return fCopyOnWrite ? 0 : fYOffset;
 }
 
 //---------------------------------------------------------------------------
 // XOffsetAbs
-//    Returns absolute X offset within fData
+//    Returns absolute X offset within fData.  Cached - see
+//    UpdateAbsOffsets().
 //---------------------------------------------------------------------------
 CATInt32 CATImage::XOffsetAbs () const
 {
-   CATInt32 absOffset = fXOffset;
-   
-   // Recursively add all parent offsets into ours to find real offset
-   // within fData.
-   if (fParentImage != 0)
-   {
-      absOffset += fParentImage->XOffsetAbs();
-   }
-   
-   return absOffset;
+   return fAbsXOffset;
 }
 
 //---------------------------------------------------------------------------
@@ -599,30 +1400,40 @@ CATInt32 CATImage::XOffsetAbs () const
 //---------------------------------------------------------------------------
 CATInt32 CATImage::YOffsetAbs () const
 {
-   CATInt32 absOffset = fYOffset;
+   return fAbsYOffset;
+}
 
-   // Recursively add all parent offsets into ours to find real offset
-   // within fData.
+//---------------------------------------------------------------------------
+// UpdateAbsOffsets
+//    Adds the parent's absolute offsets to ours to find the real offsets
+//    within fData, caches them, then does the same for our sub images.
+//
+//    Only called when an image is made or moved, so const calls never
+//    write the cache and can run on several threads at once.
+//---------------------------------------------------------------------------
+void CATImage::UpdateAbsOffsets()
+{
+   fAbsXOffset = fXOffset;
+   fAbsYOffset = fYOffset;
    if (fParentImage != 0)
    {
-      absOffset += fParentImage->YOffsetAbs();
+      fAbsXOffset += fParentImage->fAbsXOffset;
+      fAbsYOffset += fParentImage->fAbsYOffset;
+   }
+
+   for (size_t i = 0; i < fSubImages.size(); i++)
+   {
+      fSubImages[i]->UpdateAbsOffsets();
    }
-   
-   return absOffset;
 }
+
 //---------------------------------------------------------------------------
 // AbsWidth
 //    Returns the absolute width of the fData image buffer
 //---------------------------------------------------------------------------
 CATInt32 CATImage::AbsWidth   () const
 {
-   CATInt32 absWidth = fWidth;
-   if (fParentImage != 0)
-   {
-      absWidth = fParentImage->AbsWidth();
-   }
-
-   return absWidth;
+   return fRootImage->fWidth;
 }
 
 //---------------------------------------------------------------------------
@@ -631,13 +1442,41 @@ CATInt32 CATImage::AbsWidth   () const
 //---------------------------------------------------------------------------
 CATInt32 CATImage::AbsHeight  () const
 {
-   CATInt32 absHeight = fHeight;
-   if (fParentImage != 0)
+   return fRootImage->fHeight;
+}
+
+//---------------------------------------------------------------------------
+// GetRowsForRead
+//    Fills in a read-only view of our pixels.
+//---------------------------------------------------------------------------
+void CATImage::GetRowsForRead(CATImageRows& rows) const
+{
+   rows.stride = AbsWidth() * kBytesPerPixel;
+   rows.data   = fData + XOffsetAbs() * kBytesPerPixel + YOffsetAbs() * rows.stride;
+   rows.width  = fWidth;
+   rows.height = fHeight;
+}
+
+//---------------------------------------------------------------------------
+// GetRowsForWrite
+//    Detaches any copies sharing our buffer, then fills in the view.
+//---------------------------------------------------------------------------
+CATResult CATImage::GetRowsForWrite(CATImageRows& rows)
+{
+   CATASSERT(fData != 0, "Image must be created first!");
+   if (fData == 0)
+   {
+      return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
+   }
+
+   CATResult result = PrepareWrite();
+   if (CATFAILED(result))
    {
-      absHeight = fParentImage->AbsHeight();
+      return result;
    }
 
-   return absHeight;
+   GetRowsForRead(rows);
+   return CAT_SUCCESS;
 }
 
 //---------------------------------------------------------------------------
@@ -683,10 +1522,12 @@ CATInt32 CATImage::AbsSize() const
 //---------------------------------------------------------------------------
 bool CATImage::IsImageRoot() const
 {
-   bool isRoot = fOwnData;
+   // Mapped images (MapRaw()) are roots that don't own their data, and
+   // copy-on-write copies act as roots while they borrow one's.
+   bool isRoot = (fParentImage == 0) || fCopyOnWrite;
    
-   CATASSERT(isRoot == (fParentImage == 0), 
-      "Root image should not have a parent image, sub images must.");
+   CATASSERT(isRoot || (fOwnData == false), 
+      "Sub images should never own their data.");
 
    return isRoot;
 }
@@ -711,8 +1552,22 @@ bool CATImage::IsImageRoot() const
 //    Note that the xOffset and yOffset are relative to parent. They will
 //    be calculated at runtime if you call this function.      
 //---------------------------------------------------------------------------
-unsigned char* CATImage::GetRawDataPtr() const
+const unsigned char* CATImage::GetRawDataPtr() const
+{
+   return fData;
+}
+
+//---------------------------------------------------------------------------
+// GetRawDataPtrForWrite()
+//    Same as GetRawDataPtr(), but gives copy-on-write copies their own
+//    buffers first, since the caller is going to change pixels.
+//---------------------------------------------------------------------------
+unsigned char* CATImage::GetRawDataPtrForWrite()
 {
+   if (CATFAILED(PrepareWrite()))
+   {
+      return 0;
+   }
    return fData;
 }
 
@@ -777,6 +1632,9 @@ CATResult CATImage::SetSubPosition (  CATInt32      newXOffset,
    fWidth   = newWidth;
    fHeight  = newHeight;
 
+   // Sub images of this one have moved too.
+   UpdateAbsOffsets();
+
    return   CAT_SUCCESS;
 }
 
@@ -909,6 +1767,11 @@ CATResult CATImage::SetPixel (        CATInt32               x,
    {
       return CATRESULT(CAT_ERR_IMAGE_OUT_OF_RANGE);
    }
+
+   if (CATFAILED(result = PrepareWrite()))
+   {
+      return result;
+   }
    
    // Offset of pixel on x axis in image data
    CATInt32 lineOffset = (this->XOffsetAbs() + x) * kBytesPerPixel;
@@ -992,53 +1855,47 @@ CATResult  CATImage::CopyOver (    const CATImage*    srcImg,
       return CATRESULT(CAT_ERR_IMAGE_OVERLAY_OUT_OF_BOUNDS);
    }
 
-   // Now copy the image in on all four channels.
-   CATInt32 y;
-	// CATInt32 x
    CATASSERT(fData != 0, "Image must be created first!");
    if (fData == 0)
    {
       return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
    }
 
+   // May detach srcImg if it's a copy of us, so get its rows after.
+   CATImageRows dstRows;
+   CATImageRows srcRows;
+   if (CATFAILED(result = GetRowsForWrite(dstRows)))
+   {
+      return result;
+   }
+   srcImg->GetRowsForRead(srcRows);
 
-   // Offset into line for source buffer in bytes
-   CATInt32 dstOffX = (this->XOffsetAbs() + dstOffsetX) * kBytesPerPixel;   
-   
-   // Absolute length of line in fData in bytes ( >= fWidth * 3)
-   CATInt32 dstLineLength = this->AbsWidth()   * kBytesPerPixel;   
-   
-   // Distance from end of one line to beginning of the next in bytes.
-   CATInt32 dstStep   = dstLineLength - (width * kBytesPerPixel);
-   
-   // current position of start of buffer in source
-   unsigned char* dstPtr = fData + 
-                           dstOffX + 
-                           ((YOffsetAbs() + dstOffsetY) * dstLineLength);
-
-
-   // as above for source
-   CATInt32 srcOffX           = (srcImg->XOffsetAbs() + srcOffsetX) * kBytesPerPixel;   
-   CATInt32 srcLineLength     = srcImg->AbsWidth()   * kBytesPerPixel;   
-   CATInt32 srcStep           = srcLineLength - (width * kBytesPerPixel);
-   unsigned char* srcPtr = srcImg->fData + 
-                           srcOffX + 
-                           ((srcImg->YOffsetAbs() + srcOffsetY) * srcLineLength);
-
-   bool alphaUnused = true;
+   CATInt32       dstLineLength = dstRows.stride;
+   unsigned char* dstPtr        = dstRows.Pixel(dstOffsetX, dstOffsetY);
+   CATInt32       srcLineLength = srcRows.stride;
+   unsigned char* srcPtr        = srcRows.Pixel(srcOffsetX, srcOffsetY);
 
    CATASSERT(kBytesPerPixel == 4, "Woops.");
 
-   // Loop through image performing merge
-   
-	CATUInt32 lineWidth = width*4;
+   CATImageBand band;
+   band.proc            = CopyRows;
+   band.dstPtr          = dstPtr;
+   band.srcPtr          = srcPtr;
+   band.dstLineLength   = dstLineLength;
+   band.srcLineLength   = srcLineLength;
+   band.width           = width;
 
-	for (y = 0; y < height; y++)
-   {     
-		memcpy(dstPtr, srcPtr,lineWidth);
-      dstPtr += dstStep + lineWidth;
-      srcPtr += srcStep + lineWidth;
+   if (srcImg->fFormat != fFormat)
+   {
+      // Alpha formats differ - convert each row on the way over.
+      band.proc    = KernelRows;
+      band.rowFunc = (fFormat == CATIMAGE_RGBA32_PREMULTIPLIED) ?
+                           gCATImageKernels.PremultiplyRow :
+                           gCATImageKernels.UnpremultiplyRow;
    }
+
+   RunBands(band, height);
+
    return result;
 }
 
@@ -1125,95 +1982,203 @@ CATResult  CATImage::Overlay(   const CATImage*    srcImg,
    }
 
 
-   // Now copy the image in on all four channels.
-   CATInt32 x,y;
    CATASSERT(fData != 0, "Image must be created first!");
    if (fData == 0)
    {
       return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
    }
 
+   // May detach srcImg if it's a copy of us, so get its rows after.
+   CATImageRows dstRows;
+   CATImageRows srcRows;
+   if (CATFAILED(result = GetRowsForWrite(dstRows)))
+   {
+      return result;
+   }
+   srcImg->GetRowsForRead(srcRows);
 
-   // Offset into line for source buffer in bytes
-   CATInt32 dstOffX = (this->XOffsetAbs() + dstOffsetX) * kBytesPerPixel;   
-   
-   // Absolute length of line in fData in bytes ( >= fWidth * 3)
-   CATInt32 dstLineLength = this->AbsWidth()   * kBytesPerPixel;   
-   
-   // Distance from end of one line to beginning of the next in bytes.
-   CATInt32 dstStep   = dstLineLength - (width * kBytesPerPixel);
-   
-   // current position of start of buffer in source
-   unsigned char* dstPtr = fData + 
-                           dstOffX + 
-                           ((YOffsetAbs() + dstOffsetY) * dstLineLength);
+   CATInt32       dstLineLength = dstRows.stride;
+   unsigned char* dstPtr        = dstRows.Pixel(dstOffsetX, dstOffsetY);
+   CATInt32       srcLineLength = srcRows.stride;
+   unsigned char* srcPtr        = srcRows.Pixel(srcOffsetX, srcOffsetY);
 
+   // Merge row by row. The row kernel is the widest SIMD version the
+   // CPU supports (see CATImageKernels.cpp).
+   CATImageBand band;
+   band.proc            = KernelRows;
+   band.dstPtr          = dstPtr;
+   band.srcPtr          = srcPtr;
+   band.dstLineLength   = dstLineLength;
+   band.srcLineLength   = srcLineLength;
+   band.width           = width;
+   band.rowFunc         = (srcImg->fFormat == CATIMAGE_RGBA32_PREMULTIPLIED) ?
+                                 gCATImageKernels.OverlayPremulRow :
+                                 gCATImageKernels.OverlayRow;
 
-   // as above for source
-   CATInt32 srcOffX           = (srcImg->XOffsetAbs() + srcOffsetX) * 
-                           kBytesPerPixel;   
+   RunBands(band, height);
 
-   CATInt32 srcLineLength     = srcImg->AbsWidth()   * kBytesPerPixel;   
-   CATInt32 srcStep           = srcLineLength - (width * kBytesPerPixel);
-   unsigned char* srcPtr = srcImg->fData + 
-                           srcOffX + 
-                           ((srcImg->YOffsetAbs() + 
-                              srcOffsetY) * srcLineLength);
+   return result;
+}
 
-   // Loop through image performing merge.
-   // If this turns out to be a bottleneck, 
-   // convert to SIMD on win32 and equiv on Mac.
-   for (y = 0; y < height; y++)
-   {      
-      for (x = 0; x < width; x++)
-      {       
-         CATInt32 i;  
-         unsigned char alpha = srcPtr[3];
+//---------------------------------------------------------------------------
+// SliceSplit() splits one axis for OverlaySliced() into three spans;
+// span i runs from pos[i] to pos[i+1].  When the destination is too
+// small for both borders, they share it in proportion to their sizes.
+//---------------------------------------------------------------------------
+static void SliceSplit( CATInt32 srcSize,  CATInt32 lowInset, CATInt32 highInset,
+                        CATInt32 dstStart, CATInt32 dstSize,
+                        CATInt32 srcPos[4], CATInt32 dstPos[4])
+{
+   srcPos[0] = 0;
+   srcPos[1] = lowInset;
+   srcPos[2] = srcSize - highInset;
+   srcPos[3] = srcSize;
+
+   CATInt32 dstLow  = lowInset;
+   CATInt32 dstHigh = highInset;
+   if (lowInset + highInset > dstSize)
+   {
+      dstLow  = (lowInset * dstSize) / (lowInset + highInset);
+      dstHigh = dstSize - dstLow;
+   }
+
+   dstPos[0] = dstStart;
+   dstPos[1] = dstStart + dstLow;
+   dstPos[2] = dstStart + dstSize - dstHigh;
+   dstPos[3] = dstStart + dstSize;
+}
+
+//---------------------------------------------------------------------------
+// OverlaySliced() merges a nine-slice image over this one.  Pieces that
+// are the same size as their source go through Overlay(); the rest are
+// tiled or stretched by a gather through index tables.
+//---------------------------------------------------------------------------
+CATResult CATImage::OverlaySliced(  const CATImage*    srcImg,
+                                    const CATRect&     dstRect,
+                                    const CATRect&     insets,
+                                    const CATRect&     clipRect,
+                                    CATSLICEMODE       mode)
+{
+   CATASSERT(srcImg != 0, "Null source image.");
+   if (srcImg == 0)
+   {
+      return CATRESULT(CAT_ERR_IMAGE_NULL);
+   }
+
+   CATASSERT(fData != 0, "Image must be created first!");
+   if (fData == 0)
+   {
+      return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
+   }
 
-         // skip multiplication steps for totally transparent or opaque alpha.
-         if (alpha == 0)
+   CATASSERT(srcImg != this, "Can't slice an image onto itself.");
+   CATASSERT( (insets.left >= 0) && (insets.right  >= 0) &&
+              (insets.top  >= 0) && (insets.bottom >= 0) &&
+              (insets.left + insets.right  <= srcImg->Width()) &&
+              (insets.top  + insets.bottom <= srcImg->Height()),
+              "Invalid slice insets.");
+   if ( (srcImg == this) ||
+        (insets.left < 0) || (insets.right  < 0) ||
+        (insets.top  < 0) || (insets.bottom < 0) ||
+        (insets.left + insets.right  > srcImg->Width()) ||
+        (insets.top  + insets.bottom > srcImg->Height()))
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   CATRect drawRect;
+   if ((dstRect.Intersect(clipRect, &drawRect) == false) ||
+       (drawRect.Intersect(CATRect(0, 0, fWidth, fHeight), &drawRect) == false))
+   {
+      return CAT_SUCCESS;
+   }
+
+   CATInt32 srcX[4], dstX[4], srcY[4], dstY[4];
+   SliceSplit(srcImg->Width(),  insets.left, insets.right,
+              dstRect.left, dstRect.Width(),  srcX, dstX);
+   SliceSplit(srcImg->Height(), insets.top,  insets.bottom,
+              dstRect.top,  dstRect.Height(), srcY, dstY);
+
+   CATOverlayRowFunc rowFunc = (srcImg->fFormat == CATIMAGE_RGBA32_PREMULTIPLIED) ?
+                                    gCATImageKernels.OverlayPremulRow :
+                                    gCATImageKernels.OverlayRow;
+
+   CATResult result = CAT_SUCCESS;
+   for (CATInt32 row = 0; row < 3; row++)
+   {
+      for (CATInt32 col = 0; col < 3; col++)
+      {
+         CATInt32 srcW = srcX[col + 1] - srcX[col];
+         CATInt32 srcH = srcY[row + 1] - srcY[row];
+         CATRect  cell(dstX[col], dstY[row], dstX[col + 1], dstY[row + 1]);
+         CATRect  part;
+
+         if ((srcW == 0) || (srcH == 0) || (cell.Intersect(drawRect, &part) == false))
          {
-            srcPtr +=4;
-            dstPtr +=4;
             continue;
          }
-         else if (alpha == 255)
+
+         // Same size as the source - plain overlay.
+         if ((cell.Width() == srcW) && (cell.Height() == srcH))
          {
-            for (i=0; i<3; i++)
+            result = Overlay( srcImg,
+                              part.left,
+                              part.top,
+                              srcX[col] + part.left - cell.left,
+                              srcY[row] + part.top  - cell.top,
+                              part.Width(),
+                              part.Height());
+            if (CATFAILED(result))
             {
-               *dstPtr = *srcPtr;
-               dstPtr++;
-               srcPtr++;
+               return result;
             }
-            dstPtr ++;
-            srcPtr ++;
             continue;
          }
-         
-         // Blend the r,g,b channels. Alpha remains the same for destination image.         
-         for (i=0; i < 3; i++)
+
+         // Everything else goes through x and y index tables that map
+         // each drawn pixel back to a source pixel - wrapped for tiled
+         // edges and centre, or the pixel under its centre when
+         // stretched.  Corners only change size when they've been
+         // shrunk to fit, so they're always stretched.
+         bool tile = (mode == CATSLICE_TILE) && ((row == 1) || (col == 1));
+         std::vector<CATInt32> index(part.Width() + part.Height());
+         CATInt32 i;
+         for (i = 0; i < part.Width(); i++)
          {
-				*dstPtr = (CATUInt8)((( alpha * (CATInt32)( *srcPtr - *dstPtr) ) + ((CATInt32)(*dstPtr)<<8) ) >> 8);
-/*
-            *dstPtr =  (CATUInt8)((( (CATInt32)(*srcPtr) * alpha)  + 
-                        ( (CATInt32)(*dstPtr) * (255 - alpha) )) / 255);
-*/
-            dstPtr++;
-            srcPtr++;
+            CATInt32 x = part.left + i - cell.left;
+            index[i] = srcX[col] + (tile ? (x % srcW) :
+                                           ((2 * x + 1) * srcW) / (2 * cell.Width()));
+         }
+         for (i = 0; i < part.Height(); i++)
+         {
+            CATInt32 y = part.top + i - cell.top;
+            index[part.Width() + i] = srcY[row] + (tile ? (y % srcH) :
+                                           ((2 * y + 1) * srcH) / (2 * cell.Height()));
          }
-         
-         srcPtr++;
-         dstPtr++;
-      }
 
-      dstPtr += dstStep;
-      srcPtr += srcStep;
+         CATImageRows dstRows;
+         CATImageRows srcRows;
+         if (CATFAILED(result = GetRowsForWrite(dstRows)))
+         {
+            return result;
+         }
+         srcImg->GetRowsForRead(srcRows);
+
+         CATImageBand band;
+         band.proc            = OverlayNearestRows;
+         band.dstPtr          = dstRows.Pixel(part.left, part.top);
+         band.srcPtr          = srcRows.data;
+         band.dstLineLength   = dstRows.stride;
+         band.srcLineLength   = srcRows.stride;
+         band.width           = part.Width();
+         band.rowFunc         = rowFunc;
+         band.context         = &index[0];
+
+         RunBands(band, part.Height());
+      }
    }
 
-	
-
-
-   return result;
+   return CAT_SUCCESS;
 }
 
 //---------------------------------------------------------------------------
@@ -1228,15 +2193,26 @@ CATResult  CATImage::Overlay(   const CATImage*    srcImg,
 ///                 start of the image.
 ///
 /// \param image - image ref set to image from stream on success.
+/// \param format - CATIMAGE_PNG_RGBA32 for straight alpha, or
+///                 CATIMAGE_RGBA32_PREMULTIPLIED to convert the
+///                 pixels to premultiplied alpha while loading.
 /// \return CATResult - CAT_SUCCESS on success.
 //---------------------------------------------------------------------------
 CATResult CATImage::Load           (  CATStream*         stream,
-                                    CATImage*&         image)
+                                    CATImage*&         image,
+                                    CATIMAGEFORMAT     format)
 {   
    image = 0;
 
    CATResult result = CAT_SUCCESS;
 
+   CATASSERT((format == CATIMAGE_PNG_RGBA32) || (format == CATIMAGE_RGBA32_PREMULTIPLIED),
+             "Unknown image format requested.");
+   if ((format != CATIMAGE_PNG_RGBA32) && (format != CATIMAGE_RGBA32_PREMULTIPLIED))
+   {
+      return CATRESULT(CAT_ERR_IMAGE_UNKNOWN_FORMAT);
+   }
+
    CATASSERT(stream != 0, "Stream must be created and opened first!");
    CATASSERT(stream->IsOpen(), "Stream must be created and opened first!");
    if ((stream == 0) || (stream->IsOpen() == false))
@@ -1281,65 +2257,128 @@ CATResult CATImage::Load           (  CATStream*         stream,
       // Set read callback and pass stream* as user_io_ptr
       png_set_read_fn(png_ptr, (void *)stream, PNGRead);
 
-      // Convert png to 32-bit RGBA regardless of what it is
-      png_set_expand(png_ptr);
-      png_set_palette_to_rgb(png_ptr);
-      png_set_tRNS_to_alpha(png_ptr);
-      png_set_gray_to_rgb(png_ptr);
-
-      // Read in the .png file
-      png_read_png(png_ptr, info_ptr,  PNG_TRANSFORM_SHIFT, png_voidp_NULL);
+      png_read_info(png_ptr, info_ptr);
 
+      int bitDepth      = 0;
+      int colorType     = 0;
+      int interlaceType = 0;
+      png_get_IHDR(  png_ptr, info_ptr, &width, &height, 
+                     &bitDepth, &colorType, &interlaceType, 
+                     int_p_NULL, int_p_NULL);
 
-      // Get pointer to row data
-      unsigned char** rows = png_get_rows(png_ptr, info_ptr);
-
-      // Get width / height
-      width = png_get_image_width(png_ptr, info_ptr);
-      height = png_get_image_height(png_ptr, info_ptr);
+      // Rows are decoded straight into the image buffer, so make sure
+      // its size can't wrap.
+      if ((width == 0) || (height == 0) || 
+          (width > (png_uint_32)(0x7fffffff / kBytesPerPixel) / height))
+      {
+         png_destroy_read_struct(&png_ptr, &info_ptr, png_infopp_NULL);
+         delete image;
+         image = 0;
+         return CATRESULTFILE(CAT_ERR_IMAGE_INVALID_SIZE, stream->GetName());
+      }
 
-      CATUInt32 y,x;
+      bool hasTrans = (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS) != 0);
+      int  passes   = png_set_interlace_handling(png_ptr);
 
-   
-      // Since we're creating a new image here, no worries about offsets and padding -
-      // the image data is contiguous. Just copy row by row into our image
-      image->Create(width, height, true, false);
-      unsigned char* rawData = image->GetRawDataPtr();
+      // Scale down to the significant bits, as PNG_TRANSFORM_SHIFT did.
+      png_color_8p sigBits = 0;
+      if (png_get_sBIT(png_ptr, info_ptr, &sigBits))
+      {
+         png_set_shift(png_ptr, sigBits);
+      }
+      png_set_strip_16(png_ptr);
 
-      CATInt32 channels = png_get_channels(png_ptr,info_ptr);
+      // Non-interlaced RGB and palette rows are read into the tail of
+      // their destination row and expanded to RGBA in place. Everything
+      // else has libpng produce RGBA directly - interlaced passes have to
+      // land on full RGBA rows.
+      enum { kRowRGBA, kRowRGB, kRowPalette } rowType = kRowRGBA;
+      CATUInt32 paletteLut[256];
 
-      if (channels == 4)
+      if ((passes == 1) && (colorType == PNG_COLOR_TYPE_PALETTE))
       {
-         for (y=0; y < height; y++)
+         rowType = kRowPalette;
+         png_set_packing(png_ptr);
+         BuildPaletteLut(png_ptr, info_ptr, paletteLut);
+      }
+      else if ((passes == 1) && (colorType == PNG_COLOR_TYPE_RGB) && (!hasTrans))
+      {
+         rowType = kRowRGB;
+      }
+      else
+      {
+         png_set_expand(png_ptr);
+         png_set_palette_to_rgb(png_ptr);
+         png_set_tRNS_to_alpha(png_ptr);
+         png_set_gray_to_rgb(png_ptr);
+         if (((colorType & PNG_COLOR_MASK_ALPHA) == 0) && (!hasTrans))
          {
-            memcpy(  rawData + (y * width * kBytesPerPixel),
-                     rows[y],
-                     width * kBytesPerPixel);
+            png_set_filler(png_ptr, 0xff, PNG_FILLER_AFTER);
          }
       }
-      else if (channels == 3)
+
+      png_read_update_info(png_ptr, info_ptr);
+
+      CATUInt32 rowBytes   = width * kBytesPerPixel;
+      CATUInt32 readOffset = 0;
+      switch (rowType)
+      {
+         case kRowRGB:     readOffset = width;       break;
+         case kRowPalette: readOffset = width * 3;   break;
+         default:                                    break;
+      }
+
+      if (png_get_rowbytes(png_ptr, info_ptr) != rowBytes - readOffset)
       {
-         for (y=0; y < height; y++)
+         CATASSERT(false,"Unsupported number of channels in .PNG!");
+         png_destroy_read_struct(&png_ptr, &info_ptr, png_infopp_NULL);
+         delete image;
+         image = 0;
+         return CATRESULTFILE(CAT_ERR_PNG_UNSUPPORTED_FORMAT,stream->GetName());
+      }
+
+      // No need to clear it - every byte is decoded over.
+      if (CATFAILED(result = image->Create(width, height, false, false)))
+      {
+         png_destroy_read_struct(&png_ptr, &info_ptr, png_infopp_NULL);
+         delete image;
+         image = 0;
+         return result;
+      }
+      image->fFormat = format;
+      CATUInt8* rawData = image->GetRawDataPtrForWrite();
+      bool premultiply = (format == CATIMAGE_RGBA32_PREMULTIPLIED) && (rowType != kRowRGB);
+
+      for (int pass = 0; pass < passes; pass++)
+      {
+         CATUInt8* rowPtr = rawData;
+         for (png_uint_32 y = 0; y < height; y++)
          {
-            unsigned char* linePtr = rawData + (y * width * kBytesPerPixel);            
-            unsigned char* srcPtr = rows[y];
+            png_read_row(png_ptr, rowPtr + readOffset, png_bytep_NULL);
 
-            for (x = 0; x < width; x++)
+            if (rowType == kRowRGB)
+            {
+               gCATImageKernels.ExpandRGBRow(rowPtr, rowPtr + readOffset, width);
+            }
+            else if (rowType == kRowPalette)
             {
-               *linePtr = *srcPtr; linePtr++; srcPtr++;
-               *linePtr = *srcPtr; linePtr++; srcPtr++;
-               *linePtr = *srcPtr; linePtr++; srcPtr++;
-               *linePtr = 255;
-               linePtr++;
+               ExpandPaletteRow(rowPtr, rowPtr + readOffset, width, paletteLut);
             }
+
+            // Premultiplied images are converted here, once, so that
+            // compositing them later is cheap. Done on the last pass
+            // while the row is still in cache.
+            if (premultiply && (pass == passes - 1))
+            {
+               gCATImageKernels.PremultiplyRow(rowPtr, rowPtr, width);
+            }
+
+            rowPtr += rowBytes;
          }
       }
-      else
-      {
-         CATASSERT(false,"Unsupported number of channels in .PNG!");
-         result = CATRESULTFILE(CAT_ERR_PNG_UNSUPPORTED_FORMAT,stream->GetName());
-      }
-   
+
+      png_read_end(png_ptr, info_ptr);
+
       // Clean up
       png_destroy_read_struct(&png_ptr, &info_ptr, png_infopp_NULL);        
 
@@ -1376,8 +2415,9 @@ CATResult CATImage::Load           (  CATStream*         stream,
 //---------------------------------------------------------------------------
 
 
-CATResult CATImage::Save(  const CATWChar*	filename,
-                           CATImage*        image)
+CATResult CATImage::Save(  const CATWChar*	          filename,
+                           CATImage*                  image,
+                           const CATPNGSaveOptions*   options)
 {
 	CATResult result = CAT_SUCCESS;
 	CATStreamFile outFile;
@@ -1386,16 +2426,17 @@ CATResult CATImage::Save(  const CATWChar*	filename,
 		return result;
 	}
 
-	result = Save(&outFile, image);
+	result = Save(&outFile, image, CATIMAGE_PNG_RGBA32, options);
 
 	outFile.Close();
 
 	return result;
 }
 
-CATResult CATImage::Save             (  CATStream*         stream,
-                                        CATImage*          image,
-                                        CATIMAGEFORMAT     imageFormat)
+CATResult CATImage::Save             (  CATStream*                 stream,
+                                        CATImage*                  image,
+                                        CATIMAGEFORMAT             imageFormat,
+                                        const CATPNGSaveOptions*   options)
 {
    CATResult result = CAT_SUCCESS;
    unsigned char** row_pointers = 0;
@@ -1419,8 +2460,21 @@ CATResult CATImage::Save             (  CATStream*         stream,
       return CATRESULT(CAT_ERR_INVALID_PARAM);
    }
 
+   if (options == 0)
+   {
+      options = &kPNGSaveDefault;
+   }
+
+   CATASSERT((options->compressionLevel >= -1) && (options->compressionLevel <= 9),
+             "Invalid compression level.");
+   if ((options->compressionLevel < -1) || (options->compressionLevel > 9))
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
    png_structp png_ptr;
    png_infop info_ptr;
+   unsigned char*  straightData = 0;
 
    try
    {
@@ -1442,62 +2496,377 @@ CATResult CATImage::Save             (  CATStream*         stream,
          return CATRESULT(CAT_ERR_PNG_ERROR_CREATING_WRITE);
       }
 
-      // Set write callbacks
-      png_set_write_fn( png_ptr, (void*)stream, 
-                        PNGWrite,
-                        PNGFlush);      
+      // Set write callbacks
+      png_set_write_fn( png_ptr, (void*)stream, 
+                        PNGWrite,
+                        PNGFlush);      
+
+      
+      try
+      {
+         row_pointers = new unsigned char*[image->fHeight];
+      }
+      catch (...)
+      {
+         row_pointers = 0;
+         // Throw CATResult to function catch
+         throw CATRESULT(CAT_ERR_OUT_OF_MEMORY);
+      }
+
+      for (CATInt32 y = 0; y < image->fHeight; y++)
+      {
+         row_pointers[y] = image->fData + (image->XOffsetAbs() * kBytesPerPixel) +
+                           (( (y + image->YOffsetAbs()) * image->AbsWidth()) 
+                              * kBytesPerPixel);
+      }
+
+      // .PNG is always straight alpha, so premultiplied images get
+      // converted into a temporary buffer first.
+      if (image->fFormat == CATIMAGE_RGBA32_PREMULTIPLIED)
+      {
+         try
+         {
+            straightData = new unsigned char[image->fWidth * image->fHeight * kBytesPerPixel];
+         }
+         catch (...)
+         {
+            straightData = 0;
+            throw CATRESULT(CAT_ERR_OUT_OF_MEMORY);
+         }
+
+         for (CATInt32 y = 0; y < image->fHeight; y++)
+         {
+            unsigned char* straightRow = straightData + (y * image->fWidth * kBytesPerPixel);
+            gCATImageKernels.UnpremultiplyRow(straightRow, row_pointers[y], image->fWidth);
+            row_pointers[y] = straightRow;
+         }
+      }
+
+      png_set_IHDR(  png_ptr,
+                     info_ptr,
+                     image->fWidth,
+                     image->fHeight,
+                     8,
+                     PNG_COLOR_TYPE_RGB_ALPHA,
+                     PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_BASE,
+                     PNG_FILTER_TYPE_BASE);
+
+      if (options->compressionLevel >= 0)
+      {
+         png_set_compression_level(png_ptr, options->compressionLevel);
+      }
+
+      switch (options->filter)
+      {
+         case CATPNGFILTER_NONE:
+            png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+            break;
+         case CATPNGFILTER_SUB:
+            png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+            break;
+         case CATPNGFILTER_UP:
+            png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_UP);
+            break;
+         case CATPNGFILTER_ADAPTIVE:
+            png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+            break;
+         default:
+            break;
+      }
+
+      switch (options->strategy)
+      {
+         case CATPNGSTRATEGY_FILTERED:
+            png_set_compression_strategy(png_ptr, Z_FILTERED);
+            break;
+         case CATPNGSTRATEGY_HUFFMAN:
+            png_set_compression_strategy(png_ptr, Z_HUFFMAN_ONLY);
+            break;
+         case CATPNGSTRATEGY_RLE:
+            png_set_compression_strategy(png_ptr, Z_RLE);
+            break;
+         default:
+            break;
+      }
+
+      // Hand the stream bigger blocks than libpng's default 8K.
+      png_set_compression_buffer_size(png_ptr, kPNGWriteBufferSize);
+
+      png_set_rows(png_ptr,info_ptr,row_pointers);
+
+      png_write_png(png_ptr, info_ptr, 0, png_voidp_NULL);
+
+      delete [] row_pointers;
+      delete [] straightData;
+   }
+   catch (CATResult& thrownRes)
+   {            
+      if (row_pointers)
+      {
+         delete [] row_pointers;
+      }
+
+      if (straightData)
+      {
+         delete [] straightData;
+      }
+
+      result = thrownRes;
+      // Tack on filename to result if we're using result classes.
+      result = CATRESULTFILE(result,stream->GetName());      
+   }
+
+   // Clean up
+   png_destroy_write_struct(&png_ptr, &info_ptr);      
+
+   return result;
+}
+
+//---------------------------------------------------------------------------
+// IsValidRawHeader() checks a raw container header before anything is
+// allocated or mapped based on it.
+//---------------------------------------------------------------------------
+static bool IsValidRawHeader(const CATImage::CATRawImageHeader& header)
+{
+   if ((header.magic   != CATImage::kRawImageMagic) ||
+       (header.version != CATImage::kRawImageVersion))
+   {
+      return false;
+   }
+
+   if ((header.format != CATImage::CATIMAGE_PNG_RGBA32) &&
+       (header.format != CATImage::CATIMAGE_RGBA32_PREMULTIPLIED))
+   {
+      return false;
+   }
+
+   // Sizes are kept in CATInt32 elsewhere, so cap the pixel bytes.
+   if ((header.width  <= 0) || (header.height <= 0) ||
+       (header.width  > 0x7fffffff / kBytesPerPixel / header.height))
+   {
+      return false;
+   }
+
+   if ((header.stride < (CATUInt32)(header.width * kBytesPerPixel)) ||
+       ((CATUInt64)header.stride * header.height > 0x7fffffff))
+   {
+      return false;
+   }
+
+   return ((header.dataOffset >= sizeof(CATImage::CATRawImageHeader)) &&
+           ((header.dataOffset % CATImage::kRawImageAlign) == 0));
+}
+
+//---------------------------------------------------------------------------
+/// SaveRaw() writes an image in the raw container format.
+///
+/// \param stream - an opened, writeable stream.
+/// \param image - image to save.
+/// \return CATResult - CAT_SUCCESS on success.
+//---------------------------------------------------------------------------
+CATResult CATImage::SaveRaw(  CATStream*         stream,
+                              CATImage*          image)
+{
+   CATASSERT(stream != 0, "Stream must be created and opened first!");
+   CATASSERT(stream->IsOpen(), "Stream must be created and opened first!");
+   if ((stream == 0) || (stream->IsOpen() == false))
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   CATASSERT(image != 0, "Image must be valid for save.");   
+   if ((image == 0) || (image->fData == 0))
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   CATASSERT(sizeof(CATRawImageHeader) == kRawImageAlign, "Raw header should fill one block.");
+
+   CATRawImageHeader header;
+   memset(&header, 0, sizeof(header));
+   header.magic      = kRawImageMagic;
+   header.version    = kRawImageVersion;
+   header.width      = image->fWidth;
+   header.height     = image->fHeight;
+   header.stride     = image->fWidth * kBytesPerPixel;
+   header.format     = image->fFormat;
+   header.dataOffset = kRawImageAlign;
+
+   CATResult result = stream->Write(&header, sizeof(header));
+   if (CATFAILED(result))
+   {
+      return result;
+   }
+
+   CATInt32  srcLineLength = image->AbsWidth() * kBytesPerPixel;
+   CATUInt8* srcPtr        = image->fData + (image->XOffsetAbs() * kBytesPerPixel) +
+                             (image->YOffsetAbs() * srcLineLength);
+
+   // Root images (and full-width sub images) go out in one write.
+   if (srcLineLength == (CATInt32)header.stride)
+   {
+      return stream->Write(srcPtr, header.stride * header.height);
+   }
+
+   for (CATInt32 y = 0; y < image->fHeight; y++)
+   {
+      if (CATFAILED(result = stream->Write(srcPtr, header.stride)))
+      {
+         return result;
+      }
+      srcPtr += srcLineLength;
+   }
+
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+CATResult CATImage::SaveRaw(  const CATWChar*    filename,
+                              CATImage*          image)
+{
+   CATResult result = CAT_SUCCESS;
+   CATStreamFile outFile;
+   if (CATFAILED(result = outFile.Open(filename,CATStream::READ_WRITE_CREATE_TRUNC)))
+   {
+      return result;
+   }
+
+   result = SaveRaw(&outFile, image);
+
+   outFile.Close();
+
+   return result;
+}
+
+//---------------------------------------------------------------------------
+/// LoadRaw() reads an image written by SaveRaw() into a new image.
+///
+/// \param stream - an opened stream positioned at the header.
+/// \param image - image ref set to the new image on success.
+/// \return CATResult - CAT_SUCCESS on success.
+//---------------------------------------------------------------------------
+CATResult CATImage::LoadRaw(  CATStream*         stream,
+                              CATImage*&         image)
+{
+   image = 0;
+
+   CATASSERT(stream != 0, "Stream must be created and opened first!");
+   CATASSERT(stream->IsOpen(), "Stream must be created and opened first!");
+   if ((stream == 0) || (stream->IsOpen() == false))
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   CATRawImageHeader header;
+   CATUInt32 length = sizeof(header);
+   CATResult result = stream->Read(&header, length);
+   if (CATFAILED(result))
+   {
+      return result;
+   }
+
+   if ((length != sizeof(header)) || (!IsValidRawHeader(header)))
+   {
+      return CATRESULTFILE(CAT_ERR_IMAGE_UNKNOWN_FORMAT, stream->GetName());
+   }
+
+   if (header.dataOffset > sizeof(header))
+   {
+      if (CATFAILED(result = stream->SeekRelative(header.dataOffset - sizeof(header))))
+      {
+         return result;
+      }
+   }
+
+   if (CATFAILED(result = CreateImage(image, header.width, header.height, false, false)))
+   {
+      return result;
+   }
+   image->fFormat = (CATIMAGEFORMAT)header.format;
 
-      
-      try
+   // Packed rows are read in one go, straight into the image.
+   CATUInt32 rowBytes = header.width * kBytesPerPixel;
+   CATUInt32 rows     = (header.stride == rowBytes) ? 1 : header.height;
+   CATUInt32 readSize = (header.stride == rowBytes) ? rowBytes * header.height : rowBytes;
+   CATUInt8* dstPtr   = image->fData;
+
+   for (CATUInt32 y = 0; y < rows; y++)
+   {
+      length = readSize;
+      result = stream->Read(dstPtr, length);
+      if (CATSUCCEEDED(result) && (length != readSize))
       {
-         row_pointers = new unsigned char*[image->fHeight];
+         result = CATRESULTFILE(CAT_ERR_FILE_CORRUPTED, stream->GetName());
       }
-      catch (...)
+
+      if (CATSUCCEEDED(result) && (y + 1 < rows))
       {
-         row_pointers = 0;
-         // Throw CATResult to function catch
-         throw CATRESULT(CAT_ERR_OUT_OF_MEMORY);
+         result = stream->SeekRelative(header.stride - rowBytes);
       }
 
-      for (CATInt32 y = 0; y < image->fHeight; y++)
+      if (CATFAILED(result))
       {
-         row_pointers[y] = image->fData + (image->XOffsetAbs() * kBytesPerPixel) +
-                           (( (y + image->YOffsetAbs()) * image->AbsWidth()) 
-                              * kBytesPerPixel);
+         ReleaseImage(image);
+         return result;
       }
 
-      png_set_IHDR(  png_ptr,
-                     info_ptr,
-                     image->fWidth,
-                     image->fHeight,
-                     8,
-                     PNG_COLOR_TYPE_RGB_ALPHA,
-                     PNG_INTERLACE_NONE,
-                     PNG_COMPRESSION_TYPE_BASE,
-                     PNG_FILTER_TYPE_BASE);
+      dstPtr += readSize;
+   }
 
-      png_set_rows(png_ptr,info_ptr,row_pointers);
+   return CAT_SUCCESS;
+}
 
-      png_write_png(png_ptr, info_ptr, 0, png_voidp_NULL);
+//---------------------------------------------------------------------------
+/// MapRaw() wraps a memory-mapped raw image file as an image.
+///
+/// \param filename - raw image file to map.
+/// \param image - image ref set to the mapped image on success.
+/// \return CATResult - CAT_SUCCESS on success.
+//---------------------------------------------------------------------------
+CATResult CATImage::MapRaw(   const CATWChar*    filename,
+                              CATImage*&         image)
+{
+   image = 0;
 
-      delete [] row_pointers;
+   CATFileMap* fileMap = new CATFileMap();
+   CATResult   result  = fileMap->Open(filename);
+   if (CATFAILED(result))
+   {
+      delete fileMap;
+      return result;
    }
-   catch (CATResult& thrownRes)
-   {            
-      if (row_pointers)
-      {
-         delete [] row_pointers;
-      }
 
-      result = thrownRes;
-      // Tack on filename to result if we're using result classes.
-      result = CATRESULTFILE(result,stream->GetName());      
+   const CATRawImageHeader* header = (const CATRawImageHeader*)fileMap->GetData();
+   if ((fileMap->GetSize() < sizeof(CATRawImageHeader)) || (!IsValidRawHeader(*header)))
+   {
+      delete fileMap;
+      return CATRESULTFILE(CAT_ERR_IMAGE_UNKNOWN_FORMAT, filename);
    }
 
-   // Clean up
-   png_destroy_write_struct(&png_ptr, &info_ptr);      
+   // CATImage rows are always packed.
+   if (header->stride != (CATUInt32)(header->width * kBytesPerPixel))
+   {
+      delete fileMap;
+      return CATRESULTFILE(CAT_ERR_IMAGE_UNKNOWN_FORMAT, filename);
+   }
 
-   return result;
+   if ((CATUInt64)header->dataOffset + (CATUInt64)header->stride * header->height > fileMap->GetSize())
+   {
+      delete fileMap;
+      return CATRESULTFILE(CAT_ERR_FILE_CORRUPTED, filename);
+   }
+
+   image = new CATImage();
+   image->fData      = fileMap->GetData() + header->dataOffset;
+   image->fOwnData   = false;
+   image->fWidth     = header->width;
+   image->fHeight    = header->height;
+   image->fFormat    = (CATIMAGEFORMAT)header->format;
+   image->fFileMap   = fileMap;
+   image->AddRef();
+
+   return CAT_SUCCESS;
 }
 
 //---------------------------------------------------------------------------
@@ -1513,7 +2882,7 @@ CATResult CATImage::DbgSave( const CATWChar* filename)
       return result;
    }
 
-   result = this->Save(&file,this);
+   result = this->Save(&file, this, CATIMAGE_PNG_RGBA32, &kPNGSaveFast);
 
    file.Close();
    
@@ -1629,15 +2998,15 @@ void CATImage::PNGWarning(  png_structp       png_ptr,
 //---------------------------------------------------------------------------
 // CopyOutBGR() copies the RGB data from a rectangle
 // into a buffer and flips the Red and Blue channels.  
-// The buffer must be width*height*3
-// bytes in size.
+// The buffer must be widthBytes*height bytes in size, with widthBytes
+// at least width*3.
 //
 // \param rgbBuf - raw rgb buffer of width/height size
 // \param offsetX - x offset to copy from
 // \param offsetY - y offset to copy from
 // \param width    - width to copy 
 // \param height   - height to copy 
-// \param paddedWidth - padded width of buffer
+// \param widthBytes - width of line in bytes (w/pad)
 // \return CATResult - CAT_SUCCESS on success.
 //---------------------------------------------------------------------------
 CATResult  CATImage::CopyOutBGR (  CATUInt8*              rgbBuf,
@@ -1646,11 +3015,163 @@ CATResult  CATImage::CopyOutBGR (  CATUInt8*              rgbBuf,
                                  CATInt32               width,
                                  CATInt32               height,
                                  CATInt32               widthBytes)
+{
+   return CopyOutRows(  rgbBuf, offsetX, offsetY, width, height, widthBytes, 
+                        3, gCATImageKernels.CopyOutBGRRow);
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRA() copies the RGBA data from a rectangle into a buffer
+// and flips the Red and Blue channels, keeping 4 bytes per pixel.
+// The buffer must be widthBytes*height bytes in size, with widthBytes
+// at least width*4.
+//
+// \param bgraBuf - raw buffer of width/height size
+// \param offsetX - x offset to copy from
+// \param offsetY - y offset to copy from
+// \param width    - width to copy 
+// \param height   - height to copy 
+// \param widthBytes - width of line in bytes (w/pad)
+// \return CATResult - CAT_SUCCESS on success.
+//---------------------------------------------------------------------------
+CATResult  CATImage::CopyOutBGRA(  CATUInt8*              bgraBuf,
+                                 CATInt32               offsetX,
+                                 CATInt32               offsetY,
+                                 CATInt32               width,
+                                 CATInt32               height,
+                                 CATInt32               widthBytes)
+{
+   return CopyOutRows(  bgraBuf, offsetX, offsetY, width, height, widthBytes, 
+                        4, gCATImageKernels.CopyOutBGRARow);
+}
+
+//---------------------------------------------------------------------------
+// YUVCoeffs() builds the fixed-point matrix for CopyInYUV() from the
+// standard's red and blue luma weights.  Limited range stretches
+// 16-235 luma and 16-240 chroma out to 0-255.
+//---------------------------------------------------------------------------
+static void YUVCoeffs(  CATImage::CATYUVMATRIX  matrix,
+                        bool                    fullRange,
+                        bool                    bgra,
+                        CATYUVCoeffs&           coeffs)
+{
+   double kr = (matrix == CATImage::CATYUV_BT709) ? 0.2126 : 0.299;
+   double kb = (matrix == CATImage::CATYUV_BT709) ? 0.0722 : 0.114;
+   double kg = 1.0 - kr - kb;
+
+   double yScale = fullRange ? 1.0 : 255.0 / 219.0;
+   double cScale = fullRange ? 1.0 : 255.0 / 224.0;
+   double one    = (double)(1 << kCATYUVBits);
+
+   coeffs.yOffset = fullRange ? 0 : 16;
+   coeffs.ys      = (CATInt16)floor(yScale * one + 0.5);
+   coeffs.rv      = (CATInt16)floor(cScale * 2.0 * (1.0 - kr) * one + 0.5);
+   coeffs.gu      = (CATInt16)floor(-cScale * 2.0 * (1.0 - kb) * kb / kg * one + 0.5);
+   coeffs.gv      = (CATInt16)floor(-cScale * 2.0 * (1.0 - kr) * kr / kg * one + 0.5);
+   coeffs.bu      = (CATInt16)floor(cScale * 2.0 * (1.0 - kb) * one + 0.5);
+   coeffs.bgra    = bgra;
+}
+
+//---------------------------------------------------------------------------
+// CopyInYUV() converts a frame from a camera or decoder into the image,
+// one row kernel call per line.
+//---------------------------------------------------------------------------
+CATResult CATImage::CopyInYUV(   const CATUInt8* const*  planes,
+                                 const CATInt32*         strides,
+                                 CATYUVFORMAT            format,
+                                 CATYUVMATRIX            matrix,
+                                 bool                    fullRange,
+                                 bool                    bgra,
+                                 bool                    flip)
+{
+   CATASSERT(fData != 0, "Image must be created first!");
+   if (fData == 0)
+   {
+      return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
+   }
+
+   CATYUVBand yuv;
+   memset(&yuv, 0, sizeof(yuv));
+
+   CATInt32 numPlanes = 1;
+   switch (format)
+   {
+      case CATYUV_YUY2:
+         yuv.rowFunc = gCATImageKernels.YUY2Row;
+         break;
+      case CATYUV_UYVY:
+         yuv.rowFunc = gCATImageKernels.UYVYRow;
+         break;
+      case CATYUV_NV12:
+         yuv.rowFunc     = gCATImageKernels.NV12Row;
+         yuv.chromaShift = 1;
+         numPlanes       = 2;
+         break;
+      case CATYUV_I420:
+         yuv.rowFunc     = gCATImageKernels.I420Row;
+         yuv.chromaShift = 1;
+         numPlanes       = 3;
+         break;
+      default:
+         CATASSERT(false, "Unknown YUV format.");
+         return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   CATASSERT((planes != 0) && (strides != 0), "Null planes passed in.");
+   if ((planes == 0) || (strides == 0))
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   for (CATInt32 i = 0; i < numPlanes; i++)
+   {
+      CATASSERT(planes[i] != 0, "Null plane passed in.");
+      if (planes[i] == 0)
+      {
+         return CATRESULT(CAT_ERR_INVALID_PARAM);
+      }
+      yuv.planes[i]  = planes[i];
+      yuv.strides[i] = strides[i];
+   }
+
+   YUVCoeffs(matrix, fullRange, bgra, yuv.coeffs);
+
+   CATImageRows rows;
+   CATResult    result;
+   if (CATFAILED(result = GetRowsForWrite(rows)))
+   {
+      return result;
+   }
+
+   CATImageBand band;
+   band.proc            = YUVRows;
+   band.dstPtr          = flip ? rows.Row(fHeight - 1) : rows.data;
+   band.dstLineLength   = flip ? -rows.stride : rows.stride;
+   band.width           = fWidth;
+   band.context         = &yuv;
+
+   RunBands(band, fHeight);
+
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// CopyOutRows() does the bounds checking and stepping for CopyOutBGR()
+// and CopyOutBGRA(), handing each row to the selected kernel.
+//---------------------------------------------------------------------------
+CATResult  CATImage::CopyOutRows(  CATUInt8*              outBuf,
+                                 CATInt32               offsetX,
+                                 CATInt32               offsetY,
+                                 CATInt32               width,
+                                 CATInt32               height,
+                                 CATInt32               widthBytes,
+                                 CATInt32               outBytesPerPixel,
+                                 CATCopyOutRowFunc      copyRow)
 {
    CATASSERT(width != 0, "Width null");
    CATASSERT(height != 0, "Height null");
-   CATASSERT(rgbBuf != 0, "Null buffer passed in.");
-   if ((width == 0) || (height == 0) || (rgbBuf == 0))
+   CATASSERT(outBuf != 0, "Null buffer passed in.");
+   if ((width == 0) || (height == 0) || (outBuf == 0))
    {
       return CATRESULT(CAT_ERR_IMAGE_OVERLAY_OUT_OF_BOUNDS);
    }
@@ -1663,67 +3184,37 @@ CATResult  CATImage::CopyOutBGR (  CATUInt8*              rgbBuf,
       return CATRESULT(CAT_ERR_IMAGE_OVERLAY_OUT_OF_BOUNDS);
    }
 
+   CATASSERT(widthBytes >= width * outBytesPerPixel, "Output lines are too short.");
+   if (widthBytes < width * outBytesPerPixel)
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
    // Now copy the image to the buffer
-   CATInt32 x,y;
+   CATInt32 y;
    CATASSERT(fData != 0, "Image must be created first!");
    if (fData == 0)
    {
       return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
    }
 
+   CATImageRows rows;
+   GetRowsForRead(rows);
 
-   // Offset into line for source buffer in bytes
-   CATInt32 srcOffX = (this->XOffsetAbs() + offsetX) * kBytesPerPixel;   
-   
-   // Absolute length of line in fData in bytes ( >= fWidth * 3)
-   CATInt32 srcLineLength = this->AbsWidth()   * kBytesPerPixel;   
-   
-   // Distance from end of one line to beginning of the next in bytes.
-   CATInt32 srcStep   = srcLineLength - (width * kBytesPerPixel);
-   
-   // current position of start of buffer in source
-   unsigned char* srcPtr = fData + 
-                           srcOffX + 
-                           ((YOffsetAbs() + offsetY) * srcLineLength);
-
+   CATInt32       srcLineLength = rows.stride;
+   unsigned char* srcPtr        = rows.Pixel(offsetX, offsetY);
 
-   unsigned char* dstPtr = rgbBuf;
-   CATInt32 dstStep = widthBytes - width*3;
+   unsigned char* dstPtr = outBuf;
 
 	CATASSERT(kBytesPerPixel == 4, "Making assumptions on pixel size right now...");
 
-   // Loop through image performing merge
+   // Loop through image converting a row at a time
    for (y = 0; y < height; y++)
    {      
-		CATUInt32* srcDwPtr = (CATUInt32*)srcPtr;
-
-      for (x = 0; x < width; x++)
-      {
-			CATUInt32 curPixel = *srcDwPtr;
-			srcDwPtr++;
-			*dstPtr = (CATUInt8)(curPixel >> 16);
-			dstPtr++;
-			*dstPtr = (CATUInt8)(curPixel >> 8);
-			dstPtr++;
-			*dstPtr = (CATUInt8)(curPixel);
-			dstPtr++;
-			
-			
-			/*
-         dstPtr[0] = srcPtr[2];
-         dstPtr[1] = srcPtr[1];
-         dstPtr[2] = srcPtr[0];
-         
-         srcPtr += kBytesPerPixel;
-         dstPtr += 3;
-			*/
+      copyRow(dstPtr, srcPtr, width);
 
-
-			
-      }
-
-      srcPtr += srcStep + width*4;
-      dstPtr += dstStep;
+      srcPtr += srcLineLength;
+      dstPtr += widthBytes;
    }
    
    return CAT_SUCCESS;
@@ -1784,7 +3275,7 @@ CATResult CATImage::CreateImageFromDIB(	CATImage*&		image,
 		return result;
 	}
 
-	unsigned char* rawPtr = image->GetRawDataPtr();
+	unsigned char* rawPtr = image->GetRawDataPtrForWrite();
 
 	CATASSERT((bmpInfo.bmBitsPixel == 24) ||(bmpInfo.bmBitsPixel == 32), 
             "Only 24-bit and 32-bit images are currently supported.");
@@ -1908,7 +3399,7 @@ CATResult CATImage::CreateImageFromIcon( CATImage*&		image,
 
 		for (CATInt32 y = 0; y < height; y++)
 		{
-			dstPtr = image->GetRawDataPtr() + (y*image->AbsWidth()*4);
+			dstPtr = image->GetRawDataPtrForWrite() + (y*image->AbsWidth()*4);
 			srcPtr = dataPtr + ((height-1)*width*4) - (y*width*4);
 
 			for (CATInt32 x = 0; x < width; x++)
@@ -1933,28 +3424,335 @@ CATResult CATImage::CreateImageFromIcon( CATImage*&		image,
 
 CATResult CATImage::MakeDisabled()
 {
-    CATInt32 width  = Width();
-    CATInt32 height = Height();
-    
-    unsigned char* rawPtr  = GetRawDataPtr();
-    unsigned char* destPtr = 0;
+    CATASSERT(fData != 0, "Image must be created first!");
+    if (fData == 0)
+    {
+        return CATRESULT(CAT_ERR_IMAGE_MUST_INITIALIZE);
+    }
+
+    CATImageRows rows;
+    CATResult    result = GetRowsForWrite(rows);
+    if (CATFAILED(result))
+    {
+        return result;
+    }
+
+    CATImageBand band;
+    band.proc           = StateRows;
+    band.stateFunc      = gCATImageKernels.DisableRow;
+    band.dstPtr         = rows.data;
+    band.srcPtr         = rows.data;
+    band.dstLineLength  = rows.stride;
+    band.srcLineLength  = rows.stride;
+    band.width          = Width();
+    band.premultiplied  = (fFormat == CATIMAGE_RGBA32_PREMULTIPLIED);
+
+    RunBands(band, Height());
+
+    return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// CreateStateImage() creates a new image with a control state's look.
+// The kernel reads the source and writes the new image in one pass.
+//---------------------------------------------------------------------------
+CATResult CATImage::CreateStateImage(  const CATImage*    srcImg,
+                                       CATImage*&         dstImg,
+                                       CATIMAGESTATE      state)
+{
+    dstImg = 0;
+    CATASSERT(srcImg != 0, "Null source image.");
+    if ((srcImg == 0) || (srcImg->fData == 0))
+    {
+        return CATRESULT(CAT_ERR_IMAGE_NULL);
+    }
+
+    CATStateRowFunc stateFunc = 0;
+    switch (state)
+    {
+        case CATIMAGE_STATE_DISABLED: stateFunc = gCATImageKernels.DisableRow;   break;
+        case CATIMAGE_STATE_PRESSED:  stateFunc = gCATImageKernels.DarkenRow;    break;
+        case CATIMAGE_STATE_FOCUS:    stateFunc = gCATImageKernels.HighlightRow; break;
+    }
+
+    CATASSERT(stateFunc != 0, "Unknown image state.");
+    if (stateFunc == 0)
+    {
+        return CATRESULT(CAT_ERR_INVALID_PARAM);
+    }
+
+    CATResult result = CreateImage(dstImg, srcImg->Width(), srcImg->Height(), false, false);
+    if (CATFAILED(result))
+    {
+        return result;
+    }
+    dstImg->fFormat = srcImg->fFormat;
+
+    CATImageRows srcRows;
+    srcImg->GetRowsForRead(srcRows);
+
+    CATImageBand band;
+    band.proc           = StateRows;
+    band.stateFunc      = stateFunc;
+    band.dstPtr         = dstImg->fData;
+    band.srcPtr         = srcRows.data;
+    band.dstLineLength  = dstImg->fWidth * kBytesPerPixel;
+    band.srcLineLength  = srcRows.stride;
+    band.width          = dstImg->fWidth;
+    band.premultiplied  = (srcImg->fFormat == CATIMAGE_RGBA32_PREMULTIPLIED);
+
+    RunBands(band, dstImg->fHeight);
+
+    return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// Placement of one image in CreateAtlas().
+//---------------------------------------------------------------------------
+struct CATAtlasSlot
+{
+    CATUInt32   index;
+    CATInt32    page;
+    CATInt32    x;
+    CATInt32    y;
+};
+
+//---------------------------------------------------------------------------
+// Packing order for CreateAtlas() - by format, then tallest and widest
+// first so shelves waste as little height as possible.
+//---------------------------------------------------------------------------
+struct CATAtlasOrder
+{
+    CATImage** images;
+
+    bool operator()(const CATAtlasSlot& a, const CATAtlasSlot& b) const
+    {
+        const CATImage* imgA = images[a.index];
+        const CATImage* imgB = images[b.index];
+        if (imgA->GetFormat() != imgB->GetFormat())
+            return imgA->GetFormat() < imgB->GetFormat();
+        if (imgA->Height() != imgB->Height())
+            return imgA->Height() > imgB->Height();
+        if (imgA->Width() != imgB->Width())
+            return imgA->Width() > imgB->Width();
+        return a.index < b.index;
+    }
+};
+
+//---------------------------------------------------------------------------
+// CreateAtlas() packs small images into shared pages with a simple
+// shelf packer, then swaps them for sub images of the pages.
+//---------------------------------------------------------------------------
+CATResult CATImage::CreateAtlas(   CATImage**         images,
+                                   CATUInt32          numImages,
+                                   CATInt32           pageWidth,
+                                   CATInt32           pageHeight,
+                                   CATUInt32*         numPages)
+{
+    if (numPages != 0)
+    {
+        *numPages = 0;
+    }
+
+    CATASSERT((images != 0) || (numImages == 0), "Null image list.");
+    CATASSERT((pageWidth >= kAtlasAlign) && (pageHeight > 0), "Invalid atlas page size.");
+    if (((images == 0) && (numImages != 0)) || (pageWidth < kAtlasAlign) || (pageHeight <= 0))
+    {
+        return CATRESULT(CAT_ERR_INVALID_PARAM);
+    }
+
+    std::vector<CATAtlasSlot> slots;
+    for (CATUInt32 i = 0; i < numImages; i++)
+    {
+        CATImage* image = images[i];
+        if ((image == 0) || (image->fData == 0) || (image->IsImageRoot() == false))
+            continue;
+        if ((image->fWidth  > pageWidth  / 2) || (image->fHeight > pageHeight / 2))
+            continue;
+
+        CATAtlasSlot slot;
+        slot.index = i;
+        slot.page  = -1;
+        slot.x     = 0;
+        slot.y     = 0;
+        slots.push_back(slot);
+    }
+
+    // Two or more are needed for packing to buy anything.
+    if (slots.size() < 2)
+    {
+        return CAT_SUCCESS;
+    }
+
+    CATAtlasOrder order;
+    order.images = images;
+    std::sort(slots.begin(), slots.end(), order);
+
+    // Lay everything out first so each page can be sized to fit.
+    std::vector<CATInt32>       pageUsedWidth;
+    std::vector<CATInt32>       pageUsedHeight;
+    std::vector<CATIMAGEFORMAT> pageFormat;
+    CATInt32                    curX  = 0;
+    CATInt32                    curY  = 0;
+    CATInt32                    shelf = 0;
+    size_t                      i;
+
+    for (i = 0; i < slots.size(); i++)
+    {
+        const CATImage* image = images[slots[i].index];
+        CATInt32 width  = image->fWidth;
+        CATInt32 height = image->fHeight;
+
+        bool newPage = pageFormat.empty() || (pageFormat.back() != image->fFormat);
+        if ((newPage == false) && (curX + width > pageWidth))
+        {
+            // Next shelf
+            curY  += shelf;
+            curX   = 0;
+            shelf  = 0;
+        }
+        if ((newPage == false) && (curY + height > pageHeight))
+        {
+            newPage = true;
+        }
+
+        if (newPage)
+        {
+            pageFormat.push_back(image->fFormat);
+            pageUsedWidth.push_back(0);
+            pageUsedHeight.push_back(0);
+            curX  = 0;
+            curY  = 0;
+            shelf = 0;
+        }
+
+        CATInt32 page = (CATInt32)pageFormat.size() - 1;
+        slots[i].page = page;
+        slots[i].x    = curX;
+        slots[i].y    = curY;
+
+        // Rounded so the page's rows keep the alignment too.
+        pageUsedWidth[page]  = CATMax(pageUsedWidth[page],
+                                      (curX + width + kAtlasAlign - 1) & ~(kAtlasAlign - 1));
+        pageUsedHeight[page] = CATMax(pageUsedHeight[page], curY + height);
+
+        shelf = CATMax(shelf, height);
+        curX += (width + kAtlasAlign - 1) & ~(kAtlasAlign - 1);
+    }
 
-    for (CATInt32 y = 0; y < height; y++)
+    // Build each page and swap its images for sub images.
+    CATResult result = CAT_SUCCESS;
+    i = 0;
+    for (CATInt32 page = 0; page < (CATInt32)pageFormat.size(); page++)
     {
-	    destPtr = rawPtr + (y*AbsWidth()*4);
-		
-	    for (CATInt32 x = 0; x < width; x++)
-	    {
-		    // Greyscale
-            CATFloat32 colorVal = destPtr[0]*0.3f + destPtr[1]*0.59f + destPtr[2]*0.11f;
+        CATImage* pageImage = 0;
+        if (CATFAILED(result = CreateImage(   pageImage,
+                                              pageUsedWidth[page],
+                                              pageUsedHeight[page],
+                                              true,
+                                              true)))
+        {
+            return result;
+        }
+        pageImage->fFormat = pageFormat[page];
+
+        for (; (i < slots.size()) && (slots[i].page == page); i++)
+        {
+            CATImage*& image = images[slots[i].index];
+            CATImage*  sub   = 0;
+
+            if (CATFAILED(result = pageImage->CopyOver(image, slots[i].x, slots[i].y, 0, 0)) ||
+                CATFAILED(result = CreateSub(pageImage,
+                                             sub,
+                                             slots[i].x,
+                                             slots[i].y,
+                                             image->fWidth,
+                                             image->fHeight)))
+            {
+                ReleaseImage(pageImage);
+                return result;
+            }
 
-            // lower contrast and brighten
-            colorVal = colorVal/8 + 192;
+            ReleaseImage(image);
+            image = sub;
+        }
 
-            destPtr[0] = destPtr[1] = destPtr[2] = (CATUInt8)colorVal;
+        // The sub images hold the page now.
+        ReleaseImage(pageImage);
 
-            destPtr += 4;
-	    }
+        if (numPages != 0)
+        {
+            (*numPages)++;
+        }
     }
+
     return CAT_SUCCESS;
-}
\ No newline at end of file
+}
+
+//---------------------------------------------------------------------------
+// GetFormat() returns the in-memory alpha format of the image.
+//---------------------------------------------------------------------------
+CATImage::CATIMAGEFORMAT CATImage::GetFormat() const
+{
+   return fFormat;
+}
+
+//---------------------------------------------------------------------------
+// IsPremultiplied() returns true if the color channels are stored
+// premultiplied by alpha.
+//---------------------------------------------------------------------------
+bool CATImage::IsPremultiplied() const
+{
+   return (fFormat == CATIMAGE_RGBA32_PREMULTIPLIED);
+}
+
+//---------------------------------------------------------------------------
+// SetParallel() turns row-parallel execution on or off.
+//---------------------------------------------------------------------------
+void CATImage::SetParallel(bool enable, CATInt32 minPixels)
+{
+   if (minPixels < 1)
+   {
+      minPixels = 1;
+   }
+
+   // Create the shared pool here rather than from inside an operation,
+   // so it's done on the caller's thread.
+   if (enable)
+   {
+      CATWorkPool::GetShared();
+   }
+
+   gParallelMinPixels = minPixels;
+   gParallelEnabled   = enable;
+}
+
+//---------------------------------------------------------------------------
+// IsParallel() returns true if row-parallel execution is on.
+//---------------------------------------------------------------------------
+bool CATImage::IsParallel()
+{
+   return gParallelEnabled;
+}
+
+//---------------------------------------------------------------------------
+// GetParallelMinPixels() returns the current parallel threshold.
+//---------------------------------------------------------------------------
+CATInt32 CATImage::GetParallelMinPixels()
+{
+   return gParallelMinPixels;
+}
+
+//---------------------------------------------------------------------------
+// GetBufferPool() returns the pool that image pixel buffers come from.
+//---------------------------------------------------------------------------
+CATBufferPool* CATImage::GetBufferPool()
+{
+   // Never deleted - images may still be released during static
+   // destruction.  Create it before starting threads that use images.
+   if (gImageBufferPool == 0)
+   {
+      gImageBufferPool = new CATBufferPool();
+   }
+   return gImageBufferPool;
+}
@@ -13,12 +13,18 @@
 #ifndef _CATImage_H_
 #define _CATImage_H_
 
+#include <vector>
 #include "CATInternal.h"
 #include "CATStream.h"
 #include "CATColor.h"
 #include "CATRect.h"
+#include "CATImageKernels.h"
+#include "CATImageRows.h"
 #include "png.h"
 
+class CATBufferPool;
+class CATFileMap;
+
 /// \class CATImage
 /// \brief Base image class
 /// \ingroup CAT
@@ -36,9 +42,126 @@ class CATImage
       /// Eventually, this may specify file format.
       ///
       /// Currently, we only support PNG with RGB/Alpha channels.
+      ///
+      /// CATIMAGE_RGBA32_PREMULTIPLIED selects the in-memory layout on
+      /// Load(): the color channels are stored already multiplied by
+      /// alpha, so Overlay() needs one multiply-add per channel. Use it
+      /// for images that are only ever composited onto others.
       enum CATIMAGEFORMAT
       {
-         CATIMAGE_PNG_RGBA32
+         CATIMAGE_PNG_RGBA32,
+         CATIMAGE_RGBA32_PREMULTIPLIED
+      };
+
+      /// Filters for Resample().
+      enum CATRESAMPLEFILTER
+      {
+         CATRESAMPLE_NEAREST,    ///< Nearest pixel. Fastest; blocky.
+         CATRESAMPLE_BILINEAR,   ///< Linear between neighbours. Good for
+                                 ///< upscaling; aliases below half size.
+         CATRESAMPLE_BOX,        ///< Area average. Cheap, clean downscaling.
+         CATRESAMPLE_LANCZOS3    ///< 3-lobe windowed sinc. Sharpest, slowest.
+      };
+
+      /// Control state looks for CreateStateImage().
+      enum CATIMAGESTATE
+      {
+         CATIMAGE_STATE_DISABLED,   ///< Low-contrast greyscale
+         CATIMAGE_STATE_PRESSED,    ///< Darkened by a quarter
+         CATIMAGE_STATE_FOCUS       ///< Lightened a quarter toward white
+      };
+
+      /// How OverlaySliced() fills the edges and centre.
+      enum CATSLICEMODE
+      {
+         CATSLICE_STRETCH,       ///< Scale each piece to fit (nearest pixel).
+         CATSLICE_TILE           ///< Repeat each piece from its top-left.
+      };
+
+      /// Source layouts for CopyInYUV().  All are 8 bits per sample
+      /// with chroma at half horizontal resolution.
+      enum CATYUVFORMAT
+      {
+         CATYUV_YUY2,            ///< Packed Y0 U Y1 V (4:2:2)
+         CATYUV_UYVY,            ///< Packed U Y0 V Y1 (4:2:2)
+         CATYUV_NV12,            ///< Y plane, then interleaved U,V plane (4:2:0)
+         CATYUV_I420             ///< Y, U and V planes (4:2:0)
+      };
+
+      /// Colour matrices for CopyInYUV().
+      enum CATYUVMATRIX
+      {
+         CATYUV_BT601,           ///< Standard definition (most webcams)
+         CATYUV_BT709            ///< High definition
+      };
+
+      /// Row filters for Save(). Each row is run through a predictor
+      /// before zlib; better prediction means smaller files but more time.
+      enum CATPNGFILTER
+      {
+         CATPNGFILTER_DEFAULT,   ///< libpng's choice (adaptive for RGBA).
+         CATPNGFILTER_NONE,      ///< No prediction. Fastest.
+         CATPNGFILTER_SUB,       ///< Difference from the pixel to the left.
+         CATPNGFILTER_UP,        ///< Difference from the pixel above.
+         CATPNGFILTER_ADAPTIVE   ///< Tries every filter on each row. Slowest.
+      };
+
+      /// zlib strategies for Save().
+      enum CATPNGSTRATEGY
+      {
+         CATPNGSTRATEGY_DEFAULT, ///< libpng's choice (Z_FILTERED).
+         CATPNGSTRATEGY_FILTERED,///< Z_FILTERED - tuned for filtered rows.
+         CATPNGSTRATEGY_HUFFMAN, ///< Z_HUFFMAN_ONLY - no string matching.
+         CATPNGSTRATEGY_RLE      ///< Z_RLE - runs only. Nearly as fast as
+                                 ///< Huffman-only, much smaller on flat areas.
+      };
+
+      /// Options for Save().
+      struct CATPNGSaveOptions
+      {
+         CATInt32          compressionLevel; ///< zlib level 0-9, -1 for default
+         CATPNGFILTER      filter;           ///< Row filter
+         CATPNGSTRATEGY    strategy;         ///< zlib strategy
+      };
+
+      /// Raw container constants - see SaveRaw().
+      enum
+      {
+         kRawImageMagic    = 0x52544143,  ///< 'CATR', little-endian
+         kRawImageVersion  = 1,           ///< Current container version
+         kRawImageAlign    = 64           ///< Alignment of the pixel data
+      };
+
+      /// Header of the raw image container written by SaveRaw().
+      ///
+      /// The pixel rows follow at dataOffset bytes from the start of the
+      /// header, a multiple of kRawImageAlign, with stride bytes from one
+      /// row to the next. Fields are in native (little-endian) order.
+      struct CATRawImageHeader
+      {
+         CATUInt32   magic;         ///< kRawImageMagic
+         CATUInt32   version;       ///< kRawImageVersion
+         CATInt32    width;         ///< Width in pixels
+         CATInt32    height;        ///< Height in pixels
+         CATUInt32   stride;        ///< Bytes between rows, >= width * 4
+         CATUInt32   format;        ///< CATIMAGEFORMAT of the pixels
+         CATUInt32   dataOffset;    ///< Bytes from header to first row
+         CATUInt32   reserved[9];   ///< Zero - pads the header to 64 bytes
+      };
+
+      /// libpng's defaults - smallest files, slowest.
+      static const CATPNGSaveOptions kPNGSaveDefault;
+
+      /// Level 1, Sub filter, Z_RLE. Several times faster than the
+      /// defaults, for debug dumps and captured frames.
+      static const CATPNGSaveOptions kPNGSaveFast;
+
+      /// Default threshold for SetParallel(), in pixels.  This is an
+      /// untuned guess rather than a measured crossover.  Use the value
+      /// CATImagePerf -threads suggests on the target machine instead.
+      enum
+      {
+         kParallelMinPixels = 256*256
       };
 
       /// Load() loads an image from a file.
@@ -53,14 +176,19 @@ class CATImage
       ///                 start of the image.
       ///
       /// \param image - image ref set to image from stream on success.
+      /// \param format - CATIMAGE_PNG_RGBA32 for straight alpha, or
+      ///                 CATIMAGE_RGBA32_PREMULTIPLIED to convert the
+      ///                 pixels to premultiplied alpha while loading.
       /// \return CATResult - CAT_SUCCESS on success.
       static CATResult Load             (  CATStream*         stream,
-                                           CATImage*&         image);
+                                           CATImage*&         image,
+                                           CATIMAGEFORMAT     format = CATIMAGE_PNG_RGBA32);
       
       /// Save() saves an image to a .png file.
       ///
       /// Currently, only .PNG format is supported. Images are
-      /// saved as 32-bit RGBA (8-bits per channel).
+      /// saved as 32-bit RGBA (8-bits per channel). Premultiplied
+      /// images are converted back to straight alpha as they are written.
       ///
       /// \param stream - an opened stream to save the image to.
       ///                 The stream should be positioned to the location
@@ -69,14 +197,59 @@ class CATImage
       /// \param image - ptr to image to save.
       /// \param imageFormat - right now, doesn't do anything. Should 
       ///                      always be CATIMAGE_PNG_RGBA32.
+      /// \param options - compression options, e.g. &kPNGSaveFast.
+      ///                  0 uses kPNGSaveDefault.
       ///
       /// \return CATResult - CAT_SUCCESS on success.      
-      static CATResult Save(  CATStream*         stream,
-                              CATImage*          image,
-                              CATIMAGEFORMAT     imageFormat = CATIMAGE_PNG_RGBA32);
+      static CATResult Save(  CATStream*                 stream,
+                              CATImage*                  image,
+                              CATIMAGEFORMAT             imageFormat = CATIMAGE_PNG_RGBA32,
+                              const CATPNGSaveOptions*   options     = 0);
+
+      static CATResult Save(  const CATWChar*            filename,
+                              CATImage*			         image,
+                              const CATPNGSaveOptions*   options     = 0);
+
+      /// SaveRaw() writes an image as an uncompressed raw container: a
+      /// CATRawImageHeader followed by the pixel rows, 64-byte aligned.
+      /// The pixel format (straight or premultiplied) is kept as is.
+      ///
+      /// Meant for intermediate images that are saved and reloaded
+      /// often - see LoadRaw() and MapRaw(). Not a portable format.
+      ///
+      /// \param stream - an opened, writeable stream.
+      /// \param image - image to save.
+      /// \return CATResult - CAT_SUCCESS on success.
+      static CATResult SaveRaw(  CATStream*         stream,
+                                 CATImage*          image);
+
+      static CATResult SaveRaw(  const CATWChar*    filename,
+                                 CATImage*          image);
+
+      /// LoadRaw() reads an image written by SaveRaw() into a new image.
+      ///
+      /// Call CATImage::ReleaseImage() when done with the returned image.
+      ///
+      /// \param stream - an opened stream positioned at the header.
+      /// \param image - image ref set to the new image on success.
+      /// \return CATResult - CAT_SUCCESS on success.
+      static CATResult LoadRaw(  CATStream*         stream,
+                                 CATImage*&         image);
 
-      static CATResult Save(  const CATWChar*    filename,
-                              CATImage*			 image);
+      /// MapRaw() memory-maps a file written by SaveRaw() and returns an
+      /// image that uses the mapped pixels directly - nothing is read or
+      /// copied until the pixels are touched. The image doesn't own its
+      /// data; the mapping is closed when the image is released.
+      ///
+      /// The mapping is copy-on-write, so the image may be drawn on, but
+      /// the changes never reach the file. The rows must be packed
+      /// (stride == width * 4), as SaveRaw() writes them.
+      ///
+      /// \param filename - raw image file to map.
+      /// \param image - image ref set to the mapped image on success.
+      /// \return CATResult - CAT_SUCCESS on success.
+      static CATResult MapRaw(   const CATWChar*    filename,
+                                 CATImage*&         image);
 
       /// CreateImage() creates an image.
       ///
@@ -162,6 +335,14 @@ class CATImage
       /// The data from srcImg is copied into a buffer owned by 
       /// dstImg. 
       ///
+      /// The copy is copy-on-write: it shares srcImg's pixels until
+      /// either side is written to (SetPixel(), FillRect(), Clear(),
+      /// CopyOver(), Overlay(), MakeDisabled(), or
+      /// GetRawDataPtrForWrite()).  Only then is the buffer
+      /// duplicated, so copies that are only read cost nothing.
+      /// Because writes to the source detach its copies, a source and
+      /// its copies must not be used from different threads at once.
+      ///
       /// Caller must call CATImage::ReleaseImage() on the returned 
       /// image when done.
       ///
@@ -176,7 +357,7 @@ class CATImage
       
       /// CopyImage() creates a new image of the same type as srcImg
       /// and stores it in dstImg.  The data from srcImg is
-      /// copied into a buffer owned by dstImg. 
+      /// copied into a buffer owned by dstImg, copy-on-write as above.
       ///
       /// Caller must call CATImage::ReleaseImage() on the returned 
       /// image when done.
@@ -201,6 +382,84 @@ class CATImage
                                           CATInt32               width,
                                           CATInt32               height);
 
+      /// Resample() creates a new image of the given size and scales
+      /// srcImg into it with the requested filter.
+      ///
+      /// The filters run as separate horizontal and vertical passes
+      /// over precomputed fixed-point weight tables, using the SIMD row
+      /// kernels where the CPU has them.  Blending filters work in
+      /// premultiplied alpha internally; the result has the same
+      /// format as srcImg.
+      ///
+      /// Caller must call CATImage::ReleaseImage() on the returned
+      /// image when done.
+      ///
+      /// \param srcImg - source image to scale.
+      /// \param dstImg - uninitialized image ptr. Contains scaled
+      ///                 copy of srcImg on return.
+      /// \param width  - width of the new image.
+      /// \param height - height of the new image.
+      /// \param filter - scaling filter.
+      ///
+      /// \return CATResult result code
+      /// \sa CATImage::ReleaseImage()
+      static CATResult Resample        (  const CATImage*    srcImg,
+                                          CATImage*&         dstImg,
+                                          CATInt32           width,
+                                          CATInt32           height,
+                                          CATRESAMPLEFILTER  filter = CATRESAMPLE_BILINEAR);
+
+      /// CreateStateImage() creates a new image with the look of a
+      /// control state (see CATIMAGESTATE) from srcImg.  The result has
+      /// the same size and format as srcImg.
+      ///
+      /// These are meant to be made once per source image and cached,
+      /// rather than converted on every state change - see
+      /// CATApp::GetStateResourceImage().
+      ///
+      /// Caller must call CATImage::ReleaseImage() on the returned
+      /// image when done.
+      ///
+      /// \param srcImg - source image.
+      /// \param dstImg - uninitialized image ptr. Contains the state
+      ///                 image on return.
+      /// \param state  - look to apply.
+      ///
+      /// \return CATResult result code
+      /// \sa CATImage::ReleaseImage()
+      static CATResult CreateStateImage(  const CATImage*    srcImg,
+                                          CATImage*&         dstImg,
+                                          CATIMAGESTATE      state);
+
+      /// CreateAtlas() packs small images into a few shared pages so
+      /// they sit together in memory, and swaps each packed entry of
+      /// images[] for a sub image of its page.
+      ///
+      /// Root images no larger than half a page each way are packed,
+      /// tallest first, with images of different formats kept on
+      /// separate pages.  The caller's reference to each packed
+      /// original is released and replaced by one on the sub image;
+      /// the pages live until their last sub image is released.
+      /// Entries that are null, sub images, or too big are left alone.
+      ///
+      /// Pages are trimmed to the space actually used.  Each sub image
+      /// starts on a 16-byte boundary within its rows.
+      ///
+      /// \param images     - images to pack.  Packed entries are
+      ///                     replaced on return.
+      /// \param numImages  - number of entries in images.
+      /// \param pageWidth  - maximum page width in pixels.
+      /// \param pageHeight - maximum page height in pixels.
+      /// \param numPages   - optional; receives the number of pages made.
+      ///
+      /// \return CATResult result code.  On failure, entries already
+      ///         packed stay packed and the rest are left alone.
+      static CATResult CreateAtlas(    CATImage**         images,
+                                       CATUInt32          numImages,
+                                       CATInt32           pageWidth  = 1024,
+                                       CATInt32           pageHeight = 1024,
+                                       CATUInt32*         numPages   = 0);
+
       /// CopyOver() copies from another image over the current image
       /// at the specified offsets for the specified width and height.
       ///
@@ -211,6 +470,10 @@ class CATImage
       /// of bounds, an error will be returned and the copy will not
       /// be performed.
       ///
+      /// If the source and destination differ in alpha format (see 
+      /// GetFormat()), the pixels are converted to the destination's
+      /// format as they are copied.
+      ///
       /// \param srcImg - source image to copy from
       /// \param dstOffsetX - x offset in dest image to copy to
       /// \param dstOffsetY - y offset in dest image to copy to
@@ -229,8 +492,8 @@ class CATImage
 
       /// CopyOutBGR() copies the RGB data from a rectangle
       /// into a buffer and flips the Red and Blue channels.  
-      /// The buffer must be width*height*3
-      /// bytes in size.
+      /// The buffer must be widthBytes*height bytes in size,
+      /// with widthBytes >= width*3.
       ///
       /// \param rgbBuf - raw rgb buffer of width/height size
       /// \param offsetX - x offset to copy from
@@ -246,6 +509,55 @@ class CATImage
                               CATInt32               height,
                               CATInt32               widthBytes);
 
+      /// CopyOutBGRA() copies the RGBA data from a rectangle
+      /// into a buffer and flips the Red and Blue channels, keeping
+      /// 4 bytes per pixel (32-bit DIB order). This avoids the 3-byte
+      /// repack of CopyOutBGR().
+      ///
+      /// The buffer must be widthBytes*height bytes in size,
+      /// with widthBytes >= width*4.
+      ///
+      /// \param bgraBuf - raw buffer of width/height size
+      /// \param offsetX - x offset to copy from
+      /// \param offsetY - y offset to copy from
+      /// \param width    - width to copy 
+      /// \param height   - height to copy 
+      /// \param widthBytes - width of line in bytes (w/pad)
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult  CopyOutBGRA( CATUInt8*              bgraBuf,
+                              CATInt32               offsetX,
+                              CATInt32               offsetY,
+                              CATInt32               width,
+                              CATInt32               height,
+                              CATInt32               widthBytes);
+
+      /// CopyInYUV() converts a YUV frame into the image, replacing
+      /// every pixel.  The frame must be the image's size; alpha is set
+      /// to 255.
+      ///
+      /// planes and strides list the planes the format uses, in the
+      /// order given by CATYUVFORMAT (one for YUY2/UYVY, two for NV12,
+      /// three for I420).  For YV12, pass its V and U planes swapped.
+      /// 4:2:0 chroma planes have (height + 1) / 2 rows.
+      ///
+      /// \param planes - first row of each plane.
+      /// \param strides - bytes between rows of each plane.
+      /// \param format - layout of the planes.
+      /// \param matrix - BT.601 or BT.709 coefficients.
+      /// \param fullRange - true for 0-255 luma (JPEG-style), false
+      ///                    for 16-235 video range.
+      /// \param bgra - store B,G,R,A instead of R,G,B,A, e.g. for
+      ///               frames handed on in Direct3D byte order.
+      /// \param flip - true to store the frame bottom-up.
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult  CopyInYUV(   const CATUInt8* const*  planes,
+                              const CATInt32*         strides,
+                              CATYUVFORMAT            format,
+                              CATYUVMATRIX            matrix    = CATYUV_BT601,
+                              bool                    fullRange = false,
+                              bool                    bgra      = false,
+                              bool                    flip      = false);
+
       /// Overlay() merges from another image over the current image
       /// at the specified offsets for the specified width and height.
       ///
@@ -260,6 +572,9 @@ class CATImage
       /// source image only.  The destination's alpha remains 
       /// unaffected - the alpha is used for merging the colors only.
       ///
+      /// If the source is premultiplied, the blend is 
+      /// src + dst*(256-alpha)/256 with no per-pixel branching.
+      ///
       /// \param srcImg - source image to copy from
       /// \param dstOffsetX  - offset in dest image to copy to
       /// \param dstOffsetY  - offset in dest image to copy to
@@ -275,7 +590,32 @@ class CATImage
                            CATInt32               srcOffsetY,
                            CATInt32               width  = 0,
                            CATInt32               height = 0);
-      
+
+      /// OverlaySliced() merges a nine-slice image over the current
+      /// image, resized to fill dstRect.
+      ///
+      /// insets splits srcImg into a 3x3 grid: insets.left and
+      /// insets.right are the widths of the left and right columns,
+      /// insets.top and insets.bottom the heights of the top and bottom
+      /// rows.  Corners are drawn at their own size; edges and centre
+      /// are stretched or tiled along the axes that need it.  If
+      /// dstRect is smaller than the corners, they're shrunk to fit.
+      ///
+      /// Only the part of dstRect inside clipRect and the image is
+      /// drawn, so a control can redraw just its dirty rectangle.  The
+      /// merge is the same as Overlay().
+      ///
+      /// \param srcImg   - source image to slice.  Must not be this image.
+      /// \param dstRect  - rectangle to fill, in this image's coordinates.
+      /// \param insets   - column widths / row heights of the border.
+      /// \param clipRect - area of this image that may be drawn.
+      /// \param mode     - stretch or tile the edges and centre.
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult OverlaySliced(   const CATImage*    srcImg,
+                                 const CATRect&     dstRect,
+                                 const CATRect&     insets,
+                                 const CATRect&     clipRect,
+                                 CATSLICEMODE       mode = CATSLICE_STRETCH);
 
       /// GetPixel() retrieves the red, green, blue, and alpha values for a 
       /// specified pixel.
@@ -373,10 +713,57 @@ class CATImage
       /// \return CATResult - CAT_SUCCESS on success.      
       CATResult FillRect(const CATRect& rect, const CATColor& color);
 
-      /// MakeDisabled() converts the image to a low-contrast greyscale.
+      /// MakeDisabled() converts the image to a low-contrast greyscale,
+      /// in place.  Same as CATIMAGE_STATE_DISABLED.
       ///
       CATResult MakeDisabled();
 
+      /// GetFormat() returns the in-memory alpha format of the image.
+      ///
+      /// For CATIMAGE_RGBA32_PREMULTIPLIED images, GetPixel(), SetPixel(),
+      /// FillRect() and the raw data pointers work on the stored
+      /// (premultiplied) values.
+      ///
+      /// \return CATIMAGEFORMAT - CATIMAGE_PNG_RGBA32 or
+      ///                          CATIMAGE_RGBA32_PREMULTIPLIED.
+      CATIMAGEFORMAT GetFormat() const;
+
+      /// IsPremultiplied() returns true if the color channels are
+      /// stored premultiplied by alpha.
+      bool IsPremultiplied() const;
+
+      /// SetParallel() turns on row-parallel execution for Clear(),
+      /// FillRect(), MakeDisabled(), Overlay() and CopyOver().  When on,
+      /// operations covering at least minPixels pixels are split into
+      /// bands of rows and run on the shared CATWorkPool.  Smaller ones
+      /// (most widget blits) stay on the calling thread, where handing
+      /// them off would cost more than it saves.
+      ///
+      /// Off by default.  Call from the main thread before using images
+      /// from other threads.  Results are identical either way.
+      ///
+      /// \param enable    - true to split large operations across threads.
+      /// \param minPixels - smallest operation, in pixels, to split up.
+      ///                    See tools/CATImagePerf -threads for finding
+      ///                    the crossover on a given machine.
+      static void SetParallel(bool enable,
+                              CATInt32 minPixels = kParallelMinPixels);
+
+      /// IsParallel() returns true if row-parallel execution is on.
+      static bool IsParallel();
+
+      /// GetParallelMinPixels() returns the current parallel threshold.
+      static CATInt32 GetParallelMinPixels();
+
+      /// GetBufferPool() returns the pool that root images allocate their
+      /// pixel buffers from.  Buffers are 64-byte aligned, and released
+      /// images return theirs to the pool for the next image of a
+      /// similar size.  Use it to adjust retention (e.g. call Trim() after
+      /// closing a large window) or to read the hit/miss counters.
+      ///
+      /// \return CATBufferPool* - the image buffer pool.
+      static CATBufferPool* GetBufferPool();
+
       /// SetSubPosition() moves the ROI of the image within its parent.
       /// Will return CAT_ERR_IMAGE_OPERATION_INVALID_ON_ROOT if you try
       /// to use this on a root image instead of a sub image.
@@ -408,11 +795,39 @@ class CATImage
       /// CATImage::CopyImage() first to get a base image that owns its own
       /// data.
       ///
-      /// Note that the xOffset and yOffset are relative to parent. They will
-      /// be calculated at runtime if you call this function.      
+      /// GetRowsForRead() and GetRowsForWrite() do the offset math for you.
+      ///
+      /// The buffer may be shared with copy-on-write copies (see
+      /// CopyImage()), so don't write through it - use
+      /// GetRawDataPtrForWrite() for that.
+      ///
+      /// \return const unsigned char* to image data
+      const unsigned char* GetRawDataPtr() const;
+
+      /// GetRawDataPtrForWrite() is GetRawDataPtr() for callers that
+      /// change pixels.  It first gives copy-on-write copies their own
+      /// buffers, so call it again after any CopyImage() of this image.
+      ///
+      /// \return unsigned char* to image data, or 0 if a copy's buffer
+      ///         couldn't be allocated.
+      unsigned char* GetRawDataPtrForWrite();
+
+      /// GetRowsForRead() fills in a view of the image's pixels with the
+      /// sub image offsets applied.  Use it for per-pixel loops instead
+      /// of GetPixel(), which checks bounds on every call.
+      ///
+      /// Don't write through it - the buffer may be shared with
+      /// copy-on-write copies.  Use GetRowsForWrite() for that.
       ///
-      /// \return unsigned char* to image data
-      unsigned char* GetRawDataPtr() const;
+      /// \param rows - receives the view.
+      void       GetRowsForRead(CATImageRows& rows) const;
+
+      /// GetRowsForWrite() fills in a writable view of the image's
+      /// pixels, first giving copy-on-write copies their own buffers.
+      ///
+      /// \param rows - receives the view.
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult  GetRowsForWrite(CATImageRows& rows);
       
       /// Returns relative offset within parent image.
       /// \return CATInt32 - X Offset relative to parent.
@@ -478,7 +893,7 @@ class CATImage
       /// \sa AddRef(), DecRef()
       unsigned long GetRefCount();
 
-      // Debugging func for saving image to disk as a .png
+      // Debugging func for saving image to disk as a .png (fast preset)
       CATResult DbgSave     (  const CATWChar*  filename );
 
    protected:
@@ -514,6 +929,36 @@ class CATImage
                               bool           init,
                               bool           transparent);
 
+      /// PrepareWrite() must be called before changing pixels. A
+      /// copy-on-write copy gets its own buffer; otherwise any copies
+      /// sharing this image's root buffer are given theirs.
+      ///
+      /// \return CATResult - CAT_ERR_OUT_OF_MEMORY if a copy failed.
+      CATResult    PrepareWrite();
+
+      /// DetachCopy() gives a copy-on-write copy its own buffer and
+      /// turns it into an ordinary root image.
+      CATResult    DetachCopy();
+
+      /// UpdateAbsOffsets() recalculates the cached absolute offsets
+      /// of this image and every sub image made from it.  Called
+      /// whenever they move, so the const accessors only read them.
+      void         UpdateAbsOffsets();
+
+      /// CopyOutRows() - shared implementation of CopyOutBGR() and
+      /// CopyOutBGRA(). Checks bounds, then runs copyRow on each line.
+      ///
+      /// \param outBytesPerPixel - 3 or 4, used to check widthBytes.
+      /// \param copyRow - row kernel from gCATImageKernels.
+      CATResult    CopyOutRows(  CATUInt8*           outBuf,
+                                 CATInt32            offsetX,
+                                 CATInt32            offsetY,
+                                 CATInt32            width,
+                                 CATInt32            height,
+                                 CATInt32            widthBytes,
+                                 CATInt32            outBytesPerPixel,
+                                 CATCopyOutRowFunc   copyRow);
+
       //---------------------------------------------------------------------
       // PNG callbacks
 
@@ -611,6 +1056,28 @@ class CATImage
 
       CATImage*        fParentImage;    ///< Parent image - so we can decrement
                                         ///<       ref count on destruction.      
+
+      CATIMAGEFORMAT   fFormat;         ///< Alpha format of the pixel data.
+                                        ///< Sub images and copies inherit it.
+
+      CATFileMap*      fFileMap;        ///< Mapped file behind fData for
+                                        ///< MapRaw() images, otherwise 0.
+
+      bool             fCopyOnWrite;    ///< Set while this copy shares its
+                                        ///< root's fData - see CopyImage().
+                                        ///< fParentImage is then the root.
+
+      std::vector<CATImage*> fCowCopies;///< Copy-on-write copies sharing
+                                        ///< this root's fData.
+
+      CATImage*        fRootImage;      ///< Image whose fData this is
+                                        ///< (this, for roots).
+
+      std::vector<CATImage*> fSubImages;///< Sub images made directly from
+                                        ///< this one - see CreateSub().
+
+      CATInt32         fAbsXOffset;     ///< Cached XOffsetAbs()
+      CATInt32         fAbsYOffset;     ///< Cached YOffsetAbs()
 };
 
 #endif // _CATImage_H_
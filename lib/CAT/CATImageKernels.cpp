@@ -0,0 +1,1735 @@
+/// \file    CATImageKernels.cpp
+/// \brief   Per-row pixel kernels used by CATImage
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include "CATImageKernels.h"
+#include "CATCpu.h"
+
+#if defined(CAT_CONFIG_SIMD_X86)
+    #include <emmintrin.h>
+    #include <tmmintrin.h>
+    #if defined(CAT_CONFIG_SIMD_AVX2)
+        #include <immintrin.h>
+    #endif
+#endif
+
+//---------------------------------------------------------------------------
+// Plain C kernels. These define the results - SIMD versions must match
+// them bit for bit.
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// OverlayRow_C()
+//    Blends src over dst using src alpha:
+//       dst = ((alpha * (src - dst)) + (dst << 8)) >> 8
+//    Fully transparent pixels are skipped and fully opaque ones copied,
+//    so alpha 255 gives exactly src. Destination alpha is unchanged.
+//---------------------------------------------------------------------------
+static void OverlayRow_C(  CATUInt8*         dstPtr,
+                           const CATUInt8*   srcPtr,
+                           CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATInt32 alpha = srcPtr[3];
+
+      if (alpha == 255)
+      {
+         dstPtr[0] = srcPtr[0];
+         dstPtr[1] = srcPtr[1];
+         dstPtr[2] = srcPtr[2];
+      }
+      else if (alpha != 0)
+      {
+         for (CATInt32 i = 0; i < 3; i++)
+         {
+            dstPtr[i] = (CATUInt8)((( alpha * ((CATInt32)srcPtr[i] - (CATInt32)dstPtr[i]) ) +
+                                     ((CATInt32)dstPtr[i] << 8) ) >> 8);
+         }
+      }
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// OverlayPremulRow_C()
+//    Blends premultiplied src over dst:
+//       dst = src + ((dst * (256 - alpha)) >> 8)
+//    Alpha 255 leaves src and alpha 0 leaves dst, so no special cases are
+//    needed. The sum can't pass 255 while src <= alpha; the clamp only
+//    matters for invalid premultiplied data, and matches the saturating
+//    pack in the SIMD versions.
+//---------------------------------------------------------------------------
+static void OverlayPremulRow_C(  CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATInt32 invAlpha = 256 - srcPtr[3];
+
+      for (CATInt32 i = 0; i < 3; i++)
+      {
+         CATInt32 val = srcPtr[i] + ((dstPtr[i] * invAlpha) >> 8);
+         dstPtr[i] = (CATUInt8)((val > 255) ? 255 : val);
+      }
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// PremultiplyRow_C()
+//    Converts straight alpha to premultiplied: c = (c * a + 127) / 255
+//---------------------------------------------------------------------------
+static void PremultiplyRow_C( CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATUInt32 alpha = srcPtr[3];
+
+      dstPtr[0] = (CATUInt8)((srcPtr[0] * alpha + 127) / 255);
+      dstPtr[1] = (CATUInt8)((srcPtr[1] * alpha + 127) / 255);
+      dstPtr[2] = (CATUInt8)((srcPtr[2] * alpha + 127) / 255);
+      dstPtr[3] = (CATUInt8)alpha;
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// UnpremultiplyRow_C()
+//    Converts premultiplied alpha back to straight, rounding to nearest.
+//    Fully transparent pixels come back as black.
+//---------------------------------------------------------------------------
+static void UnpremultiplyRow_C(  CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATUInt32 alpha = srcPtr[3];
+
+      if (alpha == 0)
+      {
+         dstPtr[0] = dstPtr[1] = dstPtr[2] = 0;
+      }
+      else
+      {
+         for (CATInt32 i = 0; i < 3; i++)
+         {
+            CATUInt32 val = (srcPtr[i] * 255 + alpha / 2) / alpha;
+            dstPtr[i] = (CATUInt8)((val > 255) ? 255 : val);
+         }
+      }
+      dstPtr[3] = (CATUInt8)alpha;
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRRow_C()
+//    Packs RGBA pixels into 24-bit B,G,R triplets (Win32 DIB order).
+//---------------------------------------------------------------------------
+static void CopyOutBGRRow_C(  CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dstPtr[0] = srcPtr[2];
+      dstPtr[1] = srcPtr[1];
+      dstPtr[2] = srcPtr[0];
+
+      dstPtr += 3;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRARow_C()
+//    Swaps RGBA pixels to B,G,R,A (32-bit Win32 DIB order).
+//---------------------------------------------------------------------------
+static void CopyOutBGRARow_C( CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dstPtr[0] = srcPtr[2];
+      dstPtr[1] = srcPtr[1];
+      dstPtr[2] = srcPtr[0];
+      dstPtr[3] = srcPtr[3];
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// ExpandRGBRow_C()
+//    Packed RGB to RGBA, alpha 255.  Each pixel is read before it's
+//    written, so the source can overlap the tail of the destination.
+//---------------------------------------------------------------------------
+static void ExpandRGBRow_C(   CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATUInt8 r = srcPtr[0];
+      CATUInt8 g = srcPtr[1];
+      CATUInt8 b = srcPtr[2];
+      dstPtr[0] = r;
+      dstPtr[1] = g;
+      dstPtr[2] = b;
+      dstPtr[3] = 255;
+      srcPtr += 3;
+      dstPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// StateDiv255()
+//    x / 255, rounded to nearest, for x up to 255 * 255.
+//---------------------------------------------------------------------------
+static inline CATUInt32 StateDiv255(CATUInt32 x)
+{
+   x += 128;
+   return (x + (x >> 8)) >> 8;
+}
+
+//---------------------------------------------------------------------------
+// DisableRow_C()
+//    Low-contrast greyscale:
+//       grey = ((77r + 151g + 28b + 128) >> 8) / 8 + 192
+//    For premultiplied pixels the 192 is scaled by alpha as well.
+//---------------------------------------------------------------------------
+static void DisableRow_C(  CATUInt8*         dstPtr,
+                           const CATUInt8*   srcPtr,
+                           CATInt32          width,
+                           bool              premultiplied)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATUInt32 a    = srcPtr[3];
+      CATUInt32 grey = (srcPtr[0] * 77 + srcPtr[1] * 151 + srcPtr[2] * 28 + 128) >> 11;
+      grey += premultiplied ? StateDiv255(a * 192) : 192;
+
+      dstPtr[0] = dstPtr[1] = dstPtr[2] = (CATUInt8)grey;
+      dstPtr[3] = (CATUInt8)a;
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// DarkenRow_C()
+//    Pressed look - takes a quarter off each color: c = c - (c >> 2)
+//    Works the same on premultiplied pixels.
+//---------------------------------------------------------------------------
+static void DarkenRow_C(   CATUInt8*         dstPtr,
+                           const CATUInt8*   srcPtr,
+                           CATInt32          width,
+                           bool              premultiplied)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dstPtr[0] = srcPtr[0] - (srcPtr[0] >> 2);
+      dstPtr[1] = srcPtr[1] - (srcPtr[1] >> 2);
+      dstPtr[2] = srcPtr[2] - (srcPtr[2] >> 2);
+      dstPtr[3] = srcPtr[3];
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// HighlightRow_C()
+//    Focus look - moves each color a quarter of the way to white:
+//       c = c + ((max - c) >> 2)
+//    max is 255, or alpha for premultiplied pixels.
+//---------------------------------------------------------------------------
+static void HighlightRow_C(   CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width,
+                              bool              premultiplied)
+{
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      CATInt32 maxVal = premultiplied ? srcPtr[3] : 255;
+      for (CATInt32 i = 0; i < 3; i++)
+      {
+         CATInt32 diff = maxVal - srcPtr[i];
+         if (diff < 0)
+         {
+            diff = 0;
+         }
+         dstPtr[i] = (CATUInt8)(srcPtr[i] + (diff >> 2));
+      }
+      dstPtr[3] = srcPtr[3];
+
+      dstPtr += 4;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// FillRow_C()
+//    Stores the same 32-bit pixel across the row.  Also used for
+//    FillRowStream when there's no SIMD.
+//---------------------------------------------------------------------------
+static void FillRow_C(  CATUInt8*         dstPtr,
+                        CATUInt32         pixel,
+                        CATInt32          width)
+{
+   CATUInt32* dst = (CATUInt32*)dstPtr;
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dst[x] = pixel;
+   }
+}
+
+//---------------------------------------------------------------------------
+// FillRGBRow_C()
+//    Overwrites r,g,b with the pixel's; destination alpha is unchanged.
+//---------------------------------------------------------------------------
+static void FillRGBRow_C(  CATUInt8*         dstPtr,
+                           CATUInt32         pixel,
+                           CATInt32          width)
+{
+   const CATUInt8* color = (const CATUInt8*)&pixel;
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dstPtr[0] = color[0];
+      dstPtr[1] = color[1];
+      dstPtr[2] = color[2];
+      dstPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// FillBlendRow_C()
+//    Blends the pixel's r,g,b by its alpha:
+//       dst = (color * a + dst * (255 - a)) / 255
+//    Destination alpha is unchanged.
+//---------------------------------------------------------------------------
+static void FillBlendRow_C(   CATUInt8*         dstPtr,
+                              CATUInt32         pixel,
+                              CATInt32          width)
+{
+   const CATUInt8* color = (const CATUInt8*)&pixel;
+   CATInt32        alpha = color[3];
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      dstPtr[0] = (CATUInt8)((color[0] * alpha + dstPtr[0] * (255 - alpha)) / 255);
+      dstPtr[1] = (CATUInt8)((color[1] * alpha + dstPtr[1] * (255 - alpha)) / 255);
+      dstPtr[2] = (CATUInt8)((color[2] * alpha + dstPtr[2] * (255 - alpha)) / 255);
+      dstPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// ResampleClamp()
+//    Rounds a fixed-point filter sum and clamps it to a byte.
+//---------------------------------------------------------------------------
+static inline CATUInt8 ResampleClamp(CATInt32 sum)
+{
+   sum = (sum + (1 << (kCATResampleBits - 1))) >> kCATResampleBits;
+   if (sum < 0)
+      return 0;
+   if (sum > 255)
+      return 255;
+   return (CATUInt8)sum;
+}
+
+//---------------------------------------------------------------------------
+// ResampleRowH_C()
+//    Filters a row of RGBA pixels horizontally.
+//---------------------------------------------------------------------------
+static void ResampleRowH_C(   CATUInt8*               dstPtr,
+                              const CATUInt8*         srcPtr,
+                              CATInt32                dstWidth,
+                              const CATResampleTable& table)
+{
+   const CATInt16* weights = table.weights;
+   for (CATInt32 x = 0; x < dstWidth; x++)
+   {
+      const CATUInt8* src = srcPtr + table.starts[x] * 4;
+      CATInt32 r = 0, g = 0, b = 0, a = 0;
+      for (CATInt32 k = 0; k < table.taps; k++)
+      {
+         CATInt32 w = weights[k];
+         r += src[0] * w;
+         g += src[1] * w;
+         b += src[2] * w;
+         a += src[3] * w;
+         src += 4;
+      }
+      weights += table.taps;
+
+      dstPtr[0] = ResampleClamp(r);
+      dstPtr[1] = ResampleClamp(g);
+      dstPtr[2] = ResampleClamp(b);
+      dstPtr[3] = ResampleClamp(a);
+      dstPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// ResampleBytesV_C()
+//    Filters bytes [start, end) of an output row from taps source rows.
+//    Also finishes the tails of the SIMD versions.
+//---------------------------------------------------------------------------
+static void ResampleBytesV_C( CATUInt8*               dstPtr,
+                              const CATUInt8* const*  srcRows,
+                              const CATInt16*         weights,
+                              CATInt32                taps,
+                              CATInt32                start,
+                              CATInt32                end)
+{
+   for (CATInt32 i = start; i < end; i++)
+   {
+      CATInt32 sum = 0;
+      for (CATInt32 k = 0; k < taps; k++)
+      {
+         sum += srcRows[k][i] * weights[k];
+      }
+      dstPtr[i] = ResampleClamp(sum);
+   }
+}
+
+//---------------------------------------------------------------------------
+// ResampleRowV_C()
+//    Filters one output row from taps source rows, byte by byte.
+//---------------------------------------------------------------------------
+static void ResampleRowV_C(   CATUInt8*               dstPtr,
+                              const CATUInt8* const*  srcRows,
+                              const CATInt16*         weights,
+                              CATInt32                taps,
+                              CATInt32                widthBytes)
+{
+   ResampleBytesV_C(dstPtr, srcRows, weights, taps, 0, widthBytes);
+}
+
+//---------------------------------------------------------------------------
+// YUVClamp()
+//    Shifts a rounded fixed-point YUV sum down and clamps it to a byte.
+//---------------------------------------------------------------------------
+static inline CATUInt8 YUVClamp(CATInt32 sum)
+{
+   if (sum < 0)
+      return 0;
+   sum >>= kCATYUVBits;
+   if (sum > 255)
+      return 255;
+   return (CATUInt8)sum;
+}
+
+//---------------------------------------------------------------------------
+// YUVPixel_C()
+//    Converts one pixel.
+//---------------------------------------------------------------------------
+static inline void YUVPixel_C(   CATUInt8*            dstPtr,
+                                 CATInt32             y,
+                                 CATInt32             u,
+                                 CATInt32             v,
+                                 const CATYUVCoeffs&  coeffs)
+{
+   CATInt32 luma = coeffs.ys * (y - coeffs.yOffset) + (1 << (kCATYUVBits - 1));
+   u -= 128;
+   v -= 128;
+
+   CATUInt8 r = YUVClamp(luma + coeffs.rv * v);
+   CATUInt8 g = YUVClamp(luma + coeffs.gu * u + coeffs.gv * v);
+   CATUInt8 b = YUVClamp(luma + coeffs.bu * u);
+
+   dstPtr[0] = coeffs.bgra ? b : r;
+   dstPtr[1] = g;
+   dstPtr[2] = coeffs.bgra ? r : b;
+   dstPtr[3] = 255;
+}
+
+//---------------------------------------------------------------------------
+// YUY2Row_C()
+//    Y0 U Y1 V - two pixels per 4 bytes.
+//---------------------------------------------------------------------------
+static void YUY2Row_C(  CATUInt8*               dstPtr,
+                        const CATUInt8* const*  planes,
+                        CATInt32                width,
+                        const CATYUVCoeffs&     coeffs)
+{
+   const CATUInt8* srcPtr = planes[0];
+   for (CATInt32 x = 0; x < width; x += 2)
+   {
+      YUVPixel_C(dstPtr, srcPtr[0], srcPtr[1], srcPtr[3], coeffs);
+      if (x + 1 < width)
+      {
+         YUVPixel_C(dstPtr + 4, srcPtr[2], srcPtr[1], srcPtr[3], coeffs);
+      }
+      dstPtr += 8;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// UYVYRow_C()
+//    U Y0 V Y1 - two pixels per 4 bytes.
+//---------------------------------------------------------------------------
+static void UYVYRow_C(  CATUInt8*               dstPtr,
+                        const CATUInt8* const*  planes,
+                        CATInt32                width,
+                        const CATYUVCoeffs&     coeffs)
+{
+   const CATUInt8* srcPtr = planes[0];
+   for (CATInt32 x = 0; x < width; x += 2)
+   {
+      YUVPixel_C(dstPtr, srcPtr[1], srcPtr[0], srcPtr[2], coeffs);
+      if (x + 1 < width)
+      {
+         YUVPixel_C(dstPtr + 4, srcPtr[3], srcPtr[0], srcPtr[2], coeffs);
+      }
+      dstPtr += 8;
+      srcPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// NV12Row_C()
+//    Luma row plus a row of interleaved U,V pairs.
+//---------------------------------------------------------------------------
+static void NV12Row_C(  CATUInt8*               dstPtr,
+                        const CATUInt8* const*  planes,
+                        CATInt32                width,
+                        const CATYUVCoeffs&     coeffs)
+{
+   const CATUInt8* yPtr  = planes[0];
+   const CATUInt8* uvPtr = planes[1];
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      YUVPixel_C(dstPtr, yPtr[x], uvPtr[x & ~1], uvPtr[x | 1], coeffs);
+      dstPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// I420Row_C()
+//    Luma row plus separate U and V rows at half width.
+//---------------------------------------------------------------------------
+static void I420Row_C(  CATUInt8*               dstPtr,
+                        const CATUInt8* const*  planes,
+                        CATInt32                width,
+                        const CATYUVCoeffs&     coeffs)
+{
+   const CATUInt8* yPtr = planes[0];
+   const CATUInt8* uPtr = planes[1];
+   const CATUInt8* vPtr = planes[2];
+   for (CATInt32 x = 0; x < width; x++)
+   {
+      YUVPixel_C(dstPtr, yPtr[x], uPtr[x >> 1], vPtr[x >> 1], coeffs);
+      dstPtr += 4;
+   }
+}
+
+#if defined(CAT_CONFIG_SIMD_X86)
+//---------------------------------------------------------------------------
+// SSE2 kernels
+//
+// The blend is rearranged to  (alpha*src + (256-alpha)*dst) >> 8, which is
+// the same value as the C version and never leaves 0..65280, so it fits in
+// unsigned 16-bit lanes. Alpha 255 is bumped to 256 so that opaque pixels
+// mixed in with translucent ones come out as src, like the C special case.
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// BlendPixels_SSE2()
+//    Blends 4 RGBA pixels, keeping the dst alpha bytes.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static inline __m128i BlendPixels_SSE2(__m128i src, __m128i dst, __m128i alphaMask)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i k255 = _mm_set1_epi16(255);
+   const __m128i k256 = _mm_set1_epi16(256);
+
+   __m128i srcLo = _mm_unpacklo_epi8(src, zero);
+   __m128i srcHi = _mm_unpackhi_epi8(src, zero);
+   __m128i dstLo = _mm_unpacklo_epi8(dst, zero);
+   __m128i dstHi = _mm_unpackhi_epi8(dst, zero);
+
+   // Spread each pixel's alpha across its four 16-bit lanes
+   __m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(srcLo, 0xFF), 0xFF);
+   __m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(srcHi, 0xFF), 0xFF);
+
+   // 255 -> 256 (cmpeq gives -1 in matching lanes)
+   aLo = _mm_sub_epi16(aLo, _mm_cmpeq_epi16(aLo, k255));
+   aHi = _mm_sub_epi16(aHi, _mm_cmpeq_epi16(aHi, k255));
+
+   __m128i resLo = _mm_add_epi16(_mm_mullo_epi16(srcLo, aLo),
+                                 _mm_mullo_epi16(dstLo, _mm_sub_epi16(k256, aLo)));
+   __m128i resHi = _mm_add_epi16(_mm_mullo_epi16(srcHi, aHi),
+                                 _mm_mullo_epi16(dstHi, _mm_sub_epi16(k256, aHi)));
+
+   __m128i res = _mm_packus_epi16(_mm_srli_epi16(resLo, 8), _mm_srli_epi16(resHi, 8));
+
+   return _mm_or_si128(_mm_andnot_si128(alphaMask, res), _mm_and_si128(dst, alphaMask));
+}
+
+//---------------------------------------------------------------------------
+// OverlayRow_SSE2()
+//    4 pixels per step. Groups that are entirely transparent are skipped
+//    without touching dst, entirely opaque groups are copied.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void OverlayRow_SSE2(  CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width)
+{
+   const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+   const __m128i zero      = _mm_setzero_si128();
+
+   while (width >= 4)
+   {
+      __m128i src   = _mm_loadu_si128((const __m128i*)srcPtr);
+      __m128i alpha = _mm_and_si128(src, alphaMask);
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) != 0xFFFF)
+      {
+         __m128i dst = _mm_loadu_si128((const __m128i*)dstPtr);
+         __m128i res;
+
+         if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) == 0xFFFF)
+         {
+            res = _mm_or_si128(_mm_andnot_si128(alphaMask, src), _mm_and_si128(dst, alphaMask));
+         }
+         else
+         {
+            res = BlendPixels_SSE2(src, dst, alphaMask);
+         }
+
+         _mm_storeu_si128((__m128i*)dstPtr, res);
+      }
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   OverlayRow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// OverlayPremulRow_SSE2()
+//    4 premultiplied pixels per step: src + ((dst * (256 - alpha)) >> 8).
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void OverlayPremulRow_SSE2(  CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width)
+{
+   const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+   const __m128i zero      = _mm_setzero_si128();
+   const __m128i k256      = _mm_set1_epi16(256);
+
+   while (width >= 4)
+   {
+      __m128i src   = _mm_loadu_si128((const __m128i*)srcPtr);
+
+      // Transparent premultiplied pixels are all zero, and adding zero
+      // changes nothing, so all-zero groups can be skipped.
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(src, zero)) != 0xFFFF)
+      {
+         __m128i dst = _mm_loadu_si128((const __m128i*)dstPtr);
+
+         __m128i srcLo = _mm_unpacklo_epi8(src, zero);
+         __m128i srcHi = _mm_unpackhi_epi8(src, zero);
+         __m128i invLo = _mm_sub_epi16(k256, _mm_shufflehi_epi16(_mm_shufflelo_epi16(srcLo, 0xFF), 0xFF));
+         __m128i invHi = _mm_sub_epi16(k256, _mm_shufflehi_epi16(_mm_shufflelo_epi16(srcHi, 0xFF), 0xFF));
+
+         __m128i resLo = _mm_add_epi16(srcLo,
+                           _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), invLo), 8));
+         __m128i resHi = _mm_add_epi16(srcHi,
+                           _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), invHi), 8));
+
+         __m128i res = _mm_packus_epi16(resLo, resHi);
+         _mm_storeu_si128((__m128i*)dstPtr,
+                          _mm_or_si128(_mm_andnot_si128(alphaMask, res), _mm_and_si128(dst, alphaMask)));
+      }
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   OverlayPremulRow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRARow_SSE2()
+//    4 pixels per step - swaps bytes 0 and 2 of each pixel with shifts.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void CopyOutBGRARow_SSE2( CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   const __m128i keepMask = _mm_set1_epi32((int)0xFF00FF00);
+   const __m128i lowMask  = _mm_set1_epi32(0x000000FF);
+
+   while (width >= 4)
+   {
+      __m128i src = _mm_loadu_si128((const __m128i*)srcPtr);
+      __m128i res = _mm_or_si128(_mm_and_si128(src, keepMask),
+                    _mm_or_si128(_mm_and_si128(_mm_srli_epi32(src, 16), lowMask),
+                                 _mm_slli_epi32(_mm_and_si128(src, lowMask), 16)));
+      _mm_storeu_si128((__m128i*)dstPtr, res);
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   CopyOutBGRARow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// State kernels - 4 pixels per step, each pixel in a 32-bit lane.
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// DisableRow_SSE2()
+//    Channels are split out to 32-bit lanes.  Every product fits in 16
+//    bits with a zero high half, so pmullw gives the 32-bit result.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void DisableRow_SSE2(  CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width,
+                              bool              premultiplied)
+{
+   const __m128i byteMask  = _mm_set1_epi32(0x000000FF);
+   const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+   const __m128i weightR   = _mm_set1_epi32(77);
+   const __m128i weightG   = _mm_set1_epi32(151);
+   const __m128i weightB   = _mm_set1_epi32(28);
+   const __m128i round     = _mm_set1_epi32(128);
+   const __m128i offset    = _mm_set1_epi32(192);
+
+   while (width >= 4)
+   {
+      __m128i src = _mm_loadu_si128((const __m128i*)srcPtr);
+      __m128i r   = _mm_and_si128(src, byteMask);
+      __m128i g   = _mm_and_si128(_mm_srli_epi32(src, 8), byteMask);
+      __m128i b   = _mm_and_si128(_mm_srli_epi32(src, 16), byteMask);
+
+      __m128i sum = _mm_add_epi32(_mm_mullo_epi16(r, weightR),
+                    _mm_add_epi32(_mm_mullo_epi16(g, weightG),
+                    _mm_add_epi32(_mm_mullo_epi16(b, weightB), round)));
+      __m128i grey = _mm_srli_epi32(sum, 11);
+
+      if (premultiplied)
+      {
+         // StateDiv255(a * 192)
+         __m128i x = _mm_add_epi32(_mm_mullo_epi16(_mm_srli_epi32(src, 24), offset), round);
+         grey = _mm_add_epi32(grey, _mm_srli_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 8)), 8));
+      }
+      else
+      {
+         grey = _mm_add_epi32(grey, offset);
+      }
+
+      __m128i res = _mm_or_si128(_mm_or_si128(grey, _mm_slli_epi32(grey, 8)),
+                    _mm_or_si128(_mm_slli_epi32(grey, 16), _mm_and_si128(src, alphaMask)));
+      _mm_storeu_si128((__m128i*)dstPtr, res);
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   DisableRow_C(dstPtr, srcPtr, width, premultiplied);
+}
+
+//---------------------------------------------------------------------------
+// DarkenRow_SSE2()
+//    c >> 2 on bytes is a 16-bit shift with the bits from the next byte
+//    masked off.  The mask also keeps alpha out of it.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void DarkenRow_SSE2(   CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width,
+                              bool              premultiplied)
+{
+   const __m128i quarterMask = _mm_set1_epi32(0x003F3F3F);
+
+   while (width >= 4)
+   {
+      __m128i src     = _mm_loadu_si128((const __m128i*)srcPtr);
+      __m128i quarter = _mm_and_si128(_mm_srli_epi16(src, 2), quarterMask);
+      _mm_storeu_si128((__m128i*)dstPtr, _mm_sub_epi8(src, quarter));
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   DarkenRow_C(dstPtr, srcPtr, width, premultiplied);
+}
+
+//---------------------------------------------------------------------------
+// HighlightRow_SSE2()
+//    (max - c) clamped at 0 is a saturating byte subtract.  For
+//    premultiplied pixels alpha is copied into every byte for max.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void HighlightRow_SSE2(   CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width,
+                                 bool              premultiplied)
+{
+   const __m128i quarterMask = _mm_set1_epi32(0x003F3F3F);
+   const __m128i white       = _mm_set1_epi32(-1);
+
+   while (width >= 4)
+   {
+      __m128i src    = _mm_loadu_si128((const __m128i*)srcPtr);
+      __m128i maxVal = white;
+      if (premultiplied)
+      {
+         __m128i a = _mm_srli_epi32(src, 24);
+         a         = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+         maxVal    = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+      }
+
+      __m128i diff    = _mm_subs_epu8(maxVal, src);
+      __m128i quarter = _mm_and_si128(_mm_srli_epi16(diff, 2), quarterMask);
+      _mm_storeu_si128((__m128i*)dstPtr, _mm_add_epi8(src, quarter));
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   HighlightRow_C(dstPtr, srcPtr, width, premultiplied);
+}
+
+//---------------------------------------------------------------------------
+// Fill kernels
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// FillRow_SSE2()
+//    4 pixels per store.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void FillRow_SSE2(  CATUInt8*         dstPtr,
+                           CATUInt32         pixel,
+                           CATInt32          width)
+{
+   const __m128i fill = _mm_set1_epi32((int)pixel);
+
+   while (width >= 8)
+   {
+      _mm_storeu_si128((__m128i*)dstPtr,        fill);
+      _mm_storeu_si128((__m128i*)(dstPtr + 16), fill);
+      dstPtr += 32;
+      width  -= 8;
+   }
+
+   FillRow_C(dstPtr, pixel, width);
+}
+
+//---------------------------------------------------------------------------
+// FillRowStream_SSE2()
+//    Non-temporal stores, for fills much larger than the cache that would
+//    otherwise read every line in just to overwrite it.  Stores up to a
+//    16-byte boundary first, since movntdq needs one.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void FillRowStream_SSE2(  CATUInt8*         dstPtr,
+                                 CATUInt32         pixel,
+                                 CATInt32          width)
+{
+   const __m128i fill = _mm_set1_epi32((int)pixel);
+
+   while ((width > 0) && (((size_t)dstPtr & 15) != 0))
+   {
+      *(CATUInt32*)dstPtr = pixel;
+      dstPtr += 4;
+      width--;
+   }
+
+   while (width >= 8)
+   {
+      _mm_stream_si128((__m128i*)dstPtr,        fill);
+      _mm_stream_si128((__m128i*)(dstPtr + 16), fill);
+      dstPtr += 32;
+      width  -= 8;
+   }
+
+   // Streaming stores are weakly ordered - make them visible before
+   // anyone else (another band's thread, or the blit) reads the image.
+   _mm_sfence();
+
+   FillRow_C(dstPtr, pixel, width);
+}
+
+//---------------------------------------------------------------------------
+// FillRGBRow_SSE2()
+//    Keeps the destination alpha bytes, ORs in r,g,b.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void FillRGBRow_SSE2(  CATUInt8*         dstPtr,
+                              CATUInt32         pixel,
+                              CATInt32          width)
+{
+   const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+   const __m128i fill      = _mm_andnot_si128(alphaMask, _mm_set1_epi32((int)pixel));
+
+   while (width >= 4)
+   {
+      __m128i dst = _mm_loadu_si128((const __m128i*)dstPtr);
+      _mm_storeu_si128((__m128i*)dstPtr, _mm_or_si128(_mm_and_si128(dst, alphaMask), fill));
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   FillRGBRow_C(dstPtr, pixel, width);
+}
+
+//---------------------------------------------------------------------------
+// FillRGBRowStream_SSE2()
+//    FillRGBRow_SSE2() with non-temporal stores.  The alpha bytes still
+//    have to be read, but the filled lines aren't left dirty in the cache
+//    to push everything else out.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void FillRGBRowStream_SSE2(  CATUInt8*         dstPtr,
+                                    CATUInt32         pixel,
+                                    CATInt32          width)
+{
+   const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+   const __m128i fill      = _mm_andnot_si128(alphaMask, _mm_set1_epi32((int)pixel));
+
+   while ((width > 0) && (((size_t)dstPtr & 15) != 0))
+   {
+      FillRGBRow_C(dstPtr, pixel, 1);
+      dstPtr += 4;
+      width--;
+   }
+
+   while (width >= 4)
+   {
+      __m128i dst = _mm_load_si128((const __m128i*)dstPtr);
+      _mm_stream_si128((__m128i*)dstPtr, _mm_or_si128(_mm_and_si128(dst, alphaMask), fill));
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   // See FillRowStream_SSE2().
+   _mm_sfence();
+
+   FillRGBRow_C(dstPtr, pixel, width);
+}
+
+//---------------------------------------------------------------------------
+// FillBlendRow_SSE2()
+//    16-bit lanes.  color * a + dst * (255 - a) is at most 255 * 255, and
+//    (x + (x >> 8) + 1) >> 8 is exactly x / 255 over that range.  The
+//    alpha lanes use weights 0 and 255, which gives back the dst alpha.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void FillBlendRow_SSE2(   CATUInt8*         dstPtr,
+                                 CATUInt32         pixel,
+                                 CATInt32          width)
+{
+   const CATUInt8* color = (const CATUInt8*)&pixel;
+   const CATInt32  alpha = color[3];
+   const __m128i   zero  = _mm_setzero_si128();
+   const __m128i   one   = _mm_set1_epi16(1);
+
+   // color * a for r,g,b and 0 for alpha, for two pixels.  Products go
+   // past 32767, so they're stored as unsigned 16-bit bit patterns.
+   const CATInt16  r     = (CATInt16)(CATUInt16)(color[0] * alpha);
+   const CATInt16  g     = (CATInt16)(CATUInt16)(color[1] * alpha);
+   const CATInt16  b     = (CATInt16)(CATUInt16)(color[2] * alpha);
+   const CATInt16  inv   = (CATInt16)(255 - alpha);
+
+   const __m128i colorA = _mm_set_epi16(0, b, g, r, 0, b, g, r);
+   const __m128i dstW   = _mm_set_epi16(255, inv, inv, inv, 255, inv, inv, inv);
+
+   while (width >= 4)
+   {
+      __m128i dst = _mm_loadu_si128((const __m128i*)dstPtr);
+
+      __m128i lo = _mm_add_epi16(colorA, _mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), dstW));
+      __m128i hi = _mm_add_epi16(colorA, _mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), dstW));
+      lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), one), 8);
+      hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), one), 8);
+
+      _mm_storeu_si128((__m128i*)dstPtr, _mm_packus_epi16(lo, hi));
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   FillBlendRow_C(dstPtr, pixel, width);
+}
+
+//---------------------------------------------------------------------------
+// Resample kernels
+//
+// Pixels are widened to 16 bits and interleaved so each pmaddwd
+// multiplies two taps by their two weights and adds them, giving 32-bit
+// sums.  The round/shift/saturate at the end matches ResampleClamp().
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// ResampleWeightPair()
+//    Packs two weights into a pmaddwd operand.
+//---------------------------------------------------------------------------
+static inline CATInt32 ResampleWeightPair(CATInt16 w0, CATInt16 w1)
+{
+   return (CATInt32)((CATUInt16)w0 | ((CATUInt32)(CATUInt16)w1 << 16));
+}
+
+//---------------------------------------------------------------------------
+// ResampleRowH_SSE2()
+//    One output pixel per step, two taps per pmaddwd.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void ResampleRowH_SSE2(   CATUInt8*               dstPtr,
+                                 const CATUInt8*         srcPtr,
+                                 CATInt32                dstWidth,
+                                 const CATResampleTable& table)
+{
+   const __m128i zero      = _mm_setzero_si128();
+   const __m128i rounding  = _mm_set1_epi32(1 << (kCATResampleBits - 1));
+   const CATInt16* weights = table.weights;
+   const CATInt32  taps    = table.taps;
+
+   for (CATInt32 x = 0; x < dstWidth; x++)
+   {
+      const CATUInt8* src = srcPtr + table.starts[x] * 4;
+      __m128i sum = zero;
+      CATInt32 k  = 0;
+      for (; k + 1 < taps; k += 2)
+      {
+         // r0 g0 b0 a0 r1 g1 b1 a1  ->  r0 r1 g0 g1 b0 b1 a0 a1
+         __m128i pix = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + k*4)), zero);
+         pix = _mm_unpacklo_epi16(pix, _mm_srli_si128(pix, 8));
+         sum = _mm_add_epi32(sum, _mm_madd_epi16(pix, _mm_set1_epi32(ResampleWeightPair(weights[k], weights[k+1]))));
+      }
+      if (k < taps)
+      {
+         __m128i pix = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const CATInt32*)(src + k*4)), zero);
+         pix = _mm_unpacklo_epi16(pix, zero);
+         sum = _mm_add_epi32(sum, _mm_madd_epi16(pix, _mm_set1_epi32(ResampleWeightPair(weights[k], 0))));
+      }
+      weights += taps;
+
+      sum = _mm_srai_epi32(_mm_add_epi32(sum, rounding), kCATResampleBits);
+      sum = _mm_packs_epi32(sum, sum);
+      sum = _mm_packus_epi16(sum, sum);
+      *(CATInt32*)dstPtr = _mm_cvtsi128_si32(sum);
+      dstPtr += 4;
+   }
+}
+
+//---------------------------------------------------------------------------
+// ResampleRowV_SSE2()
+//    16 bytes per step, two source rows per pmaddwd.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void ResampleRowV_SSE2(   CATUInt8*               dstPtr,
+                                 const CATUInt8* const*  srcRows,
+                                 const CATInt16*         weights,
+                                 CATInt32                taps,
+                                 CATInt32                widthBytes)
+{
+   const __m128i zero      = _mm_setzero_si128();
+   const __m128i rounding  = _mm_set1_epi32(1 << (kCATResampleBits - 1));
+
+   CATInt32 i = 0;
+   for (; i + 16 <= widthBytes; i += 16)
+   {
+      __m128i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+      CATInt32 k = 0;
+      for (; k + 1 < taps; k += 2)
+      {
+         __m128i w  = _mm_set1_epi32(ResampleWeightPair(weights[k], weights[k+1]));
+         __m128i a  = _mm_loadu_si128((const __m128i*)(srcRows[k]   + i));
+         __m128i b  = _mm_loadu_si128((const __m128i*)(srcRows[k+1] + i));
+         __m128i lo = _mm_unpacklo_epi8(a, zero);
+         __m128i hi = _mm_unpackhi_epi8(a, zero);
+         __m128i bl = _mm_unpacklo_epi8(b, zero);
+         __m128i bh = _mm_unpackhi_epi8(b, zero);
+         sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, bl), w));
+         sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, bl), w));
+         sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, bh), w));
+         sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, bh), w));
+      }
+      if (k < taps)
+      {
+         __m128i w  = _mm_set1_epi32(ResampleWeightPair(weights[k], 0));
+         __m128i a  = _mm_loadu_si128((const __m128i*)(srcRows[k] + i));
+         __m128i lo = _mm_unpacklo_epi8(a, zero);
+         __m128i hi = _mm_unpackhi_epi8(a, zero);
+         sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), w));
+         sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), w));
+         sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), w));
+         sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), w));
+      }
+
+      sum0 = _mm_srai_epi32(_mm_add_epi32(sum0, rounding), kCATResampleBits);
+      sum1 = _mm_srai_epi32(_mm_add_epi32(sum1, rounding), kCATResampleBits);
+      sum2 = _mm_srai_epi32(_mm_add_epi32(sum2, rounding), kCATResampleBits);
+      sum3 = _mm_srai_epi32(_mm_add_epi32(sum3, rounding), kCATResampleBits);
+      __m128i out = _mm_packus_epi16(_mm_packs_epi32(sum0, sum1), _mm_packs_epi32(sum2, sum3));
+      _mm_storeu_si128((__m128i*)(dstPtr + i), out);
+   }
+
+   ResampleBytesV_C(dstPtr, srcRows, weights, taps, i, widthBytes);
+}
+
+//---------------------------------------------------------------------------
+// YUV kernels
+//
+// Luma is paired with a constant 1 so one pmaddwd gives ys*Y + rounding,
+// and each pixel's U,V pair goes through another pmaddwd against that
+// channel's two coefficients.  Eight pixels per step, so a step never
+// splits a chroma pair; the C versions finish the last few pixels.
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// YUVStore8_SSE2()
+//    Converts 8 pixels and stores them.  luma holds 8 16-bit Y values,
+//    chroma 4 16-bit U,V pairs (one per two pixels).
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static inline void YUVStore8_SSE2(  CATUInt8*            dstPtr,
+                                    __m128i              luma,
+                                    __m128i              chroma,
+                                    const CATYUVCoeffs&  coeffs)
+{
+   const __m128i one    = _mm_set1_epi16(1);
+   const __m128i yScale = _mm_set1_epi32(ResampleWeightPair(coeffs.ys, 1 << (kCATYUVBits - 1)));
+   const __m128i rScale = _mm_set1_epi32(ResampleWeightPair(0,         coeffs.rv));
+   const __m128i gScale = _mm_set1_epi32(ResampleWeightPair(coeffs.gu, coeffs.gv));
+   const __m128i bScale = _mm_set1_epi32(ResampleWeightPair(coeffs.bu, 0));
+
+   luma   = _mm_sub_epi16(luma,   _mm_set1_epi16(coeffs.yOffset));
+   chroma = _mm_sub_epi16(chroma, _mm_set1_epi16(128));
+
+   __m128i yLo  = _mm_madd_epi16(_mm_unpacklo_epi16(luma, one), yScale);
+   __m128i yHi  = _mm_madd_epi16(_mm_unpackhi_epi16(luma, one), yScale);
+   // U0V0 U0V0 U1V1 U1V1 / U2V2 U2V2 U3V3 U3V3
+   __m128i uvLo = _mm_unpacklo_epi32(chroma, chroma);
+   __m128i uvHi = _mm_unpackhi_epi32(chroma, chroma);
+
+   __m128i r = _mm_packs_epi32(
+                  _mm_srai_epi32(_mm_add_epi32(yLo, _mm_madd_epi16(uvLo, rScale)), kCATYUVBits),
+                  _mm_srai_epi32(_mm_add_epi32(yHi, _mm_madd_epi16(uvHi, rScale)), kCATYUVBits));
+   __m128i g = _mm_packs_epi32(
+                  _mm_srai_epi32(_mm_add_epi32(yLo, _mm_madd_epi16(uvLo, gScale)), kCATYUVBits),
+                  _mm_srai_epi32(_mm_add_epi32(yHi, _mm_madd_epi16(uvHi, gScale)), kCATYUVBits));
+   __m128i b = _mm_packs_epi32(
+                  _mm_srai_epi32(_mm_add_epi32(yLo, _mm_madd_epi16(uvLo, bScale)), kCATYUVBits),
+                  _mm_srai_epi32(_mm_add_epi32(yHi, _mm_madd_epi16(uvHi, bScale)), kCATYUVBits));
+
+   // c0 x8, c2 x8 and g x8, a x8  ->  c0 g c2 a per pixel
+   __m128i c0c2 = coeffs.bgra ? _mm_packus_epi16(b, r) : _mm_packus_epi16(r, b);
+   __m128i ga   = _mm_packus_epi16(g, _mm_set1_epi16(255));
+   __m128i lo   = _mm_unpacklo_epi8(c0c2, ga);
+   __m128i hi   = _mm_unpackhi_epi8(c0c2, ga);
+   _mm_storeu_si128((__m128i*)dstPtr,        _mm_unpacklo_epi16(lo, hi));
+   _mm_storeu_si128((__m128i*)(dstPtr + 16), _mm_unpackhi_epi16(lo, hi));
+}
+
+//---------------------------------------------------------------------------
+// YUY2Row_SSE2()
+//    Each 16-bit word is Y | (U or V) << 8, so a mask and a shift split
+//    16 bytes into 8 lumas and 4 chroma pairs.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void YUY2Row_SSE2(  CATUInt8*               dstPtr,
+                           const CATUInt8* const*  planes,
+                           CATInt32                width,
+                           const CATYUVCoeffs&     coeffs)
+{
+   const __m128i   lowBytes = _mm_set1_epi16(0x00ff);
+   const CATUInt8* srcPtr   = planes[0];
+
+   CATInt32 x = 0;
+   for (; x + 8 <= width; x += 8)
+   {
+      __m128i src = _mm_loadu_si128((const __m128i*)(srcPtr + x * 2));
+      YUVStore8_SSE2(dstPtr + x * 4, _mm_and_si128(src, lowBytes), _mm_srli_epi16(src, 8), coeffs);
+   }
+
+   const CATUInt8* tail[3] = {srcPtr + x * 2, 0, 0};
+   YUY2Row_C(dstPtr + x * 4, tail, width - x, coeffs);
+}
+
+//---------------------------------------------------------------------------
+// UYVYRow_SSE2()
+//    Same as YUY2 with the bytes of each word swapped.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void UYVYRow_SSE2(  CATUInt8*               dstPtr,
+                           const CATUInt8* const*  planes,
+                           CATInt32                width,
+                           const CATYUVCoeffs&     coeffs)
+{
+   const __m128i   lowBytes = _mm_set1_epi16(0x00ff);
+   const CATUInt8* srcPtr   = planes[0];
+
+   CATInt32 x = 0;
+   for (; x + 8 <= width; x += 8)
+   {
+      __m128i src = _mm_loadu_si128((const __m128i*)(srcPtr + x * 2));
+      YUVStore8_SSE2(dstPtr + x * 4, _mm_srli_epi16(src, 8), _mm_and_si128(src, lowBytes), coeffs);
+   }
+
+   const CATUInt8* tail[3] = {srcPtr + x * 2, 0, 0};
+   UYVYRow_C(dstPtr + x * 4, tail, width - x, coeffs);
+}
+
+//---------------------------------------------------------------------------
+// NV12Row_SSE2()
+//    The UV plane is already in pair order - just widen it.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void NV12Row_SSE2(  CATUInt8*               dstPtr,
+                           const CATUInt8* const*  planes,
+                           CATInt32                width,
+                           const CATYUVCoeffs&     coeffs)
+{
+   const __m128i   zero  = _mm_setzero_si128();
+   const CATUInt8* yPtr  = planes[0];
+   const CATUInt8* uvPtr = planes[1];
+
+   CATInt32 x = 0;
+   for (; x + 8 <= width; x += 8)
+   {
+      __m128i luma   = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(yPtr  + x)), zero);
+      __m128i chroma = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(uvPtr + x)), zero);
+      YUVStore8_SSE2(dstPtr + x * 4, luma, chroma, coeffs);
+   }
+
+   const CATUInt8* tail[3] = {yPtr + x, uvPtr + x, 0};
+   NV12Row_C(dstPtr + x * 4, tail, width - x, coeffs);
+}
+
+//---------------------------------------------------------------------------
+// I420Row_SSE2()
+//    Interleaves 4 U and 4 V bytes into pairs, then widens them.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSE2
+static void I420Row_SSE2(  CATUInt8*               dstPtr,
+                           const CATUInt8* const*  planes,
+                           CATInt32                width,
+                           const CATYUVCoeffs&     coeffs)
+{
+   const __m128i   zero = _mm_setzero_si128();
+   const CATUInt8* yPtr = planes[0];
+   const CATUInt8* uPtr = planes[1];
+   const CATUInt8* vPtr = planes[2];
+
+   CATInt32 x = 0;
+   for (; x + 8 <= width; x += 8)
+   {
+      __m128i luma   = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(yPtr + x)), zero);
+      __m128i u      = _mm_cvtsi32_si128(*(const CATInt32*)(uPtr + (x >> 1)));
+      __m128i v      = _mm_cvtsi32_si128(*(const CATInt32*)(vPtr + (x >> 1)));
+      __m128i chroma = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u, v), zero);
+      YUVStore8_SSE2(dstPtr + x * 4, luma, chroma, coeffs);
+   }
+
+   const CATUInt8* tail[3] = {yPtr + x, uPtr + (x >> 1), vPtr + (x >> 1)};
+   I420Row_C(dstPtr + x * 4, tail, width - x, coeffs);
+}
+
+//---------------------------------------------------------------------------
+// SSSE3 kernels - byte shuffles with pshufb.
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// CopyOutBGRRow_SSSE3()
+//    16 pixels (64 bytes in, 48 out) per step. Each group of 4 pixels is
+//    shuffled down to 12 bytes, then the four groups are stitched into
+//    three full 16-byte stores so nothing is written past the row.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSSE3
+static void CopyOutBGRRow_SSSE3( CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   const __m128i shuf = _mm_setr_epi8(2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1);
+
+   while (width >= 16)
+   {
+      __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(srcPtr +  0)), shuf);
+      __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(srcPtr + 16)), shuf);
+      __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(srcPtr + 32)), shuf);
+      __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(srcPtr + 48)), shuf);
+
+      _mm_storeu_si128((__m128i*)(dstPtr +  0), _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+      _mm_storeu_si128((__m128i*)(dstPtr + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+      _mm_storeu_si128((__m128i*)(dstPtr + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+
+      srcPtr += 64;
+      dstPtr += 48;
+      width  -= 16;
+   }
+
+   CopyOutBGRRow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// ExpandRGBRow_SSSE3()
+//    4 pixels per step: 16 bytes in (12 used), 16 out.  The load happens
+//    before the store, and the store never reaches past the source bytes
+//    still to be read, so in-place expansion is safe.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSSE3
+static void ExpandRGBRow_SSSE3(  CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   const __m128i shuf  = _mm_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+   const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+   // Reading 16 bytes needs 6 pixels left in the source.
+   while (width >= 6)
+   {
+      __m128i src = _mm_loadu_si128((const __m128i*)srcPtr);
+      _mm_storeu_si128((__m128i*)dstPtr, _mm_or_si128(_mm_shuffle_epi8(src, shuf), alpha));
+
+      srcPtr += 12;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   ExpandRGBRow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRARow_SSSE3()
+//    4 pixels per step with a single shuffle.
+//---------------------------------------------------------------------------
+CAT_TARGET_SSSE3
+static void CopyOutBGRARow_SSSE3(   CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width)
+{
+   const __m128i shuf = _mm_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+
+   while (width >= 4)
+   {
+      __m128i src = _mm_loadu_si128((const __m128i*)srcPtr);
+      _mm_storeu_si128((__m128i*)dstPtr, _mm_shuffle_epi8(src, shuf));
+
+      srcPtr += 16;
+      dstPtr += 16;
+      width  -= 4;
+   }
+
+   CopyOutBGRARow_C(dstPtr, srcPtr, width);
+}
+
+#if defined(CAT_CONFIG_SIMD_AVX2)
+//---------------------------------------------------------------------------
+// AVX2 kernels - same math as SSE2, 8 pixels per step. The unpack and
+// pack instructions work within each 128-bit half, so pixel order is kept.
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// BlendPixels_AVX2()
+//    Blends 8 RGBA pixels, keeping the dst alpha bytes.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static inline __m256i BlendPixels_AVX2(__m256i src, __m256i dst, __m256i alphaMask)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i k255 = _mm256_set1_epi16(255);
+   const __m256i k256 = _mm256_set1_epi16(256);
+
+   __m256i srcLo = _mm256_unpacklo_epi8(src, zero);
+   __m256i srcHi = _mm256_unpackhi_epi8(src, zero);
+   __m256i dstLo = _mm256_unpacklo_epi8(dst, zero);
+   __m256i dstHi = _mm256_unpackhi_epi8(dst, zero);
+
+   __m256i aLo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(srcLo, 0xFF), 0xFF);
+   __m256i aHi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(srcHi, 0xFF), 0xFF);
+
+   aLo = _mm256_sub_epi16(aLo, _mm256_cmpeq_epi16(aLo, k255));
+   aHi = _mm256_sub_epi16(aHi, _mm256_cmpeq_epi16(aHi, k255));
+
+   __m256i resLo = _mm256_add_epi16(_mm256_mullo_epi16(srcLo, aLo),
+                                    _mm256_mullo_epi16(dstLo, _mm256_sub_epi16(k256, aLo)));
+   __m256i resHi = _mm256_add_epi16(_mm256_mullo_epi16(srcHi, aHi),
+                                    _mm256_mullo_epi16(dstHi, _mm256_sub_epi16(k256, aHi)));
+
+   __m256i res = _mm256_packus_epi16(_mm256_srli_epi16(resLo, 8), _mm256_srli_epi16(resHi, 8));
+
+   return _mm256_or_si256(_mm256_andnot_si256(alphaMask, res), _mm256_and_si256(dst, alphaMask));
+}
+
+//---------------------------------------------------------------------------
+// OverlayRow_AVX2()
+//    8 pixels per step, with the same transparent/opaque shortcuts.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static void OverlayRow_AVX2(  CATUInt8*         dstPtr,
+                              const CATUInt8*   srcPtr,
+                              CATInt32          width)
+{
+   const __m256i alphaMask = _mm256_set1_epi32((int)0xFF000000);
+   const __m256i zero      = _mm256_setzero_si256();
+
+   while (width >= 8)
+   {
+      __m256i src   = _mm256_loadu_si256((const __m256i*)srcPtr);
+      __m256i alpha = _mm256_and_si256(src, alphaMask);
+
+      if ((CATUInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero)) != 0xFFFFFFFF)
+      {
+         __m256i dst = _mm256_loadu_si256((const __m256i*)dstPtr);
+         __m256i res;
+
+         if ((CATUInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alphaMask)) == 0xFFFFFFFF)
+         {
+            res = _mm256_or_si256(_mm256_andnot_si256(alphaMask, src), _mm256_and_si256(dst, alphaMask));
+         }
+         else
+         {
+            res = BlendPixels_AVX2(src, dst, alphaMask);
+         }
+
+         _mm256_storeu_si256((__m256i*)dstPtr, res);
+      }
+
+      srcPtr += 32;
+      dstPtr += 32;
+      width  -= 8;
+   }
+
+   // Leave the tail to SSE2 / C
+   OverlayRow_SSE2(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// OverlayPremulRow_AVX2()
+//    8 premultiplied pixels per step.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static void OverlayPremulRow_AVX2(  CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width)
+{
+   const __m256i alphaMask = _mm256_set1_epi32((int)0xFF000000);
+   const __m256i zero      = _mm256_setzero_si256();
+   const __m256i k256      = _mm256_set1_epi16(256);
+
+   while (width >= 8)
+   {
+      __m256i src   = _mm256_loadu_si256((const __m256i*)srcPtr);
+
+      if ((CATUInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(src, zero)) != 0xFFFFFFFF)
+      {
+         __m256i dst = _mm256_loadu_si256((const __m256i*)dstPtr);
+
+         __m256i srcLo = _mm256_unpacklo_epi8(src, zero);
+         __m256i srcHi = _mm256_unpackhi_epi8(src, zero);
+         __m256i invLo = _mm256_sub_epi16(k256, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(srcLo, 0xFF), 0xFF));
+         __m256i invHi = _mm256_sub_epi16(k256, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(srcHi, 0xFF), 0xFF));
+
+         __m256i resLo = _mm256_add_epi16(srcLo,
+                           _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero), invLo), 8));
+         __m256i resHi = _mm256_add_epi16(srcHi,
+                           _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero), invHi), 8));
+
+         __m256i res = _mm256_packus_epi16(resLo, resHi);
+         _mm256_storeu_si256((__m256i*)dstPtr,
+                             _mm256_or_si256(_mm256_andnot_si256(alphaMask, res), _mm256_and_si256(dst, alphaMask)));
+      }
+
+      srcPtr += 32;
+      dstPtr += 32;
+      width  -= 8;
+   }
+
+   OverlayPremulRow_SSE2(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRRow_AVX2()
+//    8 pixels per step. pshufb packs each 128-bit half to 12 bytes, then
+//    a dword permute closes the gap so the 24 bytes are contiguous and can
+//    be written with a 16 and an 8 byte store.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static void CopyOutBGRRow_AVX2(  CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   const __m256i shuf = _mm256_setr_epi8(2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1,
+                                         2,1,0, 6,5,4, 10,9,8, 14,13,12, -1,-1,-1,-1);
+   const __m256i pack = _mm256_setr_epi32(0,1,2,4,5,6,3,7);
+
+   while (width >= 8)
+   {
+      __m256i src = _mm256_loadu_si256((const __m256i*)srcPtr);
+      __m256i res = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(src, shuf), pack);
+
+      _mm_storeu_si128((__m128i*)dstPtr, _mm256_castsi256_si128(res));
+      _mm_storel_epi64((__m128i*)(dstPtr + 16), _mm256_extracti128_si256(res, 1));
+
+      srcPtr += 32;
+      dstPtr += 24;
+      width  -= 8;
+   }
+
+   CopyOutBGRRow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// CopyOutBGRARow_AVX2()
+//    8 pixels per step with a single shuffle.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static void CopyOutBGRARow_AVX2( CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   const __m256i shuf = _mm256_setr_epi8(2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15,
+                                         2,1,0,3, 6,5,4,7, 10,9,8,11, 14,13,12,15);
+
+   while (width >= 8)
+   {
+      __m256i src = _mm256_loadu_si256((const __m256i*)srcPtr);
+      _mm256_storeu_si256((__m256i*)dstPtr, _mm256_shuffle_epi8(src, shuf));
+
+      srcPtr += 32;
+      dstPtr += 32;
+      width  -= 8;
+   }
+
+   CopyOutBGRARow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// ExpandRGBRow_AVX2()
+//    8 pixels per step.  The 24 source bytes are split 12 per lane with
+//    a dword permute, then shuffled within each lane.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static void ExpandRGBRow_AVX2(   CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width)
+{
+   const __m256i perm  = _mm256_setr_epi32(0,1,2,3, 3,4,5,6);
+   const __m256i shuf  = _mm256_setr_epi8( 0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1,
+                                           0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+   const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+
+   // Reading 32 bytes needs 11 pixels left in the source.
+   while (width >= 11)
+   {
+      __m256i src = _mm256_loadu_si256((const __m256i*)srcPtr);
+      src = _mm256_permutevar8x32_epi32(src, perm);
+      _mm256_storeu_si256((__m256i*)dstPtr, _mm256_or_si256(_mm256_shuffle_epi8(src, shuf), alpha));
+
+      srcPtr += 24;
+      dstPtr += 32;
+      width  -= 8;
+   }
+
+   ExpandRGBRow_C(dstPtr, srcPtr, width);
+}
+
+//---------------------------------------------------------------------------
+// ResampleRowV_AVX2()
+//    32 bytes per step.  Unpacks and packs both work within 128-bit lanes,
+//    so the bytes come back out in order.
+//---------------------------------------------------------------------------
+CAT_TARGET_AVX2
+static void ResampleRowV_AVX2(   CATUInt8*               dstPtr,
+                                 const CATUInt8* const*  srcRows,
+                                 const CATInt16*         weights,
+                                 CATInt32                taps,
+                                 CATInt32                widthBytes)
+{
+   const __m256i zero      = _mm256_setzero_si256();
+   const __m256i rounding  = _mm256_set1_epi32(1 << (kCATResampleBits - 1));
+
+   CATInt32 i = 0;
+   for (; i + 32 <= widthBytes; i += 32)
+   {
+      __m256i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+      CATInt32 k = 0;
+      for (; k + 1 < taps; k += 2)
+      {
+         __m256i w  = _mm256_set1_epi32(ResampleWeightPair(weights[k], weights[k+1]));
+         __m256i a  = _mm256_loadu_si256((const __m256i*)(srcRows[k]   + i));
+         __m256i b  = _mm256_loadu_si256((const __m256i*)(srcRows[k+1] + i));
+         __m256i lo = _mm256_unpacklo_epi8(a, zero);
+         __m256i hi = _mm256_unpackhi_epi8(a, zero);
+         __m256i bl = _mm256_unpacklo_epi8(b, zero);
+         __m256i bh = _mm256_unpackhi_epi8(b, zero);
+         sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, bl), w));
+         sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, bl), w));
+         sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi16(hi, bh), w));
+         sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi16(hi, bh), w));
+      }
+      if (k < taps)
+      {
+         __m256i w  = _mm256_set1_epi32(ResampleWeightPair(weights[k], 0));
+         __m256i a  = _mm256_loadu_si256((const __m256i*)(srcRows[k] + i));
+         __m256i lo = _mm256_unpacklo_epi8(a, zero);
+         __m256i hi = _mm256_unpackhi_epi8(a, zero);
+         sum0 = _mm256_add_epi32(sum0, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, zero), w));
+         sum1 = _mm256_add_epi32(sum1, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, zero), w));
+         sum2 = _mm256_add_epi32(sum2, _mm256_madd_epi16(_mm256_unpacklo_epi16(hi, zero), w));
+         sum3 = _mm256_add_epi32(sum3, _mm256_madd_epi16(_mm256_unpackhi_epi16(hi, zero), w));
+      }
+
+      sum0 = _mm256_srai_epi32(_mm256_add_epi32(sum0, rounding), kCATResampleBits);
+      sum1 = _mm256_srai_epi32(_mm256_add_epi32(sum1, rounding), kCATResampleBits);
+      sum2 = _mm256_srai_epi32(_mm256_add_epi32(sum2, rounding), kCATResampleBits);
+      sum3 = _mm256_srai_epi32(_mm256_add_epi32(sum3, rounding), kCATResampleBits);
+      __m256i out = _mm256_packus_epi16(_mm256_packs_epi32(sum0, sum1), _mm256_packs_epi32(sum2, sum3));
+      _mm256_storeu_si256((__m256i*)(dstPtr + i), out);
+   }
+
+   ResampleBytesV_C(dstPtr, srcRows, weights, taps, i, widthBytes);
+}
+#endif // CAT_CONFIG_SIMD_AVX2
+#endif // CAT_CONFIG_SIMD_X86
+
+//---------------------------------------------------------------------------
+// Kernel selection
+//---------------------------------------------------------------------------
+// Start out with the C kernels so the table is usable even before
+// CATImageKernelsInit() runs.
+CATImageKernels gCATImageKernels =
+{
+   OverlayRow_C,
+   OverlayPremulRow_C,
+   PremultiplyRow_C,
+   UnpremultiplyRow_C,
+   CopyOutBGRRow_C,
+   CopyOutBGRARow_C,
+   ResampleRowH_C,
+   ResampleRowV_C,
+   ExpandRGBRow_C,
+   DisableRow_C,
+   DarkenRow_C,
+   HighlightRow_C,
+   FillRow_C,
+   FillRow_C,
+   FillRGBRow_C,
+   FillRGBRow_C,
+   FillBlendRow_C,
+   YUY2Row_C,
+   UYVYRow_C,
+   NV12Row_C,
+   I420Row_C
+};
+
+void CATImageKernelsInit(CATUInt32 cpuFeatures)
+{
+   gCATImageKernels.OverlayRow         = OverlayRow_C;
+   gCATImageKernels.OverlayPremulRow   = OverlayPremulRow_C;
+   gCATImageKernels.PremultiplyRow     = PremultiplyRow_C;
+   gCATImageKernels.UnpremultiplyRow   = UnpremultiplyRow_C;
+   gCATImageKernels.CopyOutBGRRow      = CopyOutBGRRow_C;
+   gCATImageKernels.CopyOutBGRARow     = CopyOutBGRARow_C;
+   gCATImageKernels.ResampleRowH       = ResampleRowH_C;
+   gCATImageKernels.ResampleRowV       = ResampleRowV_C;
+   gCATImageKernels.ExpandRGBRow       = ExpandRGBRow_C;
+   gCATImageKernels.DisableRow         = DisableRow_C;
+   gCATImageKernels.DarkenRow          = DarkenRow_C;
+   gCATImageKernels.HighlightRow       = HighlightRow_C;
+   gCATImageKernels.FillRow            = FillRow_C;
+   gCATImageKernels.FillRowStream      = FillRow_C;
+   gCATImageKernels.FillRGBRow         = FillRGBRow_C;
+   gCATImageKernels.FillRGBRowStream   = FillRGBRow_C;
+   gCATImageKernels.FillBlendRow       = FillBlendRow_C;
+   gCATImageKernels.YUY2Row            = YUY2Row_C;
+   gCATImageKernels.UYVYRow            = UYVYRow_C;
+   gCATImageKernels.NV12Row            = NV12Row_C;
+   gCATImageKernels.I420Row            = I420Row_C;
+
+#if defined(CAT_CONFIG_SIMD_X86)
+   if (cpuFeatures & CATCPU_SSE2)
+   {
+      gCATImageKernels.OverlayRow         = OverlayRow_SSE2;
+      gCATImageKernels.OverlayPremulRow   = OverlayPremulRow_SSE2;
+      gCATImageKernels.CopyOutBGRARow     = CopyOutBGRARow_SSE2;
+      gCATImageKernels.ResampleRowH       = ResampleRowH_SSE2;
+      gCATImageKernels.ResampleRowV       = ResampleRowV_SSE2;
+      gCATImageKernels.DisableRow         = DisableRow_SSE2;
+      gCATImageKernels.DarkenRow          = DarkenRow_SSE2;
+      gCATImageKernels.HighlightRow       = HighlightRow_SSE2;
+      gCATImageKernels.FillRow            = FillRow_SSE2;
+      gCATImageKernels.FillRowStream      = FillRowStream_SSE2;
+      gCATImageKernels.FillRGBRow         = FillRGBRow_SSE2;
+      gCATImageKernels.FillRGBRowStream   = FillRGBRowStream_SSE2;
+      gCATImageKernels.FillBlendRow       = FillBlendRow_SSE2;
+      gCATImageKernels.YUY2Row            = YUY2Row_SSE2;
+      gCATImageKernels.UYVYRow            = UYVYRow_SSE2;
+      gCATImageKernels.NV12Row            = NV12Row_SSE2;
+      gCATImageKernels.I420Row            = I420Row_SSE2;
+   }
+
+   if (cpuFeatures & CATCPU_SSSE3)
+   {
+      gCATImageKernels.CopyOutBGRRow      = CopyOutBGRRow_SSSE3;
+      gCATImageKernels.CopyOutBGRARow     = CopyOutBGRARow_SSSE3;
+      gCATImageKernels.ExpandRGBRow       = ExpandRGBRow_SSSE3;
+   }
+
+   #if defined(CAT_CONFIG_SIMD_AVX2)
+   // AVX2 kernels fall back on SSE2 for their tails, so require both.
+   if ((cpuFeatures & (CATCPU_AVX2 | CATCPU_SSE2)) == (CATCPU_AVX2 | CATCPU_SSE2))
+   {
+      gCATImageKernels.OverlayRow         = OverlayRow_AVX2;
+      gCATImageKernels.OverlayPremulRow   = OverlayPremulRow_AVX2;
+      gCATImageKernels.CopyOutBGRRow      = CopyOutBGRRow_AVX2;
+      gCATImageKernels.CopyOutBGRARow     = CopyOutBGRARow_AVX2;
+      gCATImageKernels.ResampleRowV       = ResampleRowV_AVX2;
+      gCATImageKernels.ExpandRGBRow       = ExpandRGBRow_AVX2;
+   }
+   #endif
+#endif
+}
+
+// Select kernels during static initialization so the table is ready
+// before any image code runs.
+static struct CATImageKernelsAutoInit
+{
+   CATImageKernelsAutoInit()
+   {
+      CATImageKernelsInit(CATCpuFeatures());
+   }
+} gCATImageKernelsAutoInit;
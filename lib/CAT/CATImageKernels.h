@@ -0,0 +1,171 @@
+/// \file    CATImageKernels.h
+/// \brief   Per-row pixel kernels used by CATImage
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+#ifndef _CATImageKernels_H_
+#define _CATImageKernels_H_
+
+#include "CATTypes.h"
+
+/// Blends one row of RGBA source pixels over RGBA destination pixels
+/// using the source alpha. Destination alpha is left untouched.
+typedef void (*CATOverlayRowFunc)(  CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width);
+
+/// Blends one row of premultiplied RGBA source pixels over RGBA
+/// destination pixels. Destination alpha is left untouched.
+typedef void (*CATOverlayPremulRowFunc)(  CATUInt8*         dstPtr,
+                                          const CATUInt8*   srcPtr,
+                                          CATInt32          width);
+
+/// Converts one row of pixels between straight and premultiplied alpha.
+/// dstPtr may equal srcPtr.
+typedef void (*CATConvertRowFunc)(  CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width);
+
+/// Copies one row of RGBA pixels out to a Win32-style BGR (3 bytes per
+/// pixel) or BGRA (4 bytes per pixel) buffer.
+typedef void (*CATCopyOutRowFunc)(  CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width);
+
+/// Expands one row of packed RGB pixels to RGBA with opaque alpha.
+/// Works front to back, so srcPtr may point into the same row at
+/// dstPtr + width bytes or later (where a 3-byte row fits in the tail
+/// of its 4-byte destination).
+typedef void (*CATExpandRowFunc)(   CATUInt8*         dstPtr,
+                                    const CATUInt8*   srcPtr,
+                                    CATInt32          width);
+
+/// Converts one row of RGBA pixels to a control state look (disabled,
+/// pressed or focused).  Alpha is unchanged.  dstPtr may equal srcPtr.
+typedef void (*CATStateRowFunc)( CATUInt8*         dstPtr,
+                                 const CATUInt8*   srcPtr,
+                                 CATInt32          width,
+                                 bool              premultiplied);
+
+/// Fills one row of RGBA pixels from a pixel value (4 bytes in memory
+/// order, as stored in the image).
+typedef void (*CATFillRowFunc)(  CATUInt8*         dstPtr,
+                                 CATUInt32         pixel,
+                                 CATInt32          width);
+
+/// Fixed-point precision of CATResampleTable weights.
+const CATInt32 kCATResampleBits = 14;
+
+/// \struct CATResampleTable
+/// \brief Precomputed filter weights for one axis of a resample.
+///
+/// Every output pixel reads the same number of taps, starting at its own
+/// source index.  Weights are signed (Lanczos lobes go negative) and sum
+/// to 1 << kCATResampleBits for each output pixel.
+struct CATResampleTable
+{
+   CATInt32          taps;       ///< Weights per output pixel
+   const CATInt32*   starts;     ///< First source pixel for each output pixel
+   const CATInt16*   weights;    ///< taps weights per output pixel
+};
+
+/// Horizontally filters one row of RGBA pixels, producing dstWidth
+/// pixels using the table's weights.
+typedef void (*CATResampleRowHFunc)(   CATUInt8*               dstPtr,
+                                       const CATUInt8*         srcPtr,
+                                       CATInt32                dstWidth,
+                                       const CATResampleTable& table);
+
+/// Vertically filters one output row: each of the widthBytes bytes is
+/// the weighted sum of the same byte in taps source rows.
+typedef void (*CATResampleRowVFunc)(   CATUInt8*               dstPtr,
+                                       const CATUInt8* const*  srcRows,
+                                       const CATInt16*         weights,
+                                       CATInt32                taps,
+                                       CATInt32                widthBytes);
+
+/// Fixed-point precision of CATYUVCoeffs.
+const CATInt32 kCATYUVBits = 13;
+
+/// \struct CATYUVCoeffs
+/// \brief Fixed-point YUV to RGB matrix for the YUV row kernels.
+///
+/// Each channel is  ys * (Y - yOffset) + cu * (U - 128) + cv * (V - 128),
+/// rounded, shifted down by kCATYUVBits and clamped to a byte.  Green
+/// uses gu and gv, red only rv and blue only bu.  CATImage::CopyInYUV()
+/// builds these from a matrix and range.
+struct CATYUVCoeffs
+{
+   CATInt16    yOffset;    ///< 16 for limited range, 0 for full
+   CATInt16    ys;         ///< Luma scale
+   CATInt16    rv;         ///< V into red
+   CATInt16    gu;         ///< U into green (negative)
+   CATInt16    gv;         ///< V into green (negative)
+   CATInt16    bu;         ///< U into blue
+   bool        bgra;       ///< Store B,G,R,A instead of R,G,B,A
+};
+
+/// Converts one row of YUV pixels to RGBA (or BGRA) with opaque alpha.
+/// planes holds this row of each plane the format uses:
+///    - YUY2, UYVY: planes[0] is the packed row.
+///    - NV12: planes[0] is luma, planes[1] interleaved U,V.
+///    - I420: planes[0] is luma, planes[1] U and planes[2] V.
+/// Chroma is shared by each pair of pixels; an odd last pixel uses the
+/// pair it would start.
+typedef void (*CATYUVRowFunc)(   CATUInt8*               dstPtr,
+                                 const CATUInt8* const*  planes,
+                                 CATInt32                width,
+                                 const CATYUVCoeffs&     coeffs);
+
+/// \struct CATImageKernels
+/// \brief Row kernels selected for the running CPU
+/// \ingroup CAT
+///
+/// CATImage does its own bounds checking and pointer math, then hands
+/// each row to one of these.  The table is filled in at startup by
+/// CATImageKernelsInit() with the widest SIMD version the CPU supports,
+/// falling back to plain C.  Every version of a kernel must produce
+/// exactly the same bytes as the C one.
+struct CATImageKernels
+{
+   CATOverlayRowFunc          OverlayRow;
+   CATOverlayPremulRowFunc    OverlayPremulRow;
+   CATConvertRowFunc          PremultiplyRow;
+   CATConvertRowFunc          UnpremultiplyRow;
+   CATCopyOutRowFunc          CopyOutBGRRow;
+   CATCopyOutRowFunc          CopyOutBGRARow;
+   CATResampleRowHFunc        ResampleRowH;
+   CATResampleRowVFunc        ResampleRowV;
+   CATExpandRowFunc           ExpandRGBRow;
+   CATStateRowFunc            DisableRow;
+   CATStateRowFunc            DarkenRow;
+   CATStateRowFunc            HighlightRow;
+   CATFillRowFunc             FillRow;          ///< Stores pixel
+   CATFillRowFunc             FillRowStream;    ///< Stores pixel, bypassing the cache
+   CATFillRowFunc             FillRGBRow;       ///< Stores pixel's r,g,b; keeps alpha
+   CATFillRowFunc             FillRGBRowStream; ///< FillRGBRow, bypassing the cache
+   CATFillRowFunc             FillBlendRow;     ///< Blends pixel's r,g,b by its alpha; keeps alpha
+   CATYUVRowFunc              YUY2Row;          ///< Y0 U Y1 V packed
+   CATYUVRowFunc              UYVYRow;          ///< U Y0 V Y1 packed
+   CATYUVRowFunc              NV12Row;          ///< Y plane + interleaved UV plane
+   CATYUVRowFunc              I420Row;          ///< Y, U and V planes
+};
+
+/// Kernel table used by CATImage.
+extern CATImageKernels gCATImageKernels;
+
+/// CATImageKernelsInit() selects the row kernels for a set of CPU
+/// features. This is done automatically at startup with
+/// CATCpuFeatures(); call it again after CATCpuSetFeatureMask() to switch.
+///
+/// \param cpuFeatures - combination of CATCPU_FEATURE flags.
+void CATImageKernelsInit(CATUInt32 cpuFeatures);
+
+#endif // _CATImageKernels_H_
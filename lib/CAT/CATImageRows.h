@@ -0,0 +1,51 @@
+/// \file    CATImageRows.h
+/// \brief   Base pointer and stride view of a block of RGBA pixels
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+#ifndef _CATImageRows_H_
+#define _CATImageRows_H_
+
+#include "CATTypes.h"
+
+/// \struct CATImageRows
+/// \brief Base pointer and stride view of a block of RGBA pixels
+/// \ingroup CAT
+///
+/// Filled in by CATImage::GetRowsForRead() and GetRowsForWrite() with the
+/// sub image offsets already applied, so per-pixel code is just a
+/// multiply and an add - no bounds checks, no walking parent images.
+/// Kept free of CATImage so standalone processors (e.g. CBMagInfo) can
+/// take one too.
+///
+/// The view is only valid until the image is released, written to
+/// through its own methods, or (for a read view) until a copy-on-write
+/// copy sharing the buffer is detached.
+struct CATImageRows
+{
+   CATUInt8*   data;       ///< First byte of the top-left pixel
+   CATInt32    stride;     ///< Bytes from one row to the next
+   CATInt32    width;      ///< Pixels per row
+   CATInt32    height;     ///< Number of rows
+
+   /// Row() returns the first pixel of row y.
+   inline CATUInt8* Row(CATInt32 y) const
+   {
+      return data + y * stride;
+   }
+
+   /// Pixel() returns pixel (x, y).
+   inline CATUInt8* Pixel(CATInt32 x, CATInt32 y) const
+   {
+      return data + y * stride + x * 4;
+   }
+};
+
+#endif // _CATImageRows_H_
@@ -116,7 +116,7 @@ void CATOverlayDirect3D9::DrawToScene(IDirect3DDevice9* device)
         {
             // Create a buffer to copy image into that's a power of 2 for texture happiness.
             CATUInt8* buffer = (CATUInt8*)lockedRect.pBits;
-            CATUInt8* srcBuf = fOverlay->GetRawDataPtr();
+            const CATUInt8* srcBuf = fOverlay->GetRawDataPtr();
             CATUInt32 imgWidth = fOverlay->Width();
             
             
@@ -90,7 +90,7 @@ void CATOverlayOpenGL::DrawToScene(HDC hdc)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,GL_LINEAR);
         // Create a buffer to copy image into that's a power of 2 for texture happiness.
         CATUInt8* buffer = new CATUInt8[tw*th*4];
-        CATUInt8* srcBuf = fOverlay->GetRawDataPtr();
+        const CATUInt8* srcBuf = fOverlay->GetRawDataPtr();
         CATUInt32 imgWidth = fOverlay->Width();
         memset(buffer,0,tw*th*4);        
         for (int y = 0; y < fOverlay->Height(); y++)
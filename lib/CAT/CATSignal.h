@@ -65,6 +65,11 @@ class CATSignal
       // Platform specific mutex handles
 #ifdef CAT_CONFIG_WIN32
       HANDLE fEvent;
+#else
+      pthread_mutex_t   fMutex;        ///< Protects fFired
+      pthread_cond_t    fCond;         ///< Broadcast on Fire()
+      bool              fFired;        ///< Current state
+      bool              fAutoReset;    ///< Reset after letting one through?
 #endif 
 };
 
@@ -0,0 +1,126 @@
+/// \file CATSignal_Posix.cpp
+/// \brief POSIX implementation of signal events
+/// \ingroup CAT
+/// 
+/// Built from a mutex and a condition variable, with the same
+/// auto/manual reset behaviour as the Win32 events.
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include "CATSignal.h"
+#include <errno.h>
+#include <time.h>
+
+CATSignal::CATSignal(bool autoReset)
+{
+   fFired     = false;
+   fAutoReset = autoReset;
+   pthread_mutex_init(&fMutex, 0);
+   pthread_cond_init(&fCond, 0);
+}
+
+CATSignal::~CATSignal()
+{
+   pthread_cond_destroy(&fCond);
+   pthread_mutex_destroy(&fMutex);
+}
+
+// Wait() waits up to [milliseconds] milliseconds for the
+// signal to be fired. If the CATSignal is set to auto-reset,
+// the it will be reset when a caller successfully receive
+// the event through a wait.
+//
+// Check the result code here! It can very easily time out.
+//
+// The default, however, is an infinite wait.
+//
+// \param milliseconds - milliseconds to wait while trying to get synch
+//
+// \sa Release()
+CATResult CATSignal::Wait(CATUInt32 milliseconds)
+{
+   int waitRes = 0;
+
+   pthread_mutex_lock(&fMutex);
+
+   if (milliseconds == 0xFFFFFFFF)
+   {
+      while ((!fFired) && (waitRes == 0))
+      {
+         waitRes = pthread_cond_wait(&fCond, &fMutex);
+      }
+   }
+   else
+   {
+      struct timespec endTime;
+      clock_gettime(CLOCK_REALTIME, &endTime);
+      endTime.tv_sec  += milliseconds / 1000;
+      endTime.tv_nsec += (long)(milliseconds % 1000) * 1000000L;
+      if (endTime.tv_nsec >= 1000000000L)
+      {
+         endTime.tv_sec++;
+         endTime.tv_nsec -= 1000000000L;
+      }
+
+      while ((!fFired) && (waitRes == 0))
+      {
+         waitRes = pthread_cond_timedwait(&fCond, &fMutex, &endTime);
+      }
+   }
+
+   bool fired = fFired;
+   if (fired && fAutoReset)
+   {
+      fFired = false;
+   }
+
+   pthread_mutex_unlock(&fMutex);
+
+   if (fired)
+   {
+      return CATRESULT(CAT_SUCCESS);
+   }
+
+   if (waitRes == ETIMEDOUT)
+   {
+      return CATRESULT(CAT_ERR_SIGNAL_TIMEOUT);
+   }
+
+   // Error occurred. Handle was invalid or something similar.
+   return CATRESULT(CAT_ERR_SIGNAL_WAIT_ERROR);
+}
+
+      
+// Fire() fires the signal, which then allows caller(s) through.
+CATResult CATSignal::Fire()
+{
+   pthread_mutex_lock(&fMutex);
+   fFired = true;
+   if (fAutoReset)
+   {
+      pthread_cond_signal(&fCond);
+   }
+   else
+   {
+      pthread_cond_broadcast(&fCond);
+   }
+   pthread_mutex_unlock(&fMutex);
+   
+   return CAT_SUCCESS;
+}
+
+/// Reset() resets the signal, making the signal block callers.
+CATResult CATSignal::Reset()
+{
+   pthread_mutex_lock(&fMutex);
+   fFired = false;
+   pthread_mutex_unlock(&fMutex);
+
+   return CAT_SUCCESS;
+}
@@ -268,9 +268,15 @@ CATResult CATStreamFile::Size(CATInt64& filesize)
       return CATRESULTFILE(CAT_ERR_FILE_SEEK,fFilename);
    }
    
+#ifdef CAT_CONFIG_POSIX
+   // fpos_t is opaque here - ftello() gives the offset.
+   off_t eofPos = ftello(fFileHandle);
+   if (eofPos < 0)
+#else
    fpos_t eofPos;
 
    if (0 != fgetpos(fFileHandle, &eofPos))
+#endif
    {
       return CATRESULTFILE(CAT_ERR_FILE_GET_POSITION,fFilename);
    }
@@ -334,8 +340,12 @@ CATResult CATStreamFile::SeekAbsolute(CATInt64 position)
       return CATRESULT(CAT_ERR_FILE_NOT_OPEN);
    }
 
+#ifdef CAT_CONFIG_POSIX
+   if (0 != fseeko(fFileHandle,(off_t)position,SEEK_SET))
+#else
    fpos_t filePos = position;
    if (0 != fsetpos(fFileHandle,&filePos))
+#endif
    {
       return CATRESULTFILE(CAT_ERR_FILE_SET_POSITION,fFilename);
    }
@@ -383,8 +393,13 @@ CATResult CATStreamFile::GetPosition(CATInt64& position)
       return CATRESULT(CAT_ERR_FILE_NOT_OPEN);
    }
 
+#ifdef CAT_CONFIG_POSIX
+   off_t curPos = ftello(fFileHandle);
+   if (curPos < 0)
+#else
    fpos_t curPos;
    if (0 != fgetpos(fFileHandle, &curPos))
+#endif
    {
       return CATRESULTFILE(CAT_ERR_FILE_GET_POSITION,fFilename);
    }
@@ -66,7 +66,12 @@ class CATThread
 
 	protected:
 		CATUInt32		fThreadId;        ///< thread id
+#ifdef CAT_CONFIG_WIN32
 		HANDLE			fThreadHandle;    ///< Thread handle
+#else
+		pthread_t		fThreadHandle;    ///< Thread handle
+		bool			fThreadStarted;   ///< Is fThreadHandle valid?
+#endif
 		CATTHREADPROC	fCallback;        ///< Callback
 		void*				fUserParam;	      ///< User parameter for thread
 };
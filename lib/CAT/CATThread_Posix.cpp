@@ -0,0 +1,197 @@
+//---------------------------------------------------------------------------
+/// \file    CATThread_Posix.cpp
+/// \brief   Base Thread Class - POSIX threads version
+/// \ingroup CAT
+///
+/// pthreads can't be suspended, so Pause() and Resume() fail here.
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//---------------------------------------------------------------------------
+
+#include "CATThread.h"
+#include <errno.h>
+#include <time.h>
+
+/// OS specific thread - note, the param is NOT the user param, 
+/// rather it is a pointer to the thread object....
+static void* PosixThreadProc(void *param);
+
+
+// Thread construction
+CATThread::CATThread()
+{
+    this->fThreadStarted = false;
+    this->fThreadId      = 0;
+    this->fUserParam     = 0;
+    this->fCallback      = 0;
+}
+
+// Thread destruction
+CATThread::~CATThread()
+{
+    if (this->fThreadStarted)
+    {
+        if (!this->WaitStop(1000))
+        {
+            CATTRACE("Warning: Forcing thread to stop...");
+            this->ForceStop();
+        }
+    }
+}
+
+
+// Start a thread. This is the one used if you're deriving from
+// CATThread for your own threaded class.  Override ThreadFunction()
+// for your subclass...
+bool CATThread::Start(void *param)
+{
+    CATASSERT(!fThreadStarted, "Starting a thread that's already running. Bad form....");
+    if (fThreadStarted)
+    {
+        return false;
+    }
+
+    this->fCallback  = 0;
+    this->fUserParam = param;
+
+    // If startup was successful, return true
+    if (0 == pthread_create(&fThreadHandle, 0, PosixThreadProc, this))
+    {
+        fThreadStarted = true;
+        return true;
+    }
+
+    // Thread couldn't start - bail.
+    return false;
+}
+
+// Start a thread procedure.  You can use this directly w/o deriving
+// just by creating your procedure from the CATTHREADPROC prototype.
+bool CATThread::StartProc(CATTHREADPROC proc, void* param)
+{
+    CATASSERT(!fThreadStarted, "Starting a thread that's already running. Bad form...");
+    if (fThreadStarted)
+    {
+        return false;
+    }
+
+    this->fCallback = proc;
+    this->fUserParam = param;
+
+    if (0 == pthread_create(&fThreadHandle, 0, PosixThreadProc, this))
+    {
+        fThreadStarted = true;
+        return true;
+    }
+
+    return false;
+}
+
+// Wait until the thread stops or the timer times out.
+// If successful, clears the thread handle. Start or StartProc must
+// be called before other thread commands are used.
+//
+// Threads don't have exit codes here - exitCode is set to 0.
+bool CATThread::WaitStop(CATUInt32 timeout, CATUInt32* exitCode )
+{
+    if (!fThreadStarted)
+    {
+        return true;
+    }
+
+    if (timeout == (CATUInt32)-1)
+    {
+        if (0 != pthread_join(fThreadHandle, 0))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        struct timespec endTime;
+        clock_gettime(CLOCK_REALTIME, &endTime);
+        endTime.tv_sec  += timeout / 1000;
+        endTime.tv_nsec += (long)(timeout % 1000) * 1000000L;
+        if (endTime.tv_nsec >= 1000000000L)
+        {
+            endTime.tv_sec++;
+            endTime.tv_nsec -= 1000000000L;
+        }
+
+        if (0 != pthread_timedjoin_np(fThreadHandle, 0, &endTime))
+        {
+            return false;
+        }
+    }
+
+    if (exitCode)
+    {   
+        *exitCode = 0;
+    }
+    
+    fThreadStarted  = false;
+    fCallback       = 0;
+    fUserParam      = 0;
+    return true;
+}
+
+// Forces a thread to stop - use sparingly.  As WaitStop does, this
+// one clears the thread handle.  Start or StartProc must be called
+// prior to calling other commands after ForceStop is issued.
+//
+// The thread is cancelled at its next cancellation point, rather
+// than killed outright as on Win32.
+void CATThread::ForceStop()
+{
+    if (!fThreadStarted)
+    {
+        return;
+    }
+
+    pthread_cancel(fThreadHandle);
+    pthread_detach(fThreadHandle);
+    fThreadStarted = false;
+    fCallback = 0;
+    fUserParam = 0;
+}
+
+// Pause the thread. Not supported by pthreads.
+bool CATThread::Pause()
+{
+    CATASSERT(fThreadStarted, "Invalid thread handle in Pause - start it first!");
+    return false;
+}
+
+// Resume the thread. Not supported by pthreads.
+bool CATThread::Resume()
+{
+    CATASSERT(fThreadStarted, "Invalid thread handle in Resume - start it first!");
+    return false;
+}
+
+// Thread function - either override this if you are deriving
+// from the class, or leave as is and it will call the CATTHREADPROC
+// procedure from a StartProc, then exit.
+void CATThread::ThreadFunction()
+{
+    if (this->fCallback)
+    {
+        fCallback(this->fUserParam,this);
+    }
+}
+
+
+// OS specific thread - note, the param is NOT the user param, 
+// rather it is a pointer to the thread object....
+static void* PosixThreadProc(void *param)
+{
+    CATThread* theThread = (CATThread*)param;
+    theThread->ThreadFunction();
+    return 0;
+}
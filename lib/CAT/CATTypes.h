@@ -83,6 +83,7 @@
    #define xplat_ReadRights       _S_IREAD
 
    #define xplat_inline           _inline
+   #define xplat_forceinline      __forceinline
    #define xplat_wcstoull(x,y,z)  _wcstoui64(x,y,z)
    #define xplat_vsnwprintf(w,x,y,z)   _vsnwprintf(w,x,y,z)
    #define xplat_vsnprintf            _vsnprintf
@@ -131,6 +132,7 @@
    #define xplat_ReadRights       S_IREAD
 
    #define xplat_inline           inline
+   #define xplat_forceinline      inline __attribute__((always_inline))
    #define xplat_wcstoull(x,y,z)  wcstoull(x,y,z)
    #define xplat_wtof(x)          wcstod(x,0)
    #define xplat_vsnwprintf(w,x,y,z)   vswprintf(w,x,y,z)
@@ -139,6 +141,16 @@
 
    #define xplat_ssize_t          ssize_t
 
+#ifdef CAT_CONFIG_POSIX
+    typedef uint64_t         CATUInt64;     ///< 64-bit unsigned integer
+    typedef int64_t          CATInt64;      ///< 64-bit signed   integer
+    typedef uint32_t         CATUInt32;     ///< 32-bit unsigned integer
+    typedef int32_t          CATInt32;      ///< 32-bit signed   integer
+    typedef uint16_t         CATUInt16;     ///< 16-bit unsigned integer
+    typedef int16_t          CATInt16;      ///< 16-bit signed   integer
+    typedef uint8_t          CATUInt8;      ///< 8-bit  unsigned integer
+    typedef int8_t           CATInt8;       ///< 8-bit  signed   integer
+#else
     typedef UInt64         CATUInt64;     ///< 64-bit unsigned integer
     typedef SInt64          CATInt64;      ///< 64-bit signed   integer
     typedef UInt32         CATUInt32;     ///< 32-bit unsigned integer
@@ -147,6 +159,7 @@
     typedef SInt16          CATInt16;      ///< 16-bit signed   integer
     typedef UInt8          CATUInt8;      ///< 8-bit  unsigned integer
     typedef SInt8           CATInt8;       ///< 8-bit  signed   integer
+#endif
     typedef wchar_t          CATWChar;      ///< 16-bit Character
     typedef char             CATChar;       ///< 8-bit  Character
 
@@ -115,6 +115,70 @@ void CATVMR9AllocPres::CleanSurfaces()
 	fSurfaceCount = 0;
 }
 
+//---------------------------------------------------------------------------
+// CopyInYUVSurface
+//    Converts a YUV surface straight into fImage, flipped into the same
+//    bottom-up BGRA layout the back buffer copy below produces.  Returns
+//    false if the surface isn't a YUV format we know, doesn't match the
+//    image size, or can't be locked - the caller then falls back on
+//    StretchRect.
+//---------------------------------------------------------------------------
+bool CATVMR9AllocPres::CopyInYUVSurface(IDirect3DSurface9* surf)
+{
+	D3DSURFACE_DESC desc;
+	if (FAILED(surf->GetDesc(&desc)))
+		return false;
+
+	if ((desc.Width != (UINT)fImage->Width()) || (desc.Height != (UINT)fImage->Height()))
+		return false;
+
+	CATImage::CATYUVFORMAT format;
+	bool swapUV = false;
+	switch ((DWORD)desc.Format)
+	{
+		case D3DFMT_YUY2:					format = CATImage::CATYUV_YUY2;	break;
+		case D3DFMT_UYVY:					format = CATImage::CATYUV_UYVY;	break;
+		case MAKEFOURCC('N','V','1','2'):	format = CATImage::CATYUV_NV12;	break;
+		case MAKEFOURCC('I','4','2','0'):
+		case MAKEFOURCC('I','Y','U','V'):	format = CATImage::CATYUV_I420;	break;
+		case MAKEFOURCC('Y','V','1','2'):	format = CATImage::CATYUV_I420;	swapUV = true; break;
+		default:
+			return false;
+	}
+
+	D3DLOCKED_RECT rect;
+	if (FAILED(surf->LockRect(&rect,0,D3DLOCK_READONLY|D3DLOCK_NO_DIRTY_UPDATE)))
+		return false;
+
+	// Planar formats store their chroma planes right after luma; YV12
+	// and I420 halve the pitch along with the width.
+	const CATUInt8*	luma = (const CATUInt8*)rect.pBits;
+	const CATUInt8*	planes[3];
+	CATInt32			strides[3];
+	planes[0]  = luma;
+	strides[0] = rect.Pitch;
+	if (format == CATImage::CATYUV_NV12)
+	{
+		planes[1]  = luma + rect.Pitch * desc.Height;
+		strides[1] = rect.Pitch;
+	}
+	else if (format == CATImage::CATYUV_I420)
+	{
+		CATInt32 chromaPitch = rect.Pitch / 2;
+		CATInt32 chromaSize  = chromaPitch * ((desc.Height + 1) / 2);
+		planes[swapUV ? 2 : 1]  = luma + rect.Pitch * desc.Height;
+		planes[swapUV ? 1 : 2]  = luma + rect.Pitch * desc.Height + chromaSize;
+		strides[1] = strides[2] = chromaPitch;
+	}
+
+	// Surfaces carry no matrix - assume BT.709 for HD sizes, BT.601 below.
+	CATImage::CATYUVMATRIX matrix = (desc.Height > 576) ? CATImage::CATYUV_BT709 : CATImage::CATYUV_BT601;
+	CATResult result = fImage->CopyInYUV(planes, strides, format, matrix, false, true, true);
+
+	surf->UnlockRect();
+	return CATSUCCEEDED(result);
+}
+
 //---------------------------------------------------------------------------
 // IVMRSurfaceAllocator9
 HRESULT STDMETHODCALLTYPE CATVMR9AllocPres::InitializeDevice( DWORD_PTR dwUserID, VMR9AllocationInfo *lpAllocInfo, DWORD *lpNumBuffers)
@@ -209,6 +273,16 @@ HRESULT STDMETHODCALLTYPE CATVMR9AllocPres::PresentImage( DWORD_PTR dwUserID, VM
 	if (CATFAILED(fImageLock.Wait(0)))
 		return S_OK;
 
+	// Native camera formats skip the back buffer entirely.
+	if (CopyInYUVSurface(lpPresInfo->lpSurf))
+	{
+		if (fCallback)
+			fCallback(fImage,fContext);
+
+		fImageLock.Release();
+		return S_OK;
+	}
+
 	// Copy data and/or display - lpPresInfo->lpSurf
 	HRESULT hr;
 	int w = fImage->Width();
@@ -228,7 +302,7 @@ HRESULT STDMETHODCALLTYPE CATVMR9AllocPres::PresentImage( DWORD_PTR dwUserID, VM
 		{	
 			
 			unsigned char* src, *dst;
-			dst = fImage->GetRawDataPtr();
+			dst = fImage->GetRawDataPtrForWrite();
 			src = (unsigned char*)rect.pBits+rect.Pitch*(h-1);
 			int step = w*4;
 			for (int y = 0; y < h; y++)
@@ -59,6 +59,10 @@ class CATVMR9AllocPres : public  IVMRSurfaceAllocator9, IVMRImagePresenter9
 
 	protected:
 		void CleanSurfaces();
+
+		/// Converts a lockable YUV surface directly into fImage.
+		/// \return bool - false if the back buffer path is needed.
+		bool CopyInYUVSurface(IDirect3DSurface9* surf);
 	
 	protected:
 		CATImage*							fImage;
@@ -0,0 +1,440 @@
+/// \file    CATWorkPool.cpp
+/// \brief   Shared pool of worker threads for splitting up CPU-bound work
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+
+#include "CATWorkPool.h"
+
+#ifndef CAT_CONFIG_WIN32
+    #include <unistd.h>
+#endif
+
+// Upper limit on workers, whatever the processor count says.
+const CATUInt32 kMaxWorkThreads     = 63;
+
+// ParallelFor() hands out up to this many chunks per thread so that
+// uneven chunks (or a worker that starts late) balance out.
+const CATInt32  kChunksPerThread    = 4;
+
+CATWorkPool* CATWorkPool::fSharedPool = 0;
+
+/// \struct CATWorkBatch
+/// \brief State for one ParallelFor() call.  Lives on the caller's stack.
+struct CATWorkBatch
+{
+   CATWorkPool::CATWORKRANGEPROC proc;
+   void*          param;
+   CATInt32       count;         // size of the range
+   CATInt32       chunk;         // chunk size
+   CATInt32       next;          // start of the next unclaimed chunk
+   CATCritSec     chunkLock;     // protects next
+
+   // These are protected by the pool's lock.
+   CATInt32       running;       // helper tasks currently running
+   bool           finished;      // caller is done and waiting on running
+   CATSignal      done;          // fired when running drops to 0
+};
+
+//---------------------------------------------------------------------------
+// Constructor - starts the worker threads.
+//---------------------------------------------------------------------------
+CATWorkPool::CATWorkPool(CATUInt32 numThreads)
+: fIdleSignal(false)
+{
+   fThreads    = 0;
+   fActive     = 0;
+   fStopping   = false;
+
+   if (numThreads == 0)
+   {
+      numThreads = GetNumProcessors() - 1;
+   }
+
+   if (numThreads > kMaxWorkThreads)
+   {
+      numThreads = kMaxWorkThreads;
+   }
+
+   fNumThreads = 0;
+   if (numThreads > 0)
+   {
+      fThreads = new CATThread[numThreads];
+      for (CATUInt32 i = 0; i < numThreads; i++)
+      {
+         if (!fThreads[i].StartProc(WorkerThread, this))
+         {
+            CATTRACE("Warning: Failed to start work pool thread.");
+            break;
+         }
+         fNumThreads++;
+      }
+   }
+
+   // Idle until something is queued.
+   fIdleSignal.Fire();
+}
+
+//---------------------------------------------------------------------------
+// Destructor - workers drain the queue, then exit.
+//---------------------------------------------------------------------------
+CATWorkPool::~CATWorkPool()
+{
+   fLock.Wait();
+   fStopping = true;
+   fLock.Release();
+
+   // Each worker passes the signal on as it exits.
+   fWorkSignal.Fire();
+
+   for (CATUInt32 i = 0; i < fNumThreads; i++)
+   {
+      fThreads[i].WaitStop();
+   }
+
+   delete [] fThreads;
+   fThreads = 0;
+}
+
+//---------------------------------------------------------------------------
+// ParallelFor() calls proc over [0, count) in chunks of at least
+// minChunk, and returns when they have all finished.
+//---------------------------------------------------------------------------
+CATResult CATWorkPool::ParallelFor( CATInt32          count,
+                                    CATInt32          minChunk,
+                                    CATWORKRANGEPROC  proc,
+                                    void*             param)
+{
+   CATASSERT(proc != 0, "Null procedure passed to ParallelFor.");
+   if (proc == 0)
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   if (count <= 0)
+   {
+      return CAT_SUCCESS;
+   }
+
+   if (minChunk < 1)
+   {
+      minChunk = 1;
+   }
+
+   CATInt32 numChunks = (count + minChunk - 1) / minChunk;
+   if ((fNumThreads == 0) || (numChunks < 2))
+   {
+      proc(param, 0, count);
+      return CAT_SUCCESS;
+   }
+
+   CATInt32 maxChunks = (CATInt32)(fNumThreads + 1) * kChunksPerThread;
+   if (numChunks > maxChunks)
+   {
+      numChunks = maxChunks;
+   }
+
+   CATWorkBatch batch;
+   batch.proc     = proc;
+   batch.param    = param;
+   batch.count    = count;
+   batch.chunk    = (count + numChunks - 1) / numChunks;
+   batch.next     = 0;
+   batch.running  = 0;
+   batch.finished = false;
+
+   numChunks = (count + batch.chunk - 1) / batch.chunk;
+
+   // One helper per chunk the caller won't get to first, up to one per
+   // worker.  Each helper keeps pulling chunks until they run out.
+   CATInt32 numHelpers = numChunks - 1;
+   if (numHelpers > (CATInt32)fNumThreads)
+   {
+      numHelpers = (CATInt32)fNumThreads;
+   }
+
+   Task task;
+   task.proc   = BatchTask;
+   task.param  = &batch;
+   task.batch  = &batch;
+
+   fLock.Wait();
+   for (CATInt32 i = 0; i < numHelpers; i++)
+   {
+      fQueue.push_back(task);
+   }
+   fIdleSignal.Reset();
+   fLock.Release();
+
+   fWorkSignal.Fire();
+
+   RunBatch(&batch);
+
+   // All chunks have been claimed.  Pull any helpers that haven't started
+   // (the workers may be busy with other tasks), then wait for the ones
+   // that have.
+   fLock.Wait();
+   std::list<Task>::iterator iter = fQueue.begin();
+   while (iter != fQueue.end())
+   {
+      if (iter->batch == &batch)
+      {
+         iter = fQueue.erase(iter);
+      }
+      else
+      {
+         ++iter;
+      }
+   }
+
+   if ((fQueue.size() == 0) && (fActive == 0))
+   {
+      fIdleSignal.Fire();
+   }
+
+   batch.finished = true;
+   CATInt32 running = batch.running;
+   fLock.Release();
+
+   if (running > 0)
+   {
+      batch.done.Wait();
+   }
+
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// QueueTask() queues a single task for a worker thread.
+//---------------------------------------------------------------------------
+CATResult CATWorkPool::QueueTask(   CATWORKTASKPROC   proc,
+                                    void*             param)
+{
+   CATASSERT(proc != 0, "Null procedure passed to QueueTask.");
+   if (proc == 0)
+   {
+      return CATRESULT(CAT_ERR_INVALID_PARAM);
+   }
+
+   if (fNumThreads == 0)
+   {
+      proc(param);
+      return CAT_SUCCESS;
+   }
+
+   Task task;
+   task.proc   = proc;
+   task.param  = param;
+   task.batch  = 0;
+
+   fLock.Wait();
+   fQueue.push_back(task);
+   fIdleSignal.Reset();
+   fLock.Release();
+
+   fWorkSignal.Fire();
+   return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// WaitIdle() waits until the queue is empty and no tasks are running.
+//---------------------------------------------------------------------------
+void CATWorkPool::WaitIdle()
+{
+   for (;;)
+   {
+      fLock.Wait();
+      bool idle = (fQueue.size() == 0) && (fActive == 0);
+      fLock.Release();
+
+      if (idle)
+      {
+         return;
+      }
+
+      fIdleSignal.Wait();
+   }
+}
+
+//---------------------------------------------------------------------------
+// GetNumThreads() returns the number of worker threads.
+//---------------------------------------------------------------------------
+CATUInt32 CATWorkPool::GetNumThreads() const
+{
+   return fNumThreads;
+}
+
+//---------------------------------------------------------------------------
+// GetNumProcessors() returns the number of logical processors.
+//---------------------------------------------------------------------------
+CATUInt32 CATWorkPool::GetNumProcessors()
+{
+   CATUInt32 numProcs = 1;
+#ifdef CAT_CONFIG_WIN32
+   SYSTEM_INFO sysInfo;
+   ::GetSystemInfo(&sysInfo);
+   numProcs = (CATUInt32)sysInfo.dwNumberOfProcessors;
+#else
+   long sysProcs = sysconf(_SC_NPROCESSORS_ONLN);
+   if (sysProcs > 0)
+   {
+      numProcs = (CATUInt32)sysProcs;
+   }
+#endif
+   if (numProcs < 1)
+   {
+      numProcs = 1;
+   }
+   return numProcs;
+}
+
+//---------------------------------------------------------------------------
+// GetShared() returns the process-wide pool, creating it on first use.
+//---------------------------------------------------------------------------
+CATWorkPool* CATWorkPool::GetShared()
+{
+   if (fSharedPool == 0)
+   {
+      fSharedPool = new CATWorkPool();
+   }
+   return fSharedPool;
+}
+
+//---------------------------------------------------------------------------
+// InitShared() (re)creates the process-wide pool.
+//---------------------------------------------------------------------------
+void CATWorkPool::InitShared(CATUInt32 numThreads)
+{
+   ReleaseShared();
+   fSharedPool = new CATWorkPool(numThreads);
+}
+
+//---------------------------------------------------------------------------
+// ReleaseShared() stops and deletes the process-wide pool.
+//---------------------------------------------------------------------------
+void CATWorkPool::ReleaseShared()
+{
+   if (fSharedPool != 0)
+   {
+      delete fSharedPool;
+      fSharedPool = 0;
+   }
+}
+
+//---------------------------------------------------------------------------
+// WorkerThread() - thread procedure, param is the pool.
+//---------------------------------------------------------------------------
+void CATWorkPool::WorkerThread(void* param, CATThread* theThread)
+{
+   ((CATWorkPool*)param)->WorkerLoop();
+}
+
+//---------------------------------------------------------------------------
+// BatchTask() - helper task for ParallelFor(), param is the batch.
+//---------------------------------------------------------------------------
+void CATWorkPool::BatchTask(void* param)
+{
+   RunBatch((CATWorkBatch*)param);
+}
+
+//---------------------------------------------------------------------------
+// RunBatch() claims chunks from the batch and runs them until all
+// of them have been claimed.
+//---------------------------------------------------------------------------
+void CATWorkPool::RunBatch(CATWorkBatch* batch)
+{
+   for (;;)
+   {
+      batch->chunkLock.Wait();
+      CATInt32 start = batch->next;
+      batch->next   += batch->chunk;
+      batch->chunkLock.Release();
+
+      if (start >= batch->count)
+      {
+         return;
+      }
+
+      CATInt32 end = start + batch->chunk;
+      if (end > batch->count)
+      {
+         end = batch->count;
+      }
+
+      batch->proc(batch->param, start, end);
+   }
+}
+
+//---------------------------------------------------------------------------
+// WorkerLoop() runs queued tasks until the pool is stopped.
+//
+// fWorkSignal is auto-reset, so several Fire() calls in a row may only
+// wake one worker.  A worker that takes a task while more are waiting
+// fires it again to wake the next one.
+//---------------------------------------------------------------------------
+void CATWorkPool::WorkerLoop()
+{
+   for (;;)
+   {
+      fWorkSignal.Wait();
+
+      for (;;)
+      {
+         fLock.Wait();
+         if (fQueue.size() == 0)
+         {
+            bool stopping = fStopping;
+            fLock.Release();
+
+            if (stopping)
+            {
+               // Pass the stop on to the next worker.
+               fWorkSignal.Fire();
+               return;
+            }
+            break;
+         }
+
+         Task task = fQueue.front();
+         fQueue.pop_front();
+         if (task.batch)
+         {
+            // Counted under the lock so the ParallelFor() caller can't
+            // leave (and free the batch) between the pop and the run.
+            task.batch->running++;
+         }
+         fActive++;
+
+         if (fQueue.size() != 0)
+         {
+            fWorkSignal.Fire();
+         }
+         fLock.Release();
+
+         task.proc(task.param);
+
+         fLock.Wait();
+         if (task.batch)
+         {
+            task.batch->running--;
+            if ((task.batch->running == 0) && (task.batch->finished))
+            {
+               task.batch->done.Fire();
+            }
+         }
+
+         fActive--;
+         if ((fActive == 0) && (fQueue.size() == 0))
+         {
+            fIdleSignal.Fire();
+         }
+         fLock.Release();
+      }
+   }
+}
@@ -0,0 +1,149 @@
+/// \file    CATWorkPool.h
+/// \brief   Shared pool of worker threads for splitting up CPU-bound work
+/// \ingroup CAT
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+#ifndef _CATWorkPool_H_
+#define _CATWorkPool_H_
+
+#include <list>
+#include "CATInternal.h"
+#include "CATThread.h"
+#include "CATSignal.h"
+#include "CATCritSec.h"
+
+struct CATWorkBatch;
+
+/// \class CATWorkPool
+/// \brief Shared pool of worker threads for splitting up CPU-bound work
+/// \ingroup CAT
+///
+/// CATWorkPool keeps a fixed set of worker threads waiting on a task
+/// queue.  Most callers want ParallelFor(), which splits a range (usually
+/// image rows) into chunks and blocks until they're all done.  The calling
+/// thread works on chunks too, so a ParallelFor() issued from inside a
+/// pool task can't deadlock waiting on itself.
+///
+/// One pool is shared by the whole process - see GetShared().  Create
+/// private pools only for work that must not compete with it.
+class CATWorkPool
+{
+   public:
+      /// Range procedure for ParallelFor().  Handles [start, end).
+      typedef void (*CATWORKRANGEPROC)(void* param, CATInt32 start, CATInt32 end);
+
+      /// Task procedure for QueueTask().
+      typedef void (*CATWORKTASKPROC)(void* param);
+
+      /// Constructor - starts the worker threads.
+      ///
+      /// \param numThreads - number of worker threads.  If 0, uses one
+      ///                     less than the number of processors, since the
+      ///                     thread calling ParallelFor() also works.
+      CATWorkPool(CATUInt32 numThreads = 0);
+
+      /// Destructor - finishes queued tasks, then stops the workers.
+      virtual ~CATWorkPool();
+
+      /// ParallelFor() calls proc over [0, count) in chunks of at least
+      /// minChunk, spread across the workers and the calling thread.
+      /// Returns after every chunk has finished.
+      ///
+      /// If the pool has no workers or the range only holds one chunk,
+      /// proc is simply called once on the calling thread.
+      ///
+      /// \param count    - size of the range (e.g. number of rows)
+      /// \param minChunk - smallest chunk worth handing to another thread
+      /// \param proc     - range procedure
+      /// \param param    - user parameter passed to proc
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult ParallelFor(  CATInt32          count,
+                              CATInt32          minChunk,
+                              CATWORKRANGEPROC  proc,
+                              void*             param);
+
+      /// QueueTask() queues a single task to run on a worker thread and
+      /// returns immediately.  The caller is responsible for keeping
+      /// param valid until the task runs - see WaitIdle().
+      ///
+      /// If the pool has no workers, the task is run before returning.
+      ///
+      /// \param proc  - task procedure
+      /// \param param - user parameter passed to proc
+      /// \return CATResult - CAT_SUCCESS on success.
+      CATResult QueueTask( CATWORKTASKPROC   proc,
+                           void*             param);
+
+      /// WaitIdle() waits until the queue is empty and no tasks are running.
+      void WaitIdle();
+
+      /// GetNumThreads() returns the number of worker threads, not
+      /// counting the caller.
+      CATUInt32 GetNumThreads() const;
+
+      /// GetNumProcessors() returns the number of logical processors.
+      static CATUInt32 GetNumProcessors();
+
+      /// GetShared() returns the process-wide pool, creating it on first
+      /// use.  Make the first call from the main thread (CATImage does
+      /// so in SetParallel()).
+      static CATWorkPool* GetShared();
+
+      /// InitShared() (re)creates the process-wide pool with a given
+      /// number of workers.  Only needed to override the default from
+      /// GetShared() - e.g. to benchmark different thread counts.  The
+      /// pool must not be in use.
+      ///
+      /// \param numThreads - number of worker threads; 0 for default.
+      static void InitShared(CATUInt32 numThreads = 0);
+
+      /// ReleaseShared() stops and deletes the process-wide pool.  Call
+      /// it on shutdown, once nothing else will use the pool.
+      static void ReleaseShared();
+
+   protected:
+      /// Queued task.  Helper tasks for a ParallelFor() carry the batch
+      /// so they can be pulled back out of the queue.
+      struct Task
+      {
+         CATWORKTASKPROC   proc;
+         void*             param;
+         CATWorkBatch*     batch;
+      };
+
+      /// Worker thread procedure - param is the pool.
+      static void WorkerThread(void* param, CATThread* theThread);
+
+      /// Helper task for ParallelFor() - param is the batch.
+      static void BatchTask(void* param);
+
+      /// RunBatch() pulls chunks from a batch until none are left.
+      static void RunBatch(CATWorkBatch* batch);
+
+      /// Worker loop.
+      void WorkerLoop();
+
+   private:
+      CATWorkPool(const CATWorkPool&);
+      CATWorkPool& operator=(const CATWorkPool&);
+
+      CATThread*           fThreads;         ///< Worker threads
+      CATUInt32            fNumThreads;      ///< Number of workers
+      std::list<Task>      fQueue;           ///< Pending tasks
+      CATCritSec           fLock;            ///< Protects everything below
+      CATSignal            fWorkSignal;      ///< Fired when tasks are queued
+      CATSignal            fIdleSignal;      ///< Fired when queue drains
+      CATInt32             fActive;          ///< Tasks currently running
+      bool                 fStopping;        ///< Set on destruction
+
+      static CATWorkPool*  fSharedPool;      ///< Process-wide pool
+};
+
+#endif // _CATWorkPool_H_
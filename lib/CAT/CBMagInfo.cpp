@@ -10,25 +10,74 @@
 // $Revision: 7 $
 // $NoKeywords: $
 #include "CBMagInfo.h"
+#include "CATWorkPool.h"
+#include "CATCpu.h"
+#include "CATCritSec.h"
+#include "CATSignal.h"
 #include <string.h>
 #include <memory.h>
 #include <math.h>
+#include <algorithm>
+
+#if defined(CAT_CONFIG_SIMD_X86)
+    #include <smmintrin.h>
+    #if defined(CAT_CONFIG_SIMD_AVX2)
+        #include <immintrin.h>
+    #endif
+#endif
+
+// Pixels per span when ProcessImage() repacks rows for the chain
+const int kCBMagSpanSize = 256;
+
+// Tile size for the parallel drivers.  A tile is a whole number of
+// spans wide, and 256x32 RGBA is 32K - it stays in cache with the
+// LUTs while a worker has it.
+const int kCBMagTileWidth  = kCBMagSpanSize;
+const int kCBMagTileHeight = 32;
+
+// Tables that need rebuilding - see TableChanges()
+const int kCBMagDirtyGammaRed    = 0x0001;
+const int kCBMagDirtyGammaGreen  = 0x0002;
+const int kCBMagDirtyGammaBlue   = 0x0004;
+const int kCBMagDirtyGreyRed     = 0x0008;
+const int kCBMagDirtyGreyYellow  = 0x0010;
+const int kCBMagDirtyGreyGreen   = 0x0020;
+const int kCBMagDirtyGreyCyan    = 0x0040;
+const int kCBMagDirtyGreyBlue    = 0x0080;
+const int kCBMagDirtyGreyMagenta = 0x0100;
+const int kCBMagDirtyHue         = 0x0200;
+const int kCBMagDirtySeverity    = 0x0400;
+const int kCBMagDirtyFront       = 0x0800;  // negative / swap - no table, but the 3D LUT
+const int kCBMagDirtyBack        = 0x1000;  // merge - likewise
+const int kCBMagDirtyAll         = 0x1FFF;
+
 //---------------------------------------------------
-// CBMagInfo()
-CBMagInfo::CBMagInfo()
+// CBMagBackBuffer
+//        Second set of tables for SetBackgroundBuild().  They're
+//        built on the work pool, then swapped with the front
+//        ones by CollectBackBuild().  busy and done are
+//        guarded by lock; idle is fired while no build is queued.
+struct CBMagBackBuffer
 {
-    fRedLUT        = fGreenLUT    = fBlueLUT       = 0;
-    fIntLUTRed     = fIntLUTGreen = fIntLUTBlue    = 0;
-    fSatLUTRed     = fSatLUTGreen = fSatLUTBlue    = 0;
-    fIntLUTYellow  = fIntLUTCyan  = fIntLUTMagenta = 0;
-    fSatLUTYellow  = fSatLUTCyan  = fSatLUTMagenta = 0;
-    fHueLUT        = 0;
+    CBMagBackBuffer() : idle(false)
+    {
+        busy = false;
+        done = false;
+        idle.Fire();
+    }
 
-    // Static LUTs
-    fMergeRedLUT = fMergeGreenLUT = fMergeBlueLUT  = 0;
-    fSevLUT      = 0;
-    fGreyRedLUT  = fGreyGreenLUT  = fGreyBlueLUT   = 0;
+    CBMagInfo    tables;
+    CATCritSec   lock;
+    CATSignal    idle;
+    bool         busy;
+    bool         done;
+};
 
+//---------------------------------------------------
+// CBMagInfo()
+CBMagInfo::CBMagInfo()
+{
+    InitMembers();
     SetupDefaults(&this->fInfo);    
     fFileDirty   = true;
     InitLUTs();
@@ -38,16 +87,23 @@ CBMagInfo::CBMagInfo()
 // ~CBMagInfo()
 CBMagInfo::~CBMagInfo()
 {
+    SetBackgroundBuild(false);
     FreeLUTs();
+    Free3DLUT();
 }
 
 //---------------------------------------------------
 // CBMagInfo()
 //        Copy constructors
+//        Start from defaults with the tables allocated, so the
+//        setters the copy runs have something to compare to.
 CBMagInfo::CBMagInfo( const CBMAGINFOSTRUCT& copyStruct)
 {
-    *this = copyStruct;    
+    InitMembers();
+    SetupDefaults(&this->fInfo);    
     InitLUTs();
+
+    *this = copyStruct;    
 }
 
 //---------------------------------------------------
@@ -55,10 +111,627 @@ CBMagInfo::CBMagInfo( const CBMAGINFOSTRUCT& copyStruct)
 //        Copy constructors
 CBMagInfo::CBMagInfo( const CBMagInfo&  copyInfo  )
 {
-    *this = copyInfo;    
+    InitMembers();
+    SetupDefaults(&this->fInfo);    
     InitLUTs();
+
+    *this = copyInfo;    
+}
+
+//---------------------------------------------------
+// InitMembers
+//        Clears the table pointers and runtime options.
+//        Constructors call it first.
+void CBMagInfo::InitMembers()
+{
+    fRedLUT        = fGreenLUT    = fBlueLUT       = 0;
+    fIntLUTRed     = fIntLUTGreen = fIntLUTBlue    = 0;
+    fSatLUTRed     = fSatLUTGreen = fSatLUTBlue    = 0;
+    fIntLUTYellow  = fIntLUTCyan  = fIntLUTMagenta = 0;
+    fSatLUTYellow  = fSatLUTCyan  = fSatLUTMagenta = 0;
+    fHueLUT        = 0;
+
+    // Static LUTs
+    fMergeRedLUT = fMergeGreenLUT = fMergeBlueLUT  = 0;
+    fMergeAllLUT = fSevLUT        = 0;
+    fGreyRedLUT  = fGreyGreenLUT  = fGreyBlueLUT   = 0;
+
+    fStructDirty = true;
+    fTablesBuilt = false;
+    memset(&fBuiltInfo, 0, sizeof(fBuiltInfo));
+
+    // 3D LUT is off until SetLUTMode()
+    fLUTMode     = LUT_NONE;
+    f3DLUT       = f3DFront = 0;
+    f3DSize      = 0;
+    f3DDirty     = f3DFrontDirty = true;
+    fParallel    = false;
+    fBack        = 0;
+}
+
+//---------------------------------------------------
+// ProcessFront
+//        First half of the per-pixel chain - negate, swap, then
+//        hue and grey adjustments in HSI space.  Only depends on
+//        the hue, compress, grey, negative and swap settings, so
+//        the lattice 3D LUTs cache its output.
+xplat_forceinline void CBMagInfo::ProcessFront(unsigned char& r, unsigned char& g, unsigned char& b) const
+{
+    unsigned char tmp = 0;
+
+    // Negate image
+    if (fInfo.fNegative)
+    {
+        b = 255 - b;
+        g = 255 - g;
+        r = 255 -r ;
+    }
+
+    // Swap colors first
+    switch (fInfo.fSwapType)
+    {
+        case SWAP_GREEN_BLUE: tmp = g; g = b; b = tmp; break;
+        case SWAP_RED_BLUE:   tmp = r; r = b; b = tmp; break;
+        case SWAP_RED_GREEN:  tmp = r; r = g; g = tmp; break;
+    }                
+
+    // Integer versions are much mo' faster, 
+    // big thanks to Jace/TBL for posting that info.
+    RGBtoHSI(r,g,b);
+
+    // -------- BIG NOTE - r,g,b are now hue, saturation, and intensity!!!!
+    // They are converted back by HSItoRGB.
+    
+    r = fHueLUT[r];
+
+    // Grey requested colors
+    if ((r < 22) || (r >= 234)) // red
+    {                
+        b = fIntLUTRed[b + g*256];
+        g = fSatLUTRed[g];
+    }            
+    else if (r < 64) // yellow
+    {
+        b = fIntLUTYellow[b + g*256];
+        g = fSatLUTYellow[g];
+    }
+    else if (r < 107) // green
+    {
+        b = fIntLUTGreen[b + g*256];
+        g = fSatLUTGreen[g];
+    }
+    else if (r < 150) // cyan
+    {
+        b = fIntLUTCyan[b + g*256];
+        g = fSatLUTCyan[g];
+    }
+    else if (r < 192) // blue
+    {
+        b = fIntLUTBlue[b + g*256];
+        g = fSatLUTBlue[g];
+    }
+    else // magenta
+    {
+        b = fIntLUTMagenta[b + g*256];
+        g = fSatLUTMagenta[g];
+    }
+
+    HSItoRGB(r,g,b);
+}
+
+//---------------------------------------------------
+// ProcessBack
+//        Second half of the per-pixel chain - gamma / brightness,
+//        then merging.
+xplat_forceinline void CBMagInfo::ProcessBack(unsigned char& r, unsigned char& g, unsigned char& b) const
+{
+    // Process pixel - try to use LUTs as much as possible here
+    // instead of doing the calculations real-time.
+    // 
+    r =   fRedLUT[r];
+    g =   fGreenLUT[g];
+    b =   fBlueLUT[b];
+
+
+    // Merge colors if any of the modes are on.
+    switch (fInfo.fMergeType)
+    {                
+        case MERGE_Red:     
+            r =  (unsigned char)((int)fSevLUT[r] + fMergeRedLUT[g + b*256]);
+            break;                                                  
+        
+        case MERGE_Green:                         
+            g =  (unsigned char)((int)fSevLUT[g] + fMergeGreenLUT[r + b*256]);                     
+            break;
+        
+        case MERGE_Blue:  
+            b = (unsigned char)((int)fSevLUT[b] + fMergeBlueLUT[r + g*256]); 
+            break;
+        
+        // Can't do a single LUT in easy space, so use LUTs for intensities at least
+        case MERGE_ALL: 
+            {
+                unsigned char grey = fMergeAllLUT[fGreyRedLUT[r] + fGreyGreenLUT[g] + fGreyBlueLUT[b]];
+                r = (unsigned char)(fSevLUT[r]   + grey);
+                g = (unsigned char)(fSevLUT[g] + grey);
+                b = (unsigned char)(fSevLUT[b]  + grey);
+            }
+            break;
+    }
+}
+
+//---------------------------------------------------
+// Lookup3D
+//        Tetrahedral interpolation in a lattice 3D LUT.
+//
+// The cube around the color is split into six tetrahedra along
+// its c000-c111 diagonal.  Sorting the fractions picks one - the
+// walk from c000 to c111 goes along the axis with the largest
+// fraction first - and the color is blended from its four
+// corners.  Weights are out of 255 and always add up to 255.
+//
+// Exact at the corners of the color cube.  Elsewhere it's a blend,
+// so colors close to a hue band edge (or the hue wrap) can come
+// out noticeably off - use LUT_FULL if that matters.
+xplat_forceinline CATUInt32 CBMagInfo::Lookup3D(unsigned char r, unsigned char g, unsigned char b) const
+{
+    const int dr = f3DSize*f3DSize;
+    const int dg = f3DSize;
+    const CATUInt32* c = f3DLUT + f3DBase[r]*dr + f3DBase[g]*dg + f3DBase[b];
+
+    int fr = f3DFrac[r];
+    int fg = f3DFrac[g];
+    int fb = f3DFrac[b];
+
+    // Compares and min/max rather than branches - neighboring
+    // pixels land in different tetrahedra too often to predict.
+    int order = (fr >= fg) | ((fg >= fb) << 1) | ((fr >= fb) << 2);
+    int fMax  = CBMAX(fr, CBMAX(fg, fb));
+    int fMin  = CBMIN(fr, CBMIN(fg, fb));
+    int fMid  = fr + fg + fb - fMax - fMin;
+
+    CATUInt32 w0 = 255 - fMax;
+    CATUInt32 w1 = fMax - fMid;
+    CATUInt32 w2 = fMid - fMin;
+    CATUInt32 w3 = fMin;
+
+    CATUInt32 c0 = c[0];
+    CATUInt32 c1 = c[f3DCorner[order][0]];
+    CATUInt32 c2 = c[f3DCorner[order][1]];
+    CATUInt32 c3 = c[dr + dg + 1];
+
+    // Red and blue ride together in 16-bit lanes - the weights add
+    // up to 255, so neither lane can overflow into the other.
+    CATUInt32 rb = w0*(c0 & 0x00ff00ff) + w1*(c1 & 0x00ff00ff) + 
+                   w2*(c2 & 0x00ff00ff) + w3*(c3 & 0x00ff00ff);
+    CATUInt32 gg = w0*((c0 >> 8) & 0xff) + w1*((c1 >> 8) & 0xff) + 
+                   w2*((c2 >> 8) & 0xff) + w3*((c3 >> 8) & 0xff);
+
+    // Divide each lane by 255, rounded.
+    rb += 0x00800080;
+    rb  = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    gg += 0x80;
+    gg  = (gg + (gg >> 8)) >> 8;
+
+    return rb | (gg << 8);
+}
+
+//---------------------------------------------------
+// ProcessSpan
+//        Runs the chain over a span with the best kernel for
+//        the CPU.
+void CBMagInfo::ProcessSpan(CATUInt32* pixels, int count, unsigned char alpha) const
+{
+#if defined(CAT_CONFIG_SIMD_X86)
+    CATUInt32 cpuFeatures = CATCpuFeatures();
+
+    #if defined(CAT_CONFIG_SIMD_AVX2)
+    // The AVX2 kernel's pshufb and blends need SSE4.1 too.
+    if ((cpuFeatures & (CATCPU_AVX2 | CATCPU_SSE41)) == (CATCPU_AVX2 | CATCPU_SSE41))
+    {
+        ProcessSpan_AVX2(pixels, count, alpha);
+        return;
+    }
+    #endif
+
+    if (cpuFeatures & CATCPU_SSE41)
+    {
+        ProcessSpan_SSE41(pixels, count, alpha);
+        return;
+    }
+#endif
+
+    ProcessSpan_C(pixels, count, alpha);
+}
+
+//---------------------------------------------------
+// ProcessSpan_C
+//        Plain C chain - the SIMD kernels must match this.
+void CBMagInfo::ProcessSpan_C(CATUInt32* pixels, int count, unsigned char alpha) const
+{
+    CATUInt32 a = ((CATUInt32)alpha) << 24;
+
+    for (int x = 0; x < count; x++)
+    {
+        unsigned char r = (unsigned char)(pixels[x] >> 16);
+        unsigned char g = (unsigned char)(pixels[x] >> 8);
+        unsigned char b = (unsigned char)(pixels[x]);
+
+        ProcessFront(r,g,b);
+        ProcessBack(r,g,b);
+
+        pixels[x] = ((CATUInt32)r) | (((CATUInt32)g) << 8) | (((CATUInt32)b) << 16) | a;
+    }
+}
+
+#if defined(CAT_CONFIG_SIMD_X86)
+//---------------------------------------------------
+// SIMD kernels
+//
+// One pixel per 32-bit lane, with the same integer math as
+// RGBtoHSI() and HSItoRGB().  The three divides in RGBtoHSI() are
+// done in float - every dividend is below 2^16, so the truncated
+// float quotient is always the integer one.  Products all fit in
+// 16 bits, so pmullw does for the multiplies.
+//
+// The six-way hue band branch turns into a band number (0-5) that
+// offsets into the packed band LUTs, and the output channel order
+// of HSItoRGB()'s switch into blend masks.
+//---------------------------------------------------
+
+// Base hue sector for RGBtoHSI(), indexed by the compare bits
+// (r>=g)<<2 | (r>=b)<<1 | (g>=b).  Indices 2 and 5 can't happen.
+static const char kCBMagSectors[16] = {3,2,0,1,4,4,5,0, 0,0,0,0,0,0,0,0};
+
+// 65536/6 rounded up - (x * kCBMagDiv6) >> 16 == x/6 for x < 1537
+const int kCBMagDiv6 = 10923;
+
+//---------------------------------------------------
+// CBMagLookup_SSE41
+//        Looks up a LUT entry per lane.  No gathers before AVX2,
+//        so it's four loads.
+CAT_TARGET_SSE41
+static inline __m128i CBMagLookup_SSE41(const unsigned char* lut, __m128i idx)
+{
+    return _mm_setr_epi32(  lut[_mm_cvtsi128_si32(idx)],
+                            lut[_mm_extract_epi32(idx, 1)],
+                            lut[_mm_extract_epi32(idx, 2)],
+                            lut[_mm_extract_epi32(idx, 3)]);
+}
+
+//---------------------------------------------------
+// ProcessSpan_SSE41
+//        Four pixels per step, C for the tail.
+CAT_TARGET_SSE41
+void CBMagInfo::ProcessSpan_SSE41(CATUInt32* pixels, int count, unsigned char alpha) const
+{
+    const __m128i k0        = _mm_setzero_si128();
+    const __m128i k1        = _mm_set1_epi32(1);
+    const __m128i k255      = _mm_set1_epi32(255);
+    const __m128i k256      = _mm_set1_epi32(256);
+    const __m128i kDiv6     = _mm_set1_epi32(kCBMagDiv6);
+    const __m128i kLowByte  = _mm_set1_epi32((int)0x80808000);
+    const __m128i kSectors  = _mm_loadu_si128((const __m128i*)kCBMagSectors);
+    const __m128i a         = _mm_set1_epi32((int)(((CATUInt32)alpha) << 24));
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4)
+    {
+        __m128i pix = _mm_loadu_si128((const __m128i*)(pixels + x));
+        __m128i r   = _mm_and_si128(_mm_srli_epi32(pix, 16), k255);
+        __m128i g   = _mm_and_si128(_mm_srli_epi32(pix, 8),  k255);
+        __m128i b   = _mm_and_si128(pix, k255);
+        __m128i tmp;
+
+        // Negate image
+        if (fInfo.fNegative)
+        {
+            r = _mm_xor_si128(r, k255);
+            g = _mm_xor_si128(g, k255);
+            b = _mm_xor_si128(b, k255);
+        }
+
+        // Swap colors first
+        switch (fInfo.fSwapType)
+        {
+            case SWAP_GREEN_BLUE: tmp = g; g = b; b = tmp; break;
+            case SWAP_RED_BLUE:   tmp = r; r = b; b = tmp; break;
+            case SWAP_RED_GREEN:  tmp = r; r = g; g = tmp; break;
+        }                
+
+        // RGBtoHSI
+        __m128i sector  = _mm_or_si128( _mm_or_si128(
+                                _mm_andnot_si128(_mm_cmpgt_epi32(g, r), _mm_set1_epi32(4)),
+                                _mm_andnot_si128(_mm_cmpgt_epi32(b, r), _mm_set1_epi32(2))),
+                                _mm_andnot_si128(_mm_cmpgt_epi32(b, g), k1));
+        sector          = _mm_shuffle_epi8(kSectors, _mm_or_si128(sector, kLowByte));
+
+        __m128i maxVal  = _mm_max_epi32(r, _mm_max_epi32(g, b));
+        __m128i minVal  = _mm_min_epi32(r, _mm_min_epi32(g, b));
+        __m128i midVal  = _mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(r, g), b), 
+                                        _mm_add_epi32(maxVal, minVal));
+        __m128i grey    = _mm_cmpeq_epi32(maxVal, minVal);
+
+        // Greys would divide by zero, but their hue and sat get masked off.
+        __m128  maxF    = _mm_cvtepi32_ps(_mm_max_epi32(maxVal, k1));
+        __m128  rangeF  = _mm_cvtepi32_ps(_mm_max_epi32(_mm_sub_epi32(maxVal, minVal), k1));
+
+        __m128i sat     = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_slli_epi32(minVal, 8)), maxF));
+        sat             = _mm_sub_epi32(k255, sat);
+
+        tmp             = _mm_mullo_epi16(maxVal, _mm_sub_epi32(maxVal, midVal));
+        midVal          = _mm_sub_epi32(maxVal, _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(tmp), rangeF)));
+        tmp             = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_slli_epi32(midVal, 8)), maxF));
+        tmp             = _mm_blendv_epi8(tmp, _mm_sub_epi32(k256, tmp), _mm_cmpeq_epi32(_mm_and_si128(sector, k1), k1));
+
+        __m128i hue     = _mm_mulhi_epu16(_mm_add_epi32(_mm_slli_epi32(sector, 8), tmp), kDiv6);
+        hue             = _mm_andnot_si128(grey, _mm_and_si128(hue, k255));
+        sat             = _mm_andnot_si128(grey, sat);
+        __m128i inten   = maxVal;
+
+        // Hue and grey adjustments - band 0-5 is red, yellow, green,
+        // cyan, blue, magenta, with red wrapping around at the top.
+        hue             = CBMagLookup_SSE41(fHueLUT, hue);
+
+        __m128i band    = k0;
+        band            = _mm_sub_epi32(band, _mm_cmpgt_epi32(hue, _mm_set1_epi32(21)));
+        band            = _mm_sub_epi32(band, _mm_cmpgt_epi32(hue, _mm_set1_epi32(63)));
+        band            = _mm_sub_epi32(band, _mm_cmpgt_epi32(hue, _mm_set1_epi32(106)));
+        band            = _mm_sub_epi32(band, _mm_cmpgt_epi32(hue, _mm_set1_epi32(149)));
+        band            = _mm_sub_epi32(band, _mm_cmpgt_epi32(hue, _mm_set1_epi32(191)));
+        band            = _mm_andnot_si128(_mm_cmpgt_epi32(hue, _mm_set1_epi32(233)), band);
+
+        inten           = CBMagLookup_SSE41(fIntLUTRed, _mm_add_epi32(_mm_slli_epi32(band, 16), 
+                                                        _mm_add_epi32(_mm_slli_epi32(sat, 8), inten)));
+        sat             = CBMagLookup_SSE41(fSatLUTRed, _mm_add_epi32(_mm_slli_epi32(band, 8), sat));
+
+        // HSItoRGB
+        hue             = _mm_mullo_epi16(hue, _mm_set1_epi32(6));
+        maxVal          = inten;
+        minVal          = _mm_srli_epi32(_mm_mullo_epi16(maxVal, _mm_sub_epi32(k256, sat)), 8);
+        midVal          = _mm_srli_epi32(_mm_mullo_epi16(_mm_add_epi32(_mm_and_si128(hue, k255), k1), maxVal), 8);
+        midVal          = _mm_blendv_epi8(midVal, _mm_sub_epi32(maxVal, midVal), _mm_cmpeq_epi32(_mm_and_si128(hue, k256), k256));
+        midVal          = _mm_sub_epi32(maxVal, _mm_srli_epi32(_mm_mullo_epi16(_mm_sub_epi32(maxVal, midVal), _mm_add_epi32(sat, k1)), 8));
+        sector          = _mm_srli_epi32(hue, 8);
+
+        __m128i s0      = _mm_cmpeq_epi32(sector, k0);
+        __m128i s1      = _mm_cmpeq_epi32(sector, k1);
+        __m128i s2      = _mm_cmpeq_epi32(sector, _mm_set1_epi32(2));
+        __m128i s3      = _mm_cmpeq_epi32(sector, _mm_set1_epi32(3));
+        __m128i s4      = _mm_cmpeq_epi32(sector, _mm_set1_epi32(4));
+        __m128i s5      = _mm_cmpeq_epi32(sector, _mm_set1_epi32(5));
+
+        r = _mm_blendv_epi8(_mm_blendv_epi8(minVal, midVal, _mm_or_si128(s1, s4)), maxVal, _mm_or_si128(s0, s5));
+        g = _mm_blendv_epi8(_mm_blendv_epi8(minVal, midVal, _mm_or_si128(s0, s3)), maxVal, _mm_or_si128(s1, s2));
+        b = _mm_blendv_epi8(_mm_blendv_epi8(minVal, midVal, _mm_or_si128(s2, s5)), maxVal, _mm_or_si128(s3, s4));
+
+        // Gamma / brightness
+        r = CBMagLookup_SSE41(fRedLUT,   r);
+        g = CBMagLookup_SSE41(fGreenLUT, g);
+        b = CBMagLookup_SSE41(fBlueLUT,  b);
+
+        // Merge colors if any of the modes are on.
+        switch (fInfo.fMergeType)
+        {
+            case MERGE_Red:
+                tmp = CBMagLookup_SSE41(fMergeRedLUT, _mm_add_epi32(g, _mm_slli_epi32(b, 8)));
+                r   = _mm_and_si128(_mm_add_epi32(CBMagLookup_SSE41(fSevLUT, r), tmp), k255);
+                break;
+
+            case MERGE_Green:
+                tmp = CBMagLookup_SSE41(fMergeGreenLUT, _mm_add_epi32(r, _mm_slli_epi32(b, 8)));
+                g   = _mm_and_si128(_mm_add_epi32(CBMagLookup_SSE41(fSevLUT, g), tmp), k255);
+                break;
+
+            case MERGE_Blue:
+                tmp = CBMagLookup_SSE41(fMergeBlueLUT, _mm_add_epi32(r, _mm_slli_epi32(g, 8)));
+                b   = _mm_and_si128(_mm_add_epi32(CBMagLookup_SSE41(fSevLUT, b), tmp), k255);
+                break;
+
+            case MERGE_ALL:
+                tmp = _mm_add_epi32(_mm_add_epi32(  CBMagLookup_SSE41(fGreyRedLUT,   r), 
+                                                    CBMagLookup_SSE41(fGreyGreenLUT, g)), 
+                                                    CBMagLookup_SSE41(fGreyBlueLUT,  b));
+                tmp = CBMagLookup_SSE41(fMergeAllLUT, tmp);
+                r   = _mm_and_si128(_mm_add_epi32(CBMagLookup_SSE41(fSevLUT, r), tmp), k255);
+                g   = _mm_and_si128(_mm_add_epi32(CBMagLookup_SSE41(fSevLUT, g), tmp), k255);
+                b   = _mm_and_si128(_mm_add_epi32(CBMagLookup_SSE41(fSevLUT, b), tmp), k255);
+                break;
+        }
+
+        pix = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), a));
+        _mm_storeu_si128((__m128i*)(pixels + x), pix);
+    }
+
+    if (x < count)
+    {
+        ProcessSpan_C(pixels + x, count - x, alpha);
+    }
 }
 
+#if defined(CAT_CONFIG_SIMD_AVX2)
+//---------------------------------------------------
+// CBMagLookup_AVX2
+//        Gathers a LUT entry per lane.  The gather reads 4 bytes
+//        at each entry - the LUTs have kCBMagLUTPad bytes of slack
+//        past their last one.
+CAT_TARGET_AVX2
+static inline __m256i CBMagLookup_AVX2(const unsigned char* lut, __m256i idx)
+{
+    return _mm256_and_si256(_mm256_i32gather_epi32((const int*)lut, idx, 1), _mm256_set1_epi32(255));
+}
+
+//---------------------------------------------------
+// ProcessSpan_AVX2
+//        Same as the SSE4.1 kernel, eight pixels per step.
+CAT_TARGET_AVX2
+void CBMagInfo::ProcessSpan_AVX2(CATUInt32* pixels, int count, unsigned char alpha) const
+{
+    const __m256i k0        = _mm256_setzero_si256();
+    const __m256i k1        = _mm256_set1_epi32(1);
+    const __m256i k255      = _mm256_set1_epi32(255);
+    const __m256i k256      = _mm256_set1_epi32(256);
+    const __m256i kDiv6     = _mm256_set1_epi32(kCBMagDiv6);
+    const __m256i kLowByte  = _mm256_set1_epi32((int)0x80808000);
+    const __m256i kSectors  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)kCBMagSectors));
+    const __m256i a         = _mm256_set1_epi32((int)(((CATUInt32)alpha) << 24));
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8)
+    {
+        __m256i pix = _mm256_loadu_si256((const __m256i*)(pixels + x));
+        __m256i r   = _mm256_and_si256(_mm256_srli_epi32(pix, 16), k255);
+        __m256i g   = _mm256_and_si256(_mm256_srli_epi32(pix, 8),  k255);
+        __m256i b   = _mm256_and_si256(pix, k255);
+        __m256i tmp;
+
+        // Negate image
+        if (fInfo.fNegative)
+        {
+            r = _mm256_xor_si256(r, k255);
+            g = _mm256_xor_si256(g, k255);
+            b = _mm256_xor_si256(b, k255);
+        }
+
+        // Swap colors first
+        switch (fInfo.fSwapType)
+        {
+            case SWAP_GREEN_BLUE: tmp = g; g = b; b = tmp; break;
+            case SWAP_RED_BLUE:   tmp = r; r = b; b = tmp; break;
+            case SWAP_RED_GREEN:  tmp = r; r = g; g = tmp; break;
+        }                
+
+        // RGBtoHSI
+        __m256i sector  = _mm256_or_si256( _mm256_or_si256(
+                                _mm256_andnot_si256(_mm256_cmpgt_epi32(g, r), _mm256_set1_epi32(4)),
+                                _mm256_andnot_si256(_mm256_cmpgt_epi32(b, r), _mm256_set1_epi32(2))),
+                                _mm256_andnot_si256(_mm256_cmpgt_epi32(b, g), k1));
+        sector          = _mm256_shuffle_epi8(kSectors, _mm256_or_si256(sector, kLowByte));
+
+        __m256i maxVal  = _mm256_max_epi32(r, _mm256_max_epi32(g, b));
+        __m256i minVal  = _mm256_min_epi32(r, _mm256_min_epi32(g, b));
+        __m256i midVal  = _mm256_sub_epi32(_mm256_add_epi32(_mm256_add_epi32(r, g), b), 
+                                           _mm256_add_epi32(maxVal, minVal));
+        __m256i grey    = _mm256_cmpeq_epi32(maxVal, minVal);
+
+        // Greys would divide by zero, but their hue and sat get masked off.
+        __m256  maxF    = _mm256_cvtepi32_ps(_mm256_max_epi32(maxVal, k1));
+        __m256  rangeF  = _mm256_cvtepi32_ps(_mm256_max_epi32(_mm256_sub_epi32(maxVal, minVal), k1));
+
+        __m256i sat     = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_slli_epi32(minVal, 8)), maxF));
+        sat             = _mm256_sub_epi32(k255, sat);
+
+        tmp             = _mm256_mullo_epi16(maxVal, _mm256_sub_epi32(maxVal, midVal));
+        midVal          = _mm256_sub_epi32(maxVal, _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(tmp), rangeF)));
+        tmp             = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(_mm256_slli_epi32(midVal, 8)), maxF));
+        tmp             = _mm256_blendv_epi8(tmp, _mm256_sub_epi32(k256, tmp), _mm256_cmpeq_epi32(_mm256_and_si256(sector, k1), k1));
+
+        __m256i hue     = _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_slli_epi32(sector, 8), tmp), kDiv6);
+        hue             = _mm256_andnot_si256(grey, _mm256_and_si256(hue, k255));
+        sat             = _mm256_andnot_si256(grey, sat);
+        __m256i inten   = maxVal;
+
+        // Hue and grey adjustments
+        hue             = CBMagLookup_AVX2(fHueLUT, hue);
+
+        __m256i band    = k0;
+        band            = _mm256_sub_epi32(band, _mm256_cmpgt_epi32(hue, _mm256_set1_epi32(21)));
+        band            = _mm256_sub_epi32(band, _mm256_cmpgt_epi32(hue, _mm256_set1_epi32(63)));
+        band            = _mm256_sub_epi32(band, _mm256_cmpgt_epi32(hue, _mm256_set1_epi32(106)));
+        band            = _mm256_sub_epi32(band, _mm256_cmpgt_epi32(hue, _mm256_set1_epi32(149)));
+        band            = _mm256_sub_epi32(band, _mm256_cmpgt_epi32(hue, _mm256_set1_epi32(191)));
+        band            = _mm256_andnot_si256(_mm256_cmpgt_epi32(hue, _mm256_set1_epi32(233)), band);
+
+        inten           = CBMagLookup_AVX2(fIntLUTRed, _mm256_add_epi32(_mm256_slli_epi32(band, 16), 
+                                                       _mm256_add_epi32(_mm256_slli_epi32(sat, 8), inten)));
+        sat             = CBMagLookup_AVX2(fSatLUTRed, _mm256_add_epi32(_mm256_slli_epi32(band, 8), sat));
+
+        // HSItoRGB
+        hue             = _mm256_mullo_epi16(hue, _mm256_set1_epi32(6));
+        maxVal          = inten;
+        minVal          = _mm256_srli_epi32(_mm256_mullo_epi16(maxVal, _mm256_sub_epi32(k256, sat)), 8);
+        midVal          = _mm256_srli_epi32(_mm256_mullo_epi16(_mm256_add_epi32(_mm256_and_si256(hue, k255), k1), maxVal), 8);
+        midVal          = _mm256_blendv_epi8(midVal, _mm256_sub_epi32(maxVal, midVal), _mm256_cmpeq_epi32(_mm256_and_si256(hue, k256), k256));
+        midVal          = _mm256_sub_epi32(maxVal, _mm256_srli_epi32(_mm256_mullo_epi16(_mm256_sub_epi32(maxVal, midVal), _mm256_add_epi32(sat, k1)), 8));
+        sector          = _mm256_srli_epi32(hue, 8);
+
+        __m256i s0      = _mm256_cmpeq_epi32(sector, k0);
+        __m256i s1      = _mm256_cmpeq_epi32(sector, k1);
+        __m256i s2      = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(2));
+        __m256i s3      = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(3));
+        __m256i s4      = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(4));
+        __m256i s5      = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(5));
+
+        r = _mm256_blendv_epi8(_mm256_blendv_epi8(minVal, midVal, _mm256_or_si256(s1, s4)), maxVal, _mm256_or_si256(s0, s5));
+        g = _mm256_blendv_epi8(_mm256_blendv_epi8(minVal, midVal, _mm256_or_si256(s0, s3)), maxVal, _mm256_or_si256(s1, s2));
+        b = _mm256_blendv_epi8(_mm256_blendv_epi8(minVal, midVal, _mm256_or_si256(s2, s5)), maxVal, _mm256_or_si256(s3, s4));
+
+        // Gamma / brightness
+        r = CBMagLookup_AVX2(fRedLUT,   r);
+        g = CBMagLookup_AVX2(fGreenLUT, g);
+        b = CBMagLookup_AVX2(fBlueLUT,  b);
+
+        // Merge colors if any of the modes are on.
+        switch (fInfo.fMergeType)
+        {
+            case MERGE_Red:
+                tmp = CBMagLookup_AVX2(fMergeRedLUT, _mm256_add_epi32(g, _mm256_slli_epi32(b, 8)));
+                r   = _mm256_and_si256(_mm256_add_epi32(CBMagLookup_AVX2(fSevLUT, r), tmp), k255);
+                break;
+
+            case MERGE_Green:
+                tmp = CBMagLookup_AVX2(fMergeGreenLUT, _mm256_add_epi32(r, _mm256_slli_epi32(b, 8)));
+                g   = _mm256_and_si256(_mm256_add_epi32(CBMagLookup_AVX2(fSevLUT, g), tmp), k255);
+                break;
+
+            case MERGE_Blue:
+                tmp = CBMagLookup_AVX2(fMergeBlueLUT, _mm256_add_epi32(r, _mm256_slli_epi32(g, 8)));
+                b   = _mm256_and_si256(_mm256_add_epi32(CBMagLookup_AVX2(fSevLUT, b), tmp), k255);
+                break;
+
+            case MERGE_ALL:
+                tmp = _mm256_add_epi32(_mm256_add_epi32(CBMagLookup_AVX2(fGreyRedLUT,   r), 
+                                                        CBMagLookup_AVX2(fGreyGreenLUT, g)), 
+                                                        CBMagLookup_AVX2(fGreyBlueLUT,  b));
+                tmp = CBMagLookup_AVX2(fMergeAllLUT, tmp);
+                r   = _mm256_and_si256(_mm256_add_epi32(CBMagLookup_AVX2(fSevLUT, r), tmp), k255);
+                g   = _mm256_and_si256(_mm256_add_epi32(CBMagLookup_AVX2(fSevLUT, g), tmp), k255);
+                b   = _mm256_and_si256(_mm256_add_epi32(CBMagLookup_AVX2(fSevLUT, b), tmp), k255);
+                break;
+        }
+
+        pix = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), a));
+        _mm256_storeu_si256((__m256i*)(pixels + x), pix);
+    }
+
+    if (x < count)
+    {
+        ProcessSpan_C(pixels + x, count - x, alpha);
+    }
+}
+#endif // CAT_CONFIG_SIMD_AVX2
+#endif // CAT_CONFIG_SIMD_X86
+
+//---------------------------------------------------
+// CBMagTileJob
+//        One tiled ProcessImage() or ProcessSwapRGBA() call,
+//        handed to ProcessTileRange() on the work pool.
+//        rgbBuffer is 0 for ProcessSwapRGBA().
+struct CBMagTileJob
+{
+    const CBMagInfo*   info;
+    unsigned char*     rgbBuffer;
+    int                imgWidth;
+    int                pixWidth;
+    CATImageRows       rows;
+    unsigned char      alpha;
+    int                xOff;
+    int                yOff;
+    int                procWidth;
+    int                procHeight;
+    int                tilesAcross;
+};
+
 //---------------------------------------------------
 // ProcessImage
 //        Main processing function
@@ -88,164 +761,103 @@ void CBMagInfo::ProcessImage    (    unsigned char*        rgbBuffer,
                                      int                   procHeight,
 												 bool						  skipAlpha)
 {
-    int x,y;
-
     // Rebuild our lookup tables if something has changed.
-    if (this->fStructDirty)
-    {
-        BuildLookupTables();
-    }
+    // Always done here, before any tiles go out - the tiles
+    // only read them.
+    UpdateTables();
     
-    // per pixel for now - optimize into SIMD-type stuff
-    // later as much as possible per platform.
-    unsigned char tmp = 0;
-
-    unsigned char* srcPtr;
-    unsigned char* dstPtr;
-
 	 int pixWidth = 3;
 	 if (skipAlpha)
 		 pixWidth++;
 
-    // offset from end of one line to beginning of next
-    int step = (imgWidth*pixWidth) - (procWidth*pixWidth);
+    if ((procWidth <= 0) || (procHeight <= 0))
+    {
+        return;
+    }
+
+    if (!fParallel)
+    {
+        ProcessRect(rgbBuffer, imgWidth, xOff, yOff, procWidth, procHeight, pixWidth);
+        return;
+    }
 
-    // Starting points in buffer
-    srcPtr = rgbBuffer + ((yOff)*imgWidth*pixWidth) + xOff*pixWidth;
-    dstPtr = srcPtr;
+    CBMagTileJob job;
+    job.info        = this;
+    job.rgbBuffer   = rgbBuffer;
+    job.imgWidth    = imgWidth;
+    job.pixWidth    = pixWidth;
+    job.alpha       = 0;
+    job.xOff        = xOff;
+    job.yOff        = yOff;
+    job.procWidth   = procWidth;
+    job.procHeight  = procHeight;
+    job.tilesAcross = (procWidth + kCBMagTileWidth - 1) / kCBMagTileWidth;
 
-    // convert to DWORD widths.    
+    int tilesDown   = (procHeight + kCBMagTileHeight - 1) / kCBMagTileHeight;
+    CATWorkPool::GetShared()->ParallelFor(job.tilesAcross * tilesDown, 1, ProcessTileRange, &job);
+}
+
+//---------------------------------------------------
+// ProcessRect
+//        ProcessImage() on the calling thread.  pixWidth is
+//        3 for B,G,R or 4 for B,G,R,X.
+void CBMagInfo::ProcessRect     (    unsigned char*        rgbBuffer,
+                                     int                   imgWidth,
+                                     int                   xOff,
+                                     int                   yOff,
+                                     int                   procWidth,
+                                     int                   procHeight,
+                                     int                   pixWidth) const
+{
+    int x,y;
+
+    // Chain runs on spans of packed pixels
+    CATUInt32 span[kCBMagSpanSize];
 
     for (y = yOff; y < yOff + procHeight; y++)
     {
+        unsigned char* rowPtr = rgbBuffer + (y*imgWidth + xOff)*pixWidth;
 
-        for (x = 0; x < procWidth; x++)
+        for (int spanX = 0; spanX < procWidth; spanX += kCBMagSpanSize)
         {
-            // Get pixel            
-            unsigned char r,g,b;
-            short bg;
-            // get two in one... it'd be better to do 4, but ah well...
-            bg = *(short*)srcPtr;            
-            b = (unsigned char)(bg);
-            g = (unsigned char)(bg >> 8);
-            
-            ++srcPtr;
-            ++srcPtr;
-            
-            r = *srcPtr;
-            
-				++srcPtr;
-            
-				if (skipAlpha)
-					++srcPtr;
+            int            count  = CBMIN(kCBMagSpanSize, procWidth - spanX);
+            unsigned char* pixPtr = rowPtr + spanX*pixWidth;
 
-            // Negate image
-            if (fInfo.fNegative)
+            for (x = 0; x < count; x++, pixPtr += pixWidth)
             {
-                b = 255 - b;
-                g = 255 - g;
-                r = 255 -r ;
+                span[x] = (pixPtr[2] << 16) | (pixPtr[1] << 8) | pixPtr[0];
             }
 
-            // Swap colors first
-            switch (fInfo.fSwapType)
+            if (fLUTMode == LUT_FULL)
             {
-                case SWAP_GREEN_BLUE: tmp = g; g = b; b = tmp; break;
-                case SWAP_RED_BLUE:   tmp = r; r = b; b = tmp; break;
-                case SWAP_RED_GREEN:  tmp = r; r = g; g = tmp; break;
-            }                
-
-            // Integer versions are much mo' faster, 
-            // big thanks to Jace/TBL for posting that info.
-            RGBtoHSI(r,g,b);
-
-            // -------- BIG NOTE - r,g,b are now hue, saturation, and intensity!!!!
-            // They are converted back by HSItoRGB.
-            
-            r = fHueLUT[r];
-
-            // Grey requested colors
-            if ((r < 22) || (r >= 234)) // red
-            {                
-                b = fIntLUTRed[b + g*256];
-                g = fSatLUTRed[g];
-            }            
-            else if (r < 64) // yellow
-            {
-                b = fIntLUTYellow[b + g*256];
-                g = fSatLUTYellow[g];
-            }
-            else if (r < 107) // green
-            {
-                b = fIntLUTGreen[b + g*256];
-                g = fSatLUTGreen[g];
+                for (x = 0; x < count; x++)
+                {
+                    span[x] = f3DLUT[span[x]];
+                }
             }
-            else if (r < 150) // cyan
+            else if (fLUTMode != LUT_NONE)
             {
-                b = fIntLUTCyan[b + g*256];
-                g = fSatLUTCyan[g];
+                for (x = 0; x < count; x++)
+                {
+                    span[x] = Lookup3D( (unsigned char)(span[x] >> 16), 
+                                        (unsigned char)(span[x] >> 8), 
+                                        (unsigned char)(span[x]));
+                }
             }
-            else if (r < 192) // blue
+            else
             {
-                b = fIntLUTBlue[b + g*256];
-                g = fSatLUTBlue[g];
+                ProcessSpan(span, count, 0);
             }
-            else // magenta
-            {
-                b = fIntLUTMagenta[b + g*256];
-                g = fSatLUTMagenta[g];
-            }
-
-            HSItoRGB(r,g,b);
 
-            // Process pixel - try to use LUTs as much as possible here
-            // instead of doing the calculations real-time.
-            // 
-            r =   fRedLUT[r];
-            g =   fGreenLUT[g];
-            b =   fBlueLUT[b];
-
-
-            // Merge colors if any of the modes are on.
-            switch (fInfo.fMergeType)
-            {                
-                case MERGE_Red:     
-                    r =  (unsigned char)((int)fSevLUT[r] + fMergeRedLUT[g + b*256]);
-                    break;                                                  
-                
-                case MERGE_Green:                         
-                    g =  (unsigned char)((int)fSevLUT[g] + fMergeGreenLUT[r + b*256]);                     
-                    break;
-                
-                case MERGE_Blue:  
-                    b = (unsigned char)((int)fSevLUT[b] + fMergeBlueLUT[r + g*256]); 
-                    break;
-                
-                // Can't do a single LUT in easy space, so use LUTs for intensities at least
-                case MERGE_ALL: 
-                    {
-                        unsigned char grey = (unsigned char)(((unsigned int)fGreyRedLUT[r] + fGreyGreenLUT[g] + fGreyBlueLUT[b]) * fInfo.fSeverity);
-                        r = (unsigned char)(fSevLUT[r]   + grey);
-                        g = (unsigned char)(fSevLUT[g] + grey);
-                        b = (unsigned char)(fSevLUT[b]  + grey);
-                    }
-                    break;
+            // Back out in B,G,R order
+            pixPtr = rowPtr + spanX*pixWidth;
+            for (x = 0; x < count; x++, pixPtr += pixWidth)
+            {
+                pixPtr[0] = (unsigned char)(span[x] >> 16);
+                pixPtr[1] = (unsigned char)(span[x] >> 8);
+                pixPtr[2] = (unsigned char)(span[x]);
             }
-
-            // get two in one... it'd be better to do 4, but ah well...
-            *(short*)dstPtr = ((short)b | (g << 8));
-            ++dstPtr;
-            ++dstPtr;            
-            *dstPtr = r;
-            ++dstPtr;
-
-				if (skipAlpha)
-					++dstPtr;
         }
-
-        // Inc to next line        
-        srcPtr += step;
-        dstPtr += step;
     }
 }
 
@@ -256,133 +868,118 @@ void CBMagInfo::ProcessSwapRGBA (    unsigned char*        buf,
                                      int                   yOff,
 												 unsigned char			  alpha)
 {
-    int x,y;
+    // Buffer is packed - xOff and yOff have never moved the start.
+    CATImageRows rows;
+    rows.data   = buf;
+    rows.stride = imgWidth * 4;
+    rows.width  = imgWidth;
+    rows.height = imgHeight;
+    ProcessSwapRGBA(rows, alpha);
+}
 
+void CBMagInfo::ProcessSwapRGBA (    const CATImageRows&   rows,
+                                     unsigned char         alpha)
+{
     // Rebuild our lookup tables if something has changed.
-    if (this->fStructDirty)
+    UpdateTables();
+
+    if ((rows.width <= 0) || (rows.height <= 0))
     {
-        BuildLookupTables();
+        return;
     }
-    
-    // per pixel for now - optimize into SIMD-type stuff
-    // later as much as possible per platform.
-    unsigned char tmp = 0;
 
-    unsigned char* dstPtr = buf;
-    
-    for (y = yOff; y < yOff + imgHeight; y++)
-    {		  
-        for (x = 0; x < imgWidth; x++)
-        {
-            // Get pixel            
-            unsigned char r,g,b,a;
-            CATUInt32 bg = *(CATUInt32*)dstPtr;            
-            r = (unsigned char)(bg >> 16);
-            g = (unsigned char)(bg >> 8);
-            b = (unsigned char)(bg);
-				a = alpha;
-				
-				
-            // Negate image
-            if (fInfo.fNegative)
-            {
-                b = 255 - b;
-                g = 255 - g;
-                r = 255 -r ;
-            }
+    if (!fParallel)
+    {
+        ProcessRows(rows, alpha);
+        return;
+    }
 
-            // Swap colors first
-            switch (fInfo.fSwapType)
-            {
-                case SWAP_GREEN_BLUE: tmp = g; g = b; b = tmp; break;
-                case SWAP_RED_BLUE:   tmp = r; r = b; b = tmp; break;
-                case SWAP_RED_GREEN:  tmp = r; r = g; g = tmp; break;
-            }                
+    CBMagTileJob job;
+    job.info        = this;
+    job.rgbBuffer   = 0;
+    job.imgWidth    = 0;
+    job.pixWidth    = 4;
+    job.rows        = rows;
+    job.alpha       = alpha;
+    job.xOff        = 0;
+    job.yOff        = 0;
+    job.procWidth   = rows.width;
+    job.procHeight  = rows.height;
+    job.tilesAcross = (rows.width + kCBMagTileWidth - 1) / kCBMagTileWidth;
 
-            // Integer versions are much mo' faster, 
-            // big thanks to Jace/TBL for posting that info.
-            RGBtoHSI(r,g,b);
+    int tilesDown   = (rows.height + kCBMagTileHeight - 1) / kCBMagTileHeight;
+    CATWorkPool::GetShared()->ParallelFor(job.tilesAcross * tilesDown, 1, ProcessTileRange, &job);
+}
 
-            // -------- BIG NOTE - r,g,b are now hue, saturation, and intensity!!!!
-            // They are converted back by HSItoRGB.
-            
-            r = fHueLUT[r];
-
-            // Grey requested colors
-            if ((r < 22) || (r >= 234)) // red
-            {                
-                b = fIntLUTRed[b + g*256];
-                g = fSatLUTRed[g];
-            }            
-            else if (r < 64) // yellow
-            {
-                b = fIntLUTYellow[b + g*256];
-                g = fSatLUTYellow[g];
-            }
-            else if (r < 107) // green
-            {
-                b = fIntLUTGreen[b + g*256];
-                g = fSatLUTGreen[g];
-            }
-            else if (r < 150) // cyan
-            {
-                b = fIntLUTCyan[b + g*256];
-                g = fSatLUTCyan[g];
-            }
-            else if (r < 192) // blue
+//---------------------------------------------------
+// ProcessRows
+//        ProcessSwapRGBA() on the calling thread.
+void CBMagInfo::ProcessRows     (    const CATImageRows&   rows,
+                                     unsigned char         alpha) const
+{
+    int x,y;
+
+    CATUInt32 a = ((CATUInt32)alpha) << 24;
+
+    // Pixels are already in the spans' r<<16 | g<<8 | b order,
+    // and 3D LUT entries in the output order.
+    for (y = 0; y < rows.height; y++)
+    {		  
+        CATUInt32* pixPtr = (CATUInt32*)rows.Row(y);
+
+        if (fLUTMode == LUT_FULL)
+        {
+            for (x = 0; x < rows.width; x++)
             {
-                b = fIntLUTBlue[b + g*256];
-                g = fSatLUTBlue[g];
+                pixPtr[x] = f3DLUT[pixPtr[x] & 0xffffff] | a;
             }
-            else // magenta
+        }
+        else if (fLUTMode != LUT_NONE)
+        {
+            for (x = 0; x < rows.width; x++)
             {
-                b = fIntLUTMagenta[b + g*256];
-                g = fSatLUTMagenta[g];
+                CATUInt32 bg = pixPtr[x];
+                pixPtr[x] = Lookup3D( (unsigned char)(bg >> 16),
+                                      (unsigned char)(bg >> 8),
+                                      (unsigned char)(bg)) | a;
             }
+        }
+        else
+        {
+            ProcessSpan(pixPtr, rows.width, alpha);
+        }
+    }
+}
 
-            HSItoRGB(r,g,b);
-
-            // Process pixel - try to use LUTs as much as possible here
-            // instead of doing the calculations real-time.
-            // 
-            r =   fRedLUT[r];
-            g =   fGreenLUT[g];
-            b =   fBlueLUT[b];
-
-
-            // Merge colors if any of the modes are on.
-            switch (fInfo.fMergeType)
-            {                
-                case MERGE_Red:     
-                    r =  (unsigned char)((int)fSevLUT[r] + fMergeRedLUT[g + b*256]);
-                    break;                                                  
-                
-                case MERGE_Green:                         
-                    g =  (unsigned char)((int)fSevLUT[g] + fMergeGreenLUT[r + b*256]);                     
-                    break;
-                
-                case MERGE_Blue:  
-                    b = (unsigned char)((int)fSevLUT[b] + fMergeBlueLUT[r + g*256]); 
-                    break;
-                
-                // Can't do a single LUT in easy space, so use LUTs for intensities at least
-                case MERGE_ALL: 
-                    {
-                        unsigned char grey = (unsigned char)(((unsigned int)fGreyRedLUT[r] + fGreyGreenLUT[g] + fGreyBlueLUT[b]) * fInfo.fSeverity);
-                        r = (unsigned char)(fSevLUT[r]   + grey);
-                        g = (unsigned char)(fSevLUT[g] + grey);
-                        b = (unsigned char)(fSevLUT[b]  + grey);
-                    }
-                    break;
-            }
+//---------------------------------------------------
+// ProcessTileRange
+//        Runs tiles [start,end) of a CBMagTileJob.  Tiles are
+//        numbered across, then down.
+void CBMagInfo::ProcessTileRange(void* param, CATInt32 start, CATInt32 end)
+{
+    const CBMagTileJob* job = (const CBMagTileJob*)param;
 
-            // get two in one... it'd be better to do 4, but ah well...
-            *(CATUInt32*)dstPtr = ((CATUInt32)r) | 
-					                   (((CATUInt32)g) << 8) |
-											 (((CATUInt32)b) << 16) |
-											 (((CATUInt32)a) << 24);
+    for (CATInt32 tile = start; tile < end; tile++)
+    {
+        int tileX  = (tile % job->tilesAcross) * kCBMagTileWidth;
+        int tileY  = (tile / job->tilesAcross) * kCBMagTileHeight;
+        int width  = CBMIN(kCBMagTileWidth,  job->procWidth  - tileX);
+        int height = CBMIN(kCBMagTileHeight, job->procHeight - tileY);
 
-				dstPtr+=4;
+        if (job->rgbBuffer != 0)
+        {
+            job->info->ProcessRect( job->rgbBuffer, job->imgWidth,
+                                    job->xOff + tileX, job->yOff + tileY,
+                                    width, height, job->pixWidth);
+        }
+        else
+        {
+            CATImageRows tileRows;
+            tileRows.data   = job->rows.Pixel(tileX, tileY);
+            tileRows.stride = job->rows.stride;
+            tileRows.width  = width;
+            tileRows.height = height;
+            job->info->ProcessRows(tileRows, job->alpha);
         }
     }
 }
@@ -495,6 +1092,8 @@ void CBMagInfo::BuildGamma(bool red, bool green, bool blue)
             }
         }
     }
+
+    f3DDirty = true;
 }
 
 
@@ -515,126 +1114,488 @@ void CBMagInfo::BuildGreys(bool buildRed, bool buildYellow, bool buildGreen, boo
         }
     }
 
-    if (buildYellow)
+    if (buildYellow)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            for (j = 0; j < 256; j++)
+            {
+                fIntLUTYellow[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyYellow *0.45f)) / 255);                
+            }
+            fSatLUTYellow[i] = (unsigned char)(i * (1.0f - fInfo.fGreyYellow));
+        }
+    }
+
+    if (buildGreen)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            for (j = 0; j < 256; j++)
+            {
+                fIntLUTGreen[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyGreen * 0.59f)) / 255);
+            }
+            fSatLUTGreen[i] = (unsigned char)(i * (1.0f - fInfo.fGreyGreen));
+        }
+    }
+
+    if (buildCyan)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            for (j = 0; j < 256; j++)
+            {
+                fIntLUTCyan[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyCyan * 0.3f)) / 255);                
+            }
+
+            fSatLUTCyan[i] = (unsigned char)(i * (1.0f - fInfo.fGreyCyan));
+        }
+    }
+
+
+    if (buildBlue)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            for (j = 0; j < 256; j++)
+            {
+                fIntLUTBlue[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyBlue * 0.11f)) /255);                
+            }
+
+            fSatLUTBlue[i] = (unsigned char)(i * (1.0f - fInfo.fGreyBlue));
+        }
+    }
+
+    if (buildMag)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            for (j = 0; j < 256; j++)
+            {
+                fIntLUTMagenta[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyMagenta*0.21f)) /255);
+            }
+            
+            fSatLUTMagenta[i] = (unsigned char)(i * (1.0f - fInfo.fGreyMagenta));
+        }        
+    }
+
+    f3DFrontDirty = true;
+    f3DDirty      = true;
+}
+
+void CBMagInfo::BuildHue()
+{
+    int i;
+    // Build the lookup tables
+    for (i = 0; i < 256; i++)
+    {                
+        // Compress hue space        
+        fHueLUT[i] = (unsigned char)(i * (1.0f - fInfo.fHueCompress));
+        
+        // Wrap around is automatic and fine - it's a circle.        
+        fHueLUT[i] += (unsigned char)(fInfo.fHue*255.0f - 128.0f);
+    }    
+
+    f3DFrontDirty = true;
+    f3DDirty      = true;
+}
+
+void CBMagInfo::BuildSeverity()
+{
+    // Build severity luts
+    for (int i=0; i < 256; i++)
+    {
+        // Severity luts for merging
+        fSevLUT[i]   =  (unsigned char)((1.0f -fInfo.fSeverity)*i);
+
+        // MERGE_ALL grey for a sum of the grey LUTs (at most 254)
+        fMergeAllLUT[i] = (unsigned char)(((unsigned int)i) * fInfo.fSeverity);
+
+        // Setup colorblind conversion LUTs
+        for (int j = 0; j < 256; j++)
+        {
+            // These are the assignments in processing
+            fMergeRedLUT[i + j*256]   =  (unsigned char)(fInfo.fSeverity*((0.59f*i) + (0.11f*j)) * 1.42f);
+            fMergeGreenLUT[i + j*256] =  (unsigned char)(fInfo.fSeverity*((0.3f*i)  + (0.11f*j)) * 2.4f);
+            fMergeBlueLUT[i + j*256]  =  (unsigned char)(fInfo.fSeverity*((0.3f*i)  + (0.59f*j)) * 1.12f);
+            // no lut for fMergeRGB, is 3-dimensional. Maybe LUT the grey conversion though...
+        }
+    }
+
+    f3DDirty = true;
+}
+
+//---------------------------------------------------------------
+// BuildLookupTables()
+//
+//        Lookup table builder - this rebuilds the LUTs for the
+//        ProcessImage() function from the CBMAGINFOSTRUCT.  It's called
+//        automatically if the fStructDirty flag is set and ProcessImage
+//        gets called, but if for some reason this ends up being a long
+//        function you can call it ahead of time to avoid the speed hit
+//        on the first process func.
+//
+void CBMagInfo::BuildLookupTables()
+{
+    int changes = fTablesBuilt ? TableChanges(fBuiltInfo, fInfo) : kCBMagDirtyAll;
+
+    if (changes & (kCBMagDirtyGammaRed | kCBMagDirtyGammaGreen | kCBMagDirtyGammaBlue))
+    {
+        BuildGamma( (changes & kCBMagDirtyGammaRed)   != 0,
+                    (changes & kCBMagDirtyGammaGreen) != 0,
+                    (changes & kCBMagDirtyGammaBlue)  != 0);
+    }
+
+    if (changes & (kCBMagDirtyGreyRed  | kCBMagDirtyGreyYellow | kCBMagDirtyGreyGreen |
+                   kCBMagDirtyGreyCyan | kCBMagDirtyGreyBlue   | kCBMagDirtyGreyMagenta))
+    {
+        BuildGreys( (changes & kCBMagDirtyGreyRed)     != 0,
+                    (changes & kCBMagDirtyGreyYellow)  != 0,
+                    (changes & kCBMagDirtyGreyGreen)   != 0,
+                    (changes & kCBMagDirtyGreyCyan)    != 0,
+                    (changes & kCBMagDirtyGreyBlue)    != 0,
+                    (changes & kCBMagDirtyGreyMagenta) != 0);
+    }
+
+    if (changes & kCBMagDirtyHue)
+    {
+        BuildHue();
+    }
+
+    if (changes & kCBMagDirtySeverity)
+    {
+        BuildSeverity();
+    }
+
+    // No tables for these - the chain reads them from fInfo -
+    // but the 3D LUT has them baked in.
+    if (changes & kCBMagDirtyFront)
+    {
+        f3DFrontDirty = true;
+        f3DDirty      = true;
+    }
+
+    if (changes & kCBMagDirtyBack)
+    {
+        f3DDirty      = true;
+    }
+
+    // Mark structs as clean since we've rebuild from them.
+    fBuiltInfo   = fInfo;
+    fTablesBuilt = true;
+    fStructDirty = false;
+
+    if ((fLUTMode != LUT_NONE) && f3DDirty)
+    {
+        Build3DLUT();
+    }
+}
+
+//---------------------------------------------------------------
+// TableChanges()
+//
+//        Returns the kCBMagDirty* bits for the tables that
+//        would change going from one set of settings to another.
+//
+int CBMagInfo::TableChanges(const CBMAGINFOSTRUCT& from, const CBMAGINFOSTRUCT& to)
+{
+    int changes = 0;
+
+    // Gamma feeds all three channel LUTs
+    if (from.fGamma != to.fGamma)
+    {
+        changes |= kCBMagDirtyGammaRed | kCBMagDirtyGammaGreen | kCBMagDirtyGammaBlue;
+    }
+
+    if (from.fBright_Red   != to.fBright_Red)    changes |= kCBMagDirtyGammaRed;
+    if (from.fBright_Green != to.fBright_Green)  changes |= kCBMagDirtyGammaGreen;
+    if (from.fBright_Blue  != to.fBright_Blue)   changes |= kCBMagDirtyGammaBlue;
+
+    if (from.fGreyRed      != to.fGreyRed)       changes |= kCBMagDirtyGreyRed;
+    if (from.fGreyYellow   != to.fGreyYellow)    changes |= kCBMagDirtyGreyYellow;
+    if (from.fGreyGreen    != to.fGreyGreen)     changes |= kCBMagDirtyGreyGreen;
+    if (from.fGreyCyan     != to.fGreyCyan)      changes |= kCBMagDirtyGreyCyan;
+    if (from.fGreyBlue     != to.fGreyBlue)      changes |= kCBMagDirtyGreyBlue;
+    if (from.fGreyMagenta  != to.fGreyMagenta)   changes |= kCBMagDirtyGreyMagenta;
+
+    if ((from.fHue         != to.fHue) ||
+        (from.fHueCompress != to.fHueCompress))  changes |= kCBMagDirtyHue;
+
+    if (from.fSeverity     != to.fSeverity)      changes |= kCBMagDirtySeverity;
+
+    if ((from.fNegative    != to.fNegative) ||
+        (from.fSwapType    != to.fSwapType))     changes |= kCBMagDirtyFront;
+
+    if (from.fMergeType    != to.fMergeType)     changes |= kCBMagDirtyBack;
+
+    return changes;
+}
+
+//---------------------------------------------------------------
+// UpdateTables()
+//
+//        Brings the tables up to date before a frame.  Without a
+//        back buffer, that's BuildLookupTables() in place.
+//
+//        With one, changes are built in the back buffer while
+//        frames carry on with the front tables.  It can only take
+//        over once the front tables are usable, so the first
+//        build - and the first after a LUT mode change - are
+//        still done in place.
+//
+void CBMagInfo::UpdateTables()
+{
+    if ((fBack != 0) && fTablesBuilt && ((fLUTMode == LUT_NONE) || !f3DDirty))
+    {
+        if (!CollectBackBuild() || !fStructDirty)
+        {
+            return;
+        }
+
+        if (QueueBackBuild())
+        {
+            // A pool with no workers has already run it.
+            CollectBackBuild();
+            return;
+        }
+    }
+
+    if (fStructDirty)
     {
-        for (i = 0; i < 256; i++)
-        {
-            for (j = 0; j < 256; j++)
-            {
-                fIntLUTYellow[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyYellow *0.45f)) / 255);                
-            }
-            fSatLUTYellow[i] = (unsigned char)(i * (1.0f - fInfo.fGreyYellow));
-        }
+        BuildLookupTables();
+    }
+    else if ((fLUTMode != LUT_NONE) && f3DDirty)
+    {
+        Build3DLUT();
     }
+}
 
-    if (buildGreen)
+//---------------------------------------------------------------
+// CollectBackBuild()
+//
+//        Returns false if a background build is still running.
+//        Otherwise swaps in any finished one and returns true.
+//
+bool CBMagInfo::CollectBackBuild()
+{
+    fBack->lock.Wait();
+    bool busy   = fBack->busy;
+    bool done   = fBack->done;
+    fBack->done = false;
+    fBack->lock.Release();
+
+    if (busy)
     {
-        for (i = 0; i < 256; i++)
-        {
-            for (j = 0; j < 256; j++)
-            {
-                fIntLUTGreen[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyGreen * 0.59f)) / 255);
-            }
-            fSatLUTGreen[i] = (unsigned char)(i * (1.0f - fInfo.fGreyGreen));
-        }
+        return false;
     }
 
-    if (buildCyan)
+    if (done)
     {
-        for (i = 0; i < 256; i++)
+        CBMagInfo& back = fBack->tables;
+
+        if (back.fLUTMode == fLUTMode)
         {
-            for (j = 0; j < 256; j++)
-            {
-                fIntLUTCyan[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyCyan * 0.3f)) / 255);                
-            }
+            SwapTables(back);
+        }
 
-            fSatLUTCyan[i] = (unsigned char)(i * (1.0f - fInfo.fGreyCyan));
+        // Settings may have moved on while it was building, or the
+        // LUT mode changed under it - either way, go again.
+        if ((back.fLUTMode != fLUTMode) || (TableChanges(fBuiltInfo, fInfo) != 0))
+        {
+            fStructDirty = true;
         }
     }
 
+    return true;
+}
 
-    if (buildBlue)
-    {
-        for (i = 0; i < 256; i++)
-        {
-            for (j = 0; j < 256; j++)
-            {
-                fIntLUTBlue[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyBlue * 0.11f)) /255);                
-            }
+//---------------------------------------------------------------
+// QueueBackBuild()
+//
+//        Hands the current settings to the back buffer and
+//        queues its BuildLookupTables() on the shared work pool.
+//        The back tables only rebuild what differs from what they
+//        last held, same as the front ones.
+//
+//        Returns false if the back buffer can't take the LUT mode
+//        (e.g. no memory for another LUT_FULL).
+//
+bool CBMagInfo::QueueBackBuild()
+{
+    CBMagInfo& back = fBack->tables;
 
-            fSatLUTBlue[i] = (unsigned char)(i * (1.0f - fInfo.fGreyBlue));
-        }
+    back.fInfo        = fInfo;
+    back.fStructDirty = true;
+    back.SetLUTMode(fLUTMode);
+    if (back.fLUTMode != fLUTMode)
+    {
+        return false;
     }
 
-    if (buildMag)
+    fStructDirty = false;
+
+    fBack->lock.Wait();
+    fBack->busy = true;
+    fBack->lock.Release();
+    fBack->idle.Reset();
+
+    if (CATFAILED(CATWorkPool::GetShared()->QueueTask(BackBuildTask, this)))
     {
-        for (i = 0; i < 256; i++)
-        {
-            for (j = 0; j < 256; j++)
-            {
-                fIntLUTMagenta[i+j*256] = (unsigned char)((i * (255 - j*fInfo.fGreyMagenta*0.21f)) /255);
-            }
-            
-            fSatLUTMagenta[i] = (unsigned char)(i * (1.0f - fInfo.fGreyMagenta));
-        }        
+        BackBuildTask(this);
     }
 
+    return true;
 }
 
-void CBMagInfo::BuildHue()
+//---------------------------------------------------------------
+// BackBuildTask()
+//
+//        Work pool task for QueueBackBuild().  Only touches the
+//        back buffer, so the front tables stay usable meanwhile.
+//
+void CBMagInfo::BackBuildTask(void* param)
 {
-    int i;
-    // Build the lookup tables
-    for (i = 0; i < 256; i++)
-    {                
-        // Compress hue space        
-        fHueLUT[i] = (unsigned char)(i * (1.0f - fInfo.fHueCompress));
-        
-        // Wrap around is automatic and fine - it's a circle.        
-        fHueLUT[i] += (unsigned char)(fInfo.fHue*255.0f - 128.0f);
-    }    
+    CBMagBackBuffer* back = ((CBMagInfo*)param)->fBack;
+
+    back->tables.BuildLookupTables();
+
+    back->lock.Wait();
+    back->busy = false;
+    back->done = true;
+    back->lock.Release();
+    back->idle.Fire();
 }
 
-void CBMagInfo::BuildSeverity()
+//---------------------------------------------------------------
+// SwapTables()
+//
+//        Trades lookup tables, and the state describing them,
+//        with another CBMagInfo.  Both must be in the same LUT
+//        mode, since the lattice steps aren't swapped.
+//
+void CBMagInfo::SwapTables(CBMagInfo& other)
 {
-    // Build severity luts
-    for (int i=0; i < 256; i++)
-    {
-        // Severity luts for merging
-        fSevLUT[i]   =  (unsigned char)((1.0f -fInfo.fSeverity)*i);
+    std::swap(fRedLUT,          other.fRedLUT);
+    std::swap(fGreenLUT,        other.fGreenLUT);
+    std::swap(fBlueLUT,         other.fBlueLUT);
+    std::swap(fIntLUTRed,       other.fIntLUTRed);
+    std::swap(fIntLUTGreen,     other.fIntLUTGreen);
+    std::swap(fIntLUTBlue,      other.fIntLUTBlue);
+    std::swap(fIntLUTYellow,    other.fIntLUTYellow);
+    std::swap(fIntLUTCyan,      other.fIntLUTCyan);
+    std::swap(fIntLUTMagenta,   other.fIntLUTMagenta);
+    std::swap(fSatLUTRed,       other.fSatLUTRed);
+    std::swap(fSatLUTGreen,     other.fSatLUTGreen);
+    std::swap(fSatLUTBlue,      other.fSatLUTBlue);
+    std::swap(fSatLUTYellow,    other.fSatLUTYellow);
+    std::swap(fSatLUTCyan,      other.fSatLUTCyan);
+    std::swap(fSatLUTMagenta,   other.fSatLUTMagenta);
+    std::swap(fHueLUT,          other.fHueLUT);
+    std::swap(fMergeGreenLUT,   other.fMergeGreenLUT);
+    std::swap(fMergeRedLUT,     other.fMergeRedLUT);
+    std::swap(fMergeBlueLUT,    other.fMergeBlueLUT);
+    std::swap(fMergeAllLUT,     other.fMergeAllLUT);
+    std::swap(fSevLUT,          other.fSevLUT);
+    std::swap(fGreyRedLUT,      other.fGreyRedLUT);
+    std::swap(fGreyGreenLUT,    other.fGreyGreenLUT);
+    std::swap(fGreyBlueLUT,     other.fGreyBlueLUT);
+
+    std::swap(fBuiltInfo,       other.fBuiltInfo);
+    std::swap(fTablesBuilt,     other.fTablesBuilt);
+
+    std::swap(f3DLUT,           other.f3DLUT);
+    std::swap(f3DFront,         other.f3DFront);
+    std::swap(f3DDirty,         other.f3DDirty);
+    std::swap(f3DFrontDirty,    other.f3DFrontDirty);
+}
 
-        // Setup colorblind conversion LUTs
-        for (int j = 0; j < 256; j++)
-        {
-            // These are the assignments in processing
-            fMergeRedLUT[i + j*256]   =  (unsigned char)(fInfo.fSeverity*((0.59f*i) + (0.11f*j)) * 1.42f);
-            fMergeGreenLUT[i + j*256] =  (unsigned char)(fInfo.fSeverity*((0.3f*i)  + (0.11f*j)) * 2.4f);
-            fMergeBlueLUT[i + j*256]  =  (unsigned char)(fInfo.fSeverity*((0.3f*i)  + (0.59f*j)) * 1.12f);
-            // no lut for fMergeRGB, is 3-dimensional. Maybe LUT the grey conversion though...
-        }
+//---------------------------------------------------------------
+// Build3DLUT()
+//
+//        Compiles the whole chain into f3DLUT for the current
+//        LUTMODE.  Each r slice is independent, so the slices are
+//        spread across the shared work pool.
+//
+//        The lattice modes keep the front half's output per point
+//        in f3DFront, so if only back settings changed (gamma,
+//        brightness, severity, merge) just ProcessBack() is rerun.
+//        LUT_FULL doesn't - that'd be another 64MB - so it reruns
+//        the whole chain every time.
+//
+void CBMagInfo::Build3DLUT()
+{
+    if ((fLUTMode == LUT_NONE) || (f3DLUT == 0))
+    {
+        return;
     }
+
+    CATWorkPool::GetShared()->ParallelFor(f3DSize, 1, Build3DRange, this);
+
+    f3DFrontDirty = false;
+    f3DDirty      = false;
 }
 
 //---------------------------------------------------------------
-// BuildLookupTables()
+// Build3DRange()
 //
-//        Lookup table builder - this rebuilds the LUTs for the
-//        ProcessImage() function from the CBMAGINFOSTRUCT.  It's called
-//        automatically if the fStructDirty flag is set and ProcessImage
-//        gets called, but if for some reason this ends up being a long
-//        function you can call it ahead of time to avoid the speed hit
-//        on the first process func.
+//        Builds the r slices [start,end) of the 3D LUT.  Each
+//        lattice point i sits at channel value i*255/(size-1),
+//        rounded - so every value for LUT_FULL.
 //
-void CBMagInfo::BuildLookupTables()
+void CBMagInfo::Build3DRange(void* param, CATInt32 start, CATInt32 end)
 {
+    CBMagInfo* info  = (CBMagInfo*)param;
+    const int  size  = info->f3DSize;
+    const int  half  = (size - 1) / 2;
+    const bool front = info->f3DFrontDirty;
 
-    BuildGamma(true,true,true);
-    BuildGreys(true,true,true,true,true,true);
-    BuildHue();
-    BuildSeverity();
+    for (int ri = start; ri < end; ri++)
+    {
+        CATUInt32* entry = info->f3DLUT + ri*size*size;
+        CATUInt32* cache = info->f3DFront ? info->f3DFront + ri*size*size : 0;
 
-    // Mark structs as clean since we've rebuild from them.
-    fStructDirty = false;
+        for (int gi = 0; gi < size; gi++)
+        {
+            // LUT_FULL has no front cache to split at, so its rows
+            // go straight through the span kernels.
+            if (cache == 0)
+            {
+                for (int bi = 0; bi < size; bi++)
+                {
+                    entry[bi] = (ri << 16) | (gi << 8) | bi;
+                }
+
+                info->ProcessSpan(entry, size, 0);
+                entry += size;
+                continue;
+            }
+
+            for (int bi = 0; bi < size; bi++)
+            {
+                unsigned char r,g,b;
+
+                if (front)
+                {
+                    r = (unsigned char)((ri*255 + half) / (size - 1));
+                    g = (unsigned char)((gi*255 + half) / (size - 1));
+                    b = (unsigned char)((bi*255 + half) / (size - 1));
+                    info->ProcessFront(r,g,b);
+
+                    *cache = r | (g << 8) | (b << 16);
+                }
+                else
+                {
+                    r = (unsigned char)(*cache);
+                    g = (unsigned char)(*cache >> 8);
+                    b = (unsigned char)(*cache >> 16);
+                }
+
+                info->ProcessBack(r,g,b);
+
+                *entry++ = r | (g << 8) | (b << 16);
+                ++cache;
+            }
+        }
+    }
 }
 
 //---------------------------------------------------
@@ -697,6 +1658,9 @@ CBMagInfo& CBMagInfo::operator= (const CBMagInfo& copyInfo)
     this->SetOnTop        (    copyInfo.fInfo.fOnTop > 0            );
     this->SetNegative     (    copyInfo.fInfo.fNegative > 0         );
     this->SetSwapType     (    (SWAPTYPE)copyInfo.fInfo.fSwapType   );    
+    this->SetLUTMode      (    copyInfo.fLUTMode                    );
+    this->SetParallel     (    copyInfo.fParallel                   );
+    this->SetBackgroundBuild(  copyInfo.fBack != 0                  );
 
     fFileDirty = copyInfo.fFileDirty;
     return *this;    
@@ -821,6 +1785,11 @@ CBMAGRESULT CBMagInfo::SetOnTop(bool onTop)
 // SetNegative
 CBMAGRESULT CBMagInfo::SetNegative(bool negative)
 {    
+    if ((fInfo.fNegative != 0) != negative)
+    {
+        fStructDirty = true;
+    }
+
     fInfo.fNegative   = negative;
     fFileDirty        = true;    
     return CBMAG_SUCCESS;
@@ -934,7 +1903,7 @@ CBMAGRESULT CBMagInfo::SetGamma(float gamma)
     fInfo.fGamma        = gamma;
     fFileDirty          = true;
     
-    BuildGamma(true,true,true);
+    fStructDirty = true;
 
     return res;
 }
@@ -965,7 +1934,7 @@ CBMAGRESULT CBMagInfo::SetBrightRed(float brightRed)
     fInfo.fBright_Red = brightRed;
     fFileDirty        = true;
     
-    BuildGamma(true,false,false);
+    fStructDirty = true;
 
     return res;
 }
@@ -995,7 +1964,7 @@ CBMAGRESULT CBMagInfo::SetBrightGreen(float brightGreen)
     fInfo.fBright_Green    = brightGreen;
     fFileDirty             = true;
     
-    BuildGamma(false,true,false);
+    fStructDirty = true;
     return res;
 }
 
@@ -1023,7 +1992,7 @@ CBMAGRESULT CBMagInfo::SetBrightBlue(float brightBlue)
     fInfo.fBright_Blue    = brightBlue;
     fFileDirty            = true;
 
-    BuildGamma(false,false,true);
+    fStructDirty = true;
     return res;
 }
 
@@ -1051,7 +2020,7 @@ CBMAGRESULT CBMagInfo::SetHue(float hue)
     fInfo.fHue        = hue;
     fFileDirty        = true;
     
-    BuildHue();
+    fStructDirty = true;
 
     return res;
 }
@@ -1080,7 +2049,7 @@ CBMAGRESULT CBMagInfo::SetSeverity(float severity)
     fInfo.fSeverity = severity;
     fFileDirty      = true;
     
-    BuildSeverity();
+    fStructDirty = true;
     
     return res;
 }
@@ -1109,7 +2078,7 @@ CBMAGRESULT CBMagInfo::SetGreyRed(float addbg2r)
     fInfo.fGreyRed    = addbg2r;    
     fFileDirty        = true;
     
-    BuildGreys(true,false,false,false,false,false);
+    fStructDirty = true;
     return res;
 }
 
@@ -1137,7 +2106,7 @@ CBMAGRESULT CBMagInfo::SetGreyGreen(float addbr2g)
     fInfo.fGreyGreen    = addbr2g;    
     fFileDirty          = true;
     
-    BuildGreys(false,false,true,false,false,false);
+    fStructDirty = true;
 
     return res;
 }
@@ -1166,7 +2135,7 @@ CBMAGRESULT CBMagInfo::SetGreyBlue(float addrg2b)
     fInfo.fGreyBlue        = addrg2b;    
     fFileDirty             = true;
 
-    BuildGreys(false,false,false,false,true,false);
+    fStructDirty = true;
 
     return res;
 }
@@ -1194,7 +2163,7 @@ CBMAGRESULT CBMagInfo::SetGreyYellow(float addbg2r)
     fInfo.fGreyYellow    = addbg2r;    
     fFileDirty           = true;
     
-    BuildGreys(false,true,false,false,false,false);
+    fStructDirty = true;
 
     return res;
 }
@@ -1222,7 +2191,7 @@ CBMAGRESULT CBMagInfo::SetGreyCyan(float addbg2r)
     fInfo.fGreyCyan    = addbg2r;    
     fFileDirty         = true;
     
-    BuildGreys(false,false,false,true,false,false);
+    fStructDirty = true;
     
     return res;
 }
@@ -1250,7 +2219,7 @@ CBMAGRESULT CBMagInfo::SetGreyMagenta(float addbg2r)
     fInfo.fGreyMagenta    = addbg2r;    
     fFileDirty            = true;
     
-    BuildGreys(false,false,false,false,false,true);
+    fStructDirty = true;
     
     return res;
 }
@@ -1280,6 +2249,7 @@ CBMAGRESULT CBMagInfo::SetSwapType(SWAPTYPE swapType)
 
     fInfo.fSwapType    = swapType;
     fFileDirty         = true;    
+    fStructDirty       = true;
 
     return res;
 }
@@ -1307,10 +2277,144 @@ CBMAGRESULT CBMagInfo::SetMergeType(MERGETYPE mergeType)
         
     fInfo.fMergeType = mergeType;
     fFileDirty = true;    
+    fStructDirty = true;
+
+    return res;
+}
+
+//---------------------------------------------------
+// SetLUTMode
+//        Allocates the 3D LUT for the mode.  It's filled in on
+//        the next ProcessImage() or BuildLookupTables().
+//        On failure, drops back to LUT_NONE.
+CBMAGRESULT CBMagInfo::SetLUTMode(LUTMODE lutMode)
+{
+    if (fLUTMode == lutMode)
+        return CBMAG_SUCCESS;
+
+    CBMAGRESULT res = CBMAG_SUCCESS;
+
+    if ((lutMode > LUT_LAST_MODE) || (lutMode < LUT_NONE))
+    {
+        lutMode = LUT_NONE;
+        res = CBMAG_ERR_PARAMETER_OUT_OF_RANGE;
+    }
+
+    Free3DLUT();
+    fLUTMode      = LUT_NONE;
+    f3DFrontDirty = true;
+    f3DDirty      = true;
+
+    int size = 0;
+    switch (lutMode)
+    {
+        case LUT_33:    size = 33;  break;
+        case LUT_65:    size = 65;  break;
+        case LUT_FULL:  size = 256; break;
+        default:        return res;
+    }
+
+    int count = size*size*size;
+    try
+    {
+        if (0 == (f3DLUT = new CATUInt32[count]))
+        {
+            throw CBMAG_ERR_OUT_OF_MEMORY;
+        }
+
+        // No front cache for the full table - see Build3DLUT()
+        if ((size < 256) && (0 == (f3DFront = new CATUInt32[count])))
+        {
+            throw CBMAG_ERR_OUT_OF_MEMORY;
+        }
+    }
+    catch (...)
+    {
+        Free3DLUT();
+        return CBMAG_ERR_OUT_OF_MEMORY;
+    }
 
+    // Lattice cell and position for each channel value.  Pin 255
+    // to the far edge of the last cell rather than a cell past it.
+    for (int i = 0; i < 256; i++)
+    {
+        int pos  = i * (size - 1);
+        int base = CBMIN(pos / 255, size - 2);
+        f3DBase[i] = (unsigned char)base;
+        f3DFrac[i] = (unsigned char)(pos - base*255);
+    }
+
+    // Second and third corners of each tetrahedron, indexed by the
+    // order bits Lookup3D() computes - step along the axis with the
+    // largest fraction, then the middle one.  Ties don't matter,
+    // since the corner they pick gets a weight of 0.
+    static const int kAxes[8][2] = 
+    {
+        {2,1},  // b > g > r
+        {2,0},  // b > r >= g
+        {1,2},  // g >= b > r
+        {0,1},  // can't happen
+        {0,1},  // can't happen
+        {0,2},  // r >= b > g
+        {1,0},  // g > r >= b
+        {0,1},  // r >= g >= b
+    };
+    int step[3] = {size*size, size, 1};
+    for (int order = 0; order < 8; order++)
+    {
+        f3DCorner[order][0] = step[kAxes[order][0]];
+        f3DCorner[order][1] = step[kAxes[order][0]] + step[kAxes[order][1]];
+    }
+
+    f3DSize  = size;
+    fLUTMode = lutMode;
     return res;
 }
 
+//---------------------------------------------------
+// SetParallel
+//        Turns the tiled drivers in ProcessImage() and
+//        ProcessSwapRGBA() on or off.  Like the LUT mode, it's
+//        a runtime option and isn't saved to the file.
+CBMAGRESULT CBMagInfo::SetParallel(bool parallel)
+{
+    fParallel = parallel;
+    return CBMAG_SUCCESS;
+}
+
+//---------------------------------------------------
+// SetBackgroundBuild
+//        Turns the back buffer for table builds on or off -
+//        see UpdateTables().  Turning it off waits for any
+//        build in progress and keeps its result.
+//        Also a runtime option.
+CBMAGRESULT CBMagInfo::SetBackgroundBuild(bool background)
+{
+    if (background == (fBack != 0))
+        return CBMAG_SUCCESS;
+
+    if (background)
+    {
+        try
+        {
+            fBack = new CBMagBackBuffer;
+        }
+        catch (...)
+        {
+            fBack = 0;
+            return CBMAG_ERR_OUT_OF_MEMORY;
+        }
+        return CBMAG_SUCCESS;
+    }
+
+    fBack->idle.Wait();
+    CollectBackBuild();
+
+    delete fBack;
+    fBack = 0;
+    return CBMAG_SUCCESS;
+}
+
 
 //---------------------------------------------------
 // SetCompress
@@ -1337,7 +2441,7 @@ CBMAGRESULT CBMagInfo::SetCompress(float hueCompress)
     fInfo.fHueCompress    = hueCompress;
     fFileDirty            = true;
     
-    BuildHue();
+    fStructDirty = true;
 
     return res;
 }
@@ -1500,6 +2604,27 @@ CBMagInfo::MERGETYPE CBMagInfo::GetMergeType() const
     return (CBMagInfo::MERGETYPE)fInfo.fMergeType;
 }
 
+//---------------------------------------------------
+// GetLUTMode
+CBMagInfo::LUTMODE CBMagInfo::GetLUTMode() const
+{
+    return fLUTMode;
+}
+
+//---------------------------------------------------
+// GetParallel
+bool CBMagInfo::GetParallel() const
+{
+    return fParallel;
+}
+
+//---------------------------------------------------
+// GetBackgroundBuild
+bool CBMagInfo::GetBackgroundBuild() const
+{
+    return (fBack != 0);
+}
+
 
 //---------------------------------------------------
 // GetCompress
@@ -1637,146 +2762,106 @@ void CBMagInfo::InitLUTs()
 
     try
     {
-        if (0 == (fRedLUT   = new unsigned char[256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
-        
-        if (0 == (fGreenLUT = new unsigned char[256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
-
-        if (0 == (fBlueLUT  = new unsigned char[256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
-
-        if (0 == (fGreyRedLUT   = new unsigned char[256]))
+        if (0 == (fRedLUT   = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
         
-        if (0 == (fGreyGreenLUT = new unsigned char[256]))
+        if (0 == (fGreenLUT = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fGreyBlueLUT  = new unsigned char[256]))
+        if (0 == (fBlueLUT  = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-
-        if (0 == (fIntLUTRed = new unsigned char[256*256]))
+        if (0 == (fGreyRedLUT   = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
         
-        if (0 == (fIntLUTGreen = new unsigned char[256*256]))
+        if (0 == (fGreyGreenLUT = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fIntLUTBlue  = new unsigned char[256*256]))
+        if (0 == (fGreyBlueLUT  = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fIntLUTYellow = new unsigned char[256*256]))
+        // The six hue bands' intensity and saturation LUTs each live
+        // in one block, in band order, so the SIMD code can pick a
+        // band with an offset instead of a branch.
+        if (0 == (fIntLUTRed = new unsigned char[kCBMagNumBands*256*256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
         
-        if (0 == (fIntLUTCyan = new unsigned char[256*256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
-
-        if (0 == (fIntLUTMagenta  = new unsigned char[256*256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
+        fIntLUTYellow   = fIntLUTRed + 1*256*256;
+        fIntLUTGreen    = fIntLUTRed + 2*256*256;
+        fIntLUTCyan     = fIntLUTRed + 3*256*256;
+        fIntLUTBlue     = fIntLUTRed + 4*256*256;
+        fIntLUTMagenta  = fIntLUTRed + 5*256*256;
 
-        if (0 == (fSatLUTRed = new unsigned char[256*256]))
+        if (0 == (fSatLUTRed = new unsigned char[kCBMagNumBands*256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
         
-        if (0 == (fSatLUTGreen = new unsigned char[256*256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
+        fSatLUTYellow   = fSatLUTRed + 1*256;
+        fSatLUTGreen    = fSatLUTRed + 2*256;
+        fSatLUTCyan     = fSatLUTRed + 3*256;
+        fSatLUTBlue     = fSatLUTRed + 4*256;
+        fSatLUTMagenta  = fSatLUTRed + 5*256;
 
-        if (0 == (fSatLUTBlue  = new unsigned char[256*256]))
+        if (0 == (fHueLUT  = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fSatLUTYellow = new unsigned char[256*256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
-        
-        if (0 == (fSatLUTCyan = new unsigned char[256*256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
-
-        if (0 == (fSatLUTMagenta  = new unsigned char[256*256]))
-        {
-            throw CBMAG_ERR_OUT_OF_MEMORY;
-        }
 
-        if (0 == (fHueLUT  = new unsigned char[256]))
+        if (0 == (fMergeRedLUT  = new unsigned char[256*256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-
-        if (0 == (fMergeRedLUT  = new unsigned char[256*256]))
+        if (0 == (fMergeGreenLUT  = new unsigned char[256*256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fMergeGreenLUT  = new unsigned char[256*256]))
+        if (0 == (fMergeBlueLUT  = new unsigned char[256*256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fMergeBlueLUT  = new unsigned char[256*256]))
+        if (0 == (fMergeAllLUT  = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        if (0 == (fSevLUT  = new unsigned char[256*256]))
+        if (0 == (fSevLUT  = new unsigned char[256 + kCBMagLUTPad]))
         {
             throw CBMAG_ERR_OUT_OF_MEMORY;
         }
 
-        memset(fRedLUT,0,256);
-        memset(fGreenLUT,0,256);
-        memset(fBlueLUT,0,256);        
-        memset(fGreyRedLUT,0,256);
-        memset(fGreyGreenLUT,0,256);
-        memset(fGreyBlueLUT,0,256);        
-        memset(fIntLUTRed,0,256*256);
-        memset(fIntLUTGreen,0,256*256);
-        memset(fIntLUTBlue,0,256*256);        
-        memset(fIntLUTYellow,0,256*256);
-        memset(fIntLUTCyan,0,256*256);
-        memset(fIntLUTMagenta,0,256*256);        
-        memset(fSatLUTRed,0,256);
-        memset(fSatLUTGreen,0,256);
-        memset(fSatLUTBlue,0,256);        
-        memset(fSatLUTYellow,0,256);
-        memset(fSatLUTCyan,0,256);
-        memset(fSatLUTMagenta,0,256);        
-        memset(fHueLUT,0,256);        
-        memset(fMergeRedLUT,0,256*256);        
-        memset(fMergeGreenLUT,0,256*256);        
-        memset(fMergeBlueLUT,0,256*256);        
-        memset(fSevLUT,0,256*256);        
+        memset(fRedLUT,0,256 + kCBMagLUTPad);
+        memset(fGreenLUT,0,256 + kCBMagLUTPad);
+        memset(fBlueLUT,0,256 + kCBMagLUTPad);        
+        memset(fGreyRedLUT,0,256 + kCBMagLUTPad);
+        memset(fGreyGreenLUT,0,256 + kCBMagLUTPad);
+        memset(fGreyBlueLUT,0,256 + kCBMagLUTPad);        
+        memset(fIntLUTRed,0,kCBMagNumBands*256*256 + kCBMagLUTPad);
+        memset(fSatLUTRed,0,kCBMagNumBands*256 + kCBMagLUTPad);
+        memset(fHueLUT,0,256 + kCBMagLUTPad);        
+        memset(fMergeRedLUT,0,256*256 + kCBMagLUTPad);        
+        memset(fMergeGreenLUT,0,256*256 + kCBMagLUTPad);        
+        memset(fMergeBlueLUT,0,256*256 + kCBMagLUTPad);        
+        memset(fMergeAllLUT,0,256 + kCBMagLUTPad);        
+        memset(fSevLUT,0,256 + kCBMagLUTPad);        
     }        
     catch (...)
     {
@@ -1795,6 +2880,7 @@ void CBMagInfo::InitLUTs()
     }
 
     fStructDirty = true;
+    fTablesBuilt = false;
 }
 
 //---------------------------------------------------
@@ -1804,29 +2890,34 @@ void CBMagInfo::InitLUTs()
 //
 void CBMagInfo::FreeLUTs()
 {
-    if (fRedLUT)        { delete fRedLUT;        fRedLUT        = 0;  }
-    if (fGreenLUT)      { delete fGreenLUT;      fGreenLUT      = 0;  }
-    if (fBlueLUT)       { delete fBlueLUT;       fBlueLUT       = 0;  }
-    if (fGreyRedLUT)    { delete fGreyRedLUT;    fGreyRedLUT    = 0;  }
-    if (fGreyGreenLUT)  { delete fGreyGreenLUT;  fGreyGreenLUT  = 0;  }
-    if (fGreyBlueLUT)   { delete fGreyBlueLUT;   fGreyBlueLUT   = 0;  }
-    if (fIntLUTRed)     { delete fIntLUTRed;     fIntLUTRed     = 0;  }
-    if (fIntLUTGreen)   { delete fIntLUTGreen;   fIntLUTGreen   = 0;  }
-    if (fIntLUTBlue)    { delete fIntLUTBlue;    fIntLUTBlue    = 0;  }
-    if (fIntLUTYellow)  { delete fIntLUTYellow;  fIntLUTYellow  = 0;  }
-    if (fIntLUTCyan)    { delete fIntLUTCyan;    fIntLUTCyan    = 0;  }
-    if (fIntLUTMagenta) { delete fIntLUTMagenta; fIntLUTMagenta = 0;  }
-    if (fSatLUTRed)     { delete fSatLUTRed;     fSatLUTRed     = 0;  }
-    if (fSatLUTGreen)   { delete fSatLUTGreen;   fSatLUTGreen   = 0;  }
-    if (fSatLUTBlue)    { delete fSatLUTBlue;    fSatLUTBlue    = 0;  }
-    if (fSatLUTYellow)  { delete fSatLUTYellow;  fSatLUTYellow  = 0;  }
-    if (fSatLUTCyan)    { delete fSatLUTCyan;    fSatLUTCyan    = 0;  }
-    if (fSatLUTMagenta) { delete fSatLUTMagenta; fSatLUTMagenta = 0;  }
-    if (fHueLUT)        { delete fHueLUT;        fHueLUT        = 0;  }
-    if (fMergeRedLUT)   { delete fMergeRedLUT;   fMergeRedLUT   = 0;  }
-    if (fMergeGreenLUT) { delete fMergeGreenLUT; fMergeGreenLUT = 0;  }
-    if (fMergeBlueLUT)  { delete fMergeBlueLUT;  fMergeBlueLUT  = 0;  }
-    if (fSevLUT)        { delete fSevLUT;        fSevLUT        = 0;  }
+    if (fRedLUT)        { delete [] fRedLUT;        fRedLUT        = 0;  }
+    if (fGreenLUT)      { delete [] fGreenLUT;      fGreenLUT      = 0;  }
+    if (fBlueLUT)       { delete [] fBlueLUT;       fBlueLUT       = 0;  }
+    if (fGreyRedLUT)    { delete [] fGreyRedLUT;    fGreyRedLUT    = 0;  }
+    if (fGreyGreenLUT)  { delete [] fGreyGreenLUT;  fGreyGreenLUT  = 0;  }
+    if (fGreyBlueLUT)   { delete [] fGreyBlueLUT;   fGreyBlueLUT   = 0;  }
+    if (fHueLUT)        { delete [] fHueLUT;        fHueLUT        = 0;  }
+    if (fMergeRedLUT)   { delete [] fMergeRedLUT;   fMergeRedLUT   = 0;  }
+    if (fMergeGreenLUT) { delete [] fMergeGreenLUT; fMergeGreenLUT = 0;  }
+    if (fMergeBlueLUT)  { delete [] fMergeBlueLUT;  fMergeBlueLUT  = 0;  }
+    if (fMergeAllLUT)   { delete [] fMergeAllLUT;   fMergeAllLUT   = 0;  }
+    if (fSevLUT)        { delete [] fSevLUT;        fSevLUT        = 0;  }
+
+    // Band LUTs are one block each, starting at the red band.
+    if (fIntLUTRed)     { delete [] fIntLUTRed;     fIntLUTRed     = 0;  }
+    if (fSatLUTRed)     { delete [] fSatLUTRed;     fSatLUTRed     = 0;  }
+    fIntLUTGreen  = fIntLUTBlue  = fIntLUTYellow  = fIntLUTCyan  = fIntLUTMagenta  = 0;
+    fSatLUTGreen  = fSatLUTBlue  = fSatLUTYellow  = fSatLUTCyan  = fSatLUTMagenta  = 0;
+}
+
+//---------------------------------------------------
+// Free3DLUT
+//    Frees the 3D LUT, if any.
+void CBMagInfo::Free3DLUT()
+{
+    if (f3DLUT)         { delete [] f3DLUT;      f3DLUT         = 0;  }
+    if (f3DFront)       { delete [] f3DFront;    f3DFront       = 0;  }
+    f3DSize = 0;
 }
 
 
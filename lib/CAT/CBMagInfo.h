@@ -35,6 +35,16 @@
 // don't change much - only the ProcessImage() function is worth 
 // optimizing.  The robustness gains seem worthwhile to me.
 //
+// The Set*() functions just mark the lookup tables dirty.  The next
+// ProcessImage() rebuilds only the tables whose settings changed, so
+// dragging one knob doesn't redo all of them every frame.  With
+// SetBackgroundBuild(), even that happens on a worker thread, into a
+// second set of tables that's swapped in when it's done.
+//
+// ProcessImage() can also run from a single 3D LUT - see SetLUTMode().
+// LUT_FULL gives the same output as the per-pixel chain.  The lattice
+// modes interpolate, so colors near a hue band edge may be a bit off.
+//
 // This file is tested under Win32 with Microsoft's Visual C++ 6.0.  
 // I've tried to make it operable for other platforms, but those 
 // functions have not been fully tested.
@@ -45,6 +55,9 @@
 
 #include <stdio.h>
 #include "CATTypes.h"
+#include "CATImageRows.h"
+
+struct CBMagBackBuffer;
 //----------------------------------------------------------------------
 // Constants
 //----------------------------------------------------------------------
@@ -55,6 +68,12 @@ const int kCBMagNameBufferSize = kCBMagMaxNameLength + 1;
 
 // Current version of the structure
 const int kCBMagVersion           = 1;
+
+// Number of hue bands with their own grey LUTs
+const int kCBMagNumBands          = 6;
+
+// Slack after each LUT, so SIMD gathers can read 4 bytes at the last entry
+const int kCBMagLUTPad            = 4;
 // CBMagInfo error / status codes
 enum CBMAGRESULT
 {
@@ -186,6 +205,18 @@ class CBMagInfo
             MERGE_Green,
             MERGE_LAST_TYPE = MERGE_Green
         };    
+
+        // How ProcessImage() applies the chain.  The 3D modes compile
+        // the whole chain into one table indexed by (r,g,b) - see
+        // Build3DLUT().  This is a runtime option, not part of the file.
+        enum LUTMODE
+        {
+            LUT_NONE,            // Run the chain per pixel (default)
+            LUT_33,              // 33^3 lattice, tetrahedral interpolation
+            LUT_65,              // 65^3 lattice, tetrahedral interpolation
+            LUT_FULL,            // Every 24-bit color - exact, but 64MB
+            LUT_LAST_MODE = LUT_FULL
+        };
     
     //-----------------------------------------------------------------
     public:        
@@ -250,6 +281,24 @@ class CBMagInfo
                                             int               yOff,
 														  unsigned char alpha = 255);
 
+        // Same as above, but walks a row view so sub images and
+        // padded strides work.
+        void            ProcessSwapRGBA(    const CATImageRows& rows,
+														  unsigned char alpha = 255);
+
+        // With SetParallel(true), both of the above split the region
+        // into tiles and run them on the shared CATWorkPool.  The
+        // lookup tables are built first, on the calling thread, and
+        // are only read by the tiles.  Results are identical either way.
+        //
+        // With SetBackgroundBuild(true), changed settings are built
+        // into a back set of tables on the shared CATWorkPool instead,
+        // and frames keep using the current tables until it's done.
+        // A frame may lag the settings by a build, but never stalls
+        // on one.  The first build, and the first after a LUT mode
+        // change, still happen in place.  The back buffer is a second
+        // copy of every table, including any 3D LUT.
+
         //--------------------------------------------------------------
         // Accessors w/validation
 
@@ -275,6 +324,9 @@ class CBMagInfo
         CBMAGRESULT SetCompress     (float       compress    );
         CBMAGRESULT SetSwapType     (SWAPTYPE    swapType    );
         CBMAGRESULT SetMergeType    (MERGETYPE   mergeType   );
+        CBMAGRESULT SetLUTMode      (LUTMODE     lutMode     );
+        CBMAGRESULT SetParallel     (bool        parallel    );
+        CBMAGRESULT SetBackgroundBuild(bool      background  );
         
 
         //--------------------------------------------------------------
@@ -303,6 +355,9 @@ class CBMagInfo
         float       GetCompress     () const;
         SWAPTYPE    GetSwapType     () const;
         MERGETYPE   GetMergeType    () const;
+        LUTMODE     GetLUTMode      () const;
+        bool        GetParallel     () const;
+        bool        GetBackgroundBuild() const;
         
 
     //---------------------------------------------------------------
@@ -313,6 +368,9 @@ class CBMagInfo
     // function you can call it ahead of time to avoid the speed hit
     // on the first process func.
     //
+    // Only the tables whose settings changed since the last build are
+    // rebuilt.  If a 3D LUT mode is set, it also updates the 3D LUT.
+    //
     void BuildLookupTables();
     
     void BuildGamma(bool buildRed, 
@@ -328,6 +386,13 @@ class CBMagInfo
 
     void BuildHue();
     void BuildSeverity();
+
+    // Compiles the chain into the 3D LUT for the current LUTMODE.
+    // Called from ProcessImage() when a setting has changed, spread
+    // across the shared CATWorkPool.  In the lattice modes, only the
+    // back half of the chain is rerun if just the gamma, brightness,
+    // severity or merge settings changed.
+    void Build3DLUT();
         
     //---------------------------------------------------------------
     // Static utility functions
@@ -348,26 +413,83 @@ class CBMagInfo
     static CBMAGRESULT CorrectEndian    (    CBMAGINFOSTRUCT&    infoStruct);
     //-------------------------------------------------------------------
     protected:
+        void InitMembers();
         void InitLUTs();
         void FreeLUTs();
+        void Free3DLUT();
+
+        // The per-pixel chain, split where the 3D LUT caches it.
+        // Front: negate, swap, hue and greys in HSI space.
+        // Back:  gamma / brightness and merge.
+        xplat_forceinline void ProcessFront  ( unsigned char& r, unsigned char& g, unsigned char& b) const;
+        xplat_forceinline void ProcessBack   ( unsigned char& r, unsigned char& g, unsigned char& b) const;
+
+        // Runs the whole chain over a span of pixels in place.  Input is
+        // r<<16 | g<<8 | b (the top byte is ignored), output is
+        // r | g<<8 | b<<16 | alpha<<24.  ProcessSpan() picks the SIMD
+        // version for the CPU - each gives exactly the same results as
+        // ProcessSpan_C().
+        void ProcessSpan       ( CATUInt32* pixels, int count, unsigned char alpha) const;
+        void ProcessSpan_C     ( CATUInt32* pixels, int count, unsigned char alpha) const;
+        void ProcessSpan_SSE41 ( CATUInt32* pixels, int count, unsigned char alpha) const;
+        void ProcessSpan_AVX2  ( CATUInt32* pixels, int count, unsigned char alpha) const;
+
+        // Interpolated lookup in a lattice 3D LUT.
+        // Returns r | g<<8 | b<<16.
+        xplat_forceinline CATUInt32 Lookup3D ( unsigned char r, unsigned char g, unsigned char b) const;
+
+        // CATWorkPool range proc for Build3DLUT() - param is this.
+        static void Build3DRange        ( void* param, CATInt32 start, CATInt32 end);
+
+        // Single threaded bodies of ProcessImage() and ProcessSwapRGBA().
+        // The lookup tables must already be built.
+        void ProcessRect       ( unsigned char* rgbBuffer, int imgWidth,
+                                 int xOff, int yOff, int procWidth, int procHeight,
+                                 int pixWidth) const;
+        void ProcessRows       ( const CATImageRows& rows, unsigned char alpha) const;
+
+        // CATWorkPool range proc for the tiled drivers - param is a
+        // CBMagTileJob, range is in tiles.
+        static void ProcessTileRange    ( void* param, CATInt32 start, CATInt32 end);
+
+        // Brings the tables up to date before processing - in place, or
+        // from the back buffer if SetBackgroundBuild() is on.
+        void UpdateTables();
+
+        // Which tables differ between two sets of settings, as
+        // kCBMagDirty* bits.
+        static int  TableChanges        ( const CBMAGINFOSTRUCT& from,
+                                          const CBMAGINFOSTRUCT& to);
+
+        // Back buffer helpers.  CollectBackBuild() returns false if a
+        // build is still running, and swaps a finished one in.
+        // QueueBackBuild() returns false if it couldn't start one.
+        bool CollectBackBuild();
+        bool QueueBackBuild();
+        void SwapTables        ( CBMagInfo& other);
+
+        // CATWorkPool task for QueueBackBuild() - param is this.
+        static void BackBuildTask       ( void* param);
 
     //-------------------------------------------------------------------
     protected:        
         CBMAGINFOSTRUCT                   fInfo;            // All our parameters.
         bool                              fFileDirty;       // Have we modified from the file?
-        bool                              fStructDirty;     // Do we need to rebuild lookups?
+        bool                              fStructDirty;     // Have settings changed since the last build?
+        bool                              fTablesBuilt;     // Have the lookups been built at all?
+        CBMAGINFOSTRUCT                   fBuiltInfo;       // Settings the lookups were built from
         
         // Lookup Tables
         unsigned char*                    fRedLUT;          // gamma/brightness lookups
         unsigned char*                    fGreenLUT;        
         unsigned char*                    fBlueLUT;
-        unsigned char*                    fIntLUTRed;       // Intensity lookups
+        unsigned char*                    fIntLUTRed;       // Intensity lookups - block for all bands
         unsigned char*                    fIntLUTGreen;
         unsigned char*                    fIntLUTBlue;
         unsigned char*                    fIntLUTYellow;    // Intensity lookups
         unsigned char*                    fIntLUTCyan;
         unsigned char*                    fIntLUTMagenta;
-        unsigned char*                    fSatLUTRed;       // Saturation lookups
+        unsigned char*                    fSatLUTRed;       // Saturation lookups - block for all bands
         unsigned char*                    fSatLUTGreen;
         unsigned char*                    fSatLUTBlue;
         unsigned char*                    fSatLUTYellow;    // Saturation lookups
@@ -377,11 +499,26 @@ class CBMagInfo
         unsigned char*                    fMergeGreenLUT;   // Merge lut's for Greens
         unsigned char*                    fMergeRedLUT;     // Merge lut for Reds
         unsigned char*                    fMergeBlueLUT;    // Merge lut's
+        unsigned char*                    fMergeAllLUT;     // Merge lut for MERGE_ALL greys
         unsigned char*                    fSevLUT;          // Severity LUT
 
         unsigned char*                    fGreyRedLUT;      // Convert red->intensity
         unsigned char*                    fGreyGreenLUT;    // Convert green->intensity
         unsigned char*                    fGreyBlueLUT;     // convert blue->intensity
+
+        // 3D LUT - entries are r | g<<8 | b<<16
+        LUTMODE                           fLUTMode;         // Current 3D LUT mode
+        bool                              f3DDirty;         // Do we need to rebuild the 3D LUT?
+        bool                              f3DFrontDirty;    // Is the lattice's front cache stale too?
+        int                               f3DSize;          // Points per axis in f3DLUT
+        CATUInt32*                        f3DLUT;           // Chain output per point
+        CATUInt32*                        f3DFront;         // Front output per lattice point
+        unsigned char                     f3DBase[256];     // Lattice cell for each channel value
+        unsigned char                     f3DFrac[256];     // Position within cell, 0-255
+        int                               f3DCorner[8][2];  // Tetrahedron corner offsets - see Lookup3D()
+
+        bool                              fParallel;        // Tile frames across the shared CATWorkPool?
+        CBMagBackBuffer*                  fBack;            // Background build state, if on
 };
 
 //---------------------------------------------------
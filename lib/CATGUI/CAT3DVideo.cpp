@@ -47,6 +47,11 @@ CAT3DVideo::CAT3DVideo(  const CATString&        element,
 	fViewX	 = fViewY	 = fViewZ	 = 0.0;
 	fViewRotX = fViewRotY = fViewRotZ = 0.0;
 	fCursor.SetType(CATCURSOR_HAND);	
+
+	// Captured frames are big enough to be worth splitting up, and
+	// knob drags shouldn't hold up the next frame on a table rebuild.
+	fProcessor.SetParallel(true);
+	fProcessor.SetBackgroundBuild(true);
 }
 
 // Destructor
@@ -97,10 +102,11 @@ void CAT3DVideo::PostDraw(	CATDRAWCONTEXT		hdc,
 	{
 		if (fIsProcDirty)
 		{
-			fProcessor.ProcessSwapRGBA(fCurImage->GetRawDataPtr(),
-				fCurImage->Width(), 
-				fCurImage->Height(),
-				0,0,255);
+			CATImageRows rows;
+			if (CATSUCCEEDED(fCurImage->GetRowsForWrite(rows)))
+			{
+				fProcessor.ProcessSwapRGBA(rows,255);
+			}
 			fIsProcDirty = false;
 		}
 		::glDrawPixels(fCurImage->Width(),fCurImage->Height(),GL_RGBA,GL_UNSIGNED_BYTE,fCurImage->GetRawDataPtr());
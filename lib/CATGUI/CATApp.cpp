@@ -27,6 +27,7 @@
 #include "CATWindow.h"
 #include "CATControl.h"
 #include "CATWaitDlg.h"
+#include "CATWorkPool.h"
 
 
 CATApp* gApp = 0;
@@ -164,6 +165,9 @@ CATApp::~CATApp()
 
     FlushResourceCache();
 
+    // Stop the shared work pool, if anything started it.
+    CATWorkPool::ReleaseShared();
+
     if (gPlatform != 0)
     {
         delete gPlatform;
@@ -699,63 +703,66 @@ void CATApp::OnHelp()
 /// image w/o wasting more space...
 CATResult CATApp::AddResourceImage( const CATString& path, CATImage* image)
 {
-    CATImage* oldImage = 0;
-    std::map<CATString, CATImage*>::iterator iter = fImageCache.find(path);
-    if (iter != fImageCache.end())
-    {
-        return CATRESULT(CAT_STAT_IMAGE_ALREADY_LOADED);
-    }
-
-
-    // For now, we add a ref just for this list. Call FlushResourceCache() to
-    // remove this additional reference and free otherwise unused images...
-    //
-    // AFAIK, this would only be done if switching skins at runtime anyway,
-    // or on exit.
-    //
-    // This does prevent the possibility of us having old deleted images
-    // in our list though...
-    image->AddRef();
-    fImageCache.insert(std::make_pair(path,image));   
-    return CAT_SUCCESS;
+    // The cache adds a ref of its own. Images only the cache still
+    // references are released oldest first once it's over budget, or
+    // all at once by FlushResourceCache().
+    return fImageCache.Add(path, image);
 }
 
 // Find image if available and increment reference count.
 CATResult CATApp::GetResourceImage( const CATString& path, CATImage*& image)
 {       
-    std::map<CATString, CATImage*>::iterator iter = fImageCache.find(path);
-    if (iter != fImageCache.end())
-    {
-        image = iter->second;
-        image->AddRef();
-        return CAT_SUCCESS;
-    }
-
-    return CATRESULT(CAT_ERR_IMAGE_NULL);
+    return fImageCache.Get(path, image);
 }
 
 
 // Flush unused images from the cache.
 CATResult CATApp::FlushResourceCache()
 {
-    std::map<CATString, CATImage*>::iterator iter = fImageCache.begin();
-    while (iter != fImageCache.end())
+    fImageCache.Flush();
+    return CAT_SUCCESS;
+}
+
+// Retrieve the resource cache for budget/stats.
+CATImageCache* CATApp::GetResourceCache()
+{
+    return &fImageCache;
+}
+
+// Find or create a state version of a cached image and increment
+// its reference count.
+CATResult CATApp::GetStateResourceImage( const CATString&          path,
+                                         CATImage::CATIMAGESTATE   state,
+                                         CATImage*&                image)
+{
+    image = 0;
+
+    CATString stateKey = path;
+    stateKey << L"|state:" << (CATInt32)state;
+
+    if (CATSUCCEEDED(fImageCache.Get(stateKey, image)))
     {
-        if (iter->second->GetRefCount() == 1)
-        {
-            CATImage::ReleaseImage(iter->second);
-            iter = fImageCache.erase(iter);
-        }
-        else
-        {
-            ++iter;
-        }
+        return CAT_SUCCESS;
+    }
+
+    CATImage* orgImage = 0;
+    CATResult result   = fImageCache.Get(path, orgImage);
+    if (CATFAILED(result))
+    {
+        return result;
     }
 
+    result = CATImage::CreateStateImage(orgImage, image, state);
+    CATImage::ReleaseImage(orgImage);
+    if (CATFAILED(result))
+    {
+        return result;
+    }
+
+    fImageCache.Add(stateKey, image);
     return CAT_SUCCESS;
 }
 
-
 CATResult CATApp::InitWaitDlg(CATInt32 bmpId, CATRect& textRect, CATInt32 progOnId, CATInt32 progOffId, CATInt32 progLeft, CATInt32 progTop)
 {
     if (fWaitDlg != 0)
@@ -21,6 +21,7 @@
 #include "CATStringTableCore.h"
 #include "CATMutex.h"
 #include "CATSkin.h"
+#include "CATImageCache.h"
 
 class CATPrefs;
 class CATWaitDlg;
@@ -338,6 +339,25 @@ public:
     CATResult             GetResourceImage( const CATString& path, CATImage*& image);
     CATResult             FlushResourceCache();
 
+    /// GetResourceCache() returns the resource image cache, for setting
+    /// its byte budget or reading its hit/miss/eviction counters.
+    CATImageCache*        GetResourceCache();
+
+    /// GetStateResourceImage() retrieves a control state version
+    /// (disabled, pressed or focused look) of a cached resource image,
+    /// creating it with CATImage::CreateStateImage() on first use.
+    /// Controls that are enabled, disabled or pressed then just swap
+    /// images instead of converting pixels.
+    ///
+    /// \param path   - cache key of the original, as given to AddResourceImage().
+    /// \param state  - state look to retrieve.
+    /// \param image  - receives the state image, with a reference added.
+    ///                 Call CATImage::ReleaseImage() when done.
+    /// \return CATResult - CAT_ERR_IMAGE_NULL if the original isn't cached.
+    CATResult             GetStateResourceImage(  const CATString&          path,
+                                                  CATImage::CATIMAGESTATE   state,
+                                                  CATImage*&                image);
+
     virtual void OSOnAppCreate();
     //---------------------------------------------------------------------
     // Global objects
@@ -373,7 +393,7 @@ protected:
     CATSkin*                fSkin;               // Application's skin
     CATWaitDlg*				fWaitDlg;
 
-    std::map<CATString, CATImage*>  fImageCache; // Image cache
+    CATImageCache           fImageCache;         // Image cache
 };
 
 extern CATApp* gApp;
@@ -289,8 +289,7 @@ CATResult CATAppButton::Load(CATPROGRESSCB progressCB,
                                         fIcon);
         if (fIconImage)
         {
-            CATImage::CopyImage(fIconImage,fIconDisabled);
-            fIconDisabled->MakeDisabled();
+            CATImage::CreateStateImage(fIconImage,fIconDisabled,CATImage::CATIMAGE_STATE_DISABLED);
         }
     }
 
@@ -54,6 +54,9 @@ CATControl::CATControl(  const CATString&             element,
     fTextOffset.y        = 0;
     fTextOffsetPressed.x = 2;
     fTextOffsetPressed.y = 2;
+    fSliced              = false;
+    fSliceInsets.Set(0,0,0,0);
+    fSliceMode           = CATImage::CATSLICE_STRETCH;
 }
 
 //---------------------------------------------------------------------------
@@ -247,6 +250,28 @@ CATResult CATControl::ParseAttributes()
     }
 
 
+    // Nine-slice - the image border that keeps its size as the control
+    // is resized.  The edges and centre stretch, or tile if
+    // SliceMode="Tile".  Applies to the state images too.
+    fSliceInsets.left   = GetAttribute(L"SliceLeft",   fSliceInsets.left);
+    fSliceInsets.top    = GetAttribute(L"SliceTop",    fSliceInsets.top);
+    fSliceInsets.right  = GetAttribute(L"SliceRight",  fSliceInsets.right);
+    fSliceInsets.bottom = GetAttribute(L"SliceBottom", fSliceInsets.bottom);
+    fSliced = (fSliceInsets.left  != 0) || (fSliceInsets.top    != 0) ||
+              (fSliceInsets.right != 0) || (fSliceInsets.bottom != 0);
+
+    attrib = GetAttribute(L"SliceMode");
+    if (0 == attrib.Compare("Tile"))
+    {
+        fSliced    = true;
+        fSliceMode = CATImage::CATSLICE_TILE;
+    }
+    else if (0 == attrib.Compare("Stretch"))
+    {
+        fSliced    = true;
+        fSliceMode = CATImage::CATSLICE_STRETCH;
+    }
+
     CATCURSORTYPE cursorType = CATCURSOR_ARROW;
     attrib = GetAttribute(L"Cursor");
     // Select based on value here...
@@ -261,17 +286,19 @@ CATResult CATControl::ParseAttributes()
 
     this->fCursor.SetType(cursorType);
 
+    // The state images are only ever overlaid onto the window, so load
+    // them premultiplied for the cheaper blend.
     attrib = GetAttribute(L"ImageDisabled");
     if (!attrib.IsEmpty())
     {
-        CATResult tmpResult = LoadSkinImage(attrib,fImageDisabled);
+        CATResult tmpResult = LoadSkinImage(attrib,fImageDisabled,true);
         if (CATFAILED(tmpResult))
             result = tmpResult;
     }
     attrib = GetAttribute(L"ImagePressed");
     if (!attrib.IsEmpty())
     {
-        CATResult tmpResult = LoadSkinImage(attrib,fImagePressed);
+        CATResult tmpResult = LoadSkinImage(attrib,fImagePressed,true);
         if (CATFAILED(tmpResult))
             result = tmpResult;
     }
@@ -279,7 +306,7 @@ CATResult CATControl::ParseAttributes()
     attrib = GetAttribute(L"ImageFocus");
     if (!attrib.IsEmpty())
     {
-        CATResult tmpResult = LoadSkinImage(attrib,fImageFocus);
+        CATResult tmpResult = LoadSkinImage(attrib,fImageFocus,true);
         if (CATFAILED(tmpResult))
             result = tmpResult;
     }
@@ -287,7 +314,7 @@ CATResult CATControl::ParseAttributes()
     attrib = GetAttribute(L"ImageFocusAct");
     if (!attrib.IsEmpty())
     {
-        CATResult tmpResult = LoadSkinImage(attrib,fImageFocusAct);
+        CATResult tmpResult = LoadSkinImage(attrib,fImageFocusAct,true);
         if (CATFAILED(tmpResult))
             result = tmpResult;
     }
@@ -295,14 +322,52 @@ CATResult CATControl::ParseAttributes()
     attrib = GetAttribute(L"ImageActive");
     if (!attrib.IsEmpty())
     {
-        CATResult tmpResult = LoadSkinImage(attrib,fImageActive);
+        CATResult tmpResult = LoadSkinImage(attrib,fImageActive,true);
         if (CATFAILED(tmpResult))
             result = tmpResult;
     }
 
+    // AutoStateImages fills in missing disabled, pressed and focus images
+    // from Image.  They're made once per file and shared through the
+    // resource cache.
+    attrib = GetAttribute(L"Image");
+    if ((!attrib.IsEmpty()) && GetAttribute(L"AutoStateImages", false))
+    {
+        CATResult tmpResult = CAT_SUCCESS;
+        if (fImageDisabled == 0)
+        {
+            tmpResult = LoadSkinStateImage(attrib, CATImage::CATIMAGE_STATE_DISABLED, fImageDisabled);
+            if (CATFAILED(tmpResult))
+                result = tmpResult;
+        }
+        if (fImagePressed == 0)
+        {
+            tmpResult = LoadSkinStateImage(attrib, CATImage::CATIMAGE_STATE_PRESSED, fImagePressed);
+            if (CATFAILED(tmpResult))
+                result = tmpResult;
+        }
+        if (fImageFocus == 0)
+        {
+            tmpResult = LoadSkinStateImage(attrib, CATImage::CATIMAGE_STATE_FOCUS, fImageFocus);
+            if (CATFAILED(tmpResult))
+                result = tmpResult;
+        }
+    }
+
     return result;
 }
 
+/// IsPremultipliedImage() returns true for the state images that
+/// ParseAttributes() loads premultiplied.
+bool CATControl::IsPremultipliedImage(const CATString& attribName)
+{
+    return (attribName.Compare(L"ImageDisabled") == 0) ||
+           (attribName.Compare(L"ImagePressed")  == 0) ||
+           (attribName.Compare(L"ImageFocus")    == 0) ||
+           (attribName.Compare(L"ImageFocusAct") == 0) ||
+           (attribName.Compare(L"ImageActive")   == 0);
+}
+
 //---------------------------------------------------------------------------
 // GetWindow() retrieves the parent window.
 //---------------------------------------------------------------------------
@@ -512,134 +577,36 @@ void CATControl::Draw(CATImage* image, const CATRect& dirtyRect)
     // available.
     if (this->fRect.Intersect(dirtyRect, &drawRect))
     {  
-        CATRect ourRect;
         if ( (this->IsEnabled() == false) && (this->fImageDisabled))
         {
-            if (drawRect.Intersect(CATRect( fRect.left, 
-                                            fRect.top, 
-                                            fRect.left + fImageDisabled->Width(),
-                                            fRect.top  + fImageDisabled->Height()),
-                                    &ourRect))
-            {
-                ourRect.Offset(-fRect.left, -fRect.top);
-
-                image->Overlay( this->fImageDisabled,
-                                drawRect.left, 
-                                drawRect.top, 
-                                ourRect.left,
-                                ourRect.top,
-                                ourRect.Width(),
-                                ourRect.Height());
-                drawn = true;
-            }        
+            drawn = DrawSkinImage(image, fImageDisabled, drawRect);
         }
         else 
         {
             if (this->IsPressed() && (this->fImagePressed))
             {
-                if (drawRect.Intersect(CATRect(fRect.left, 
-                                               fRect.top, 
-                                               fRect.left + fImagePressed->Width(),
-                                               fRect.top  + fImagePressed->Height()),
-                                       &ourRect))
-                {
-                    ourRect.Offset(-fRect.left, -fRect.top);
-
-                    image->Overlay( this->fImagePressed,
-                                    drawRect.left,
-                                    drawRect.top,
-                                    ourRect.left,
-                                    ourRect.top,
-                                    ourRect.Width(),
-                                    ourRect.Height());
-                    drawn = true;
-                }
+                drawn = DrawSkinImage(image, fImagePressed, drawRect);
             }
 
             if ((!drawn) &&  ((IsFocused() && IsActive()) || IsPressed()) && (this->fImageFocusAct))
             {
-                if (drawRect.Intersect( CATRect(fRect.left, 
-                                                fRect.top, 
-                                                fRect.left + fImageFocusAct->Width(),
-                                                fRect.top  + fImageFocusAct->Height()),
-                                        &ourRect))
-                {
-                    ourRect.Offset(-fRect.left, -fRect.top);
-
-                    image->Overlay( this->fImageFocusAct,
-                                    drawRect.left,
-                                    drawRect.top,
-                                    ourRect.left,
-                                    ourRect.top,
-                                    ourRect.Width(),
-                                    ourRect.Height());
-                    drawn = true;
-                }
+                drawn = DrawSkinImage(image, fImageFocusAct, drawRect);
             }
             
             if ((!drawn) &&  (IsFocused() || IsPressed()) && (this->fImageFocus))
             {
-                if (drawRect.Intersect( CATRect(fRect.left, 
-                                                fRect.top, 
-                                                fRect.left + fImageFocus->Width(),
-                                                fRect.top  + fImageFocus->Height()),
-                                        &ourRect))
-                {
-                    ourRect.Offset(-fRect.left, -fRect.top);
-
-                    image->Overlay( this->fImageFocus,
-                                    drawRect.left,
-                                    drawRect.top,
-                                    ourRect.left,
-                                    ourRect.top,
-                                    ourRect.Width(),
-                                    ourRect.Height());
-                    drawn = true;
-                }
+                drawn = DrawSkinImage(image, fImageFocus, drawRect);
             }
 
-
             if ((!drawn) && (IsActive() && (this->fImageActive)))
             {
-                if (drawRect.Intersect( CATRect(fRect.left, 
-                                                fRect.top, 
-                                                fRect.left + fImageActive->Width(),
-                                                fRect.top  + fImageActive->Height()),
-                                        &ourRect))
-                {
-                    ourRect.Offset(-fRect.left, -fRect.top);
-
-                    image->Overlay( this->fImageActive,
-                                    drawRect.left,
-                                    drawRect.top,
-                                    ourRect.left,
-                                    ourRect.top,
-                                    ourRect.Width(),
-                                    ourRect.Height());
-                    drawn = true;
-                }
+                drawn = DrawSkinImage(image, fImageActive, drawRect);
             }
         }
 
         if ((!drawn) && (this->fImage != 0))
         {
-            if (drawRect.Intersect( CATRect(fRect.left, 
-                                            fRect.top, 
-                                            fRect.left + fImage->Width(),
-                                            fRect.top  + fImage->Height()),
-                                    &ourRect))
-            {
-                ourRect.Offset(-fRect.left, -fRect.top);
-
-                image->Overlay( this->fImage,
-                                drawRect.left,
-                                drawRect.top,
-                                ourRect.left,
-                                ourRect.top,
-                                ourRect.Width(),
-                                ourRect.Height());
-                drawn = true;
-            }
+            drawn = DrawSkinImage(image, fImage, drawRect);
         }
 
         if (!drawn)
@@ -658,6 +625,40 @@ void CATControl::Draw(CATImage* image, const CATRect& dirtyRect)
     }
 }
 
+//---------------------------------------------------------------------------
+// DrawSkinImage() overlays one of the control's images within drawRect.
+// Sliced controls stretch or tile it to fill fRect; others draw it at
+// its own size from fRect's top-left.
+//---------------------------------------------------------------------------
+bool CATControl::DrawSkinImage(CATImage* image, CATImage* skinImage, const CATRect& drawRect)
+{
+    if (fSliced)
+    {
+        return CATSUCCEEDED(image->OverlaySliced(skinImage, fRect, fSliceInsets, drawRect, fSliceMode));
+    }
+
+    CATRect ourRect;
+    if (drawRect.Intersect( CATRect(fRect.left, 
+                                    fRect.top, 
+                                    fRect.left + skinImage->Width(),
+                                    fRect.top  + skinImage->Height()),
+                            &ourRect) == false)
+    {
+        return false;
+    }
+
+    ourRect.Offset(-fRect.left, -fRect.top);
+
+    image->Overlay( skinImage,
+                    drawRect.left, 
+                    drawRect.top, 
+                    ourRect.left,
+                    ourRect.top,
+                    ourRect.Width(),
+                    ourRect.Height());
+    return true;
+}
+
 //---------------------------------------------------------------------------
 // PostDraw() draws the control into the parent window using OS-specific
 // code.
@@ -305,6 +305,24 @@ protected:
     /// ParseAttributes() parses the known attributes for an object.
     virtual CATResult ParseAttributes();
 
+    /// IsPremultipliedImage() returns true for the state images
+    /// ParseAttributes() loads premultiplied.
+    virtual bool      IsPremultipliedImage(const CATString& attribName);
+
+
+    /// DrawSkinImage() overlays one of the control's images onto the
+    /// window's image within drawRect.  If the skin gave slice insets
+    /// it's nine-sliced to fill fRect, otherwise it's drawn at its own
+    /// size from fRect's top-left.
+    ///
+    /// \param image     - window image to draw into.
+    /// \param skinImage - control image to draw.
+    /// \param drawRect  - portion of the control to draw, in window
+    ///                    coordinates.
+    /// \return bool - true if anything was drawn.
+    virtual bool      DrawSkinImage(  CATImage*       image,
+                                      CATImage*       skinImage,
+                                      const CATRect&  drawRect);
 
     /// CheckImageSize() performs a sanity check on the image vs. the base
     /// image of the control.
@@ -377,6 +395,12 @@ protected:
     /// MouseOver image for control
     CATImage*   fImageActive;
 
+    /// Nine-slice insets (border widths) for the images, and how the
+    /// edges and centre fill.  fSliced is set if any were given.
+    bool                    fSliced;
+    CATRect                 fSliceInsets;
+    CATImage::CATSLICEMODE  fSliceMode;
+
     CATString       fText;
     bool            fAutoScaleText;
     bool		    fTextCentered;
@@ -149,7 +149,7 @@ CATResult CATGuiObj::ParseAttributes()
 //---------------------------------------------------------------------------
 // LoadSkinImage()
 //---------------------------------------------------------------------------
-CATResult CATGuiObj::LoadSkinImage(const CATString& filename, CATImage*& imagePtr)
+CATResult CATGuiObj::LoadSkinImage(const CATString& filename, CATImage*& imagePtr, bool premultiplied)
 {
     // This retrieves a member of app - no need to release
     CATFileSystem* fs = gApp->GetGlobalFileSystem();
@@ -162,9 +162,11 @@ CATResult CATGuiObj::LoadSkinImage(const CATString& filename, CATImage*& imagePt
     CATStream* stream     = 0;
     CATResult result      = CAT_SUCCESS;
 
+    CATString cacheKey    = GetImageCacheKey(imageFile, premultiplied);
+
     // If we already have the image cached, just return it.
     // GetResourceImage() will increment the reference count for us.
-    if (CATSUCCEEDED(result = gApp->GetResourceImage(imageFile, imagePtr)))
+    if (CATSUCCEEDED(result = gApp->GetResourceImage(cacheKey, imagePtr)))
     {
         return result;
     }
@@ -172,13 +174,16 @@ CATResult CATGuiObj::LoadSkinImage(const CATString& filename, CATImage*& imagePt
     // Don't have it in our resource map - load it directly.
     if (CATSUCCEEDED(result = fs->OpenFile(imageFile,CATStream::READ_ONLY,stream)))
     {
-        result = CATImage::Load(stream,imagePtr);
+        result = CATImage::Load(stream,
+                                imagePtr,
+                                premultiplied ? CATImage::CATIMAGE_RGBA32_PREMULTIPLIED :
+                                                CATImage::CATIMAGE_PNG_RGBA32);
         fs->ReleaseFile(stream);
 
         if (CATSUCCEEDED(result))
         {
             // Got it loaded. Add to our resource map.
-            gApp->AddResourceImage(imageFile,imagePtr);
+            gApp->AddResourceImage(cacheKey,imagePtr);
         }
     }
 
@@ -193,6 +198,103 @@ CATResult CATGuiObj::LoadSkinImage(const CATString& filename, CATImage*& imagePt
 
 
 
+//---------------------------------------------------------------------------
+// LoadSkinStateImage()
+//---------------------------------------------------------------------------
+CATResult CATGuiObj::LoadSkinStateImage(  const CATString&          filename,
+                                          CATImage::CATIMAGESTATE   state,
+                                          CATImage*&                imagePtr)
+{
+    imagePtr = 0;
+
+    // Holding the original keeps it from being evicted before the
+    // state version is made from it.
+    CATImage* orgImage = 0;
+    CATResult result   = LoadSkinImage(filename, orgImage, true);
+    if (CATFAILED(result))
+    {
+        return result;
+    }
+
+    CATFileSystem* fs        = gApp->GetGlobalFileSystem();
+    CATString      imageFile = fs->BuildPath(fRootDir,filename);
+
+    result = gApp->GetStateResourceImage(GetImageCacheKey(imageFile, true), state, imagePtr);
+    CATImage::ReleaseImage(orgImage);
+
+    if (CATFAILED(result))
+    {
+        result = CATRESULTFILE(result,imageFile);
+    }
+
+    return result;
+}
+
+//---------------------------------------------------------------------------
+// GetImageCacheKey() returns the resource cache key for an image file.
+//---------------------------------------------------------------------------
+CATString CATGuiObj::GetImageCacheKey(const CATString& imageFile, bool premultiplied)
+{
+    // Premultiplied copies are cached under their own key so they don't
+    // get handed to code expecting straight alpha.
+    CATString cacheKey = imageFile;
+    if (premultiplied)
+    {
+        cacheKey << L"|premultiplied";
+    }
+    return cacheKey;
+}
+
+//---------------------------------------------------------------------------
+// IsPremultipliedImage() - plain objects load everything straight.
+//---------------------------------------------------------------------------
+bool CATGuiObj::IsPremultipliedImage(const CATString& attribName)
+{
+    return false;
+}
+
+//---------------------------------------------------------------------------
+// GetSkinImages() collects the image files named in our attributes and
+// those of our children.
+//---------------------------------------------------------------------------
+void CATGuiObj::GetSkinImages(std::vector<CATSkinImageRef>& images)
+{
+    CATFileSystem* fs = gApp->GetGlobalFileSystem();
+
+    if (fAttribs != 0)
+    {
+        CATXMLAttribsIter iter = fAttribs->begin();
+        while (iter != fAttribs->end())
+        {
+            // Image attributes all start with "Image" or "Icon", except
+            // for a window's "Icon", which the OS loads.
+            CATString attribName = iter->first;
+            bool isImage = (attribName.Compare(L"Image", 5) == 0) ||
+                           ((attribName.Compare(L"Icon", 4) == 0) &&
+                            (attribName.Compare(L"Icon") != 0));
+
+            if (isImage && (iter->second != 0) && (iter->second[0] != 0))
+            {
+                CATSkinImageRef ref;
+                ref.path          = fs->BuildPath(fRootDir, iter->second);
+                ref.premultiplied = IsPremultipliedImage(attribName);
+                images.push_back(ref);
+            }
+            ++iter;
+        }
+    }
+
+    CATUInt32 numChildren = GetNumChildren();
+    for (CATUInt32 i = 0; i < numChildren; i++)
+    {
+        CATGuiObj* curObj = (CATGuiObj*)GetChild(i);
+        if (curObj != 0)
+        {
+            curObj->GetSkinImages(images);
+        }
+    }
+}
+
 //---------------------------------------------------------------------------
 // GetName() retrieves the name of the control.
 //---------------------------------------------------------------------------
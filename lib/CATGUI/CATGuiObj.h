@@ -25,6 +25,14 @@ class CATGuiObj;
 // Callback used for control enumeration. REturn true to continue enumeration.
 typedef bool (*CATCONTROLFUNCB)(CATControl* control, void* userParam);
 
+/// \struct CATSkinImageRef
+/// \brief An image file named in a skin object's attributes.
+struct CATSkinImageRef
+{
+    CATString   path;           ///< Full path, as LoadSkinImage() builds it
+    bool        premultiplied;  ///< Loaded as CATIMAGE_RGBA32_PREMULTIPLIED
+};
+
 /// \class CATGuiObj
 /// \brief GUI object base class
 /// \ingroup CATGUI
@@ -147,6 +155,22 @@ public:
     /// ParseAttributes() parses the known attributes for an object.
     virtual CATResult ParseAttributes();
 
+    /// GetSkinImages() adds the image files named in this object's
+    /// attributes, and its children's, to images.  Used by CATSkin to
+    /// decode them all up front before ParseAttributes() asks for them.
+    /// Duplicates are not removed.
+    ///
+    /// \param images - list to append to.
+    virtual void      GetSkinImages(std::vector<CATSkinImageRef>& images);
+
+    /// GetImageCacheKey() returns the resource cache key LoadSkinImage()
+    /// uses for an image file.
+    ///
+    /// \param imageFile     - full path of the image.
+    /// \param premultiplied - true for the premultiplied version.
+    /// \return CATString - key for CATApp::GetResourceImage().
+    static CATString  GetImageCacheKey(const CATString& imageFile, bool premultiplied);
+
     virtual CATUInt32       GetAccessRole();
     virtual CATUInt32       GetAccessState();
 	 virtual bool				 NeedsArrows() {return false;}
@@ -154,8 +178,35 @@ public:
 protected:      
 
     /// LoadSkinImage() loads an image from the skin
+    ///
+    /// \param filename - image filename, relative to the skin root.
+    /// \param imagePtr - set to the image on success. Release when done.
+    /// \param premultiplied - if true, the image is loaded with 
+    ///        CATIMAGE_RGBA32_PREMULTIPLIED. Only use this for images
+    ///        that are just composited with Overlay(). Straight and
+    ///        premultiplied versions of a file are cached separately.
     CATResult LoadSkinImage( const CATString&  filename, 
-                             CATImage*&        imagePtr);
+                             CATImage*&        imagePtr,
+                             bool              premultiplied = false);
+
+    /// LoadSkinStateImage() loads an image from the skin (premultiplied)
+    /// and returns a control state version of it.  Both are kept in the
+    /// resource cache, so the conversion is done once per file.
+    ///
+    /// \param filename - image filename, relative to the skin root.
+    /// \param state    - state look to retrieve.
+    /// \param imagePtr - set to the state image on success. Release when done.
+    CATResult LoadSkinStateImage( const CATString&          filename,
+                                  CATImage::CATIMAGESTATE   state,
+                                  CATImage*&                imagePtr);
+
+    /// IsPremultipliedImage() returns true if the image named by an
+    /// attribute is loaded premultiplied, so GetSkinImages() can decode
+    /// the right version.  Override alongside ParseAttributes() when
+    /// passing premultiplied = true to LoadSkinImage().
+    ///
+    /// \param attribName - name of the image attribute.
+    virtual bool      IsPremultipliedImage(const CATString& attribName);
 
     //---------------------------------------------------------------------
     // Common data members for all objects in a skin
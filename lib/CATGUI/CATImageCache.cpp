@@ -0,0 +1,361 @@
+//---------------------------------------------------------------------------
+/// \file    CATImageCache.cpp
+/// \brief   Byte-budgeted LRU cache of shared skin images
+/// \ingroup CATGUI
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//---------------------------------------------------------------------------
+
+#include <string.h>
+#include "CATImageCache.h"
+
+// Starting bucket count.  Doubles when entries outnumber buckets.
+const CATUInt32 kInitialBuckets = 256;
+
+//---------------------------------------------------------------------------
+// Constructor
+//---------------------------------------------------------------------------
+CATImageCache::CATImageCache(CATUInt32 byteBudget)
+{
+    fBuckets.assign(kInitialBuckets, (Entry*)0);
+    fLruHead = 0;
+    fLruTail = 0;
+    memset(&fStats, 0, sizeof(fStats));
+    fStats.byteBudget = byteBudget;
+}
+
+//---------------------------------------------------------------------------
+// Destructor - drops our reference to everything
+//---------------------------------------------------------------------------
+CATImageCache::~CATImageCache()
+{
+    fLock.Wait();
+    while (fLruHead != 0)
+    {
+        Remove(fLruHead);
+    }
+    fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// Add() inserts an image and takes a reference to it.
+//---------------------------------------------------------------------------
+CATResult CATImageCache::Add(   const CATString& key,
+                                CATImage*        image)
+{
+    CATASSERT(image != 0, "Null image added to cache.");
+    if (image == 0)
+    {
+        return CATRESULT(CAT_ERR_IMAGE_NULL);
+    }
+
+    CATUInt32 hash = HashKey(key);
+
+    fLock.Wait();
+    if (Find(key, hash) != 0)
+    {
+        fLock.Release();
+        return CATRESULT(CAT_STAT_IMAGE_ALREADY_LOADED);
+    }
+
+    Entry* entry    = new Entry;
+    entry->key      = key;
+    entry->hash     = hash;
+    entry->image    = image;
+    entry->bytes    = ImageBytes(image);
+
+    image->AddRef();
+
+    CATUInt32 bucket  = hash & (fBuckets.size() - 1);
+    entry->hashNext   = fBuckets[bucket];
+    fBuckets[bucket]  = entry;
+    LinkFront(entry);
+
+    fStats.bytesCached += entry->bytes;
+    fStats.imagesCached++;
+
+    if (fStats.imagesCached > fBuckets.size())
+    {
+        Grow();
+    }
+
+    TrimLocked();
+    fLock.Release();
+    return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// Replace() swaps the image under a key, or adds it if there's none.
+//---------------------------------------------------------------------------
+CATResult CATImageCache::Replace(   const CATString& key,
+                                    CATImage*        image)
+{
+    CATASSERT(image != 0, "Null image added to cache.");
+    if (image == 0)
+    {
+        return CATRESULT(CAT_ERR_IMAGE_NULL);
+    }
+
+    fLock.Wait();
+    Entry* entry = Find(key, HashKey(key));
+    if (entry == 0)
+    {
+        fLock.Release();
+        return Add(key, image);
+    }
+
+    if (entry->image != image)
+    {
+        image->AddRef();
+        CATImage::ReleaseImage(entry->image);
+        entry->image = image;
+
+        fStats.bytesCached -= entry->bytes;
+        entry->bytes        = ImageBytes(image);
+        fStats.bytesCached += entry->bytes;
+    }
+
+    TrimLocked();
+    fLock.Release();
+    return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// Get() finds an image and adds a reference for the caller.
+//---------------------------------------------------------------------------
+CATResult CATImageCache::Get(   const CATString& key,
+                                CATImage*&       image)
+{
+    image = 0;
+    CATUInt32 hash = HashKey(key);
+
+    fLock.Wait();
+    Entry* entry = Find(key, hash);
+    if (entry == 0)
+    {
+        fStats.misses++;
+
+        // A miss usually means a load is coming - make room first.
+        TrimLocked();
+        fLock.Release();
+        return CATRESULT(CAT_ERR_IMAGE_NULL);
+    }
+
+    fStats.hits++;
+    Unlink(entry);
+    LinkFront(entry);
+
+    image = entry->image;
+    image->AddRef();
+    fLock.Release();
+
+    return CAT_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+// Flush() releases every idle image.
+//---------------------------------------------------------------------------
+void CATImageCache::Flush()
+{
+    fLock.Wait();
+    Entry* entry = fLruHead;
+    while (entry != 0)
+    {
+        Entry* next = entry->lruNext;
+        if (entry->image->GetRefCount() == 1)
+        {
+            Remove(entry);
+        }
+        entry = next;
+    }
+    fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// Trim() evicts idle images until within budget.
+//---------------------------------------------------------------------------
+void CATImageCache::Trim()
+{
+    fLock.Wait();
+    TrimLocked();
+    fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// SetBudget() changes the byte budget.
+//---------------------------------------------------------------------------
+void CATImageCache::SetBudget(CATUInt32 byteBudget)
+{
+    fLock.Wait();
+    fStats.byteBudget = byteBudget;
+    TrimLocked();
+    fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// GetStats() retrieves the counters.
+//---------------------------------------------------------------------------
+void CATImageCache::GetStats(CATImageCacheStats& stats)
+{
+    fLock.Wait();
+    stats = fStats;
+    fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// ResetStats() zeroes the event counters.
+//---------------------------------------------------------------------------
+void CATImageCache::ResetStats()
+{
+    fLock.Wait();
+    fStats.hits      = 0;
+    fStats.misses    = 0;
+    fStats.evictions = 0;
+    fLock.Release();
+}
+
+//---------------------------------------------------------------------------
+// HashKey() - FNV-1a over the key's characters.
+//---------------------------------------------------------------------------
+CATUInt32 CATImageCache::HashKey(const CATString& key)
+{
+    const CATWChar* str  = (const CATWChar*)key;
+    CATUInt32       hash = 2166136261u;
+    while (*str != 0)
+    {
+        hash ^= (CATUInt32)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//---------------------------------------------------------------------------
+// ImageBytes() - bytes an image is charged.  Sub images share their
+// parent's buffer, so they're charged for their own pixels only.
+//---------------------------------------------------------------------------
+CATUInt32 CATImageCache::ImageBytes(CATImage* image)
+{
+    if (image->IsImageRoot())
+    {
+        return (CATUInt32)image->AbsSize();
+    }
+    return (CATUInt32)image->Size();
+}
+
+//---------------------------------------------------------------------------
+// Find() looks up an entry.  Strings are only compared on a hash match.
+//---------------------------------------------------------------------------
+CATImageCache::Entry* CATImageCache::Find(const CATString& key, CATUInt32 hash)
+{
+    Entry* entry = fBuckets[hash & (fBuckets.size() - 1)];
+    while (entry != 0)
+    {
+        if ((entry->hash == hash) && (entry->key.Compare(key) == 0))
+        {
+            return entry;
+        }
+        entry = entry->hashNext;
+    }
+    return 0;
+}
+
+//---------------------------------------------------------------------------
+// Remove() unlinks an entry, releases its image, and deletes it.
+//---------------------------------------------------------------------------
+void CATImageCache::Remove(Entry* entry)
+{
+    Entry** link = &fBuckets[entry->hash & (fBuckets.size() - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->hashNext;
+    }
+    *link = entry->hashNext;
+
+    Unlink(entry);
+
+    fStats.bytesCached -= entry->bytes;
+    fStats.imagesCached--;
+
+    CATImage::ReleaseImage(entry->image);
+    delete entry;
+}
+
+//---------------------------------------------------------------------------
+// LinkFront() puts an entry at the most-recently-used end.
+//---------------------------------------------------------------------------
+void CATImageCache::LinkFront(Entry* entry)
+{
+    entry->lruPrev = 0;
+    entry->lruNext = fLruHead;
+    if (fLruHead != 0)
+    {
+        fLruHead->lruPrev = entry;
+    }
+    fLruHead = entry;
+    if (fLruTail == 0)
+    {
+        fLruTail = entry;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Unlink() takes an entry out of the LRU list.
+//---------------------------------------------------------------------------
+void CATImageCache::Unlink(Entry* entry)
+{
+    if (entry->lruPrev != 0)
+        entry->lruPrev->lruNext = entry->lruNext;
+    else
+        fLruHead = entry->lruNext;
+
+    if (entry->lruNext != 0)
+        entry->lruNext->lruPrev = entry->lruPrev;
+    else
+        fLruTail = entry->lruPrev;
+
+    entry->lruPrev = 0;
+    entry->lruNext = 0;
+}
+
+//---------------------------------------------------------------------------
+// Grow() doubles the bucket count and rehashes.
+//---------------------------------------------------------------------------
+void CATImageCache::Grow()
+{
+    std::vector<Entry*> buckets(fBuckets.size() * 2, (Entry*)0);
+    CATUInt32 mask = (CATUInt32)buckets.size() - 1;
+
+    for (Entry* entry = fLruHead; entry != 0; entry = entry->lruNext)
+    {
+        CATUInt32 bucket = entry->hash & mask;
+        entry->hashNext  = buckets[bucket];
+        buckets[bucket]  = entry;
+    }
+
+    fBuckets.swap(buckets);
+}
+
+//---------------------------------------------------------------------------
+// TrimLocked() evicts idle images from the least-recently-used end
+// until the cache is within budget.  Caller must hold fLock.
+//---------------------------------------------------------------------------
+void CATImageCache::TrimLocked()
+{
+    Entry* entry = fLruTail;
+    while ((entry != 0) && (fStats.bytesCached > fStats.byteBudget))
+    {
+        Entry* prev = entry->lruPrev;
+        if (entry->image->GetRefCount() == 1)
+        {
+            Remove(entry);
+            fStats.evictions++;
+        }
+        entry = prev;
+    }
+}
@@ -0,0 +1,157 @@
+//---------------------------------------------------------------------------
+/// \file    CATImageCache.h
+/// \brief   Byte-budgeted LRU cache of shared skin images
+/// \ingroup CATGUI
+///
+/// Copyright (c) 2003-2008 by Michael Ellison.
+/// See COPYING.txt for license (MIT License).
+///
+// $Author: mike $
+// $Date: 2011-05-30 17:06:23 -0500 (Mon, 30 May 2011) $
+// $Revision: 3 $
+// $NoKeywords: $
+//
+//---------------------------------------------------------------------------
+#ifndef CATImageCache_H_
+#define CATImageCache_H_
+
+#include <vector>
+#include "CATInternal.h"
+#include "CATString.h"
+#include "CATImage.h"
+#include "CATCritSec.h"
+
+/// \struct CATImageCacheStats
+/// \brief Counters returned by CATImageCache::GetStats()
+/// \ingroup CATGUI
+struct CATImageCacheStats
+{
+    CATUInt64   hits;           ///< Get() calls that found the image
+    CATUInt64   misses;         ///< Get() calls that didn't
+    CATUInt64   evictions;      ///< Images released to stay under budget
+    CATUInt64   bytesCached;    ///< Pixel bytes of all cached images
+    CATUInt32   imagesCached;   ///< Number of cached images
+    CATUInt32   byteBudget;     ///< Current budget
+};
+
+/// \class CATImageCache CATImageCache.h
+/// \brief Byte-budgeted LRU cache of shared skin images
+/// \ingroup CATGUI
+///
+/// The cache holds one reference to each image it's given.  An image
+/// whose only remaining reference is the cache's is idle; when the
+/// pixel bytes of all cached images go over the budget, idle images are
+/// released oldest-use first until it's back under (or nothing idle is
+/// left).  Images still in use are never evicted, so the budget is a
+/// target rather than a hard limit.
+///
+/// Sub images (e.g. from a skin atlas) count only their own pixels;
+/// their parent is freed once its last sub image is released.
+///
+/// Keys are hashed into buckets, so lookups compare strings only on a
+/// hash match.
+///
+/// All calls are thread-safe.
+class CATImageCache
+{
+public:
+    enum
+    {
+        kDefaultBudget = 128 * 1024 * 1024  ///< Default byte budget
+    };
+
+    /// Constructor
+    ///
+    /// \param byteBudget - pixel bytes to keep before evicting idle images.
+    CATImageCache(CATUInt32 byteBudget = kDefaultBudget);
+
+    /// Destructor - releases the cache's references to all images.
+    virtual ~CATImageCache();
+
+    /// Add() inserts an image under key and adds a reference for the
+    /// cache.  May evict idle images to stay under budget.
+    ///
+    /// \param key   - cache key (usually the image's path).
+    /// \param image - image to cache.
+    /// \return CATResult - CAT_STAT_IMAGE_ALREADY_LOADED if key is taken.
+    CATResult Add(  const CATString& key,
+                    CATImage*        image);
+
+    /// Replace() swaps the image cached under key for another, keeping
+    /// the entry's place in the LRU list.  The cache's
+    /// reference moves to the new image.  Adds it if key isn't cached.
+    ///
+    /// \param key   - cache key.
+    /// \param image - image to cache in its place.
+    /// \return CATResult - CAT_SUCCESS on success.
+    CATResult Replace(  const CATString& key,
+                        CATImage*        image);
+
+    /// Get() finds an image and adds a reference for the caller.
+    /// Marks the image as most recently used.
+    ///
+    /// \param key   - cache key.
+    /// \param image - receives the image, or 0.
+    /// \return CATResult - CAT_ERR_IMAGE_NULL if not cached.
+    CATResult Get(  const CATString& key,
+                    CATImage*&       image);
+
+    /// Flush() releases every idle image, regardless of budget.
+    void      Flush();
+
+    /// Trim() evicts idle images, least recently used first, until the
+    /// cache is within budget.  Done automatically on Add() and on
+    /// misses; call it after releasing a lot of images (e.g. closing a
+    /// window) to free their memory sooner.
+    void      Trim();
+
+    /// SetBudget() changes the byte budget and trims to it.
+    ///
+    /// \param byteBudget - pixel bytes to keep before evicting idle images.
+    void      SetBudget(CATUInt32 byteBudget);
+
+    /// GetStats() retrieves the cache's counters.
+    ///
+    /// \param stats - receives the counters.
+    void      GetStats(CATImageCacheStats& stats);
+
+    /// ResetStats() zeroes the hit, miss and eviction counters.
+    void      ResetStats();
+
+protected:
+    /// \struct Entry
+    /// \brief One cached image, in a hash bucket chain and the LRU list.
+    struct Entry
+    {
+        CATString   key;
+        CATUInt32   hash;
+        CATImage*   image;
+        CATUInt32   bytes;
+        Entry*      hashNext;   // next in bucket
+        Entry*      lruPrev;    // more recently used
+        Entry*      lruNext;    // less recently used
+    };
+
+    static CATUInt32 HashKey(const CATString& key);
+    static CATUInt32 ImageBytes(CATImage* image);
+
+    // These all require fLock to be held.
+    Entry*    Find(const CATString& key, CATUInt32 hash);
+    void      Remove(Entry* entry);
+    void      LinkFront(Entry* entry);
+    void      Unlink(Entry* entry);
+    void      Grow();
+    void      TrimLocked();
+
+private:
+    CATImageCache(const CATImageCache&);
+    CATImageCache& operator=(const CATImageCache&);
+
+    std::vector<Entry*> fBuckets;   ///< Hash buckets, size is a power of 2
+    Entry*              fLruHead;   ///< Most recently used
+    Entry*              fLruTail;   ///< Least recently used
+    CATImageCacheStats  fStats;     ///< Counters, including the budget
+    CATCritSec          fLock;      ///< Protects the above
+};
+
+#endif // CATImageCache_H_
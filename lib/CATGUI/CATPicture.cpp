@@ -68,7 +68,12 @@ void CATPicture::Draw(CATImage* image, const CATRect& dirtyRect)
     // rectangles don't fit.
     if (this->fRect.Intersect(dirtyRect, &drawRect))
     {  
-        if (fImage)
+        if (fImage && fSliced)
+        {
+            // Nine-sliced to fill the rect - see CATControl::ParseAttributes().
+            result = image->OverlaySliced(fImage, fRect, fSliceInsets, drawRect, fSliceMode);
+        }
+        else if (fImage)
         {
             if ((fImage->Width() == fRect.Width()) && 
                 (fImage->Height() == fRect.Height()))
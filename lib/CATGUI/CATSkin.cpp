@@ -18,10 +18,80 @@
 #include "CATApp.h"
 #include "CATEventDefs.h"
 #include "CATGuiFactory.h"
+#include "CATFileSystem.h"
+#include "CATStream.h"
+#include "CATWorkPool.h"
+#include "CATCritSec.h"
+#include "CATSignal.h"
+#include <set>
+
 /// This is the maximum frequence for updating other window's controls
 /// in response to a command of the same name.
 const CATFloat32 kUPDATESPEED = 0.05f;
 
+/// Share of the load progress bar given to decoding images.
+const CATFloat32 kIMAGEPROGRESS = 0.5f;
+
+/// Atlas page size in pixels.  Images over half this either way get
+/// their own buffers.
+const CATInt32 kATLASPAGESIZE = 1024;
+
+/// Progress shared by the image decode tasks in CATSkin::Load().
+struct CATSkinDecodeState
+{
+    CATCritSec      lock;
+    CATUInt32       numDone;    // protected by lock
+    CATSignal       doneSignal; // fired as each task finishes
+};
+
+/// One image for the decode pre-pass.
+struct CATSkinDecodeJob
+{
+    CATString               path;
+    CATString               cacheKey;
+    bool                    premultiplied;
+    CATImage*               image;      // our reference, released after Load()
+    CATSkinDecodeState*     state;
+};
+
+//---------------------------------------------------------------------------
+// DecodeImageTask() - work pool task that loads one skin image into the
+// resource cache.  Failures are left for LoadSkinImage() to report.
+//---------------------------------------------------------------------------
+static void DecodeImageTask(void* param)
+{
+    CATSkinDecodeJob* job = (CATSkinDecodeJob*)param;
+
+    if (CATFAILED(gApp->GetResourceImage(job->cacheKey, job->image)))
+    {
+        CATFileSystem* fs     = gApp->GetGlobalFileSystem();
+        CATStream*     stream = 0;
+        if (CATSUCCEEDED(fs->OpenFile(job->path, CATStream::READ_ONLY, stream)))
+        {
+            CATResult result = CATImage::Load(  stream,
+                                                job->image,
+                                                job->premultiplied ?
+                                                   CATImage::CATIMAGE_RGBA32_PREMULTIPLIED :
+                                                   CATImage::CATIMAGE_PNG_RGBA32);
+            fs->ReleaseFile(stream);
+
+            if (CATSUCCEEDED(result))
+            {
+                gApp->AddResourceImage(job->cacheKey, job->image);
+            }
+            else
+            {
+                job->image = 0;
+            }
+        }
+    }
+
+    job->state->lock.Wait();
+    job->state->numDone++;
+    job->state->lock.Release();
+    job->state->doneSignal.Fire();
+}
+
 //---------------------------------------------------------------------------
 /// CATSkin constructor (inherited from CATXMLObject)
 /// \param element - Type name ("Skin")
@@ -459,7 +529,107 @@ CATResult CATSkin::Load(  CATPROGRESSCB				progressCB,
                         CATFloat32						progMin,
                         CATFloat32						progMax)
 {
+    // Decode every image the skin names on the work pool first - PNG
+    // inflate is most of the load time.  The objects' ParseAttributes()
+    // calls below then find them in the resource cache.
+    std::vector<CATSkinImageRef> refs;
+    this->GetSkinImages(refs);
+
+    CATSkinDecodeState            state;
+    std::vector<CATSkinDecodeJob> jobs;
+    std::set<CATString>           queued;
+    state.numDone = 0;
+
+    for (size_t i = 0; i < refs.size(); i++)
+    {
+        CATSkinDecodeJob job;
+        job.path          = refs[i].path;
+        job.cacheKey      = GetImageCacheKey(refs[i].path, refs[i].premultiplied);
+        job.premultiplied = refs[i].premultiplied;
+        job.image         = 0;
+        job.state         = &state;
+
+        if (queued.insert(job.cacheKey).second)
+        {
+            jobs.push_back(job);
+        }
+    }
+
+    CATFloat32 progImages = progMin + (progMax - progMin) * kIMAGEPROGRESS;
+    if (jobs.size() == 0)
+    {
+        progImages = progMin;
+    }
+    else
+    {
+        // The image buffer pool is created on first use, and this is
+        // often the first image code to run - create it before the
+        // decodes start loading images at the same time.
+        CATImage::GetBufferPool();
+
+        CATWorkPool* pool = CATWorkPool::GetShared();
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            pool->QueueTask(DecodeImageTask, &jobs[i]);
+        }
+
+        // Report progress from this thread as the decodes finish.
+        for (;;)
+        {
+            state.lock.Wait();
+            CATUInt32 numDone = state.numDone;
+            state.lock.Release();
+
+            if (progressCB)
+            {
+                progressCB( progMin + (progImages - progMin) * numDone / jobs.size(),
+                            L"Images",
+                            progressParam);
+            }
+
+            if (numDone == jobs.size())
+            {
+                break;
+            }
+            state.doneSignal.Wait();
+        }
+    }
+
+    // Pack the small images into a few shared pages so controls blit
+    // from the same cache-resident buffers, and swap the cached copies
+    // for the packed sub images.  Atlas="false" on the skin turns it off.
+    if ((jobs.size() > 1) && GetAttribute(L"Atlas", true))
+    {
+        std::vector<CATImage*> images(jobs.size());
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            images[i] = jobs[i].image;
+        }
+
+        CATImage::CreateAtlas(&images[0], (CATUInt32)images.size(), kATLASPAGESIZE, kATLASPAGESIZE);
+
+        CATImageCache* cache = gApp->GetResourceCache();
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            if (images[i] != jobs[i].image)
+            {
+                cache->Replace(jobs[i].cacheKey, images[i]);
+                jobs[i].image = images[i];
+            }
+        }
+    }
+
     CATResult result = CAT_SUCCESS;
-    result = CATGuiObj::Load(progressCB, progressParam, progMin, progMax);
+    result = CATGuiObj::Load(progressCB, progressParam, progImages, progMax);
+
+    // The objects hold their own references now.
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (jobs[i].image != 0)
+        {
+            CATImage::ReleaseImage(jobs[i].image);
+        }
+    }
+
     return result;
 }
@@ -682,7 +682,9 @@ void CATWindow::OSDraw(CATDRAWCONTEXT drawContext, CATRect* dirtyRect)
     HDC imageDC = CreateCompatibleDC(drawContext);  
 
     // Create a bitmap from the dirty part of our image
-    // Create a 24-bit dib section we can modify...
+    // Create a 32-bit dib section we can modify. 32-bit lines match our
+    // pixel layout, so the copy is just a red/blue swap with no repacking
+    // or line padding.
     BITMAPINFO bmpInfo;   
     CATUInt8* bmpBits = 0;
     memset(&bmpInfo,0,sizeof(bmpInfo));
@@ -691,7 +693,7 @@ void CATWindow::OSDraw(CATDRAWCONTEXT drawContext, CATRect* dirtyRect)
     bmpInfo.bmiHeader.biPlanes	     = 1;
     bmpInfo.bmiHeader.biWidth        = drawRect.Width();
     bmpInfo.bmiHeader.biHeight       = -drawRect.Height();
-    bmpInfo.bmiHeader.biBitCount     = 24;
+    bmpInfo.bmiHeader.biBitCount     = 32;
     bmpInfo.bmiHeader.biSizeImage    = 0;
     bmpInfo.bmiHeader.biCompression  = BI_RGB;
     
@@ -699,11 +701,11 @@ void CATWindow::OSDraw(CATDRAWCONTEXT drawContext, CATRect* dirtyRect)
     
     CATASSERT(imageBmp != 0, "Failed to create DIB for window drawing.");
 
-    CATInt32 widthBytes = (((drawRect.Width() *3) + 3) / 4 ) * 4;
+    CATInt32 widthBytes = drawRect.Width() * 4;
 
     if (bmpBits != 0)
     {
-        fImageCopy->CopyOutBGR( bmpBits,
+        fImageCopy->CopyOutBGRA(bmpBits,
                                 drawRect.left, 
                                 drawRect.top, 
                                 drawRect.Width(), 
@@ -1846,9 +1848,12 @@ HRGN CATWindow::RegionFromImage(CATImage* image)
 	CATInt32 startPos	= 0;
 	CATUInt32 curRect	= 0;
 
-	unsigned char* srcPtr = image->GetRawDataPtr();
-	for (y=0; y<image->Height(); y++)
+	// Read-only view - doesn't detach shared copies and honors sub images.
+	CATImageRows rows;
+	image->GetRowsForRead(rows);
+	for (y=0; y<rows.height; y++)
 	{
+		unsigned char* srcPtr = rows.Row(y);
 		curRect = 0;
 
 		for (x=0; x < image->Width(); x++)		
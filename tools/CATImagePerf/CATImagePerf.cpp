@@ -0,0 +1,540 @@
+// Quick util to track CATImage performance between releases.
+//
+// Times Overlay, CopyOver, CopyOutBGR, FillRect, Clear, MakeDisabled,
+// CreateSub, Load and Save on images from 32x32 up to 3840x2160, each
+// with all-opaque, all-transparent and mixed alpha, and writes the
+// results as JSON so runs can be diffed by script.
+//
+// Usage: CATImagePerf [-o file] [-quick] [-nosimd] [-threads n]
+//
+//    -o file    - write the JSON to file instead of stdout.
+//    -quick     - stop at 512x512 and take one timing per case.
+//    -nosimd    - force the plain C kernels.
+//    -threads n - also time the ops CATImage::SetParallel() covers split
+//                 across n threads, including the calling thread, and
+//                 report the size from which that pays off (the
+//                 crossover).  Counts above the processor count
+//                 oversubscribe the CPU, so run on the target machine
+//                 for real numbers.
+//
+// Progress goes to stderr.  Without -threads everything is
+// single-threaded.  On Linux, build it with the Makefile here.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CATInternal.h"
+#include "CATImage.h"
+#include "CATImageKernels.h"
+#include "CATStreamRAM.h"
+#include "CATCpu.h"
+#include "CATWorkPool.h"
+
+#ifndef CAT_CONFIG_WIN32
+    #include <time.h>
+#endif
+
+// Image sizes to test, smallest first
+struct BENCH_SIZE
+{
+   CATInt32 width;
+   CATInt32 height;
+};
+
+static const BENCH_SIZE kSizes[] =
+{
+   {   32,   32 },
+   {   64,   64 },
+   {  128,  128 },
+   {  256,  256 },
+   {  512,  512 },
+   { 1024, 1024 },
+   { 1920, 1080 },
+   { 3840, 2160 }
+};
+static const CATInt32 kNumSizes      = sizeof(kSizes) / sizeof(kSizes[0]);
+static const CATInt32 kNumQuickSizes = 5;
+
+// Each timing repeats the op until at least this long has passed,
+// and the best of kTimingRuns timings is kept.
+static const double   kMinTimingSecs = 0.05;
+static const CATInt32 kTimingRuns    = 3;
+
+enum BENCH_OP
+{
+   BENCH_OVERLAY,
+   BENCH_COPYOVER,
+   BENCH_COPYOUTBGR,
+   BENCH_FILLRECT,
+   BENCH_CLEAR,
+   BENCH_DISABLE,
+   BENCH_CREATESUB,
+   BENCH_LOAD,
+   BENCH_SAVE,
+
+   BENCH_NUM_OPS
+};
+
+static const char* kOpNames[BENCH_NUM_OPS] =
+{
+   "Overlay",
+   "CopyOver",
+   "CopyOutBGR",
+   "FillRect",
+   "Clear",
+   "MakeDisabled",
+   "CreateSub",
+   "Load",
+   "Save"
+};
+
+// Ops that CATImage::SetParallel() splits into row bands
+static bool IsParallelOp(BENCH_OP op)
+{
+   switch (op)
+   {
+      case BENCH_OVERLAY:
+      case BENCH_COPYOVER:
+      case BENCH_FILLRECT:
+      case BENCH_CLEAR:
+      case BENCH_DISABLE:
+         return true;
+      default:
+         return false;
+   }
+}
+
+// Alpha in the source image (and of the FillRect() colour)
+enum BENCH_ALPHA
+{
+   BENCH_ALPHA_OPAQUE,
+   BENCH_ALPHA_TRANSPARENT,
+   BENCH_ALPHA_MIXED,
+
+   BENCH_NUM_ALPHAS
+};
+
+static const char* kAlphaNames[BENCH_NUM_ALPHAS] =
+{
+   "opaque",
+   "transparent",
+   "mixed"
+};
+
+// Everything one case works on.  src has the case's alpha; dst is
+// opaque noise; png is src saved for the Load case.
+struct BENCH_CASE
+{
+   BENCH_ALPHA    alpha;
+   CATImage*      src;
+   CATImage*      dst;
+   CATUInt8*      bgrBuf;
+   CATStreamRAM*  png;
+   CATStreamRAM*  out;
+   bool           failed;
+};
+
+static double Seconds()
+{
+#ifdef CAT_CONFIG_WIN32
+   LARGE_INTEGER freq, count;
+   ::QueryPerformanceFrequency(&freq);
+   ::QueryPerformanceCounter(&count);
+   return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void RunOp(BENCH_OP op, BENCH_CASE& bench)
+{
+   CATImage* src    = bench.src;
+   CATImage* dst    = bench.dst;
+   CATResult result = CAT_SUCCESS;
+
+   switch (op)
+   {
+      case BENCH_OVERLAY:
+         result = dst->Overlay(src,0,0,0,0,0,0);
+         break;
+      case BENCH_COPYOVER:
+         result = dst->CopyOver(src,0,0,0,0,0,0);
+         break;
+      case BENCH_COPYOUTBGR:
+         result = src->CopyOutBGR(bench.bgrBuf, 0, 0, src->Width(), src->Height(), src->Width()*3);
+         break;
+      case BENCH_FILLRECT:
+         {
+            CATUInt8 alpha = (bench.alpha == BENCH_ALPHA_OPAQUE) ? 255 :
+                             (bench.alpha == BENCH_ALPHA_TRANSPARENT) ? 0 : 128;
+            result = dst->FillRect(CATRect(0,0,dst->Width(),dst->Height()), CATColor(32,64,96,alpha));
+         }
+         break;
+      case BENCH_CLEAR:
+         result = dst->Clear(bench.alpha != BENCH_ALPHA_OPAQUE);
+         break;
+      case BENCH_DISABLE:
+         // Keeps alpha, so src stays in its distribution.
+         src->MakeDisabled();
+         break;
+      case BENCH_CREATESUB:
+         {
+            CATImage* sub = 0;
+            result = CATImage::CreateSub( src, sub, src->Width()/4, src->Height()/4,
+                                          src->Width()/2, src->Height()/2);
+            if (sub != 0)
+            {
+               CATImage::ReleaseImage(sub);
+            }
+         }
+         break;
+      case BENCH_LOAD:
+         {
+            CATImage* image = 0;
+            bench.png->SeekAbsolute(0);
+            result = CATImage::Load(bench.png, image);
+            if (image != 0)
+            {
+               CATImage::ReleaseImage(image);
+            }
+         }
+         break;
+      case BENCH_SAVE:
+         bench.out->SeekAbsolute(0);
+         result = CATImage::Save(bench.out, src);
+         break;
+      default:
+         break;
+   }
+
+   if (CATFAILED(result))
+   {
+      bench.failed = true;
+   }
+}
+
+// Returns the best time for one op in microseconds, and the
+// repetitions behind it.
+static double TimeOp(BENCH_OP op, BENCH_CASE& bench, CATInt32 runs, CATInt32& bestReps)
+{
+   double best = 0;
+   for (CATInt32 run = 0; run < runs; run++)
+   {
+      CATInt32 reps  = 0;
+      double   start = Seconds();
+      double   elapsed;
+      do
+      {
+         RunOp(op, bench);
+         reps++;
+         elapsed = Seconds() - start;
+      } while (elapsed < kMinTimingSecs);
+
+      double perOp = elapsed * 1e6 / reps;
+      if ((run == 0) || (perOp < best))
+      {
+         best     = perOp;
+         bestReps = reps;
+      }
+   }
+   return best;
+}
+
+// Fills an image with noise and sets its alpha.  Mixed alpha is a
+// third each of opaque, transparent and in-between pixels, so
+// Overlay() takes all of its paths.
+static void FillNoise(CATImage* image, BENCH_ALPHA alpha)
+{
+   CATImageRows rows;
+   image->GetRowsForWrite(rows);
+   for (CATInt32 y = 0; y < rows.height; y++)
+   {
+      CATUInt8* pixel = rows.Row(y);
+      for (CATInt32 x = 0; x < rows.width; x++)
+      {
+         pixel[0] = (CATUInt8)(rand() & 0xFF);
+         pixel[1] = (CATUInt8)(rand() & 0xFF);
+         pixel[2] = (CATUInt8)(rand() & 0xFF);
+         switch (alpha)
+         {
+            case BENCH_ALPHA_OPAQUE:      pixel[3] = 255;   break;
+            case BENCH_ALPHA_TRANSPARENT: pixel[3] = 0;     break;
+            default:
+               switch (rand() % 3)
+               {
+                  case 0:  pixel[3] = 255;                                 break;
+                  case 1:  pixel[3] = 0;                                   break;
+                  default: pixel[3] = (CATUInt8)(1 + rand() % 254);        break;
+               }
+               break;
+         }
+         pixel += 4;
+      }
+   }
+}
+
+static void FreeCase(BENCH_CASE& bench)
+{
+   if (bench.src)
+   {
+      CATImage::ReleaseImage(bench.src);
+   }
+   if (bench.dst)
+   {
+      CATImage::ReleaseImage(bench.dst);
+   }
+   delete [] bench.bgrBuf;
+   bench.bgrBuf = 0;
+   if (bench.png)
+   {
+      bench.png->Close();
+      delete bench.png;
+      bench.png = 0;
+   }
+   if (bench.out)
+   {
+      bench.out->Close();
+      delete bench.out;
+      bench.out = 0;
+   }
+}
+
+static bool MakeCase(BENCH_CASE& bench, const BENCH_SIZE& size, BENCH_ALPHA alpha)
+{
+   memset(&bench, 0, sizeof(bench));
+   bench.alpha = alpha;
+
+   if (CATFAILED(CATImage::CreateImage(bench.src, size.width, size.height, false, false)) ||
+       CATFAILED(CATImage::CreateImage(bench.dst, size.width, size.height, false, false)))
+   {
+      FreeCase(bench);
+      return false;
+   }
+   FillNoise(bench.src, alpha);
+   FillNoise(bench.dst, BENCH_ALPHA_OPAQUE);
+
+   bench.bgrBuf = new CATUInt8[size.width * size.height * 3];
+   bench.png    = new CATStreamRAM();
+   bench.out    = new CATStreamRAM();
+   if (CATFAILED(bench.png->Open(L"png", CATStream::READ_WRITE_CREATE_TRUNC)) ||
+       CATFAILED(bench.out->Open(L"out", CATStream::READ_WRITE_CREATE_TRUNC)) ||
+       CATFAILED(CATImage::Save(bench.png, bench.src)))
+   {
+      FreeCase(bench);
+      return false;
+   }
+   return true;
+}
+
+static const char* FeatureString(CATUInt32 features)
+{
+   static char buf[64];
+   buf[0] = 0;
+   if (features & CATCPU_SSE2)   strcat(buf, " sse2");
+   if (features & CATCPU_SSSE3)  strcat(buf, " ssse3");
+   if (features & CATCPU_SSE41)  strcat(buf, " sse4.1");
+   if (features & CATCPU_AVX2)   strcat(buf, " avx2");
+   return (buf[0] != 0) ? buf + 1 : "none";
+}
+
+int main(int argc, char** argv)
+{
+   const char* outName = 0;
+   bool        quick   = false;
+   bool        noSimd  = false;
+   CATInt32    threads = 1;
+
+   for (int i = 1; i < argc; i++)
+   {
+      if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+      {
+         outName = argv[++i];
+      }
+      else if (strcmp(argv[i], "-quick") == 0)
+      {
+         quick = true;
+      }
+      else if (strcmp(argv[i], "-nosimd") == 0)
+      {
+         noSimd = true;
+      }
+      else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc) && (atoi(argv[i + 1]) >= 2))
+      {
+         threads = atoi(argv[++i]);
+      }
+      else
+      {
+         printf("Usage: CATImagePerf [-o file] [-quick] [-nosimd] [-threads n]\n");
+         return 1;
+      }
+   }
+
+   if (noSimd)
+   {
+      CATCpuSetFeatureMask(CATCPU_NONE);
+      CATImageKernelsInit(CATCpuFeatures());
+   }
+
+   FILE* out = stdout;
+   if ((outName != 0) && ((out = fopen(outName, "w")) == 0))
+   {
+      printf("Can't open %s for writing.\n", outName);
+      return 2;
+   }
+
+   if (threads > 1)
+   {
+      CATWorkPool::InitShared(threads - 1);
+      threads = CATWorkPool::GetShared()->GetNumThreads() + 1;
+   }
+
+   srand(1);
+   CATImage::SetParallel(false);
+
+   CATInt32 numSizes = quick ? kNumQuickSizes : kNumSizes;
+   CATInt32 runs     = quick ? 1 : kTimingRuns;
+   int      errors   = 0;
+
+   // gains[op][size] - parallel beat serial for every alpha at that size.
+   bool     gains[BENCH_NUM_OPS][kNumSizes];
+   for (CATInt32 op = 0; op < BENCH_NUM_OPS; op++)
+   {
+      for (CATInt32 s = 0; s < kNumSizes; s++)
+      {
+         gains[op][s] = true;
+      }
+   }
+
+   fprintf(out, "{\n");
+   fprintf(out, "  \"tool\": \"CATImagePerf\",\n");
+   fprintf(out, "  \"formatVersion\": 1,\n");
+   fprintf(out, "  \"simd\": \"%s\",\n", FeatureString(CATCpuFeatures()));
+   fprintf(out, "  \"processors\": %d,\n", CATWorkPool::GetNumProcessors());
+   fprintf(out, "  \"threads\": %d,\n", threads);
+   fprintf(out, "  \"timingRuns\": %d,\n", runs);
+   fprintf(out, "  \"results\": [");
+
+   bool first = true;
+   for (CATInt32 s = 0; s < numSizes; s++)
+   {
+      for (CATInt32 a = 0; a < BENCH_NUM_ALPHAS; a++)
+      {
+         BENCH_CASE bench;
+         if (!MakeCase(bench, kSizes[s], (BENCH_ALPHA)a))
+         {
+            fprintf(stderr, "Error creating %dx%d images.\n", kSizes[s].width, kSizes[s].height);
+            errors++;
+            continue;
+         }
+
+         for (CATInt32 op = 0; op < BENCH_NUM_OPS; op++)
+         {
+            CATInt32 reps   = 0;
+            double   usecs  = TimeOp((BENCH_OP)op, bench, runs, reps);
+            double   pixels = (double)kSizes[s].width * kSizes[s].height;
+
+            fprintf(out, "%s\n    { \"op\": \"%s\", \"width\": %d, \"height\": %d, \"alpha\": \"%s\", "
+                         "\"usPerOp\": %.3f, \"mpixPerSec\": %.2f, \"reps\": %d",
+                    first ? "" : ",",
+                    kOpNames[op], kSizes[s].width, kSizes[s].height, kAlphaNames[a],
+                    usecs, pixels / usecs, reps);
+            first = false;
+
+            if ((threads > 1) && IsParallelOp((BENCH_OP)op))
+            {
+               // Threshold of 1 - we want the pool's cost at every size.
+               CATInt32 parReps  = 0;
+               CATImage::SetParallel(true, 1);
+               double   parUsecs = TimeOp((BENCH_OP)op, bench, runs, parReps);
+               CATImage::SetParallel(false);
+
+               if (parUsecs >= usecs)
+               {
+                  gains[op][s] = false;
+               }
+
+               fprintf(stderr, "%-13s %5dx%-5d %-12s %12.2f us %12.2f us %7.2fx%s\n",
+                       kOpNames[op], kSizes[s].width, kSizes[s].height, kAlphaNames[a],
+                       usecs, parUsecs, usecs / parUsecs, bench.failed ? "  FAILED" : "");
+
+               fprintf(out, ", \"usPerOpParallel\": %.3f, \"speedup\": %.2f",
+                       parUsecs, usecs / parUsecs);
+            }
+            else
+            {
+               fprintf(stderr, "%-13s %5dx%-5d %-12s %12.2f us%s\n",
+                       kOpNames[op], kSizes[s].width, kSizes[s].height, kAlphaNames[a],
+                       usecs, bench.failed ? "  FAILED" : "");
+            }
+
+            fprintf(out, ", \"ok\": %s }", bench.failed ? "false" : "true");
+
+            if (bench.failed)
+            {
+               errors++;
+               bench.failed = false;
+            }
+         }
+
+         FreeCase(bench);
+      }
+   }
+
+   fprintf(out, "\n  ]");
+
+   if (threads > 1)
+   {
+      // Crossover - smallest size from which parallel is faster at every
+      // larger size too.  The suggested threshold covers every op that
+      // gains at all.
+      CATInt32 suggested = 0;
+
+      fprintf(out, ",\n  \"crossover\": [");
+      first = true;
+      for (CATInt32 op = 0; op < BENCH_NUM_OPS; op++)
+      {
+         if (!IsParallelOp((BENCH_OP)op))
+         {
+            continue;
+         }
+
+         CATInt32 cross = numSizes;
+         while ((cross > 0) && gains[op][cross - 1])
+         {
+            cross--;
+         }
+
+         CATInt32 pixels = 0;
+         if (cross < numSizes)
+         {
+            pixels = kSizes[cross].width * kSizes[cross].height;
+            if (pixels > suggested)
+            {
+               suggested = pixels;
+            }
+            fprintf(stderr, "Crossover %-13s %9d pixels\n", kOpNames[op], pixels);
+         }
+         else
+         {
+            fprintf(stderr, "Crossover %-13s never\n", kOpNames[op]);
+         }
+
+         // 0 - parallel never won, up to the largest size tested.
+         fprintf(out, "%s\n    { \"op\": \"%s\", \"pixels\": %d }",
+                 first ? "" : ",", kOpNames[op], pixels);
+         first = false;
+      }
+      fprintf(out, "\n  ],\n");
+      fprintf(out, "  \"suggestedParallelMinPixels\": %d", suggested);
+   }
+
+   fprintf(out, "\n}\n");
+   if (out != stdout)
+   {
+      fclose(out);
+   }
+
+   CATWorkPool::ReleaseShared();
+   return (errors != 0) ? 3 : 0;
+}
@@ -0,0 +1,612 @@
+// Batch filter for directories of PNGs using a saved CBMagInfo profile.
+//
+// Runs every .png in a directory through a profile written by
+// CBMagInfo::SaveToFile() and writes the results, under the same names,
+// to another directory:
+//
+//    decode threads -> filter thread -> encode threads
+//
+// The stages are joined by bounded queues, so reading and inflating the
+// next files, and deflating and writing finished ones, overlap the
+// filter - and only a few images per stage are ever in memory.  The
+// filter itself is split into tiles on the shared CATWorkPool.
+//
+// Usage: CATMagBatch -p profile -o outdir [-j threads] [-q depth] [-f] indir
+//
+//    -p profile  - CBMagInfo profile to apply.
+//    -o outdir   - directory for the filtered images.  Created if needed.
+//    -j threads  - decode threads, and encode threads (default: one each
+//                  per processor).
+//    -q depth    - images each queue holds before its producers wait
+//                  (default 4).
+//    -f          - save with CATImage::kPNGSaveFast instead of libpng's
+//                  defaults.
+//
+// Per-file errors go to stderr, the throughput summary to stdout.  Needs
+// no GUI - on Linux, build it with the Makefile here.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <deque>
+#include <vector>
+#include "CATInternal.h"
+#include "CATCmdLine.h"
+#include "CATStringTable.h"
+#include "CATStreamFile.h"
+#include "CATImage.h"
+#include "CATCritSec.h"
+#include "CATSignal.h"
+#include "CATThread.h"
+#include "CATWorkPool.h"
+#include "CBMagInfo.h"
+
+#ifdef CAT_CONFIG_WIN32
+    #include <direct.h>
+#else
+    #include <dirent.h>
+    #include <strings.h>
+    #include <time.h>
+#endif
+
+static const CATUInt32 kDefaultQueueDepth = 4;
+
+// Switches.  CATCmdLine only parses here - PrintUsage() wants a full
+// string table, so Usage() below prints the help instead.
+static const CATCMDLINEARG kCmdTable[] =
+{
+   // Switch      Group Required TakesArg Callback Flag ArgOptDescId   DescriptionId
+   { 0,             0,  false,   false,   0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // executable
+   { 'p',           0,  true,    true,    0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // profile
+   { 'o',           0,  true,    true,    0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // outdir
+   { 'j',           0,  false,   true,    0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // threads
+   { 'q',           0,  false,   true,    0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // depth
+   { 'f',           0,  false,   false,   0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // fast save
+   { 0,             0,  true,    false,   0,       0,   CAT_STR_EMPTY, CAT_STR_EMPTY },  // indir
+   { (CATWChar)-1,  0,  false,   false,   0,       0,   0,             0             }
+};
+
+// One image on its way through the pipeline
+struct BATCH_ITEM
+{
+   CATString   name;       // File name, without the directory
+   CATImage*   image;      // Decoded image, straight RGBA
+};
+
+// Bounded FIFO between two stages.  Push() waits while the queue is
+// full and Pop() while it's empty.  Once Close() is called, Pop()
+// drains what's left and then returns 0.
+//
+// The signals are auto-reset and wake one waiter, so whoever gets
+// through passes them on while there's still room or still work -
+// that way every waiter gets its turn.
+class BatchQueue
+{
+   public:
+      BatchQueue(CATUInt32 depth)
+      {
+         fDepth  = depth;
+         fClosed = false;
+      }
+
+      void Push(BATCH_ITEM* item)
+      {
+         for (;;)
+         {
+            fLock.Wait();
+            if (fItems.size() < fDepth)
+            {
+               fItems.push_back(item);
+               bool room = (fItems.size() < fDepth);
+               fLock.Release();
+
+               fNotEmpty.Fire();
+               if (room)
+               {
+                  fNotFull.Fire();
+               }
+               return;
+            }
+            fLock.Release();
+            fNotFull.Wait();
+         }
+      }
+
+      BATCH_ITEM* Pop()
+      {
+         for (;;)
+         {
+            fLock.Wait();
+            if (!fItems.empty())
+            {
+               BATCH_ITEM* item = fItems.front();
+               fItems.pop_front();
+               bool more = (!fItems.empty()) || fClosed;
+               fLock.Release();
+
+               fNotFull.Fire();
+               if (more)
+               {
+                  fNotEmpty.Fire();
+               }
+               return item;
+            }
+
+            bool closed = fClosed;
+            fLock.Release();
+            if (closed)
+            {
+               fNotEmpty.Fire();
+               return 0;
+            }
+            fNotEmpty.Wait();
+         }
+      }
+
+      void Close()
+      {
+         fLock.Wait();
+         fClosed = true;
+         fLock.Release();
+         fNotEmpty.Fire();
+      }
+
+   private:
+      std::deque<BATCH_ITEM*> fItems;
+      CATUInt32               fDepth;
+      bool                    fClosed;
+      CATCritSec              fLock;
+      CATSignal               fNotEmpty;
+      CATSignal               fNotFull;
+};
+
+// Shared by all the stages
+struct BATCH_CONTEXT
+{
+   CATString                              inDir;
+   CATString                              outDir;
+   std::vector<CATString>                 files;
+   CATUInt32                              nextFile;      // Next file to decode - under lock
+   CATUInt32                              decodersLeft;  // Last one out closes toFilter - under lock
+   CATCritSec                             lock;
+   BatchQueue*                            toFilter;
+   BatchQueue*                            toEncode;
+   CBMagInfo                              magInfo;
+   const CATImage::CATPNGSaveOptions*     saveOptions;
+};
+
+// What a stage got through
+struct BATCH_TOTALS
+{
+   CATUInt32         images;
+   CATUInt32         failed;
+   CATInt64          bytes;      // PNG read or written, or RGBA filtered
+   double            busySecs;   // Time spent working rather than waiting
+};
+
+// One stage thread.  Its totals are only read after the thread has
+// stopped, so they aren't locked.
+struct BATCH_WORKER
+{
+   BATCH_CONTEXT*    ctx;
+   CATThread         thread;
+   BATCH_TOTALS      totals;
+};
+
+static double Seconds()
+{
+#ifdef CAT_CONFIG_WIN32
+   LARGE_INTEGER freq, count;
+   ::QueryPerformanceFrequency(&freq);
+   ::QueryPerformanceCounter(&count);
+   return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static CATString JoinPath(const CATString& dir, const CATString& name)
+{
+   CATString path = dir;
+   path << (char)CAT_PATHSEPERATOR << name;
+   return path;
+}
+
+static bool IsPNGName(const char* name)
+{
+   size_t len = strlen(name);
+   if (len <= 4)
+   {
+      return false;
+   }
+#ifdef CAT_CONFIG_WIN32
+   return (_stricmp(name + len - 4, ".png") == 0);
+#else
+   return (strcasecmp(name + len - 4, ".png") == 0);
+#endif
+}
+
+// Lists the .png files directly inside dir.
+static bool ListPNGs(const CATString& dir, std::vector<CATString>& files)
+{
+#ifdef CAT_CONFIG_WIN32
+   CATString        mask = JoinPath(dir, "*.png");
+   WIN32_FIND_DATAA findData;
+   HANDLE           findHandle = ::FindFirstFileA(mask, &findData);
+   if (findHandle == INVALID_HANDLE_VALUE)
+   {
+      return (::GetLastError() == ERROR_FILE_NOT_FOUND);
+   }
+
+   do
+   {
+      if ((!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) &&
+          IsPNGName(findData.cFileName))
+      {
+         files.push_back(CATString(findData.cFileName));
+      }
+   } while (::FindNextFileA(findHandle, &findData));
+
+   ::FindClose(findHandle);
+   return true;
+#else
+   DIR* dirHandle = opendir(dir);
+   if (dirHandle == 0)
+   {
+      return false;
+   }
+
+   struct dirent* entry;
+   while ((entry = readdir(dirHandle)) != 0)
+   {
+      if (IsPNGName(entry->d_name))
+      {
+         struct stat fileInfo;
+         if ((stat(JoinPath(dir, entry->d_name), &fileInfo) == 0) &&
+             S_ISREG(fileInfo.st_mode))
+         {
+            files.push_back(CATString(entry->d_name));
+         }
+      }
+   }
+
+   closedir(dirHandle);
+   return true;
+#endif
+}
+
+static bool MakeDir(const CATString& dir)
+{
+#ifdef CAT_CONFIG_WIN32
+   return (_mkdir(dir) == 0) || (errno == EEXIST);
+#else
+   return (mkdir(dir, 0755) == 0) || (errno == EEXIST);
+#endif
+}
+
+// CBMagInfo works on pixels in B,G,R memory order, and CATImage keeps
+// them R,G,B,A - so the filter stage swaps red and blue on either side.
+static void SwapRedBlue(const CATImageRows& rows)
+{
+   for (CATInt32 y = 0; y < rows.height; y++)
+   {
+      CATUInt8* pixPtr = rows.Row(y);
+      for (CATInt32 x = 0; x < rows.width; x++, pixPtr += 4)
+      {
+         CATUInt8 red = pixPtr[0];
+         pixPtr[0]    = pixPtr[2];
+         pixPtr[2]    = red;
+      }
+   }
+}
+
+// Decode stage - takes the next file name, loads it, and queues it for
+// the filter.  The last decoder to finish closes the filter's queue.
+static void DecodeThread(void* param, CATThread*)
+{
+   BATCH_WORKER*  worker = (BATCH_WORKER*)param;
+   BATCH_CONTEXT* ctx    = worker->ctx;
+
+   for (;;)
+   {
+      // CATStrings cache their conversions, so even copying one
+      // out of the shared list is done under the lock.
+      CATString name;
+      ctx->lock.Wait();
+      bool done = (ctx->nextFile >= ctx->files.size());
+      if (!done)
+      {
+         name = ctx->files[ctx->nextFile++];
+      }
+      ctx->lock.Release();
+
+      if (done)
+      {
+         break;
+      }
+
+      double        start  = Seconds();
+      CATString     path   = JoinPath(ctx->inDir, name);
+      CATImage*     image  = 0;
+      CATInt64      size   = 0;
+      CATStreamFile stream;
+
+      CATResult result = stream.Open(path, CATStream::READ_ONLY);
+      if (CATSUCCEEDED(result))
+      {
+         stream.Size(size);
+         result = CATImage::Load(&stream, image);
+         stream.Close();
+      }
+      worker->totals.busySecs += Seconds() - start;
+
+      if (CATFAILED(result))
+      {
+         fprintf(stderr, "Error 0x%08x loading %s\n", (unsigned int)result, (const char*)path);
+         worker->totals.failed++;
+         continue;
+      }
+
+      worker->totals.images++;
+      worker->totals.bytes += size;
+
+      BATCH_ITEM* item = new BATCH_ITEM;
+      item->name  = name;
+      item->image = image;
+      ctx->toFilter->Push(item);
+   }
+
+   ctx->lock.Wait();
+   bool last = (--ctx->decodersLeft == 0);
+   ctx->lock.Release();
+
+   if (last)
+   {
+      ctx->toFilter->Close();
+   }
+}
+
+// Filter stage - one thread, since the CBMagInfo tables are built on
+// the calling thread.  Each image is tiled across the work pool.
+static void FilterThread(void* param, CATThread*)
+{
+   BATCH_WORKER*  worker = (BATCH_WORKER*)param;
+   BATCH_CONTEXT* ctx    = worker->ctx;
+   BATCH_ITEM*    item;
+
+   while ((item = ctx->toFilter->Pop()) != 0)
+   {
+      double       start = Seconds();
+      CATImageRows rows;
+
+      if (CATFAILED(item->image->GetRowsForWrite(rows)))
+      {
+         fprintf(stderr, "Error filtering %s\n", (const char*)item->name);
+         worker->totals.failed++;
+         CATImage::ReleaseImage(item->image);
+         delete item;
+         continue;
+      }
+
+      // skipAlpha leaves the alpha bytes alone, and the stride may be
+      // padded, so pass it as the buffer width.
+      SwapRedBlue(rows);
+      ctx->magInfo.ProcessImage(rows.data, rows.stride / 4, rows.height,
+                                0, 0, rows.width, rows.height, true);
+      SwapRedBlue(rows);
+
+      worker->totals.busySecs += Seconds() - start;
+      worker->totals.images++;
+      worker->totals.bytes += (CATInt64)rows.width * rows.height * 4;
+
+      ctx->toEncode->Push(item);
+   }
+
+   ctx->toEncode->Close();
+}
+
+// Encode stage - saves each filtered image to the output directory.
+static void EncodeThread(void* param, CATThread*)
+{
+   BATCH_WORKER*  worker = (BATCH_WORKER*)param;
+   BATCH_CONTEXT* ctx    = worker->ctx;
+   BATCH_ITEM*    item;
+
+   while ((item = ctx->toEncode->Pop()) != 0)
+   {
+      double        start = Seconds();
+      CATString     path  = JoinPath(ctx->outDir, item->name);
+      CATInt64      size  = 0;
+      CATStreamFile stream;
+
+      CATResult result = stream.Open(path, CATStream::READ_WRITE_CREATE_TRUNC);
+      if (CATSUCCEEDED(result))
+      {
+         result = CATImage::Save(&stream, item->image, CATImage::CATIMAGE_PNG_RGBA32, ctx->saveOptions);
+         stream.Size(size);
+         stream.Close();
+      }
+      worker->totals.busySecs += Seconds() - start;
+
+      if (CATFAILED(result))
+      {
+         fprintf(stderr, "Error 0x%08x saving %s\n", (unsigned int)result, (const char*)path);
+         worker->totals.failed++;
+      }
+      else
+      {
+         worker->totals.images++;
+         worker->totals.bytes += size;
+      }
+
+      CATImage::ReleaseImage(item->image);
+      delete item;
+   }
+}
+
+static void StartWorkers(std::vector<BATCH_WORKER*>& workers,
+                         CATUInt32                   count,
+                         BATCH_CONTEXT*              ctx,
+                         CATThread::CATTHREADPROC    proc)
+{
+   for (CATUInt32 i = 0; i < count; i++)
+   {
+      BATCH_WORKER* worker = new BATCH_WORKER;
+      worker->ctx = ctx;
+      memset(&worker->totals, 0, sizeof(worker->totals));
+      workers.push_back(worker);
+      worker->thread.StartProc(proc, worker);
+   }
+}
+
+// Waits for the workers to stop, adds up their totals, and deletes them.
+static void StopWorkers(std::vector<BATCH_WORKER*>& workers, BATCH_TOTALS& totals)
+{
+   memset(&totals, 0, sizeof(totals));
+
+   for (size_t i = 0; i < workers.size(); i++)
+   {
+      workers[i]->thread.WaitStop();
+      totals.images   += workers[i]->totals.images;
+      totals.failed   += workers[i]->totals.failed;
+      totals.bytes    += workers[i]->totals.bytes;
+      totals.busySecs += workers[i]->totals.busySecs;
+      delete workers[i];
+   }
+   workers.clear();
+}
+
+static void Usage()
+{
+   printf("Usage: CATMagBatch -p profile -o outdir [-j threads] [-q depth] [-f] indir\n\n");
+   printf("   -p profile  CBMagInfo profile to apply\n");
+   printf("   -o outdir   directory for the filtered images (created if needed)\n");
+   printf("   -j threads  decode threads, and encode threads (default %u each)\n",
+          (unsigned int)CATWorkPool::GetNumProcessors());
+   printf("   -q depth    images each queue holds (default %u)\n", (unsigned int)kDefaultQueueDepth);
+   printf("   -f          fast PNG compression\n");
+}
+
+int main(int argc, char** argv)
+{
+   // CATCmdLine wants wide arguments
+   std::vector<CATWChar*> argvw;
+   for (int i = 0; i < argc; i++)
+   {
+      CATString arg = argv[i];
+      const CATWChar* wideArg = arg;
+      CATWChar* copy = new CATWChar[wcslen(wideArg) + 1];
+      wcscpy(copy, wideArg);
+      argvw.push_back(copy);
+   }
+
+   CATStringTable stringTable;
+   CATCmdLine     cmdLine;
+   cmdLine.Initialize(CAT_STR_EMPTY, kCmdTable, &stringTable);
+   CATResult parseResult = cmdLine.Parse(argc, argc ? &argvw[0] : 0);
+
+   for (size_t i = 0; i < argvw.size(); i++)
+   {
+      delete [] argvw[i];
+   }
+
+   if (CATFAILED(parseResult)         || (cmdLine.GetNumOps() != 2) ||
+       (cmdLine.GetArgument('p') == 0) || (cmdLine.GetArgument('o') == 0))
+   {
+      Usage();
+      return 1;
+   }
+
+   BATCH_CONTEXT ctx;
+   CATString profile  = cmdLine.GetArgument('p');
+   ctx.inDir          = cmdLine.GetOpByIndex(1);
+   ctx.outDir         = cmdLine.GetArgument('o');
+   ctx.nextFile       = 0;
+   ctx.saveOptions    = cmdLine.IsSwitchSet('f') ? &CATImage::kPNGSaveFast : 0;
+
+   CATUInt32 threads    = cmdLine.IsSwitchSet('j') ? cmdLine.GetArgUInt('j') : CATWorkPool::GetNumProcessors();
+   CATUInt32 queueDepth = cmdLine.IsSwitchSet('q') ? cmdLine.GetArgUInt('q') : kDefaultQueueDepth;
+   if ((threads == 0) || (queueDepth == 0))
+   {
+      Usage();
+      return 1;
+   }
+
+   if (ctx.magInfo.LoadFromFile(profile) != CBMAG_SUCCESS)
+   {
+      printf("Can't load profile %s.\n", (const char*)profile);
+      return 2;
+   }
+
+   if (0 == ctx.inDir.Compare(ctx.outDir))
+   {
+      printf("The output directory must differ from the input directory.\n");
+      return 2;
+   }
+
+   if (!ListPNGs(ctx.inDir, ctx.files))
+   {
+      printf("Can't read directory %s.\n", (const char*)ctx.inDir);
+      return 2;
+   }
+
+   if (!MakeDir(ctx.outDir))
+   {
+      printf("Can't create directory %s.\n", (const char*)ctx.outDir);
+      return 2;
+   }
+
+   if (ctx.files.empty())
+   {
+      printf("No .png files in %s.\n", (const char*)ctx.inDir);
+      return 0;
+   }
+
+   ctx.magInfo.SetParallel(true);
+
+   // The image buffer pool is created on first use - do that before
+   // the decoders start loading images at the same time.
+   CATImage::GetBufferPool();
+
+   BatchQueue toFilter(queueDepth);
+   BatchQueue toEncode(queueDepth);
+   ctx.toFilter     = &toFilter;
+   ctx.toEncode     = &toEncode;
+   ctx.decodersLeft = threads;
+
+   std::vector<BATCH_WORKER*> decoders;
+   std::vector<BATCH_WORKER*> filters;
+   std::vector<BATCH_WORKER*> encoders;
+   BATCH_TOTALS               decoded;
+   BATCH_TOTALS               filtered;
+   BATCH_TOTALS               encoded;
+
+   double start = Seconds();
+
+   StartWorkers(encoders, threads, &ctx, EncodeThread);
+   StartWorkers(filters,  1,       &ctx, FilterThread);
+   StartWorkers(decoders, threads, &ctx, DecodeThread);
+
+   StopWorkers(decoders, decoded);
+   StopWorkers(filters,  filtered);
+   StopWorkers(encoders, encoded);
+
+   double secs    = Seconds() - start;
+   double mb      = 1024.0 * 1024.0;
+   CATUInt32 failed = decoded.failed + filtered.failed + encoded.failed;
+
+   printf("%u of %u images in %.2f s (%u failed), %u decode / %u encode threads\n",
+          (unsigned int)encoded.images, (unsigned int)ctx.files.size(), secs,
+          (unsigned int)failed, (unsigned int)threads, (unsigned int)threads);
+   printf("   %8.2f images/s\n", encoded.images / secs);
+   printf("   %8.2f MB/s read      (%.2f MB of PNG)\n",  decoded.bytes  / mb / secs, decoded.bytes  / mb);
+   printf("   %8.2f MB/s filtered  (%.2f MB of RGBA)\n", filtered.bytes / mb / secs, filtered.bytes / mb);
+   printf("   %8.2f MB/s written   (%.2f MB of PNG)\n",  encoded.bytes  / mb / secs, encoded.bytes  / mb);
+   printf("   busy: decode %.2f s, filter %.2f s, encode %.2f s\n",
+          decoded.busySecs, filtered.busySecs, encoded.busySecs);
+
+   CATWorkPool::ReleaseShared();
+   return (failed != 0) ? 3 : 0;
+}
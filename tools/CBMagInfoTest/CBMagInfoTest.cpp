@@ -0,0 +1,383 @@
+// Checks that CBMagInfo's SIMD kernels match the plain C one exactly.
+//
+// Every 24-bit colour is run through the chain with each kernel that
+// CBMagInfo::ProcessSpan() can pick - C, SSE4.1 and AVX2 - selected the
+// same way the library does, by limiting CATCpuFeatures() with
+// CATCpuSetFeatureMask().  This is repeated for the default settings
+// and for a spread of random ones that between them use every swap and
+// merge type, with and without negative and hue compression.  The
+// results must be bit-identical to the C kernel's.
+//
+// It also checks spans of every length up to a few SIMD widths at odd
+// alignments (the kernels' tails), ProcessImage() on 24 and 32-bit
+// buffers with a region of interest, and that LUT_FULL gives the same
+// output as the per-pixel chain.
+//
+// Usage: CBMagInfoTest [-quick]
+//
+//    -quick - only the default settings and a handful of random ones.
+//
+// Kernels the CPU doesn't support are reported and skipped.  Returns 0
+// if everything matched.  On Linux, "make check" here builds and runs it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CATInternal.h"
+#include "CATCpu.h"
+#include "CATWorkPool.h"
+#include "CBMagInfo.h"
+
+enum TEST_KERNEL
+{
+   TEST_KERNEL_C,
+   TEST_KERNEL_SSE41,
+   TEST_KERNEL_AVX2,
+
+   TEST_NUM_KERNELS
+};
+
+static const char* kKernelNames[TEST_NUM_KERNELS] =
+{
+   "C",
+   "SSE4.1",
+   "AVX2"
+};
+
+// Feature masks that make ProcessSpan() pick each kernel
+static const CATUInt32 kKernelMasks[TEST_NUM_KERNELS] =
+{
+   CATCPU_NONE,
+   CATCPU_SSE2 | CATCPU_SSSE3 | CATCPU_SSE41,
+   CATCPU_ALL
+};
+
+// Settings sets to test.  Set 0 is the defaults; the rest are random,
+// and sets 1-20 cover every swap / merge type pair.
+static const int kNumSettings      = 24;
+static const int kNumQuickSettings = 5;
+
+// Every 24-bit colour, as a 4096x4096 image.
+static const int kAllWidth  = 4096;
+static const int kAllHeight = 4096;
+static const int kAllPixels = kAllWidth * kAllHeight;
+
+// Longest span for the tail checks - a few AVX2 widths.
+static const int kMaxSpan   = 67;
+
+static int gFailures = 0;
+
+// Random setting in [0,1], in thousandths.
+static float RandSetting()
+{
+   return (rand() % 1001) / 1000.0f;
+}
+
+static void MakeSettings(CBMagInfo& magInfo, int set)
+{
+   CBMAGINFOSTRUCT settings;
+   CBMagInfo::SetupDefaults(&settings);
+
+   if (set != 0)
+   {
+      settings.fGamma        = RandSetting();
+      settings.fBright_Red   = RandSetting();
+      settings.fBright_Green = RandSetting();
+      settings.fBright_Blue  = RandSetting();
+      settings.fGreyRed      = RandSetting();
+      settings.fGreyGreen    = RandSetting();
+      settings.fGreyBlue     = RandSetting();
+      settings.fGreyYellow   = RandSetting();
+      settings.fGreyCyan     = RandSetting();
+      settings.fGreyMagenta  = RandSetting();
+      settings.fHue          = RandSetting();
+      settings.fHueCompress  = (set & 1) ? 0.0f : RandSetting();
+      settings.fSeverity     = RandSetting();
+      settings.fSwapType     = set % (CBMagInfo::SWAP_LAST_TYPE + 1);
+      settings.fMergeType    = set % (CBMagInfo::MERGE_LAST_TYPE + 1);
+      settings.fNegative     = ((set / 4) & 1) ? 1 : 0;
+   }
+
+   magInfo = settings;
+}
+
+// Compares two buffers and reports the first few differences.
+static void Compare(  const char*         what,
+                      const char*         kernel,
+                      const CATUInt32*    expected,
+                      const CATUInt32*    actual,
+                      int                 count)
+{
+   int bad = 0;
+   for (int i = 0; i < count; i++)
+   {
+      if (expected[i] != actual[i])
+      {
+         if (bad < 4)
+         {
+            printf("   %s, %s: pixel %d is %08x, C gave %08x\n",
+                   what, kernel, i, actual[i], expected[i]);
+         }
+         bad++;
+      }
+   }
+
+   if (bad != 0)
+   {
+      printf("   %s, %s: %d pixels differ\n", what, kernel, bad);
+      gFailures++;
+   }
+}
+
+// Runs every colour through each kernel and compares with C.  The
+// input alpha bytes are junk, which the kernels must ignore.
+static void TestAllColors(   CBMagInfo&        magInfo,
+                             int               set,
+                             const bool*       haveKernel,
+                             const CATUInt32*  allColors,
+                             CATUInt32*        expected,
+                             CATUInt32*        actual)
+{
+   unsigned char alpha = (unsigned char)(255 - set * 11);
+   char          what[64];
+   sprintf(what, "settings %d, all colours", set);
+
+   CATImageRows expectedRows = { (CATUInt8*)expected, kAllWidth * 4, kAllWidth, kAllHeight };
+   CATImageRows actualRows   = { (CATUInt8*)actual,   kAllWidth * 4, kAllWidth, kAllHeight };
+
+   CATCpuSetFeatureMask(kKernelMasks[TEST_KERNEL_C]);
+   memcpy(expected, allColors, kAllPixels * 4);
+   magInfo.ProcessSwapRGBA(expectedRows, alpha);
+
+   for (int kernel = TEST_KERNEL_C + 1; kernel < TEST_NUM_KERNELS; kernel++)
+   {
+      if (!haveKernel[kernel])
+      {
+         continue;
+      }
+
+      CATCpuSetFeatureMask(kKernelMasks[kernel]);
+      memcpy(actual, allColors, kAllPixels * 4);
+      magInfo.ProcessSwapRGBA(actualRows, alpha);
+      Compare(what, kKernelNames[kernel], expected, actual, kAllPixels);
+   }
+}
+
+// Spans of 1 to kMaxSpan pixels, starting 0-7 pixels past an aligned
+// address, so the SIMD kernels hit every tail length at every alignment.
+static void TestTails(CBMagInfo& magInfo, int set, const bool* haveKernel)
+{
+   CATUInt32 source[kMaxSpan + 8];
+   CATUInt32 expected[kMaxSpan + 8];
+   CATUInt32 actual[kMaxSpan + 8];
+   int       badSpans[TEST_NUM_KERNELS] = { 0 };
+
+   for (int i = 0; i < kMaxSpan + 8; i++)
+   {
+      source[i] = ((CATUInt32)rand() << 16) ^ (CATUInt32)rand();
+   }
+
+   for (int offset = 0; offset < 8; offset++)
+   {
+      for (int count = 1; count <= kMaxSpan; count++)
+      {
+         CATImageRows expectedRows = { (CATUInt8*)(expected + offset), count * 4, count, 1 };
+         CATImageRows actualRows   = { (CATUInt8*)(actual   + offset), count * 4, count, 1 };
+
+         CATCpuSetFeatureMask(kKernelMasks[TEST_KERNEL_C]);
+         memcpy(expected, source, sizeof(source));
+         magInfo.ProcessSwapRGBA(expectedRows);
+
+         for (int kernel = TEST_KERNEL_C + 1; kernel < TEST_NUM_KERNELS; kernel++)
+         {
+            if (!haveKernel[kernel])
+            {
+               continue;
+            }
+
+            CATCpuSetFeatureMask(kKernelMasks[kernel]);
+            memcpy(actual, source, sizeof(source));
+            magInfo.ProcessSwapRGBA(actualRows);
+
+            // Pixels around the span must be untouched too.
+            if (memcmp(expected, actual, sizeof(expected)) != 0)
+            {
+               if (badSpans[kernel] == 0)
+               {
+                  printf("   settings %d, %s: span of %d at +%d differs\n",
+                         set, kKernelNames[kernel], count, offset);
+               }
+               badSpans[kernel]++;
+            }
+         }
+      }
+   }
+
+   for (int kernel = TEST_KERNEL_C + 1; kernel < TEST_NUM_KERNELS; kernel++)
+   {
+      if (badSpans[kernel] != 0)
+      {
+         printf("   settings %d, %s: %d of %d spans differ\n",
+                set, kKernelNames[kernel], badSpans[kernel], kMaxSpan * 8);
+         gFailures++;
+      }
+   }
+}
+
+// ProcessImage() on packed BGR and on BGRA with skipAlpha, with a
+// region of interest that leaves odd-width borders.
+static void TestProcessImage(CBMagInfo& magInfo, int set, const bool* haveKernel)
+{
+   const int width  = 613;
+   const int height = 37;
+   char      what[64];
+
+   for (int skipAlpha = 0; skipAlpha < 2; skipAlpha++)
+   {
+      int            bytes    = width * height * (skipAlpha ? 4 : 3);
+      unsigned char* source   = new unsigned char[bytes];
+      unsigned char* expected = new unsigned char[bytes];
+      unsigned char* actual   = new unsigned char[bytes];
+
+      for (int i = 0; i < bytes; i++)
+      {
+         source[i] = (unsigned char)rand();
+      }
+
+      CATCpuSetFeatureMask(kKernelMasks[TEST_KERNEL_C]);
+      memcpy(expected, source, bytes);
+      magInfo.ProcessImage(expected, width, height, 5, 3, width - 12, height - 4, skipAlpha != 0);
+
+      for (int kernel = TEST_KERNEL_C + 1; kernel < TEST_NUM_KERNELS; kernel++)
+      {
+         if (!haveKernel[kernel])
+         {
+            continue;
+         }
+
+         CATCpuSetFeatureMask(kKernelMasks[kernel]);
+         memcpy(actual, source, bytes);
+         magInfo.ProcessImage(actual, width, height, 5, 3, width - 12, height - 4, skipAlpha != 0);
+
+         if (memcmp(expected, actual, bytes) != 0)
+         {
+            sprintf(what, "settings %d, ProcessImage(%s)", set, skipAlpha ? "BGRA" : "BGR");
+            printf("   %s, %s: output differs\n", what, kKernelNames[kernel]);
+            gFailures++;
+         }
+      }
+
+      delete [] source;
+      delete [] expected;
+      delete [] actual;
+   }
+}
+
+// LUT_FULL is built with the fastest kernel, then looked up - it must
+// give the same output as the C chain.
+static void TestFullLUT(  CBMagInfo&        magInfo,
+                          int               set,
+                          const CATUInt32*  allColors,
+                          CATUInt32*        expected,
+                          CATUInt32*        actual)
+{
+   char what[64];
+   sprintf(what, "settings %d, LUT_FULL", set);
+
+   CATImageRows expectedRows = { (CATUInt8*)expected, kAllWidth * 4, kAllWidth, kAllHeight };
+   CATImageRows actualRows   = { (CATUInt8*)actual,   kAllWidth * 4, kAllWidth, kAllHeight };
+
+   CATCpuSetFeatureMask(kKernelMasks[TEST_KERNEL_C]);
+   memcpy(expected, allColors, kAllPixels * 4);
+   magInfo.ProcessSwapRGBA(expectedRows);
+
+   CATCpuSetFeatureMask(CATCPU_ALL);
+   magInfo.SetLUTMode(CBMagInfo::LUT_FULL);
+   memcpy(actual, allColors, kAllPixels * 4);
+   magInfo.ProcessSwapRGBA(actualRows);
+   magInfo.SetLUTMode(CBMagInfo::LUT_NONE);
+
+   Compare(what, "LUT", expected, actual, kAllPixels);
+}
+
+int main(int argc, char** argv)
+{
+   bool quick = false;
+
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-quick") == 0)
+      {
+         quick = true;
+      }
+      else
+      {
+         printf("Usage: CBMagInfoTest [-quick]\n");
+         return 1;
+      }
+   }
+
+   // Which kernels can run here - C always can.
+   bool      haveKernel[TEST_NUM_KERNELS];
+   CATUInt32 features = CATCpuFeatures();
+   haveKernel[TEST_KERNEL_C]     = true;
+   haveKernel[TEST_KERNEL_SSE41] = (features & CATCPU_SSE41) != 0;
+   haveKernel[TEST_KERNEL_AVX2]  = ((features & (CATCPU_AVX2 | CATCPU_SSE41)) == (CATCPU_AVX2 | CATCPU_SSE41));
+#if !defined(CAT_CONFIG_SIMD_X86)
+   haveKernel[TEST_KERNEL_SSE41] = false;
+#endif
+#if !defined(CAT_CONFIG_SIMD_AVX2)
+   haveKernel[TEST_KERNEL_AVX2]  = false;
+#endif
+
+   for (int kernel = TEST_KERNEL_C + 1; kernel < TEST_NUM_KERNELS; kernel++)
+   {
+      printf("%-7s %s\n", kKernelNames[kernel], haveKernel[kernel] ? "checked" : "not supported here - skipped");
+   }
+
+   CATUInt32* allColors = new CATUInt32[kAllPixels];
+   CATUInt32* expected  = new CATUInt32[kAllPixels];
+   CATUInt32* actual    = new CATUInt32[kAllPixels];
+   for (int i = 0; i < kAllPixels; i++)
+   {
+      allColors[i] = (CATUInt32)i | ((CATUInt32)(i * 7) << 24);
+   }
+
+   srand(22);
+
+   int numSettings = quick ? kNumQuickSettings : kNumSettings;
+   for (int set = 0; set < numSettings; set++)
+   {
+      CBMagInfo magInfo;
+      MakeSettings(magInfo, set);
+
+      int failures = gFailures;
+      TestAllColors(magInfo, set, haveKernel, allColors, expected, actual);
+      TestTails(magInfo, set, haveKernel);
+      TestProcessImage(magInfo, set, haveKernel);
+
+      // The full LUT is slow to build, so only for a few.
+      if ((set % 8) == 0)
+      {
+         TestFullLUT(magInfo, set, allColors, expected, actual);
+      }
+
+      printf("Settings %2d: %s\n", set, (failures == gFailures) ? "ok" : "FAILED");
+   }
+
+   CATCpuSetFeatureMask(CATCPU_ALL);
+
+   delete [] allColors;
+   delete [] expected;
+   delete [] actual;
+
+   CATWorkPool::ReleaseShared();
+
+   if (gFailures != 0)
+   {
+      printf("%d checks failed.\n", gFailures);
+      return 2;
+   }
+
+   printf("All kernels match.\n");
+   return 0;
+}